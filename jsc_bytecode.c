@@ -5,6 +5,10 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 static void jsc_write_u8(uint8_t** buffer, uint8_t value)
 {
@@ -168,6 +172,15 @@ void jsc_bytecode_free(jsc_bytecode_context* ctx)
     free(ctx->attributes);
   }
 
+  for (uint16_t i = 0; i < ctx->bootstrap_method_count; i++)
+  {
+    free(ctx->bootstrap_methods[i].arguments);
+  }
+
+  free(ctx->bootstrap_methods);
+  free(ctx->labels);
+  free(ctx->branch_fixups);
+
   free(ctx);
 }
 
@@ -324,6 +337,9 @@ uint16_t jsc_bytecode_add_long_constant(jsc_bytecode_context* ctx,
   entry->tag = JSC_CP_LONG;
   entry->long_info.value = value;
 
+  /* the unusable second slot must not match in later pool searches */
+  memset(entry + 1, 0, sizeof(jsc_constant_pool_entry));
+
   ctx->constant_pool_count += 2;
 
   return index;
@@ -350,6 +366,9 @@ uint16_t jsc_bytecode_add_double_constant(jsc_bytecode_context* ctx,
   entry->tag = JSC_CP_DOUBLE;
   entry->double_info.value = value;
 
+  /* the unusable second slot must not match in later pool searches */
+  memset(entry + 1, 0, sizeof(jsc_constant_pool_entry));
+
   ctx->constant_pool_count += 2;
 
   return index;
@@ -590,6 +609,206 @@ uint16_t jsc_bytecode_add_interface_method_reference(
   return ctx->constant_pool_count++;
 }
 
+static uint16_t jsc_bytecode_add_method_handle_entry(jsc_bytecode_context* ctx,
+                                                     uint8_t reference_kind,
+                                                     uint16_t reference_index)
+{
+  for (uint16_t i = 1; i < ctx->constant_pool_count; i++)
+  {
+    if (ctx->constant_pool[i].tag == JSC_CP_METHOD_HANDLE &&
+        ctx->constant_pool[i].method_handle_info.reference_kind ==
+            reference_kind &&
+        ctx->constant_pool[i].method_handle_info.reference_index ==
+            reference_index)
+    {
+      return i;
+    }
+  }
+
+  ctx->constant_pool = (jsc_constant_pool_entry*)realloc(
+      ctx->constant_pool,
+      (ctx->constant_pool_count + 1) * sizeof(jsc_constant_pool_entry));
+
+  jsc_constant_pool_entry* entry =
+      &ctx->constant_pool[ctx->constant_pool_count];
+  entry->tag = JSC_CP_METHOD_HANDLE;
+  entry->method_handle_info.reference_kind = reference_kind;
+  entry->method_handle_info.reference_index = reference_index;
+
+  return ctx->constant_pool_count++;
+}
+
+/**
+ * @brief add a CONSTANT_MethodHandle for a field or method
+ *
+ * @details reference_kind is one of JSC_REF_*; the first four refer to a
+ *          field, JSC_REF_INVOKE_INTERFACE to an interface method and the
+ *          rest to a class method.
+ */
+uint16_t jsc_bytecode_add_method_handle(jsc_bytecode_context* ctx,
+                                       uint8_t reference_kind,
+                                       const char* class_name,
+                                       const char* name,
+                                       const char* descriptor)
+{
+  uint16_t reference_index = 0;
+
+  if (reference_kind >= JSC_REF_GET_FIELD &&
+      reference_kind <= JSC_REF_PUT_STATIC)
+  {
+    reference_index =
+        jsc_bytecode_add_field_reference(ctx, class_name, name, descriptor);
+  }
+  else if (reference_kind == JSC_REF_INVOKE_INTERFACE)
+  {
+    reference_index = jsc_bytecode_add_interface_method_reference(
+        ctx, class_name, name, descriptor);
+  }
+  else if (reference_kind >= JSC_REF_INVOKE_VIRTUAL &&
+           reference_kind <= JSC_REF_NEW_INVOKE_SPECIAL)
+  {
+    reference_index =
+        jsc_bytecode_add_method_reference(ctx, class_name, name, descriptor);
+  }
+
+  if (reference_index == 0)
+  {
+    return 0;
+  }
+
+  return jsc_bytecode_add_method_handle_entry(ctx, reference_kind,
+                                              reference_index);
+}
+
+uint16_t jsc_bytecode_add_method_type(jsc_bytecode_context* ctx,
+                                     const char* descriptor)
+{
+  uint16_t descriptor_index = jsc_bytecode_add_utf8_constant(ctx, descriptor);
+
+  for (uint16_t i = 1; i < ctx->constant_pool_count; i++)
+  {
+    if (ctx->constant_pool[i].tag == JSC_CP_METHOD_TYPE &&
+        ctx->constant_pool[i].method_type_info.descriptor_index ==
+            descriptor_index)
+    {
+      return i;
+    }
+  }
+
+  ctx->constant_pool = (jsc_constant_pool_entry*)realloc(
+      ctx->constant_pool,
+      (ctx->constant_pool_count + 1) * sizeof(jsc_constant_pool_entry));
+
+  jsc_constant_pool_entry* entry =
+      &ctx->constant_pool[ctx->constant_pool_count];
+  entry->tag = JSC_CP_METHOD_TYPE;
+  entry->method_type_info.descriptor_index = descriptor_index;
+
+  return ctx->constant_pool_count++;
+}
+
+/**
+ * @brief add an entry to the class's BootstrapMethods table
+ *
+ * @details Returns the entry's index for CONSTANT_InvokeDynamic, or -1.
+ *          Identical entries are shared.
+ */
+int32_t jsc_bytecode_add_bootstrap_method(jsc_bytecode_context* ctx,
+                                          uint16_t method_handle_index,
+                                          const uint16_t* arguments,
+                                          uint16_t argument_count)
+{
+  for (uint16_t i = 0; i < ctx->bootstrap_method_count; i++)
+  {
+    const jsc_bootstrap_method* bootstrap = &ctx->bootstrap_methods[i];
+
+    if (bootstrap->method_handle_index == method_handle_index &&
+        bootstrap->argument_count == argument_count &&
+        (argument_count == 0 ||
+         memcmp(bootstrap->arguments, arguments,
+                argument_count * sizeof(uint16_t)) == 0))
+    {
+      return i;
+    }
+  }
+
+  if (ctx->bootstrap_method_count == UINT16_MAX ||
+      jsc_bytecode_add_utf8_constant(ctx, "BootstrapMethods") == 0)
+  {
+    return -1;
+  }
+
+  jsc_bootstrap_method* bootstrap_methods = (jsc_bootstrap_method*)realloc(
+      ctx->bootstrap_methods,
+      (ctx->bootstrap_method_count + 1) * sizeof(jsc_bootstrap_method));
+
+  if (!bootstrap_methods)
+  {
+    return -1;
+  }
+
+  ctx->bootstrap_methods = bootstrap_methods;
+
+  jsc_bootstrap_method* bootstrap =
+      &ctx->bootstrap_methods[ctx->bootstrap_method_count];
+  bootstrap->method_handle_index = method_handle_index;
+  bootstrap->argument_count = argument_count;
+  bootstrap->arguments = NULL;
+
+  if (argument_count > 0)
+  {
+    bootstrap->arguments = (uint16_t*)malloc(argument_count * sizeof(uint16_t));
+
+    if (!bootstrap->arguments)
+    {
+      return -1;
+    }
+
+    memcpy(bootstrap->arguments, arguments, argument_count * sizeof(uint16_t));
+  }
+
+  return ctx->bootstrap_method_count++;
+}
+
+uint16_t jsc_bytecode_add_invoke_dynamic(jsc_bytecode_context* ctx,
+                                         uint16_t bootstrap_index,
+                                         const char* name,
+                                         const char* descriptor)
+{
+  uint16_t name_and_type_index =
+      jsc_bytecode_add_name_and_type_constant(ctx, name, descriptor);
+
+  if (name_and_type_index == 0 ||
+      bootstrap_index >= ctx->bootstrap_method_count)
+  {
+    return 0;
+  }
+
+  for (uint16_t i = 1; i < ctx->constant_pool_count; i++)
+  {
+    if (ctx->constant_pool[i].tag == JSC_CP_INVOKE_DYNAMIC &&
+        ctx->constant_pool[i].invoke_dynamic_info.bootstrap_method_attr_index ==
+            bootstrap_index &&
+        ctx->constant_pool[i].invoke_dynamic_info.name_and_type_index ==
+            name_and_type_index)
+    {
+      return i;
+    }
+  }
+
+  ctx->constant_pool = (jsc_constant_pool_entry*)realloc(
+      ctx->constant_pool,
+      (ctx->constant_pool_count + 1) * sizeof(jsc_constant_pool_entry));
+
+  jsc_constant_pool_entry* entry =
+      &ctx->constant_pool[ctx->constant_pool_count];
+  entry->tag = JSC_CP_INVOKE_DYNAMIC;
+  entry->invoke_dynamic_info.bootstrap_method_attr_index = bootstrap_index;
+  entry->invoke_dynamic_info.name_and_type_index = name_and_type_index;
+
+  return ctx->constant_pool_count++;
+}
+
 uint16_t jsc_bytecode_add_interface(jsc_bytecode_context* ctx,
                                     const char* interface_name)
 {
@@ -1003,312 +1222,578 @@ void jsc_bytecode_add_stackmap_frame(jsc_bytecode_context* ctx,
   free(stackmap_info);
 }
 
-uint32_t jsc_bytecode_write(jsc_bytecode_context* ctx, uint8_t** out_buffer)
+/* blobs shorter than this are copied into the scratch area rather than
+   given a segment of their own */
+#define JSC_CLASS_WRITER_INLINE 64
+
+/* iovecs handed to one writev call */
+#define JSC_CLASS_WRITER_IOV 64
+
+void jsc_class_writer_init(jsc_class_writer* writer)
 {
-  uint32_t total_size = 0;
+  memset(writer, 0, sizeof(jsc_class_writer));
+}
 
-  total_size += 4;
-  total_size += 2;
-  total_size += 2;
-  total_size += 2;
+void jsc_class_writer_free(jsc_class_writer* writer)
+{
+  free(writer->segments);
+  free(writer->scratch);
+  memset(writer, 0, sizeof(jsc_class_writer));
+}
 
-  for (uint16_t i = 1; i < ctx->constant_pool_count; i++)
+static bool jsc_writer_segment(jsc_class_writer* writer, const uint8_t* data,
+                               uint32_t offset, uint32_t length)
+{
+  if (writer->segment_count == writer->segment_capacity)
   {
-    total_size += 1;
+    uint32_t capacity =
+        writer->segment_capacity ? writer->segment_capacity * 2 : 64;
+    jsc_class_segment* segments = (jsc_class_segment*)realloc(
+        writer->segments, capacity * sizeof(jsc_class_segment));
 
-    switch (ctx->constant_pool[i].tag)
+    if (!segments)
     {
-    case JSC_CP_UTF8:
-      total_size += 2;
-      total_size += ctx->constant_pool[i].utf8_info.length;
-      break;
-    case JSC_CP_INTEGER:
-    case JSC_CP_FLOAT:
-      total_size += 4;
-      break;
-    case JSC_CP_LONG:
-    case JSC_CP_DOUBLE:
-      total_size += 8;
-      i++;
-      break;
-    case JSC_CP_CLASS:
-    case JSC_CP_STRING:
-      total_size += 2;
-      break;
-    case JSC_CP_FIELDREF:
-    case JSC_CP_METHODREF:
-    case JSC_CP_INTERFACE_METHODREF:
-    case JSC_CP_NAME_AND_TYPE:
-      total_size += 4;
-      break;
-    case JSC_CP_METHOD_HANDLE:
-      total_size += 3;
-      break;
-    case JSC_CP_METHOD_TYPE:
-      total_size += 2;
-      break;
-    case JSC_CP_INVOKE_DYNAMIC:
-      total_size += 4;
-      break;
+      writer->failed = true;
+      return false;
     }
+
+    writer->segments = segments;
+    writer->segment_capacity = capacity;
+  }
+
+  jsc_class_segment* segment = &writer->segments[writer->segment_count++];
+  segment->data = data;
+  segment->offset = offset;
+  segment->length = length;
+  return true;
+}
+
+/**
+ * @brief room for length more bytes of small fields, or NULL
+ *
+ * @details Consecutive small fields share one scratch segment; segments
+ *          refer to scratch by offset, so growing it moves nothing.
+ */
+static uint8_t* jsc_writer_reserve(jsc_class_writer* writer, uint32_t length)
+{
+  if (writer->failed || (uint64_t)writer->size + length > UINT32_MAX)
+  {
+    writer->failed = true;
+    return NULL;
   }
 
-  total_size += 2;
-  total_size += 2;
-  total_size += 2;
+  if (writer->scratch_size + length > writer->scratch_capacity)
+  {
+    uint32_t capacity = writer->scratch_capacity ? writer->scratch_capacity
+                                                 : 4096;
 
-  total_size += 2;
-  total_size += 2 * ctx->interface_count;
+    while (capacity < writer->scratch_size + length)
+    {
+      capacity *= 2;
+    }
 
-  total_size += 2;
+    uint8_t* scratch = (uint8_t*)realloc(writer->scratch, capacity);
 
-  for (uint16_t i = 0; i < ctx->field_count; i++)
+    if (!scratch)
+    {
+      writer->failed = true;
+      return NULL;
+    }
+
+    writer->scratch = scratch;
+    writer->scratch_capacity = capacity;
+  }
+
+  jsc_class_segment* last = writer->segment_count > 0
+                                ? &writer->segments[writer->segment_count - 1]
+                                : NULL;
+
+  if (last && !last->data &&
+      last->offset + last->length == writer->scratch_size)
+  {
+    last->length += length;
+  }
+  else if (!jsc_writer_segment(writer, NULL, writer->scratch_size, length))
   {
-    total_size += 2;
-    total_size += 2;
-    total_size += 2;
-    total_size += 2;
+    return NULL;
+  }
 
-    for (uint16_t j = 0; j < ctx->fields[i].attribute_count; j++)
+  uint8_t* p = writer->scratch + writer->scratch_size;
+  writer->scratch_size += length;
+  writer->size += length;
+  return p;
+}
+
+static void jsc_writer_u8(jsc_class_writer* writer, uint8_t value)
+{
+  uint8_t* p = jsc_writer_reserve(writer, 1);
+
+  if (p)
+  {
+    jsc_write_u8(&p, value);
+  }
+}
+
+static void jsc_writer_u16(jsc_class_writer* writer, uint16_t value)
+{
+  uint8_t* p = jsc_writer_reserve(writer, 2);
+
+  if (p)
+  {
+    jsc_write_u16(&p, value);
+  }
+}
+
+static void jsc_writer_u32(jsc_class_writer* writer, uint32_t value)
+{
+  uint8_t* p = jsc_writer_reserve(writer, 4);
+
+  if (p)
+  {
+    jsc_write_u32(&p, value);
+  }
+}
+
+/* large blobs are referenced where they live, not copied */
+static void jsc_writer_bytes(jsc_class_writer* writer, const uint8_t* data,
+                             uint32_t length)
+{
+  if (length < JSC_CLASS_WRITER_INLINE)
+  {
+    uint8_t* p = jsc_writer_reserve(writer, length);
+
+    if (p && length > 0)
     {
-      total_size += 2;
-      total_size += 4;
-      total_size += ctx->fields[i].attributes[j].length;
+      jsc_write_bytes(&p, data, length);
     }
   }
+  else if (writer->failed || (uint64_t)writer->size + length > UINT32_MAX)
+  {
+    writer->failed = true;
+  }
+  else if (jsc_writer_segment(writer, data, 0, length))
+  {
+    writer->size += length;
+  }
+}
 
-  total_size += 2;
+/**
+ * @brief serialize the class into writer in a single walk
+ *
+ * @details The writer is reset first and may be reused from class to
+ *          class. Its segments refer to the constant pool and attributes of
+ *          ctx, so they are valid until ctx is next changed; writer->size
+ *          is the exact size of the class file. Returns false on failure,
+ *          when a method of a version 50 or later class cannot be typed, or
+ *          when the class uses invokedynamic constants below version 51.
+ */
+bool jsc_bytecode_serialize(jsc_bytecode_context* ctx,
+                            jsc_class_writer* writer)
+{
+  bool dynamic_constants = false;
+
+  writer->segment_count = 0;
+  writer->scratch_size = 0;
+  writer->size = 0;
+  writer->failed = false;
 
+  /* max_stack and max_locals, and from version 50 on the frames of the
+     type-checking verifier, are derived here from the final code; before
+     the pool is written, since frames may add class constants */
   for (uint16_t i = 0; i < ctx->method_count; i++)
   {
-    total_size += 2;
-    total_size += 2;
-    total_size += 2;
-    total_size += 2;
+    jsc_bytecode_resolve_branches(ctx, &ctx->methods[i]);
+    jsc_bytecode_compute_maxs(ctx, &ctx->methods[i]);
 
-    for (uint16_t j = 0; j < ctx->methods[i].attribute_count; j++)
+    /* a method without frames fails verification, so it is not written */
+    if (ctx->major_version >= 50 &&
+        !jsc_bytecode_compute_stack_map(ctx, &ctx->methods[i]))
     {
-      total_size += 2;
-      total_size += 4;
-      total_size += ctx->methods[i].attributes[j].length;
+      return false;
     }
   }
 
-  total_size += 2;
+  for (uint16_t i = 1; i < ctx->constant_pool_count; i++)
+  {
+    uint8_t tag = ctx->constant_pool[i].tag;
 
-  for (uint16_t i = 0; i < ctx->attribute_count; i++)
+    dynamic_constants = dynamic_constants || tag == JSC_CP_METHOD_HANDLE ||
+                        tag == JSC_CP_METHOD_TYPE ||
+                        tag == JSC_CP_INVOKE_DYNAMIC;
+  }
+
+  /* a class file below 51 with these constants is rejected at load time */
+  if ((dynamic_constants || ctx->bootstrap_method_count > 0) &&
+      ctx->major_version < 51)
   {
-    total_size += 2;
-    total_size += 4;
-    total_size += ctx->attributes[i].length;
+    return false;
   }
 
-  uint8_t* buffer = (uint8_t*)malloc(total_size);
+  uint32_t bootstrap_length = 0;
 
-  if (!buffer)
+  if (ctx->bootstrap_method_count > 0)
   {
-    return 0;
-  }
+    bootstrap_length += 2;
 
-  uint8_t* p = buffer;
+    for (uint16_t i = 0; i < ctx->bootstrap_method_count; i++)
+    {
+      bootstrap_length += 2 + 2 + 2 * ctx->bootstrap_methods[i].argument_count;
+    }
+  }
 
   uint32_t magic = 0xCAFEBABE;
-  jsc_write_u32(&p, magic);
+  jsc_writer_u32(writer, magic);
 
-  jsc_write_u16(&p, ctx->minor_version);
-  jsc_write_u16(&p, ctx->major_version);
+  jsc_writer_u16(writer, ctx->minor_version);
+  jsc_writer_u16(writer, ctx->major_version);
 
-  jsc_write_u16(&p, ctx->constant_pool_count);
+  jsc_writer_u16(writer, ctx->constant_pool_count);
 
   for (uint16_t i = 1; i < ctx->constant_pool_count; i++)
   {
-    jsc_write_u8(&p, ctx->constant_pool[i].tag);
+    const jsc_constant_pool_entry* entry = &ctx->constant_pool[i];
 
-    switch (ctx->constant_pool[i].tag)
+    jsc_writer_u8(writer, entry->tag);
+
+    switch (entry->tag)
     {
     case JSC_CP_UTF8:
-      jsc_write_u16(&p, ctx->constant_pool[i].utf8_info.length);
-      jsc_write_bytes(&p, ctx->constant_pool[i].utf8_info.bytes,
-                      ctx->constant_pool[i].utf8_info.length);
+      jsc_writer_u16(writer, entry->utf8_info.length);
+      jsc_writer_bytes(writer, entry->utf8_info.bytes, entry->utf8_info.length);
       break;
     case JSC_CP_INTEGER:
-      jsc_write_u32(&p, (uint32_t)ctx->constant_pool[i].integer_info.value);
+      jsc_writer_u32(writer, (uint32_t)entry->integer_info.value);
       break;
     case JSC_CP_FLOAT:
     {
       uint32_t float_bits;
-      memcpy(&float_bits, &ctx->constant_pool[i].float_info.value, 4);
-      jsc_write_u32(&p, float_bits);
+      memcpy(&float_bits, &entry->float_info.value, 4);
+      jsc_writer_u32(writer, float_bits);
       break;
     }
     case JSC_CP_LONG:
     {
-      uint64_t long_value = (uint64_t)ctx->constant_pool[i].long_info.value;
-      jsc_write_u32(&p, (uint32_t)(long_value >> 32));
-      jsc_write_u32(&p, (uint32_t)long_value);
+      uint64_t long_value = (uint64_t)entry->long_info.value;
+      jsc_writer_u32(writer, (uint32_t)(long_value >> 32));
+      jsc_writer_u32(writer, (uint32_t)long_value);
       i++;
       break;
     }
     case JSC_CP_DOUBLE:
     {
       uint64_t double_bits;
-      memcpy(&double_bits, &ctx->constant_pool[i].double_info.value, 8);
-      jsc_write_u32(&p, (uint32_t)(double_bits >> 32));
-      jsc_write_u32(&p, (uint32_t)double_bits);
+      memcpy(&double_bits, &entry->double_info.value, 8);
+      jsc_writer_u32(writer, (uint32_t)(double_bits >> 32));
+      jsc_writer_u32(writer, (uint32_t)double_bits);
       i++;
       break;
     }
     case JSC_CP_CLASS:
-      jsc_write_u16(&p, ctx->constant_pool[i].class_info.name_index);
+      jsc_writer_u16(writer, entry->class_info.name_index);
       break;
     case JSC_CP_STRING:
-      jsc_write_u16(&p, ctx->constant_pool[i].string_info.string_index);
+      jsc_writer_u16(writer, entry->string_info.string_index);
       break;
     case JSC_CP_FIELDREF:
-      jsc_write_u16(&p, ctx->constant_pool[i].fieldref_info.class_index);
-      jsc_write_u16(&p,
-                    ctx->constant_pool[i].fieldref_info.name_and_type_index);
+      jsc_writer_u16(writer, entry->fieldref_info.class_index);
+      jsc_writer_u16(writer, entry->fieldref_info.name_and_type_index);
       break;
     case JSC_CP_METHODREF:
-      jsc_write_u16(&p, ctx->constant_pool[i].methodref_info.class_index);
-      jsc_write_u16(&p,
-                    ctx->constant_pool[i].methodref_info.name_and_type_index);
+      jsc_writer_u16(writer, entry->methodref_info.class_index);
+      jsc_writer_u16(writer, entry->methodref_info.name_and_type_index);
       break;
     case JSC_CP_INTERFACE_METHODREF:
-      jsc_write_u16(&p,
-                    ctx->constant_pool[i].interface_methodref_info.class_index);
-      jsc_write_u16(
-          &p,
-          ctx->constant_pool[i].interface_methodref_info.name_and_type_index);
+      jsc_writer_u16(writer, entry->interface_methodref_info.class_index);
+      jsc_writer_u16(writer,
+                     entry->interface_methodref_info.name_and_type_index);
       break;
     case JSC_CP_NAME_AND_TYPE:
-      jsc_write_u16(&p, ctx->constant_pool[i].name_and_type_info.name_index);
-      jsc_write_u16(&p,
-                    ctx->constant_pool[i].name_and_type_info.descriptor_index);
+      jsc_writer_u16(writer, entry->name_and_type_info.name_index);
+      jsc_writer_u16(writer, entry->name_and_type_info.descriptor_index);
       break;
     case JSC_CP_METHOD_HANDLE:
-      jsc_write_u8(&p, ctx->constant_pool[i].method_handle_info.reference_kind);
-      jsc_write_u16(&p,
-                    ctx->constant_pool[i].method_handle_info.reference_index);
+      jsc_writer_u8(writer, entry->method_handle_info.reference_kind);
+      jsc_writer_u16(writer, entry->method_handle_info.reference_index);
       break;
     case JSC_CP_METHOD_TYPE:
-      jsc_write_u16(&p,
-                    ctx->constant_pool[i].method_type_info.descriptor_index);
+      jsc_writer_u16(writer, entry->method_type_info.descriptor_index);
       break;
     case JSC_CP_INVOKE_DYNAMIC:
-      jsc_write_u16(&p, ctx->constant_pool[i]
-                            .invoke_dynamic_info.bootstrap_method_attr_index);
-      jsc_write_u16(
-          &p, ctx->constant_pool[i].invoke_dynamic_info.name_and_type_index);
+      jsc_writer_u16(writer,
+                     entry->invoke_dynamic_info.bootstrap_method_attr_index);
+      jsc_writer_u16(writer, entry->invoke_dynamic_info.name_and_type_index);
       break;
     }
   }
 
-  jsc_write_u16(&p, ctx->access_flags);
-  jsc_write_u16(&p, ctx->this_class);
-  jsc_write_u16(&p, ctx->super_class);
+  jsc_writer_u16(writer, ctx->access_flags);
+  jsc_writer_u16(writer, ctx->this_class);
+  jsc_writer_u16(writer, ctx->super_class);
 
-  jsc_write_u16(&p, ctx->interface_count);
+  jsc_writer_u16(writer, ctx->interface_count);
 
   for (uint16_t i = 0; i < ctx->interface_count; i++)
   {
-    jsc_write_u16(&p, ctx->interfaces[i]);
+    jsc_writer_u16(writer, ctx->interfaces[i]);
   }
 
-  jsc_write_u16(&p, ctx->field_count);
+  jsc_writer_u16(writer, ctx->field_count);
 
   for (uint16_t i = 0; i < ctx->field_count; i++)
   {
-    jsc_write_u16(&p, ctx->fields[i].access_flags);
-    jsc_write_u16(&p, ctx->fields[i].name_index);
-    jsc_write_u16(&p, ctx->fields[i].descriptor_index);
-    jsc_write_u16(&p, ctx->fields[i].attribute_count);
+    jsc_writer_u16(writer, ctx->fields[i].access_flags);
+    jsc_writer_u16(writer, ctx->fields[i].name_index);
+    jsc_writer_u16(writer, ctx->fields[i].descriptor_index);
+    jsc_writer_u16(writer, ctx->fields[i].attribute_count);
 
     for (uint16_t j = 0; j < ctx->fields[i].attribute_count; j++)
     {
-      jsc_write_u16(&p, ctx->fields[i].attributes[j].name_index);
-      jsc_write_u32(&p, ctx->fields[i].attributes[j].length);
-      jsc_write_bytes(&p, ctx->fields[i].attributes[j].info,
-                      ctx->fields[i].attributes[j].length);
+      jsc_writer_u16(writer, ctx->fields[i].attributes[j].name_index);
+      jsc_writer_u32(writer, ctx->fields[i].attributes[j].length);
+      jsc_writer_bytes(writer, ctx->fields[i].attributes[j].info,
+                       ctx->fields[i].attributes[j].length);
     }
   }
 
-  jsc_write_u16(&p, ctx->method_count);
+  jsc_writer_u16(writer, ctx->method_count);
 
   for (uint16_t i = 0; i < ctx->method_count; i++)
   {
-    jsc_write_u16(&p, ctx->methods[i].access_flags);
-    jsc_write_u16(&p, ctx->methods[i].name_index);
-    jsc_write_u16(&p, ctx->methods[i].descriptor_index);
-    jsc_write_u16(&p, ctx->methods[i].attribute_count);
+    jsc_writer_u16(writer, ctx->methods[i].access_flags);
+    jsc_writer_u16(writer, ctx->methods[i].name_index);
+    jsc_writer_u16(writer, ctx->methods[i].descriptor_index);
+    jsc_writer_u16(writer, ctx->methods[i].attribute_count);
 
     for (uint16_t j = 0; j < ctx->methods[i].attribute_count; j++)
     {
-      jsc_write_u16(&p, ctx->methods[i].attributes[j].name_index);
-      jsc_write_u32(&p, ctx->methods[i].attributes[j].length);
-      jsc_write_bytes(&p, ctx->methods[i].attributes[j].info,
-                      ctx->methods[i].attributes[j].length);
+      jsc_writer_u16(writer, ctx->methods[i].attributes[j].name_index);
+      jsc_writer_u32(writer, ctx->methods[i].attributes[j].length);
+      jsc_writer_bytes(writer, ctx->methods[i].attributes[j].info,
+                       ctx->methods[i].attributes[j].length);
     }
   }
 
-  jsc_write_u16(&p, ctx->attribute_count);
+  jsc_writer_u16(writer,
+                 ctx->attribute_count + (bootstrap_length > 0 ? 1 : 0));
 
   for (uint16_t i = 0; i < ctx->attribute_count; i++)
   {
-    jsc_write_u16(&p, ctx->attributes[i].name_index);
-    jsc_write_u32(&p, ctx->attributes[i].length);
-    jsc_write_bytes(&p, ctx->attributes[i].info, ctx->attributes[i].length);
+    jsc_writer_u16(writer, ctx->attributes[i].name_index);
+    jsc_writer_u32(writer, ctx->attributes[i].length);
+    jsc_writer_bytes(writer, ctx->attributes[i].info,
+                     ctx->attributes[i].length);
   }
 
-  *out_buffer = buffer;
+  if (bootstrap_length > 0)
+  {
+    /* the name was interned by jsc_bytecode_add_bootstrap_method */
+    jsc_writer_u16(writer,
+                   jsc_bytecode_add_utf8_constant(ctx, "BootstrapMethods"));
+    jsc_writer_u32(writer, bootstrap_length);
+    jsc_writer_u16(writer, ctx->bootstrap_method_count);
 
-  return total_size;
-}
+    for (uint16_t i = 0; i < ctx->bootstrap_method_count; i++)
+    {
+      const jsc_bootstrap_method* bootstrap = &ctx->bootstrap_methods[i];
 
-bool jsc_bytecode_write_to_file(jsc_bytecode_context* ctx, const char* filename)
-{
-  uint8_t* buffer;
-  uint32_t size = jsc_bytecode_write(ctx, &buffer);
+      jsc_writer_u16(writer, bootstrap->method_handle_index);
+      jsc_writer_u16(writer, bootstrap->argument_count);
 
-  if (size == 0)
-  {
-    return false;
+      for (uint16_t j = 0; j < bootstrap->argument_count; j++)
+      {
+        jsc_writer_u16(writer, bootstrap->arguments[j]);
+      }
+    }
   }
 
-  FILE* file = fopen(filename, "wb");
+  return !writer->failed;
+}
 
-  if (!file)
+/**
+ * @brief copy the serialized class into out, which has writer->size bytes
+ *
+ * @details out may be any memory, such as a mapping of the output file.
+ */
+void jsc_class_writer_gather(const jsc_class_writer* writer, uint8_t* out)
+{
+  for (uint32_t i = 0; i < writer->segment_count; i++)
   {
-    free(buffer);
-    return false;
-  }
+    const jsc_class_segment* segment = &writer->segments[i];
+    const uint8_t* data =
+        segment->data ? segment->data : writer->scratch + segment->offset;
 
-  size_t written = fwrite(buffer, 1, size, file);
-  fclose(file);
-
-  free(buffer);
-
-  return written == size;
+    memcpy(out, data, segment->length);
+    out += segment->length;
+  }
 }
 
-jsc_bytecode_context* jsc_bytecode_create_class(const char* class_name,
-                                                const char* super_class_name,
-                                                uint16_t access_flags)
+/**
+ * @brief write the serialized class to fd with writev, resuming after
+ *        short writes
+ */
+bool jsc_class_writer_writev(const jsc_class_writer* writer, int fd)
 {
-  jsc_bytecode_context* ctx = jsc_bytecode_init();
+  struct iovec iov[JSC_CLASS_WRITER_IOV];
+  uint32_t next = 0; /* first segment not completely written */
+  uint32_t skip = 0; /* bytes of segment next already written */
 
-  if (!ctx)
+  while (next < writer->segment_count)
   {
-    return NULL;
-  }
+    int count = 0;
 
-  jsc_bytecode_set_class_name(ctx, class_name);
-  jsc_bytecode_set_super_class(ctx, super_class_name ? super_class_name
-                                                     : "java/lang/Object");
-  jsc_bytecode_set_access_flags(ctx, access_flags);
+    for (uint32_t i = next;
+         i < writer->segment_count && count < JSC_CLASS_WRITER_IOV; i++)
+    {
+      const jsc_class_segment* segment = &writer->segments[i];
+      const uint8_t* data =
+          segment->data ? segment->data : writer->scratch + segment->offset;
+      uint32_t offset = i == next ? skip : 0;
+
+      iov[count].iov_base = (void*)(data + offset);
+      iov[count].iov_len = segment->length - offset;
+      count++;
+    }
 
-  uint16_t class_name_idx = jsc_bytecode_add_utf8_constant(ctx, class_name);
-  ctx->this_class = jsc_bytecode_add_class_constant(ctx, class_name);
+    ssize_t written = writev(fd, iov, count);
+
+    if (written < 0 && errno == EINTR)
+    {
+      continue;
+    }
+
+    if (written <= 0)
+    {
+      return false;
+    }
+
+    size_t left = (size_t)written;
+
+    while (left > 0)
+    {
+      uint32_t remaining = writer->segments[next].length - skip;
+
+      if (left < remaining)
+      {
+        skip += (uint32_t)left;
+        break;
+      }
+
+      left -= remaining;
+      next++;
+      skip = 0;
+    }
+
+    while (next < writer->segment_count &&
+           writer->segments[next].length == skip)
+    {
+      next++;
+      skip = 0;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * @brief serialize the class into a caller-owned buffer reused across calls
+ *
+ * @details *buffer is grown to the exact size when it is too small and
+ *          kept otherwise, so compiling many classes settles on one
+ *          allocation. Returns the size of the class file, or 0.
+ */
+uint32_t jsc_bytecode_write_buffer(jsc_bytecode_context* ctx,
+                                   jsc_class_writer* writer, uint8_t** buffer,
+                                   uint32_t* capacity)
+{
+  if (!jsc_bytecode_serialize(ctx, writer) || writer->size == 0)
+  {
+    return 0;
+  }
+
+  if (*capacity < writer->size)
+  {
+    uint8_t* grown = (uint8_t*)realloc(*buffer, writer->size);
+
+    if (!grown)
+    {
+      return 0;
+    }
+
+    *buffer = grown;
+    *capacity = writer->size;
+  }
+
+  jsc_class_writer_gather(writer, *buffer);
+  return writer->size;
+}
+
+uint32_t jsc_bytecode_write(jsc_bytecode_context* ctx, uint8_t** out_buffer)
+{
+  jsc_class_writer writer;
+  uint8_t* buffer = NULL;
+  uint32_t capacity = 0;
+
+  jsc_class_writer_init(&writer);
+
+  uint32_t size = jsc_bytecode_write_buffer(ctx, &writer, &buffer, &capacity);
+
+  jsc_class_writer_free(&writer);
+
+  if (size == 0)
+  {
+    free(buffer);
+    return 0;
+  }
+
+  *out_buffer = buffer;
+  return size;
+}
+
+/* write a serialized class to filename, replacing it */
+bool jsc_class_writer_write_file(const jsc_class_writer* writer,
+                                 const char* filename)
+{
+  int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  bool written = fd >= 0 && jsc_class_writer_writev(writer, fd);
+
+  if (fd >= 0 && close(fd) != 0)
+  {
+    written = false;
+  }
+
+  return written;
+}
+
+bool jsc_bytecode_write_to_file(jsc_bytecode_context* ctx, const char* filename)
+{
+  jsc_class_writer writer;
+  jsc_class_writer_init(&writer);
+
+  bool written = jsc_bytecode_serialize(ctx, &writer) &&
+                 jsc_class_writer_write_file(&writer, filename);
+
+  jsc_class_writer_free(&writer);
+  return written;
+}
+
+jsc_bytecode_context* jsc_bytecode_create_class(const char* class_name,
+                                                const char* super_class_name,
+                                                uint16_t access_flags)
+{
+  jsc_bytecode_context* ctx = jsc_bytecode_init();
+
+  if (!ctx)
+  {
+    return NULL;
+  }
+
+  jsc_bytecode_set_class_name(ctx, class_name);
+  jsc_bytecode_set_super_class(ctx, super_class_name ? super_class_name
+                                                     : "java/lang/Object");
+  jsc_bytecode_set_access_flags(ctx, access_flags);
+
+  uint16_t class_name_idx = jsc_bytecode_add_utf8_constant(ctx, class_name);
+  ctx->this_class = jsc_bytecode_add_class_constant(ctx, class_name);
 
   uint16_t super_name_idx = jsc_bytecode_add_utf8_constant(
       ctx, super_class_name ? super_class_name : "java/lang/Object");
@@ -1593,10 +2078,28 @@ void jsc_bytecode_emit_local_var(jsc_bytecode_context* ctx, jsc_method* method,
   }
 }
 
+/* add increment to the int in local index, widened when out of a byte */
+void jsc_bytecode_emit_iinc(jsc_bytecode_context* ctx, jsc_method* method,
+                            uint16_t index, int16_t increment)
+{
+  if (index < 256 && increment >= INT8_MIN && increment <= INT8_MAX)
+  {
+    jsc_bytecode_emit_u8(ctx, method, JSC_JVM_IINC, (uint8_t)index);
+    jsc_bytecode_emit(ctx, method, (uint8_t)(int8_t)increment);
+  }
+  else
+  {
+    jsc_bytecode_emit(ctx, method, JSC_JVM_WIDE);
+    jsc_bytecode_emit_u16(ctx, method, JSC_JVM_IINC, index);
+    jsc_bytecode_emit(ctx, method, (uint8_t)((uint16_t)increment >> 8));
+    jsc_bytecode_emit(ctx, method, (uint8_t)increment);
+  }
+}
+
 void jsc_bytecode_emit_const_load(jsc_bytecode_context* ctx, jsc_method* method,
                                   uint16_t index)
 {
-  if (index < 256)
+  if (index < 256 && !ctx->wide_constant_loads)
   {
     jsc_bytecode_emit_u8(ctx, method, JSC_JVM_LDC, (uint8_t)index);
   }
@@ -1680,6 +2183,18 @@ void jsc_bytecode_emit_invoke_interface(jsc_bytecode_context* ctx,
   }
 }
 
+void jsc_bytecode_emit_invokedynamic(jsc_bytecode_context* ctx,
+                                     jsc_method* method,
+                                     uint16_t bootstrap_index, const char* name,
+                                     const char* descriptor)
+{
+  uint16_t index =
+      jsc_bytecode_add_invoke_dynamic(ctx, bootstrap_index, name, descriptor);
+  jsc_bytecode_emit_u16(ctx, method, JSC_JVM_INVOKEDYNAMIC, index);
+  jsc_bytecode_emit(ctx, method, 0); /* two reserved zero bytes */
+  jsc_bytecode_emit(ctx, method, 0);
+}
+
 void jsc_bytecode_emit_field_access(jsc_bytecode_context* ctx,
                                     jsc_method* method, uint8_t opcode,
                                     const char* class_name,
@@ -1787,6 +2302,122 @@ uint32_t jsc_bytecode_get_method_code_offset(jsc_method* method)
   return 0;
 }
 
+/**
+ * @brief drop the code of method from offset length on
+ *
+ * @details For code just emitted that turned out to be unneeded. Branches
+ *          to labels emitted in the dropped code go with it; no surviving
+ *          branch or table entry may refer past length.
+ */
+void jsc_bytecode_truncate_method_code(jsc_bytecode_context* ctx,
+                                       jsc_method* method, uint32_t length)
+{
+  if (!method)
+  {
+    return;
+  }
+
+  for (uint16_t i = 0; i < method->attribute_count; i++)
+  {
+    jsc_attribute* attr = &method->attributes[i];
+    const jsc_constant_pool_entry* entry =
+        &ctx->constant_pool[attr->name_index];
+
+    if (entry->tag != JSC_CP_UTF8 || entry->utf8_info.length != 4 ||
+        memcmp(entry->utf8_info.bytes, "Code", 4) != 0)
+    {
+      continue;
+    }
+
+    uint32_t code_length;
+    memcpy(&code_length, attr->info + 4, 4);
+    code_length = be32toh(code_length);
+
+    if (length < code_length)
+    {
+      memmove(attr->info + 8 + length, attr->info + 8 + code_length,
+              attr->length - 8 - code_length);
+      attr->length -= code_length - length;
+
+      uint32_t length_be = htobe32(length);
+      memcpy(attr->info + 4, &length_be, 4);
+    }
+
+    break;
+  }
+
+  uint16_t method_index = (uint16_t)(method - ctx->methods);
+  uint32_t kept = 0;
+
+  for (uint32_t i = 0; i < ctx->branch_fixup_count; i++)
+  {
+    const jsc_branch_fixup* fixup = &ctx->branch_fixups[i];
+
+    if (fixup->method != method_index || fixup->pc < length)
+    {
+      ctx->branch_fixups[kept++] = *fixup;
+    }
+  }
+
+  ctx->branch_fixup_count = kept;
+}
+
+/**
+ * @brief replace the code of method with length bytes of code
+ *
+ * @details max_stack, max_locals, the exception table and the attributes
+ *          of the Code attribute are kept. Returns false if method has no
+ *          Code attribute or memory runs out.
+ */
+bool jsc_bytecode_replace_method_code(jsc_bytecode_context* ctx,
+                                      jsc_method* method, const uint8_t* code,
+                                      uint32_t length)
+{
+  if (!method)
+  {
+    return false;
+  }
+
+  for (uint16_t i = 0; i < method->attribute_count; i++)
+  {
+    jsc_attribute* attr = &method->attributes[i];
+    const jsc_constant_pool_entry* entry =
+        &ctx->constant_pool[attr->name_index];
+
+    if (entry->tag != JSC_CP_UTF8 || entry->utf8_info.length != 4 ||
+        memcmp(entry->utf8_info.bytes, "Code", 4) != 0)
+    {
+      continue;
+    }
+
+    uint32_t code_length;
+    memcpy(&code_length, attr->info + 4, 4);
+    code_length = be32toh(code_length);
+
+    uint32_t tail = attr->length - 8 - code_length;
+    uint8_t* info = (uint8_t*)malloc(8 + length + tail);
+
+    if (!info)
+    {
+      return false;
+    }
+
+    uint32_t length_be = htobe32(length);
+
+    memcpy(info, attr->info, 4);
+    memcpy(info + 4, &length_be, 4);
+    memcpy(info + 8, code, length);
+    memcpy(info + 8 + length, attr->info + 8 + code_length, tail);
+
+    free(attr->info);
+    attr->info = info;
+    attr->length = 8 + length + tail;
+    return true;
+  }
+
+  return false;
+}
+
 void jsc_bytecode_emit_constructor(jsc_bytecode_context* ctx,
                                    jsc_method* method, const char* super_class)
 {
@@ -2193,6 +2824,16 @@ void jsc_bytecode_emit_load_constant_int_boxed(jsc_bytecode_context* ctx,
                                    "(I)V");
 }
 
+/* the shared Boolean.TRUE or Boolean.FALSE, as Boolean.valueOf returns */
+void jsc_bytecode_emit_load_constant_boolean_boxed(jsc_bytecode_context* ctx,
+                                                   jsc_method* method,
+                                                   bool value)
+{
+  jsc_bytecode_emit_field_access(ctx, method, JSC_JVM_GETSTATIC,
+                                 "java/lang/Boolean", value ? "TRUE" : "FALSE",
+                                 "Ljava/lang/Boolean;");
+}
+
 void jsc_bytecode_emit_load_constant_long_boxed(jsc_bytecode_context* ctx,
                                                 jsc_method* method,
                                                 int64_t value)
@@ -2271,3 +2912,6173 @@ void jsc_bytecode_emit_load_constant_double_boxed(jsc_bytecode_context* ctx,
   jsc_bytecode_emit_invoke_special(ctx, method, "java/lang/Double", "<init>",
                                    "(D)V");
 }
+
+/* operand bytes per opcode; -1 marks variable-length and unused opcodes */
+static const int8_t jsc_jvm_operand_sizes[1 << 8] = {
+    /* 0x00 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 0x10 */ 1, 2, 1, 2, 2, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,
+    /* 0x20 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 0x30 */ 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0,
+    /* 0x40 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 0x50 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 0x60 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 0x70 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 0x80 */ 0, 0, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 0x90 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 2, 2, 2, 2,
+    /* 0xa0 */ 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, -1, -1, 0, 0, 0, 0,
+    /* 0xb0 */ 0, 0, 2, 2, 2, 2, 2, 2, 2, 4, 4, 2, 1, 2, 0, 0,
+    /* 0xc0 */ 2, 2, 0, 0, -1, 3, 2, 2, 4, 4, -1, -1, -1, -1, -1, -1,
+    /* 0xd0 */ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    /* 0xe0 */ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    /* 0xf0 */ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1};
+
+static uint16_t jsc_read_u16(const uint8_t* p)
+{
+  uint16_t value;
+  memcpy(&value, p, 2);
+  return be16toh(value);
+}
+
+static int32_t jsc_read_s32(const uint8_t* p)
+{
+  uint32_t value;
+  memcpy(&value, p, 4);
+  return (int32_t)be32toh(value);
+}
+
+static uint32_t jsc_read_u32(const uint8_t* p)
+{
+  return (uint32_t)jsc_read_s32(p);
+}
+
+/**
+ * @brief size in bytes of the instruction at pc, or 0 if it is malformed
+ */
+uint32_t jsc_bytecode_instruction_length(const uint8_t* code, uint32_t pc,
+                                         uint32_t code_length)
+{
+  if (pc >= code_length)
+  {
+    return 0;
+  }
+
+  uint8_t opcode = code[pc];
+  uint32_t length;
+
+  if (opcode == JSC_JVM_TABLESWITCH || opcode == JSC_JVM_LOOKUPSWITCH)
+  {
+    uint32_t base = (pc + 4) & ~3u; /* operands are 4-byte aligned */
+
+    if (base + 12 > code_length)
+    {
+      return 0;
+    }
+
+    if (opcode == JSC_JVM_TABLESWITCH)
+    {
+      int64_t low = jsc_read_s32(code + base + 4);
+      int64_t high = jsc_read_s32(code + base + 8);
+
+      /* 64-bit, so a huge table cannot wrap around to a short one */
+      if (high < low || base + 12 + (high - low + 1) * 4 > code_length)
+      {
+        return 0;
+      }
+
+      length = base + 12 + (uint32_t)(high - low + 1) * 4 - pc;
+    }
+    else
+    {
+      int64_t pairs = jsc_read_s32(code + base + 4);
+
+      if (pairs < 0 || base + 8 + pairs * 8 > code_length)
+      {
+        return 0;
+      }
+
+      length = base + 8 + (uint32_t)pairs * 8 - pc;
+    }
+  }
+  else if (opcode == JSC_JVM_WIDE)
+  {
+    if (pc + 1 >= code_length)
+    {
+      return 0;
+    }
+
+    length = code[pc + 1] == JSC_JVM_IINC ? 6 : 4;
+  }
+  else if (jsc_jvm_operand_sizes[opcode] < 0)
+  {
+    return 0;
+  }
+  else
+  {
+    length = 1 + (uint32_t)jsc_jvm_operand_sizes[opcode];
+  }
+
+  return pc + length <= code_length ? length : 0;
+}
+
+static char* jsc_bytecode_utf8_dup(const jsc_bytecode_context* ctx,
+                                   uint16_t index)
+{
+  if (index == 0 || index >= ctx->constant_pool_count ||
+      ctx->constant_pool[index].tag != JSC_CP_UTF8)
+  {
+    return NULL;
+  }
+
+  const jsc_constant_pool_entry* entry = &ctx->constant_pool[index];
+  char* str = (char*)malloc(entry->utf8_info.length + 1);
+
+  if (str)
+  {
+    memcpy(str, entry->utf8_info.bytes, entry->utf8_info.length);
+    str[entry->utf8_info.length] = '\0';
+  }
+
+  return str;
+}
+
+static char* jsc_bytecode_class_name_dup(const jsc_bytecode_context* ctx,
+                                         uint16_t index)
+{
+  if (index == 0 || index >= ctx->constant_pool_count ||
+      ctx->constant_pool[index].tag != JSC_CP_CLASS)
+  {
+    return NULL;
+  }
+
+  return jsc_bytecode_utf8_dup(ctx,
+                               ctx->constant_pool[index].class_info.name_index);
+}
+
+/**
+ * @brief copy constant index of source into ctx, returning its new index
+ *
+ * @details Goes through the regular add functions, so an equal constant
+ *          already in ctx is reused. Returns 0 for constants that cannot be
+ *          imported.
+ */
+uint16_t jsc_bytecode_import_constant(jsc_bytecode_context* ctx,
+                                      const jsc_bytecode_context* source,
+                                      uint16_t index)
+{
+  if (index == 0 || index >= source->constant_pool_count)
+  {
+    return 0;
+  }
+
+  const jsc_constant_pool_entry* entry = &source->constant_pool[index];
+  uint16_t result = 0;
+
+  switch (entry->tag)
+  {
+  case JSC_CP_UTF8:
+  {
+    char* str = jsc_bytecode_utf8_dup(source, index);
+    result = str ? jsc_bytecode_add_utf8_constant(ctx, str) : 0;
+    free(str);
+    break;
+  }
+
+  case JSC_CP_INTEGER:
+    result = jsc_bytecode_add_integer_constant(ctx, entry->integer_info.value);
+    break;
+
+  case JSC_CP_FLOAT:
+    result = jsc_bytecode_add_float_constant(ctx, entry->float_info.value);
+    break;
+
+  case JSC_CP_LONG:
+    result = jsc_bytecode_add_long_constant(ctx, entry->long_info.value);
+    break;
+
+  case JSC_CP_DOUBLE:
+    result = jsc_bytecode_add_double_constant(ctx, entry->double_info.value);
+    break;
+
+  case JSC_CP_STRING:
+  {
+    char* str = jsc_bytecode_utf8_dup(source, entry->string_info.string_index);
+    result = str ? jsc_bytecode_add_string_constant(ctx, str) : 0;
+    free(str);
+    break;
+  }
+
+  case JSC_CP_CLASS:
+  {
+    char* name = jsc_bytecode_class_name_dup(source, index);
+    result = name ? jsc_bytecode_add_class_constant(ctx, name) : 0;
+    free(name);
+    break;
+  }
+
+  case JSC_CP_NAME_AND_TYPE:
+  {
+    char* name =
+        jsc_bytecode_utf8_dup(source, entry->name_and_type_info.name_index);
+    char* descriptor = jsc_bytecode_utf8_dup(
+        source, entry->name_and_type_info.descriptor_index);
+
+    if (name && descriptor)
+    {
+      result = jsc_bytecode_add_name_and_type_constant(ctx, name, descriptor);
+    }
+
+    free(name);
+    free(descriptor);
+    break;
+  }
+
+  case JSC_CP_FIELDREF:
+  case JSC_CP_METHODREF:
+  case JSC_CP_INTERFACE_METHODREF:
+  {
+    /* the three reference kinds share one layout */
+    uint16_t name_and_type_index = entry->fieldref_info.name_and_type_index;
+
+    if (name_and_type_index == 0 ||
+        name_and_type_index >= source->constant_pool_count)
+    {
+      break;
+    }
+
+    const jsc_constant_pool_entry* name_and_type =
+        &source->constant_pool[name_and_type_index];
+
+    char* class_name =
+        jsc_bytecode_class_name_dup(source, entry->fieldref_info.class_index);
+    char* name = jsc_bytecode_utf8_dup(
+        source, name_and_type->name_and_type_info.name_index);
+    char* descriptor = jsc_bytecode_utf8_dup(
+        source, name_and_type->name_and_type_info.descriptor_index);
+
+    if (class_name && name && descriptor)
+    {
+      if (entry->tag == JSC_CP_FIELDREF)
+      {
+        result = jsc_bytecode_add_field_reference(ctx, class_name, name,
+                                                  descriptor);
+      }
+      else if (entry->tag == JSC_CP_METHODREF)
+      {
+        result = jsc_bytecode_add_method_reference(ctx, class_name, name,
+                                                   descriptor);
+      }
+      else
+      {
+        result = jsc_bytecode_add_interface_method_reference(
+            ctx, class_name, name, descriptor);
+      }
+    }
+
+    free(class_name);
+    free(name);
+    free(descriptor);
+    break;
+  }
+
+  case JSC_CP_METHOD_HANDLE:
+  {
+    uint16_t reference_index = jsc_bytecode_import_constant(
+        ctx, source, entry->method_handle_info.reference_index);
+
+    if (reference_index != 0)
+    {
+      result = jsc_bytecode_add_method_handle_entry(
+          ctx, entry->method_handle_info.reference_kind, reference_index);
+    }
+    break;
+  }
+
+  case JSC_CP_METHOD_TYPE:
+  {
+    char* descriptor = jsc_bytecode_utf8_dup(
+        source, entry->method_type_info.descriptor_index);
+
+    if (descriptor)
+    {
+      result = jsc_bytecode_add_method_type(ctx, descriptor);
+    }
+
+    free(descriptor);
+    break;
+  }
+
+  case JSC_CP_INVOKE_DYNAMIC:
+  {
+    uint16_t bootstrap_index =
+        entry->invoke_dynamic_info.bootstrap_method_attr_index;
+    uint16_t name_and_type_index =
+        entry->invoke_dynamic_info.name_and_type_index;
+
+    if (bootstrap_index >= source->bootstrap_method_count ||
+        name_and_type_index == 0 ||
+        name_and_type_index >= source->constant_pool_count)
+    {
+      break;
+    }
+
+    /* the bootstrap entry moves along with the call site */
+    const jsc_bootstrap_method* bootstrap =
+        &source->bootstrap_methods[bootstrap_index];
+    uint16_t method_handle_index = jsc_bytecode_import_constant(
+        ctx, source, bootstrap->method_handle_index);
+    uint16_t* arguments = (uint16_t*)malloc(
+        (bootstrap->argument_count + 1) * sizeof(uint16_t));
+    bool imported = method_handle_index != 0 && arguments;
+
+    for (uint16_t i = 0; imported && i < bootstrap->argument_count; i++)
+    {
+      arguments[i] =
+          jsc_bytecode_import_constant(ctx, source, bootstrap->arguments[i]);
+      imported = arguments[i] != 0;
+    }
+
+    int32_t imported_bootstrap =
+        imported ? jsc_bytecode_add_bootstrap_method(
+                       ctx, method_handle_index, arguments,
+                       bootstrap->argument_count)
+                 : -1;
+    free(arguments);
+
+    const jsc_constant_pool_entry* name_and_type =
+        &source->constant_pool[name_and_type_index];
+    char* name = jsc_bytecode_utf8_dup(
+        source, name_and_type->name_and_type_info.name_index);
+    char* descriptor = jsc_bytecode_utf8_dup(
+        source, name_and_type->name_and_type_info.descriptor_index);
+
+    if (imported_bootstrap >= 0 && name && descriptor)
+    {
+      result = jsc_bytecode_add_invoke_dynamic(
+          ctx, (uint16_t)imported_bootstrap, name, descriptor);
+    }
+
+    free(name);
+    free(descriptor);
+    break;
+  }
+
+  default:
+    break;
+  }
+
+  return result;
+}
+
+static bool jsc_bytecode_import_u16(jsc_bytecode_context* ctx,
+                                    const jsc_bytecode_context* source,
+                                    uint8_t* p)
+{
+  uint16_t index;
+  memcpy(&index, p, 2);
+  index = be16toh(index);
+
+  if (index == 0)
+  {
+    return true;
+  }
+
+  uint16_t imported = jsc_bytecode_import_constant(ctx, source, index);
+
+  if (imported == 0)
+  {
+    return false;
+  }
+
+  uint16_t imported_be = htobe16(imported);
+  memcpy(p, &imported_be, 2);
+
+  return true;
+}
+
+/**
+ * @brief rewrite the constant pool operands of a code array in place
+ *
+ * @details Instruction lengths never change, so branch offsets stay valid;
+ *          an ldc whose constant lands beyond index 255 cannot be rewritten
+ *          and fails the import (compile with wide_constant_loads to avoid).
+ */
+static bool jsc_bytecode_import_code(jsc_bytecode_context* ctx,
+                                     const jsc_bytecode_context* source,
+                                     uint8_t* code, uint32_t code_length)
+{
+  uint32_t pc = 0;
+
+  while (pc < code_length)
+  {
+    uint32_t length = jsc_bytecode_instruction_length(code, pc, code_length);
+
+    if (length == 0)
+    {
+      return false;
+    }
+
+    switch (code[pc])
+    {
+    case JSC_JVM_LDC:
+    {
+      uint16_t imported =
+          jsc_bytecode_import_constant(ctx, source, code[pc + 1]);
+
+      if (imported == 0 || imported > UINT8_MAX)
+      {
+        return false;
+      }
+
+      code[pc + 1] = (uint8_t)imported;
+      break;
+    }
+
+    case JSC_JVM_LDC_W:
+    case JSC_JVM_LDC2_W:
+    case JSC_JVM_GETSTATIC:
+    case JSC_JVM_PUTSTATIC:
+    case JSC_JVM_GETFIELD:
+    case JSC_JVM_PUTFIELD:
+    case JSC_JVM_INVOKEVIRTUAL:
+    case JSC_JVM_INVOKESPECIAL:
+    case JSC_JVM_INVOKESTATIC:
+    case JSC_JVM_INVOKEINTERFACE:
+    case JSC_JVM_INVOKEDYNAMIC:
+    case JSC_JVM_NEW:
+    case JSC_JVM_ANEWARRAY:
+    case JSC_JVM_CHECKCAST:
+    case JSC_JVM_INSTANCEOF:
+    case JSC_JVM_MULTIANEWARRAY:
+      if (!jsc_bytecode_import_u16(ctx, source, code + pc + 1))
+      {
+        return false;
+      }
+      break;
+
+    default:
+      break;
+    }
+
+    pc += length;
+  }
+
+  return true;
+}
+
+/**
+ * @brief copy a method compiled into another class file into ctx
+ *
+ * @details Used to merge separately compiled shards of one class. All
+ *          constant pool references, including those inside the Code
+ *          attribute, its exception table and local variable tables, are
+ *          re-resolved against the constant pool of ctx.
+ */
+jsc_method* jsc_bytecode_import_method(jsc_bytecode_context* ctx,
+                                       const jsc_bytecode_context* source,
+                                       const jsc_method* method)
+{
+  char* name = jsc_bytecode_utf8_dup(source, method->name_index);
+  char* descriptor = jsc_bytecode_utf8_dup(source, method->descriptor_index);
+
+  jsc_method* imported =
+      (name && descriptor)
+          ? jsc_bytecode_add_method(ctx, name, descriptor, method->access_flags)
+          : NULL;
+
+  free(name);
+  free(descriptor);
+
+  if (!imported)
+  {
+    return NULL;
+  }
+
+  for (uint16_t i = 0; i < method->attribute_count; i++)
+  {
+    const jsc_attribute* attr = &method->attributes[i];
+    char* attr_name = jsc_bytecode_utf8_dup(source, attr->name_index);
+
+    if (!attr_name)
+    {
+      return NULL;
+    }
+
+    jsc_attribute* copy = jsc_bytecode_add_method_attribute(
+        ctx, imported, attr_name, attr->length);
+
+    bool is_code = strcmp(attr_name, "Code") == 0;
+    free(attr_name);
+
+    if (!copy || !copy->info)
+    {
+      return NULL;
+    }
+
+    memcpy(copy->info, attr->info, attr->length);
+
+    if (!is_code)
+    {
+      continue;
+    }
+
+    uint8_t* p = copy->info + 4;
+    uint32_t code_length;
+    memcpy(&code_length, p, 4);
+    code_length = be32toh(code_length);
+    p += 4;
+
+    if (!jsc_bytecode_import_code(ctx, source, p, code_length))
+    {
+      return NULL;
+    }
+
+    p += code_length;
+
+    uint16_t exception_table_length;
+    memcpy(&exception_table_length, p, 2);
+    exception_table_length = be16toh(exception_table_length);
+    p += 2;
+
+    for (uint16_t j = 0; j < exception_table_length; j++, p += 8)
+    {
+      if (!jsc_bytecode_import_u16(ctx, source, p + 6)) /* catch_type */
+      {
+        return NULL;
+      }
+    }
+
+    uint16_t attributes_count;
+    memcpy(&attributes_count, p, 2);
+    attributes_count = be16toh(attributes_count);
+    p += 2;
+
+    for (uint16_t j = 0; j < attributes_count; j++)
+    {
+      uint16_t nested_name_index;
+      memcpy(&nested_name_index, p, 2);
+      nested_name_index = be16toh(nested_name_index);
+
+      uint32_t nested_length;
+      memcpy(&nested_length, p + 2, 4);
+      nested_length = be32toh(nested_length);
+
+      const jsc_constant_pool_entry* nested_name =
+          &source->constant_pool[nested_name_index];
+      bool is_local_variable_table =
+          nested_name->tag == JSC_CP_UTF8 &&
+          ((nested_name->utf8_info.length == 18 &&
+            memcmp(nested_name->utf8_info.bytes, "LocalVariableTable", 18) ==
+                0) ||
+           (nested_name->utf8_info.length == 22 &&
+            memcmp(nested_name->utf8_info.bytes, "LocalVariableTypeTable",
+                   22) == 0));
+
+      if (!jsc_bytecode_import_u16(ctx, source, p))
+      {
+        return NULL;
+      }
+
+      if (is_local_variable_table)
+      {
+        uint16_t entry_count;
+        memcpy(&entry_count, p + 6, 2);
+        entry_count = be16toh(entry_count);
+
+        for (uint16_t k = 0; k < entry_count; k++)
+        {
+          uint8_t* entry = p + 8 + k * 10;
+
+          if (!jsc_bytecode_import_u16(ctx, source, entry + 4) ||
+              !jsc_bytecode_import_u16(ctx, source, entry + 6))
+          {
+            return NULL;
+          }
+        }
+      }
+
+      p += 6 + nested_length;
+    }
+  }
+
+  return imported;
+}
+
+/* per code offset flags of the stack map analysis */
+#define JSC_FRAME_INSTRUCTION 0x01 /* an instruction starts here */
+#define JSC_FRAME_LEADER 0x02      /* needs a frame if it is reachable */
+#define JSC_FRAME_REACHED 0x04
+#define JSC_FRAME_QUEUED 0x08
+
+typedef struct
+{
+  uint8_t tag;
+  uint16_t index; /* class constant of an OBJECT, offset of the new
+                     instruction of an UNINITIALIZED */
+} jsc_frame_type;
+
+typedef struct
+{
+  jsc_frame_type* locals;
+  jsc_frame_type* stack;
+  uint16_t stack_size;
+} jsc_frame;
+
+typedef struct
+{
+  jsc_bytecode_context* ctx;
+  uint8_t* code;
+  uint32_t code_length;
+  const uint8_t* exception_table;
+  uint16_t exception_table_length;
+  uint16_t max_stack;
+  uint16_t max_locals;
+  uint8_t* flags;
+  jsc_frame** frames; /* entry state of every block that has been reached */
+  uint32_t* worklist;
+  uint32_t worklist_size;
+  jsc_frame current;
+  bool wrote_local;
+  bool failed;
+} jsc_frame_analysis;
+
+static bool jsc_frame_is_wide(jsc_frame_type type)
+{
+  return type.tag == JSC_ITEM_LONG || type.tag == JSC_ITEM_DOUBLE;
+}
+
+static bool jsc_frame_is_reference(jsc_frame_type type)
+{
+  return type.tag == JSC_ITEM_OBJECT || type.tag == JSC_ITEM_NULL;
+}
+
+static bool jsc_frame_type_equal(jsc_frame_type a, jsc_frame_type b)
+{
+  if (a.tag != b.tag)
+  {
+    return false;
+  }
+
+  return (a.tag != JSC_ITEM_OBJECT && a.tag != JSC_ITEM_UNINITIALIZED) ||
+         a.index == b.index;
+}
+
+static jsc_frame_type jsc_frame_make(uint8_t tag, uint16_t index)
+{
+  jsc_frame_type type = {tag, index};
+  return type;
+}
+
+static jsc_frame_type jsc_frame_object(jsc_frame_analysis* a, const char* name,
+                                       size_t length)
+{
+  char* copy = (char*)malloc(length + 1);
+  uint16_t index = 0;
+
+  if (copy)
+  {
+    memcpy(copy, name, length);
+    copy[length] = '\0';
+    index = jsc_bytecode_add_class_constant(a->ctx, copy);
+    free(copy);
+  }
+
+  if (index == 0)
+  {
+    a->failed = true;
+  }
+
+  return jsc_frame_make(JSC_ITEM_OBJECT, index);
+}
+
+/* the bytes of utf8 constant index; the bytes outlive pool reallocations */
+static const uint8_t* jsc_frame_utf8(jsc_frame_analysis* a, uint16_t index,
+                                     uint16_t* length)
+{
+  if (index == 0 || index >= a->ctx->constant_pool_count ||
+      a->ctx->constant_pool[index].tag != JSC_CP_UTF8)
+  {
+    a->failed = true;
+    return NULL;
+  }
+
+  *length = a->ctx->constant_pool[index].utf8_info.length;
+  return a->ctx->constant_pool[index].utf8_info.bytes;
+}
+
+static const uint8_t* jsc_frame_class_name(jsc_frame_analysis* a,
+                                           uint16_t index, uint16_t* length)
+{
+  if (index == 0 || index >= a->ctx->constant_pool_count ||
+      a->ctx->constant_pool[index].tag != JSC_CP_CLASS)
+  {
+    a->failed = true;
+    return NULL;
+  }
+
+  return jsc_frame_utf8(a, a->ctx->constant_pool[index].class_info.name_index,
+                        length);
+}
+
+/**
+ * @brief skip one field type of a descriptor, returning its slot count
+ */
+static uint16_t jsc_frame_skip_type(const uint8_t** p, const uint8_t* end)
+{
+  const uint8_t* q = *p;
+
+  while (q < end && *q == '[')
+  {
+    q++;
+  }
+
+  if (q >= end)
+  {
+    return 0;
+  }
+
+  uint16_t slots = (q == *p && (*q == 'J' || *q == 'D')) ? 2 : 1;
+
+  if (*q == 'L')
+  {
+    while (q < end && *q != ';')
+    {
+      q++;
+    }
+
+    if (q >= end)
+    {
+      return 0;
+    }
+  }
+  else if (!strchr("ZBCSIFJD", *q))
+  {
+    return 0;
+  }
+
+  *p = q + 1;
+  return slots;
+}
+
+static jsc_frame_type jsc_frame_parse_type(jsc_frame_analysis* a,
+                                           const uint8_t** p,
+                                           const uint8_t* end)
+{
+  const uint8_t* start = *p;
+
+  if (jsc_frame_skip_type(p, end) == 0)
+  {
+    a->failed = true;
+    return jsc_frame_make(JSC_ITEM_TOP, 0);
+  }
+
+  switch (*start)
+  {
+  case 'J':
+    return jsc_frame_make(JSC_ITEM_LONG, 0);
+  case 'D':
+    return jsc_frame_make(JSC_ITEM_DOUBLE, 0);
+  case 'F':
+    return jsc_frame_make(JSC_ITEM_FLOAT, 0);
+  case 'L':
+    return jsc_frame_object(a, (const char*)start + 1, *p - start - 2);
+  case '[':
+    return jsc_frame_object(a, (const char*)start, *p - start);
+  default:
+    return jsc_frame_make(JSC_ITEM_INTEGER, 0);
+  }
+}
+
+static void jsc_frame_push(jsc_frame_analysis* a, jsc_frame_type type)
+{
+  uint16_t slots = jsc_frame_is_wide(type) ? 2 : 1;
+
+  if (a->current.stack_size + slots > a->max_stack)
+  {
+    a->failed = true;
+    return;
+  }
+
+  a->current.stack[a->current.stack_size++] = type;
+
+  if (slots == 2)
+  {
+    a->current.stack[a->current.stack_size++] =
+        jsc_frame_make(JSC_ITEM_TOP, 0);
+  }
+}
+
+/* pops count slots, returning the lowest of them */
+static jsc_frame_type* jsc_frame_pop(jsc_frame_analysis* a, uint16_t count)
+{
+  if (a->current.stack_size < count)
+  {
+    a->failed = true;
+    return NULL;
+  }
+
+  a->current.stack_size -= count;
+  return &a->current.stack[a->current.stack_size];
+}
+
+static void jsc_frame_pop_push(jsc_frame_analysis* a, uint16_t count,
+                               uint8_t tag)
+{
+  if (jsc_frame_pop(a, count))
+  {
+    jsc_frame_push(a, jsc_frame_make(tag, 0));
+  }
+}
+
+static void jsc_frame_load(jsc_frame_analysis* a, uint32_t index, uint8_t tag)
+{
+  uint32_t slots = (tag == JSC_ITEM_LONG || tag == JSC_ITEM_DOUBLE) ? 2 : 1;
+
+  if (index + slots > a->max_locals)
+  {
+    a->failed = true;
+    return;
+  }
+
+  jsc_frame_type local = a->current.locals[index];
+
+  if (tag == JSC_ITEM_OBJECT ? !jsc_frame_is_reference(local) &&
+                                   local.tag != JSC_ITEM_UNINITIALIZED &&
+                                   local.tag != JSC_ITEM_UNINITIALIZED_THIS
+                             : local.tag != tag)
+  {
+    a->failed = true;
+    return;
+  }
+
+  jsc_frame_push(a, local);
+}
+
+static void jsc_frame_store(jsc_frame_analysis* a, uint32_t index,
+                            uint16_t slots)
+{
+  jsc_frame_type* value = jsc_frame_pop(a, slots);
+
+  if (!value || index + slots > a->max_locals)
+  {
+    a->failed = true;
+    return;
+  }
+
+  if (index > 0 && jsc_frame_is_wide(a->current.locals[index - 1]))
+  {
+    a->current.locals[index - 1] = jsc_frame_make(JSC_ITEM_TOP, 0);
+  }
+
+  memcpy(&a->current.locals[index], value, slots * sizeof(jsc_frame_type));
+  a->wrote_local = true;
+}
+
+/**
+ * @brief merge a type flowing into a block into the one recorded there
+ *
+ * @details References of different classes widen to java/lang/Object; any
+ *          other disagreement turns a local into TOP and fails the analysis
+ *          on the stack.
+ */
+static bool jsc_frame_merge_type(jsc_frame_analysis* a, jsc_frame_type* into,
+                                 jsc_frame_type from, bool local)
+{
+  if (jsc_frame_type_equal(*into, from) || (local && into->tag == JSC_ITEM_TOP))
+  {
+    return false;
+  }
+
+  if (jsc_frame_is_reference(*into) && jsc_frame_is_reference(from))
+  {
+    if (from.tag == JSC_ITEM_NULL)
+    {
+      return false;
+    }
+
+    if (into->tag == JSC_ITEM_NULL)
+    {
+      *into = from;
+      return true;
+    }
+
+    jsc_frame_type object = jsc_frame_object(a, "java/lang/Object", 16);
+
+    if (jsc_frame_type_equal(*into, object))
+    {
+      return false;
+    }
+
+    *into = object;
+    return true;
+  }
+
+  if (!local)
+  {
+    a->failed = true;
+    return false;
+  }
+
+  *into = jsc_frame_make(JSC_ITEM_TOP, 0);
+  return true;
+}
+
+/**
+ * @brief merge the current state into the entry state of target
+ *
+ * @details stack, when not NULL, replaces the current operand stack (used
+ *          for exception handlers). A block whose entry state changed is
+ *          queued again.
+ */
+static void jsc_frame_merge(jsc_frame_analysis* a, int64_t target,
+                            const jsc_frame_type* stack, uint16_t stack_size)
+{
+  if (target < 0 || target >= a->code_length ||
+      !(a->flags[target] & JSC_FRAME_INSTRUCTION))
+  {
+    a->failed = true;
+    return;
+  }
+
+  if (!stack)
+  {
+    stack = a->current.stack;
+    stack_size = a->current.stack_size;
+  }
+
+  jsc_frame* frame = a->frames[target];
+  bool changed = false;
+
+  if (!frame)
+  {
+    size_t types = (size_t)a->max_locals + a->max_stack;
+
+    frame = (jsc_frame*)malloc(sizeof(jsc_frame) +
+                               types * sizeof(jsc_frame_type));
+
+    if (!frame)
+    {
+      a->failed = true;
+      return;
+    }
+
+    frame->locals = (jsc_frame_type*)(frame + 1);
+    frame->stack = frame->locals + a->max_locals;
+    frame->stack_size = stack_size;
+    memcpy(frame->locals, a->current.locals,
+           a->max_locals * sizeof(jsc_frame_type));
+    memcpy(frame->stack, stack, stack_size * sizeof(jsc_frame_type));
+    a->frames[target] = frame;
+    changed = true;
+  }
+  else
+  {
+    if (frame->stack_size != stack_size)
+    {
+      a->failed = true;
+      return;
+    }
+
+    for (uint16_t i = 0; i < a->max_locals; i++)
+    {
+      changed |= jsc_frame_merge_type(a, &frame->locals[i],
+                                      a->current.locals[i], true);
+    }
+
+    for (uint16_t i = 0; i < stack_size; i++)
+    {
+      changed |= jsc_frame_merge_type(a, &frame->stack[i], stack[i], false);
+    }
+  }
+
+  if (changed && !(a->flags[target] & JSC_FRAME_QUEUED))
+  {
+    a->flags[target] |= JSC_FRAME_QUEUED;
+    a->worklist[a->worklist_size++] = (uint32_t)target;
+  }
+}
+
+static void jsc_frame_merge_handlers(jsc_frame_analysis* a, uint32_t pc)
+{
+  for (uint16_t i = 0; i < a->exception_table_length; i++)
+  {
+    const uint8_t* entry = a->exception_table + i * 8;
+
+    if (pc < jsc_read_u16(entry) || pc >= jsc_read_u16(entry + 2))
+    {
+      continue;
+    }
+
+    uint16_t catch_type = jsc_read_u16(entry + 6);
+    jsc_frame_type thrown =
+        catch_type ? jsc_frame_make(JSC_ITEM_OBJECT, catch_type)
+                   : jsc_frame_object(a, "java/lang/Throwable", 19);
+
+    jsc_frame_merge(a, jsc_read_u16(entry + 4), &thrown, 1);
+  }
+}
+
+/* name and descriptor of the name_and_type constant behind a member */
+static bool jsc_frame_member(jsc_frame_analysis* a, uint16_t name_and_type,
+                             const uint8_t** name, uint16_t* name_length,
+                             const uint8_t** descriptor, uint16_t* length)
+{
+  jsc_bytecode_context* ctx = a->ctx;
+
+  if (name_and_type == 0 || name_and_type >= ctx->constant_pool_count ||
+      ctx->constant_pool[name_and_type].tag != JSC_CP_NAME_AND_TYPE)
+  {
+    a->failed = true;
+    return false;
+  }
+
+  *name = jsc_frame_utf8(
+      a, ctx->constant_pool[name_and_type].name_and_type_info.name_index,
+      name_length);
+  *descriptor = jsc_frame_utf8(
+      a, ctx->constant_pool[name_and_type].name_and_type_info.descriptor_index,
+      length);
+
+  return *name && *descriptor && *length > 0;
+}
+
+static void jsc_frame_field(jsc_frame_analysis* a, uint8_t opcode,
+                            uint16_t index)
+{
+  jsc_bytecode_context* ctx = a->ctx;
+
+  if (index == 0 || index >= ctx->constant_pool_count ||
+      ctx->constant_pool[index].tag != JSC_CP_FIELDREF)
+  {
+    a->failed = true;
+    return;
+  }
+
+  const uint8_t* name;
+  const uint8_t* descriptor;
+  uint16_t name_length = 0;
+  uint16_t length = 0;
+
+  if (!jsc_frame_member(
+          a, ctx->constant_pool[index].fieldref_info.name_and_type_index, &name,
+          &name_length, &descriptor, &length))
+  {
+    return;
+  }
+
+  const uint8_t* p = descriptor;
+  uint16_t slots = jsc_frame_skip_type(&p, descriptor + length);
+
+  switch (opcode)
+  {
+  case JSC_JVM_GETFIELD:
+    jsc_frame_pop(a, 1);
+    /* fall through */
+  case JSC_JVM_GETSTATIC:
+    p = descriptor;
+    jsc_frame_push(a, jsc_frame_parse_type(a, &p, descriptor + length));
+    break;
+  case JSC_JVM_PUTFIELD:
+    jsc_frame_pop(a, slots + 1);
+    break;
+  default:
+    jsc_frame_pop(a, slots);
+    break;
+  }
+}
+
+/* replaces every occurrence of an uninitialized type after its <init> */
+static void jsc_frame_initialize(jsc_frame_analysis* a, jsc_frame_type type)
+{
+  jsc_frame_type initialized;
+
+  if (type.tag == JSC_ITEM_UNINITIALIZED_THIS)
+  {
+    initialized = jsc_frame_make(JSC_ITEM_OBJECT, a->ctx->this_class);
+  }
+  else if (type.tag == JSC_ITEM_UNINITIALIZED)
+  {
+    initialized =
+        jsc_frame_make(JSC_ITEM_OBJECT, jsc_read_u16(a->code + type.index + 1));
+  }
+  else
+  {
+    return;
+  }
+
+  for (uint16_t i = 0; i < a->max_locals; i++)
+  {
+    if (jsc_frame_type_equal(a->current.locals[i], type))
+    {
+      a->current.locals[i] = initialized;
+      a->wrote_local = true;
+    }
+  }
+
+  for (uint16_t i = 0; i < a->current.stack_size; i++)
+  {
+    if (jsc_frame_type_equal(a->current.stack[i], type))
+    {
+      a->current.stack[i] = initialized;
+    }
+  }
+}
+
+static void jsc_frame_invoke(jsc_frame_analysis* a, uint8_t opcode,
+                             uint16_t index)
+{
+  jsc_bytecode_context* ctx = a->ctx;
+  uint8_t tag = index < ctx->constant_pool_count
+                    ? ctx->constant_pool[index].tag
+                    : 0;
+  bool valid;
+
+  switch (opcode)
+  {
+  case JSC_JVM_INVOKEVIRTUAL:
+    valid = tag == JSC_CP_METHODREF;
+    break;
+  case JSC_JVM_INVOKEINTERFACE:
+    valid = tag == JSC_CP_INTERFACE_METHODREF;
+    break;
+  case JSC_JVM_INVOKEDYNAMIC:
+    valid = tag == JSC_CP_INVOKE_DYNAMIC;
+    break;
+  default:
+    valid = tag == JSC_CP_METHODREF || tag == JSC_CP_INTERFACE_METHODREF;
+    break;
+  }
+
+  if (index == 0 || !valid)
+  {
+    a->failed = true;
+    return;
+  }
+
+  /* every member reference keeps name_and_type_index at the same place */
+  uint16_t name_and_type =
+      tag == JSC_CP_INVOKE_DYNAMIC
+          ? ctx->constant_pool[index].invoke_dynamic_info.name_and_type_index
+          : ctx->constant_pool[index].methodref_info.name_and_type_index;
+
+  const uint8_t* name;
+  const uint8_t* descriptor;
+  uint16_t name_length = 0;
+  uint16_t length = 0;
+
+  if (!jsc_frame_member(a, name_and_type, &name, &name_length, &descriptor,
+                        &length) ||
+      length < 3 || descriptor[0] != '(')
+  {
+    a->failed = true;
+    return;
+  }
+
+  const uint8_t* end = descriptor + length;
+  const uint8_t* p = descriptor + 1;
+  uint32_t slots = 0;
+
+  while (p < end && *p != ')')
+  {
+    uint16_t size = jsc_frame_skip_type(&p, end);
+
+    if (size == 0)
+    {
+      a->failed = true;
+      return;
+    }
+
+    slots += size;
+  }
+
+  if (p >= end || slots > a->current.stack_size)
+  {
+    a->failed = true;
+    return;
+  }
+
+  p++;
+  jsc_frame_pop(a, (uint16_t)slots);
+
+  if (opcode != JSC_JVM_INVOKESTATIC && opcode != JSC_JVM_INVOKEDYNAMIC)
+  {
+    jsc_frame_type* receiver = jsc_frame_pop(a, 1);
+
+    if (receiver && opcode == JSC_JVM_INVOKESPECIAL && name_length == 6 &&
+        memcmp(name, "<init>", 6) == 0)
+    {
+      jsc_frame_initialize(a, *receiver);
+    }
+  }
+
+  if (p < end && *p != 'V')
+  {
+    jsc_frame_push(a, jsc_frame_parse_type(a, &p, end));
+  }
+}
+
+static void jsc_frame_ldc(jsc_frame_analysis* a, uint16_t index)
+{
+  uint8_t tag = index > 0 && index < a->ctx->constant_pool_count
+                    ? a->ctx->constant_pool[index].tag
+                    : 0;
+
+  switch (tag)
+  {
+  case JSC_CP_INTEGER:
+    jsc_frame_push(a, jsc_frame_make(JSC_ITEM_INTEGER, 0));
+    break;
+  case JSC_CP_FLOAT:
+    jsc_frame_push(a, jsc_frame_make(JSC_ITEM_FLOAT, 0));
+    break;
+  case JSC_CP_LONG:
+    jsc_frame_push(a, jsc_frame_make(JSC_ITEM_LONG, 0));
+    break;
+  case JSC_CP_DOUBLE:
+    jsc_frame_push(a, jsc_frame_make(JSC_ITEM_DOUBLE, 0));
+    break;
+  case JSC_CP_STRING:
+    jsc_frame_push(a, jsc_frame_object(a, "java/lang/String", 16));
+    break;
+  case JSC_CP_CLASS:
+    jsc_frame_push(a, jsc_frame_object(a, "java/lang/Class", 15));
+    break;
+  case JSC_CP_METHOD_TYPE:
+    jsc_frame_push(a, jsc_frame_object(a, "java/lang/invoke/MethodType", 27));
+    break;
+  case JSC_CP_METHOD_HANDLE:
+    jsc_frame_push(a,
+                   jsc_frame_object(a, "java/lang/invoke/MethodHandle", 29));
+    break;
+  default:
+    a->failed = true;
+    break;
+  }
+}
+
+static void jsc_frame_aaload(jsc_frame_analysis* a)
+{
+  jsc_frame_type* operands = jsc_frame_pop(a, 2);
+
+  if (!operands)
+  {
+    return;
+  }
+
+  if (operands[0].tag == JSC_ITEM_NULL)
+  {
+    jsc_frame_push(a, operands[0]);
+    return;
+  }
+
+  uint16_t length = 0;
+  const uint8_t* name = operands[0].tag == JSC_ITEM_OBJECT
+                            ? jsc_frame_class_name(a, operands[0].index,
+                                                   &length)
+                            : NULL;
+
+  if (!name || length < 3 || name[0] != '[' ||
+      (name[1] != '[' && name[1] != 'L'))
+  {
+    a->failed = true;
+    return;
+  }
+
+  const uint8_t* p = name + 1;
+  jsc_frame_push(a, jsc_frame_parse_type(a, &p, name + length));
+}
+
+static void jsc_frame_anewarray(jsc_frame_analysis* a, uint16_t index)
+{
+  uint16_t length = 0;
+  const uint8_t* name = jsc_frame_class_name(a, index, &length);
+
+  if (!name || !jsc_frame_pop(a, 1))
+  {
+    a->failed = true;
+    return;
+  }
+
+  char* array = (char*)malloc(length + 4);
+
+  if (!array)
+  {
+    a->failed = true;
+    return;
+  }
+
+  int array_length =
+      name[0] == '['
+          ? snprintf(array, length + 4, "[%.*s", length, (const char*)name)
+          : snprintf(array, length + 4, "[L%.*s;", length, (const char*)name);
+
+  jsc_frame_push(a, jsc_frame_object(a, array, (size_t)array_length));
+  free(array);
+}
+
+static void jsc_frame_dup(jsc_frame_analysis* a, uint16_t count,
+                          uint16_t depth)
+{
+  jsc_frame_type* values = jsc_frame_pop(a, count + depth);
+
+  if (!values || a->current.stack_size + 2 * count + depth > a->max_stack)
+  {
+    a->failed = true;
+    return;
+  }
+
+  jsc_frame_type copy[6];
+  memcpy(copy, values, (count + depth) * sizeof(jsc_frame_type));
+
+  jsc_frame_type* out = values;
+  memcpy(out, copy + depth, count * sizeof(jsc_frame_type));
+  memcpy(out + count, copy, (count + depth) * sizeof(jsc_frame_type));
+  a->current.stack_size += 2 * count + depth;
+}
+
+/**
+ * @brief apply the instruction at pc to the current state
+ *
+ * @details Returns false when control never falls through to the next
+ *          instruction. Branch targets are merged along the way.
+ */
+static bool jsc_frame_execute(jsc_frame_analysis* a, uint32_t pc)
+{
+  const uint8_t* code = a->code;
+  uint8_t opcode = code[pc];
+
+  switch (opcode)
+  {
+  case JSC_JVM_NOP:
+    break;
+
+  case JSC_JVM_ACONST_NULL:
+    jsc_frame_push(a, jsc_frame_make(JSC_ITEM_NULL, 0));
+    break;
+
+  case JSC_JVM_ICONST_M1:
+  case JSC_JVM_ICONST_0:
+  case JSC_JVM_ICONST_1:
+  case JSC_JVM_ICONST_2:
+  case JSC_JVM_ICONST_3:
+  case JSC_JVM_ICONST_4:
+  case JSC_JVM_ICONST_5:
+  case JSC_JVM_BIPUSH:
+  case JSC_JVM_SIPUSH:
+    jsc_frame_push(a, jsc_frame_make(JSC_ITEM_INTEGER, 0));
+    break;
+
+  case JSC_JVM_LCONST_0:
+  case JSC_JVM_LCONST_1:
+    jsc_frame_push(a, jsc_frame_make(JSC_ITEM_LONG, 0));
+    break;
+
+  case JSC_JVM_FCONST_0:
+  case JSC_JVM_FCONST_1:
+  case JSC_JVM_FCONST_2:
+    jsc_frame_push(a, jsc_frame_make(JSC_ITEM_FLOAT, 0));
+    break;
+
+  case JSC_JVM_DCONST_0:
+  case JSC_JVM_DCONST_1:
+    jsc_frame_push(a, jsc_frame_make(JSC_ITEM_DOUBLE, 0));
+    break;
+
+  case JSC_JVM_LDC:
+    jsc_frame_ldc(a, code[pc + 1]);
+    break;
+
+  case JSC_JVM_LDC_W:
+  case JSC_JVM_LDC2_W:
+    jsc_frame_ldc(a, jsc_read_u16(code + pc + 1));
+    break;
+
+  case JSC_JVM_ILOAD:
+    jsc_frame_load(a, code[pc + 1], JSC_ITEM_INTEGER);
+    break;
+  case JSC_JVM_LLOAD:
+    jsc_frame_load(a, code[pc + 1], JSC_ITEM_LONG);
+    break;
+  case JSC_JVM_FLOAD:
+    jsc_frame_load(a, code[pc + 1], JSC_ITEM_FLOAT);
+    break;
+  case JSC_JVM_DLOAD:
+    jsc_frame_load(a, code[pc + 1], JSC_ITEM_DOUBLE);
+    break;
+  case JSC_JVM_ALOAD:
+    jsc_frame_load(a, code[pc + 1], JSC_ITEM_OBJECT);
+    break;
+
+  case JSC_JVM_ILOAD_0:
+  case JSC_JVM_ILOAD_1:
+  case JSC_JVM_ILOAD_2:
+  case JSC_JVM_ILOAD_3:
+    jsc_frame_load(a, opcode - JSC_JVM_ILOAD_0, JSC_ITEM_INTEGER);
+    break;
+  case JSC_JVM_LLOAD_0:
+  case JSC_JVM_LLOAD_1:
+  case JSC_JVM_LLOAD_2:
+  case JSC_JVM_LLOAD_3:
+    jsc_frame_load(a, opcode - JSC_JVM_LLOAD_0, JSC_ITEM_LONG);
+    break;
+  case JSC_JVM_FLOAD_0:
+  case JSC_JVM_FLOAD_1:
+  case JSC_JVM_FLOAD_2:
+  case JSC_JVM_FLOAD_3:
+    jsc_frame_load(a, opcode - JSC_JVM_FLOAD_0, JSC_ITEM_FLOAT);
+    break;
+  case JSC_JVM_DLOAD_0:
+  case JSC_JVM_DLOAD_1:
+  case JSC_JVM_DLOAD_2:
+  case JSC_JVM_DLOAD_3:
+    jsc_frame_load(a, opcode - JSC_JVM_DLOAD_0, JSC_ITEM_DOUBLE);
+    break;
+  case JSC_JVM_ALOAD_0:
+  case JSC_JVM_ALOAD_1:
+  case JSC_JVM_ALOAD_2:
+  case JSC_JVM_ALOAD_3:
+    jsc_frame_load(a, opcode - JSC_JVM_ALOAD_0, JSC_ITEM_OBJECT);
+    break;
+
+  case JSC_JVM_IALOAD:
+  case JSC_JVM_BALOAD:
+  case JSC_JVM_CALOAD:
+  case JSC_JVM_SALOAD:
+    jsc_frame_pop_push(a, 2, JSC_ITEM_INTEGER);
+    break;
+  case JSC_JVM_LALOAD:
+    jsc_frame_pop_push(a, 2, JSC_ITEM_LONG);
+    break;
+  case JSC_JVM_FALOAD:
+    jsc_frame_pop_push(a, 2, JSC_ITEM_FLOAT);
+    break;
+  case JSC_JVM_DALOAD:
+    jsc_frame_pop_push(a, 2, JSC_ITEM_DOUBLE);
+    break;
+  case JSC_JVM_AALOAD:
+    jsc_frame_aaload(a);
+    break;
+
+  case JSC_JVM_ISTORE:
+  case JSC_JVM_FSTORE:
+  case JSC_JVM_ASTORE:
+    jsc_frame_store(a, code[pc + 1], 1);
+    break;
+  case JSC_JVM_LSTORE:
+  case JSC_JVM_DSTORE:
+    jsc_frame_store(a, code[pc + 1], 2);
+    break;
+
+  case JSC_JVM_ISTORE_0:
+  case JSC_JVM_ISTORE_1:
+  case JSC_JVM_ISTORE_2:
+  case JSC_JVM_ISTORE_3:
+    jsc_frame_store(a, opcode - JSC_JVM_ISTORE_0, 1);
+    break;
+  case JSC_JVM_LSTORE_0:
+  case JSC_JVM_LSTORE_1:
+  case JSC_JVM_LSTORE_2:
+  case JSC_JVM_LSTORE_3:
+    jsc_frame_store(a, opcode - JSC_JVM_LSTORE_0, 2);
+    break;
+  case JSC_JVM_FSTORE_0:
+  case JSC_JVM_FSTORE_1:
+  case JSC_JVM_FSTORE_2:
+  case JSC_JVM_FSTORE_3:
+    jsc_frame_store(a, opcode - JSC_JVM_FSTORE_0, 1);
+    break;
+  case JSC_JVM_DSTORE_0:
+  case JSC_JVM_DSTORE_1:
+  case JSC_JVM_DSTORE_2:
+  case JSC_JVM_DSTORE_3:
+    jsc_frame_store(a, opcode - JSC_JVM_DSTORE_0, 2);
+    break;
+  case JSC_JVM_ASTORE_0:
+  case JSC_JVM_ASTORE_1:
+  case JSC_JVM_ASTORE_2:
+  case JSC_JVM_ASTORE_3:
+    jsc_frame_store(a, opcode - JSC_JVM_ASTORE_0, 1);
+    break;
+
+  case JSC_JVM_IASTORE:
+  case JSC_JVM_FASTORE:
+  case JSC_JVM_AASTORE:
+  case JSC_JVM_BASTORE:
+  case JSC_JVM_CASTORE:
+  case JSC_JVM_SASTORE:
+    jsc_frame_pop(a, 3);
+    break;
+  case JSC_JVM_LASTORE:
+  case JSC_JVM_DASTORE:
+    jsc_frame_pop(a, 4);
+    break;
+
+  case JSC_JVM_POP:
+  case JSC_JVM_MONITORENTER:
+  case JSC_JVM_MONITOREXIT:
+    jsc_frame_pop(a, 1);
+    break;
+  case JSC_JVM_POP2:
+    jsc_frame_pop(a, 2);
+    break;
+  case JSC_JVM_DUP:
+    jsc_frame_dup(a, 1, 0);
+    break;
+  case JSC_JVM_DUP_X1:
+    jsc_frame_dup(a, 1, 1);
+    break;
+  case JSC_JVM_DUP_X2:
+    jsc_frame_dup(a, 1, 2);
+    break;
+  case JSC_JVM_DUP2:
+    jsc_frame_dup(a, 2, 0);
+    break;
+  case JSC_JVM_DUP2_X1:
+    jsc_frame_dup(a, 2, 1);
+    break;
+  case JSC_JVM_DUP2_X2:
+    jsc_frame_dup(a, 2, 2);
+    break;
+  case JSC_JVM_SWAP:
+  {
+    jsc_frame_type* values = jsc_frame_pop(a, 2);
+
+    if (values)
+    {
+      jsc_frame_type top = values[1];
+      values[1] = values[0];
+      values[0] = top;
+      a->current.stack_size += 2;
+    }
+    break;
+  }
+
+  case JSC_JVM_IADD:
+  case JSC_JVM_ISUB:
+  case JSC_JVM_IMUL:
+  case JSC_JVM_IDIV:
+  case JSC_JVM_IREM:
+  case JSC_JVM_ISHL:
+  case JSC_JVM_ISHR:
+  case JSC_JVM_IUSHR:
+  case JSC_JVM_IAND:
+  case JSC_JVM_IOR:
+  case JSC_JVM_IXOR:
+  case JSC_JVM_FCMPL:
+  case JSC_JVM_FCMPG:
+    jsc_frame_pop_push(a, 2, JSC_ITEM_INTEGER);
+    break;
+  case JSC_JVM_LADD:
+  case JSC_JVM_LSUB:
+  case JSC_JVM_LMUL:
+  case JSC_JVM_LDIV:
+  case JSC_JVM_LREM:
+  case JSC_JVM_LAND:
+  case JSC_JVM_LOR:
+  case JSC_JVM_LXOR:
+    jsc_frame_pop_push(a, 4, JSC_ITEM_LONG);
+    break;
+  case JSC_JVM_LSHL:
+  case JSC_JVM_LSHR:
+  case JSC_JVM_LUSHR:
+    jsc_frame_pop_push(a, 3, JSC_ITEM_LONG);
+    break;
+  case JSC_JVM_FADD:
+  case JSC_JVM_FSUB:
+  case JSC_JVM_FMUL:
+  case JSC_JVM_FDIV:
+  case JSC_JVM_FREM:
+    jsc_frame_pop_push(a, 2, JSC_ITEM_FLOAT);
+    break;
+  case JSC_JVM_DADD:
+  case JSC_JVM_DSUB:
+  case JSC_JVM_DMUL:
+  case JSC_JVM_DDIV:
+  case JSC_JVM_DREM:
+    jsc_frame_pop_push(a, 4, JSC_ITEM_DOUBLE);
+    break;
+  case JSC_JVM_LCMP:
+  case JSC_JVM_DCMPL:
+  case JSC_JVM_DCMPG:
+    jsc_frame_pop_push(a, 4, JSC_ITEM_INTEGER);
+    break;
+
+  case JSC_JVM_INEG:
+  case JSC_JVM_I2B:
+  case JSC_JVM_I2C:
+  case JSC_JVM_I2S:
+  case JSC_JVM_F2I:
+  case JSC_JVM_ARRAYLENGTH:
+  case JSC_JVM_INSTANCEOF:
+    jsc_frame_pop_push(a, 1, JSC_ITEM_INTEGER);
+    break;
+  case JSC_JVM_LNEG:
+    jsc_frame_pop_push(a, 2, JSC_ITEM_LONG);
+    break;
+  case JSC_JVM_FNEG:
+  case JSC_JVM_I2F:
+    jsc_frame_pop_push(a, 1, JSC_ITEM_FLOAT);
+    break;
+  case JSC_JVM_DNEG:
+  case JSC_JVM_L2D:
+    jsc_frame_pop_push(a, 2, JSC_ITEM_DOUBLE);
+    break;
+  case JSC_JVM_I2L:
+  case JSC_JVM_F2L:
+    jsc_frame_pop_push(a, 1, JSC_ITEM_LONG);
+    break;
+  case JSC_JVM_I2D:
+  case JSC_JVM_F2D:
+    jsc_frame_pop_push(a, 1, JSC_ITEM_DOUBLE);
+    break;
+  case JSC_JVM_L2I:
+  case JSC_JVM_D2I:
+    jsc_frame_pop_push(a, 2, JSC_ITEM_INTEGER);
+    break;
+  case JSC_JVM_L2F:
+  case JSC_JVM_D2F:
+    jsc_frame_pop_push(a, 2, JSC_ITEM_FLOAT);
+    break;
+  case JSC_JVM_D2L:
+    jsc_frame_pop_push(a, 2, JSC_ITEM_LONG);
+    break;
+
+  case JSC_JVM_IINC:
+    if (code[pc + 1] >= a->max_locals)
+    {
+      a->failed = true;
+    }
+    break;
+
+  case JSC_JVM_IFEQ:
+  case JSC_JVM_IFNE:
+  case JSC_JVM_IFLT:
+  case JSC_JVM_IFGE:
+  case JSC_JVM_IFGT:
+  case JSC_JVM_IFLE:
+  case JSC_JVM_IFNULL:
+  case JSC_JVM_IFNONNULL:
+    jsc_frame_pop(a, 1);
+    jsc_frame_merge(a, (int64_t)pc + (int16_t)jsc_read_u16(code + pc + 1),
+                    NULL, 0);
+    break;
+
+  case JSC_JVM_IF_ICMPEQ:
+  case JSC_JVM_IF_ICMPNE:
+  case JSC_JVM_IF_ICMPLT:
+  case JSC_JVM_IF_ICMPGE:
+  case JSC_JVM_IF_ICMPGT:
+  case JSC_JVM_IF_ICMPLE:
+  case JSC_JVM_IF_ACMPEQ:
+  case JSC_JVM_IF_ACMPNE:
+    jsc_frame_pop(a, 2);
+    jsc_frame_merge(a, (int64_t)pc + (int16_t)jsc_read_u16(code + pc + 1),
+                    NULL, 0);
+    break;
+
+  case JSC_JVM_GOTO:
+    jsc_frame_merge(a, (int64_t)pc + (int16_t)jsc_read_u16(code + pc + 1),
+                    NULL, 0);
+    return false;
+
+  case JSC_JVM_GOTO_W:
+    jsc_frame_merge(a, (int64_t)pc + jsc_read_s32(code + pc + 1), NULL, 0);
+    return false;
+
+  case JSC_JVM_TABLESWITCH:
+  case JSC_JVM_LOOKUPSWITCH:
+  {
+    uint32_t base = (pc + 4) & ~3u;
+    uint32_t count;
+    uint32_t stride;
+
+    if (opcode == JSC_JVM_TABLESWITCH)
+    {
+      count = (uint32_t)(jsc_read_s32(code + base + 8) -
+                         jsc_read_s32(code + base + 4) + 1);
+      base += 12;
+      stride = 4;
+    }
+    else
+    {
+      count = (uint32_t)jsc_read_s32(code + base + 4);
+      base += 12;
+      stride = 8;
+    }
+
+    jsc_frame_pop(a, 1);
+    jsc_frame_merge(a, (int64_t)pc + jsc_read_s32(code + ((pc + 4) & ~3u)),
+                    NULL, 0);
+
+    for (uint32_t i = 0; i < count && !a->failed; i++)
+    {
+      jsc_frame_merge(a, (int64_t)pc + jsc_read_s32(code + base + i * stride),
+                      NULL, 0);
+    }
+
+    return false;
+  }
+
+  case JSC_JVM_IRETURN:
+  case JSC_JVM_LRETURN:
+  case JSC_JVM_FRETURN:
+  case JSC_JVM_DRETURN:
+  case JSC_JVM_ARETURN:
+  case JSC_JVM_RETURN:
+  case JSC_JVM_ATHROW:
+    return false;
+
+  case JSC_JVM_GETSTATIC:
+  case JSC_JVM_PUTSTATIC:
+  case JSC_JVM_GETFIELD:
+  case JSC_JVM_PUTFIELD:
+    jsc_frame_field(a, opcode, jsc_read_u16(code + pc + 1));
+    break;
+
+  case JSC_JVM_INVOKEVIRTUAL:
+  case JSC_JVM_INVOKESPECIAL:
+  case JSC_JVM_INVOKESTATIC:
+  case JSC_JVM_INVOKEINTERFACE:
+  case JSC_JVM_INVOKEDYNAMIC:
+    jsc_frame_invoke(a, opcode, jsc_read_u16(code + pc + 1));
+    break;
+
+  case JSC_JVM_NEW:
+    jsc_frame_push(a, jsc_frame_make(JSC_ITEM_UNINITIALIZED, (uint16_t)pc));
+    break;
+
+  case JSC_JVM_NEWARRAY:
+  {
+    static const char* const arrays[] = {"[Z", "[C", "[F", "[D",
+                                         "[B", "[S", "[I", "[J"};
+    uint8_t type = code[pc + 1];
+
+    if (type < 4 || type > 11 || !jsc_frame_pop(a, 1))
+    {
+      a->failed = true;
+      break;
+    }
+
+    jsc_frame_push(a, jsc_frame_object(a, arrays[type - 4], 2));
+    break;
+  }
+
+  case JSC_JVM_ANEWARRAY:
+    jsc_frame_anewarray(a, jsc_read_u16(code + pc + 1));
+    break;
+
+  case JSC_JVM_CHECKCAST:
+  case JSC_JVM_MULTIANEWARRAY:
+  {
+    uint16_t index = jsc_read_u16(code + pc + 1);
+    uint16_t length = 0;
+
+    if (!jsc_frame_class_name(a, index, &length) ||
+        !jsc_frame_pop(a, opcode == JSC_JVM_CHECKCAST ? 1 : code[pc + 3]))
+    {
+      a->failed = true;
+      break;
+    }
+
+    jsc_frame_push(a, jsc_frame_make(JSC_ITEM_OBJECT, index));
+    break;
+  }
+
+  case JSC_JVM_WIDE:
+  {
+    uint16_t index = jsc_read_u16(code + pc + 2);
+
+    switch (code[pc + 1])
+    {
+    case JSC_JVM_ILOAD:
+      jsc_frame_load(a, index, JSC_ITEM_INTEGER);
+      break;
+    case JSC_JVM_LLOAD:
+      jsc_frame_load(a, index, JSC_ITEM_LONG);
+      break;
+    case JSC_JVM_FLOAD:
+      jsc_frame_load(a, index, JSC_ITEM_FLOAT);
+      break;
+    case JSC_JVM_DLOAD:
+      jsc_frame_load(a, index, JSC_ITEM_DOUBLE);
+      break;
+    case JSC_JVM_ALOAD:
+      jsc_frame_load(a, index, JSC_ITEM_OBJECT);
+      break;
+    case JSC_JVM_ISTORE:
+    case JSC_JVM_FSTORE:
+    case JSC_JVM_ASTORE:
+      jsc_frame_store(a, index, 1);
+      break;
+    case JSC_JVM_LSTORE:
+    case JSC_JVM_DSTORE:
+      jsc_frame_store(a, index, 2);
+      break;
+    case JSC_JVM_IINC:
+      if (index >= a->max_locals)
+      {
+        a->failed = true;
+      }
+      break;
+    default:
+      a->failed = true; /* ret */
+      break;
+    }
+    break;
+  }
+
+  default: /* jsr, ret and anything unknown */
+    a->failed = true;
+    return false;
+  }
+
+  return true;
+}
+
+static bool jsc_frame_utf8_equals(const jsc_bytecode_context* ctx,
+                                  uint16_t index, const char* str)
+{
+  size_t length = strlen(str);
+
+  return index > 0 && index < ctx->constant_pool_count &&
+         ctx->constant_pool[index].tag == JSC_CP_UTF8 &&
+         ctx->constant_pool[index].utf8_info.length == length &&
+         memcmp(ctx->constant_pool[index].utf8_info.bytes, str, length) == 0;
+}
+
+/* one verification type per value: the TOP after a long or double goes */
+static uint16_t jsc_frame_compress(const jsc_frame_type* slots, uint16_t count,
+                                   jsc_frame_type* out, bool trim)
+{
+  uint16_t length = 0;
+
+  for (uint16_t i = 0; i < count; i++)
+  {
+    out[length++] = slots[i];
+
+    if (jsc_frame_is_wide(slots[i]))
+    {
+      i++;
+    }
+  }
+
+  while (trim && length > 0 && out[length - 1].tag == JSC_ITEM_TOP)
+  {
+    length--;
+  }
+
+  return length;
+}
+
+static void jsc_frame_write_type(uint8_t** p, jsc_frame_type type)
+{
+  jsc_write_u8(p, type.tag);
+
+  if (type.tag == JSC_ITEM_OBJECT || type.tag == JSC_ITEM_UNINITIALIZED)
+  {
+    jsc_write_u16(p, type.index);
+  }
+}
+
+/**
+ * @brief write one stack_map_frame in its most compact form
+ *
+ * @details Locals are compared with those of the previous frame, which
+ *          picks between same, same_locals_1_stack_item, chop, append and
+ *          full_frame (JVMS 4.7.4).
+ */
+static void jsc_frame_encode(uint8_t** p, uint16_t delta,
+                             const jsc_frame_type* previous,
+                             uint16_t previous_count,
+                             const jsc_frame_type* locals, uint16_t local_count,
+                             const jsc_frame_type* stack, uint16_t stack_count)
+{
+  uint16_t common = 0;
+
+  while (common < previous_count && common < local_count &&
+         jsc_frame_type_equal(previous[common], locals[common]))
+  {
+    common++;
+  }
+
+  bool same_locals = common == previous_count && common == local_count;
+
+  if (same_locals && stack_count == 0)
+  {
+    if (delta < 64)
+    {
+      jsc_write_u8(p, (uint8_t)delta);
+    }
+    else
+    {
+      jsc_write_u8(p, 251);
+      jsc_write_u16(p, delta);
+    }
+  }
+  else if (same_locals && stack_count == 1)
+  {
+    if (delta < 64)
+    {
+      jsc_write_u8(p, (uint8_t)(64 + delta));
+    }
+    else
+    {
+      jsc_write_u8(p, 247);
+      jsc_write_u16(p, delta);
+    }
+
+    jsc_frame_write_type(p, stack[0]);
+  }
+  else if (stack_count == 0 && common == local_count &&
+           previous_count - local_count <= 3)
+  {
+    jsc_write_u8(p, (uint8_t)(251 - (previous_count - local_count)));
+    jsc_write_u16(p, delta);
+  }
+  else if (stack_count == 0 && common == previous_count &&
+           local_count - previous_count <= 3)
+  {
+    jsc_write_u8(p, (uint8_t)(251 + (local_count - previous_count)));
+    jsc_write_u16(p, delta);
+
+    for (uint16_t i = previous_count; i < local_count; i++)
+    {
+      jsc_frame_write_type(p, locals[i]);
+    }
+  }
+  else
+  {
+    jsc_write_u8(p, 255);
+    jsc_write_u16(p, delta);
+    jsc_write_u16(p, local_count);
+
+    for (uint16_t i = 0; i < local_count; i++)
+    {
+      jsc_frame_write_type(p, locals[i]);
+    }
+
+    jsc_write_u16(p, stack_count);
+
+    for (uint16_t i = 0; i < stack_count; i++)
+    {
+      jsc_frame_write_type(p, stack[i]);
+    }
+  }
+}
+
+/**
+ * @brief replace the StackMapTable of a Code attribute
+ *
+ * @details A table without frames drops the attribute altogether.
+ */
+static bool jsc_frame_install(jsc_bytecode_context* ctx,
+                              jsc_attribute* code_attr, uint32_t prefix_length,
+                              const uint8_t* table, uint32_t table_length,
+                              uint16_t frame_count)
+{
+  const uint8_t* attributes = code_attr->info + prefix_length;
+  uint16_t attributes_count = jsc_read_u16(attributes);
+  uint16_t name_index = 0;
+
+  if (frame_count > 0)
+  {
+    name_index = jsc_bytecode_add_utf8_constant(ctx, "StackMapTable");
+
+    if (name_index == 0)
+    {
+      return false;
+    }
+  }
+
+  uint32_t kept_length = 0;
+  uint16_t kept_count = 0;
+  const uint8_t* attr = attributes + 2;
+
+  for (uint16_t i = 0; i < attributes_count; i++)
+  {
+    uint32_t length = 6 + (uint32_t)jsc_read_s32(attr + 2);
+
+    if (!jsc_frame_utf8_equals(ctx, jsc_read_u16(attr), "StackMapTable"))
+    {
+      kept_length += length;
+      kept_count++;
+    }
+
+    attr += length;
+  }
+
+  uint32_t new_length = prefix_length + 2 + kept_length +
+                        (frame_count > 0 ? 6 + table_length : 0);
+  uint8_t* info = (uint8_t*)malloc(new_length);
+
+  if (!info)
+  {
+    return false;
+  }
+
+  uint8_t* p = info;
+  jsc_write_bytes(&p, code_attr->info, prefix_length);
+  jsc_write_u16(&p, kept_count + (frame_count > 0 ? 1 : 0));
+
+  attr = attributes + 2;
+
+  for (uint16_t i = 0; i < attributes_count; i++)
+  {
+    uint32_t length = 6 + (uint32_t)jsc_read_s32(attr + 2);
+
+    if (!jsc_frame_utf8_equals(ctx, jsc_read_u16(attr), "StackMapTable"))
+    {
+      jsc_write_bytes(&p, attr, length);
+    }
+
+    attr += length;
+  }
+
+  if (frame_count > 0)
+  {
+    jsc_write_u16(&p, name_index);
+    jsc_write_u32(&p, table_length);
+    jsc_write_bytes(&p, table, table_length);
+  }
+
+  free(code_attr->info);
+  code_attr->info = info;
+  code_attr->length = new_length;
+
+  return true;
+}
+
+static bool jsc_frame_mark(jsc_frame_analysis* a, int64_t target)
+{
+  if (target < 0 || target >= a->code_length)
+  {
+    return false;
+  }
+
+  a->flags[target] |= JSC_FRAME_LEADER;
+  return true;
+}
+
+/**
+ * @brief find instruction boundaries and every offset that starts a block
+ */
+static bool jsc_frame_find_leaders(jsc_frame_analysis* a)
+{
+  const uint8_t* code = a->code;
+  uint32_t length;
+
+  for (uint32_t pc = 0; pc < a->code_length; pc += length)
+  {
+    length = jsc_bytecode_instruction_length(code, pc, a->code_length);
+
+    if (length == 0)
+    {
+      return false;
+    }
+
+    a->flags[pc] |= JSC_FRAME_INSTRUCTION;
+
+    uint8_t opcode = code[pc];
+    bool ends_block = false;
+
+    if ((opcode >= JSC_JVM_IFEQ && opcode <= JSC_JVM_JSR) ||
+        opcode == JSC_JVM_IFNULL || opcode == JSC_JVM_IFNONNULL)
+    {
+      int16_t offset = (int16_t)jsc_read_u16(code + pc + 1);
+
+      if (!jsc_frame_mark(a, (int64_t)pc + offset))
+      {
+        return false;
+      }
+
+      ends_block = opcode == JSC_JVM_GOTO;
+    }
+    else if (opcode == JSC_JVM_GOTO_W || opcode == JSC_JVM_JSR_W)
+    {
+      if (!jsc_frame_mark(a, (int64_t)pc + jsc_read_s32(code + pc + 1)))
+      {
+        return false;
+      }
+
+      ends_block = opcode == JSC_JVM_GOTO_W;
+    }
+    else if (opcode == JSC_JVM_TABLESWITCH || opcode == JSC_JVM_LOOKUPSWITCH)
+    {
+      uint32_t base = (pc + 4) & ~3u;
+      uint32_t first = base + 12; /* first jump offset past the header */
+      uint32_t stride = opcode == JSC_JVM_TABLESWITCH ? 4 : 8;
+
+      if (!jsc_frame_mark(a, (int64_t)pc + jsc_read_s32(code + base)))
+      {
+        return false;
+      }
+
+      for (uint32_t at = first; at < pc + length; at += stride)
+      {
+        if (!jsc_frame_mark(a, (int64_t)pc + jsc_read_s32(code + at)))
+        {
+          return false;
+        }
+      }
+
+      ends_block = true;
+    }
+    else if ((opcode >= JSC_JVM_IRETURN && opcode <= JSC_JVM_RETURN) ||
+             opcode == JSC_JVM_ATHROW || opcode == JSC_JVM_RET)
+    {
+      ends_block = true;
+    }
+
+    if (ends_block && pc + length < a->code_length)
+    {
+      a->flags[pc + length] |= JSC_FRAME_LEADER;
+    }
+  }
+
+  for (uint16_t i = 0; i < a->exception_table_length; i++)
+  {
+    const uint8_t* entry = a->exception_table + i * 8;
+    uint16_t start = jsc_read_u16(entry);
+    uint16_t end = jsc_read_u16(entry + 2);
+
+    if (start >= end || end > a->code_length ||
+        !(a->flags[start] & JSC_FRAME_INSTRUCTION) ||
+        (end < a->code_length && !(a->flags[end] & JSC_FRAME_INSTRUCTION)) ||
+        !jsc_frame_mark(a, jsc_read_u16(entry + 4)))
+    {
+      return false;
+    }
+  }
+
+  for (uint32_t pc = 0; pc < a->code_length; pc++)
+  {
+    if ((a->flags[pc] & JSC_FRAME_LEADER) &&
+        !(a->flags[pc] & JSC_FRAME_INSTRUCTION))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/* the implicit frame at offset 0, built from the method descriptor */
+static bool jsc_frame_enter(jsc_frame_analysis* a, const jsc_method* method)
+{
+  uint16_t length = 0;
+  uint16_t name_length = 0;
+  const uint8_t* descriptor = jsc_frame_utf8(a, method->descriptor_index,
+                                             &length);
+  const uint8_t* name = jsc_frame_utf8(a, method->name_index, &name_length);
+  uint32_t local = 0;
+
+  for (uint16_t i = 0; i < a->max_locals; i++)
+  {
+    a->current.locals[i] = jsc_frame_make(JSC_ITEM_TOP, 0);
+  }
+
+  a->current.stack_size = 0;
+
+  if (!descriptor || !name || length < 3 || descriptor[0] != '(')
+  {
+    return false;
+  }
+
+  if (!(method->access_flags & JSC_ACC_STATIC))
+  {
+    if (a->max_locals == 0)
+    {
+      return false;
+    }
+
+    bool constructor = name_length == 6 && memcmp(name, "<init>", 6) == 0 &&
+                       a->ctx->class_name &&
+                       strcmp(a->ctx->class_name, "java/lang/Object") != 0;
+
+    a->current.locals[local++] =
+        constructor ? jsc_frame_make(JSC_ITEM_UNINITIALIZED_THIS, 0)
+                    : jsc_frame_make(JSC_ITEM_OBJECT, a->ctx->this_class);
+  }
+
+  const uint8_t* end = descriptor + length;
+  const uint8_t* p = descriptor + 1;
+
+  while (p < end && *p != ')' && !a->failed)
+  {
+    jsc_frame_type type = jsc_frame_parse_type(a, &p, end);
+    uint32_t slots = jsc_frame_is_wide(type) ? 2 : 1;
+
+    if (local + slots > a->max_locals)
+    {
+      return false;
+    }
+
+    a->current.locals[local] = type;
+    local += slots;
+  }
+
+  return p < end && !a->failed;
+}
+
+/**
+ * @brief run the type-state dataflow to a fixed point
+ *
+ * @details Blocks are revisited whenever the entry state of one of their
+ *          successors widens. Exception handlers see the locals before each
+ *          covered instruction, and after it when the instruction wrote one.
+ */
+static bool jsc_frame_solve(jsc_frame_analysis* a)
+{
+  jsc_frame_merge(a, 0, NULL, 0);
+
+  while (a->worklist_size > 0 && !a->failed)
+  {
+    uint32_t pc = a->worklist[--a->worklist_size];
+    jsc_frame* entry = a->frames[pc];
+
+    a->flags[pc] &= ~JSC_FRAME_QUEUED;
+    memcpy(a->current.locals, entry->locals,
+           a->max_locals * sizeof(jsc_frame_type));
+    memcpy(a->current.stack, entry->stack,
+           entry->stack_size * sizeof(jsc_frame_type));
+    a->current.stack_size = entry->stack_size;
+
+    for (;;)
+    {
+      a->flags[pc] |= JSC_FRAME_REACHED;
+      a->wrote_local = false;
+
+      jsc_frame_merge_handlers(a, pc);
+      bool falls_through = jsc_frame_execute(a, pc);
+
+      if (a->wrote_local)
+      {
+        jsc_frame_merge_handlers(a, pc);
+      }
+
+      if (!falls_through || a->failed)
+      {
+        break;
+      }
+
+      pc += jsc_bytecode_instruction_length(a->code, pc, a->code_length);
+
+      if (pc >= a->code_length)
+      {
+        a->failed = true; /* falls off the end of the code */
+        break;
+      }
+
+      if (a->flags[pc] & JSC_FRAME_LEADER)
+      {
+        jsc_frame_merge(a, pc, NULL, 0);
+        break;
+      }
+    }
+  }
+
+  return !a->failed;
+}
+
+/**
+ * @brief turn every unreachable span into nop ... athrow
+ *
+ * @details Dead code has no type state to describe, so like javac's
+ *          back ends it is replaced by a sequence the verifier accepts from
+ *          a frame of no locals and a Throwable on the stack. Spans covered
+ *          by an exception handler are left alone and fail the analysis.
+ */
+static bool jsc_frame_clear_dead_code(jsc_frame_analysis* a)
+{
+  uint32_t pc = 0;
+
+  while (pc < a->code_length)
+  {
+    if (!(a->flags[pc] & JSC_FRAME_INSTRUCTION) ||
+        (a->flags[pc] & JSC_FRAME_REACHED))
+    {
+      pc++;
+      continue;
+    }
+
+    uint32_t end = pc + 1;
+
+    while (end < a->code_length && !(a->flags[end] & JSC_FRAME_REACHED))
+    {
+      end++;
+    }
+
+    for (uint16_t i = 0; i < a->exception_table_length; i++)
+    {
+      const uint8_t* entry = a->exception_table + i * 8;
+
+      if (jsc_read_u16(entry) < end && jsc_read_u16(entry + 2) > pc)
+      {
+        return false;
+      }
+    }
+
+    memset(a->code + pc, JSC_JVM_NOP, end - pc - 1);
+    a->code[end - 1] = JSC_JVM_ATHROW;
+    memset(a->flags + pc, JSC_FRAME_INSTRUCTION, end - pc);
+    a->flags[pc] |= JSC_FRAME_LEADER;
+
+    pc = end;
+  }
+
+  return true;
+}
+
+/**
+ * @brief compute the StackMapTable of a method from its final code
+ *
+ * @details Abstract interpretation over the control-flow graph of the Code
+ *          attribute gives the verifier's type state at every branch target,
+ *          exception handler and instruction following an unconditional
+ *          transfer; each becomes one compactly encoded frame. Any existing
+ *          table is replaced. Returns false, leaving the method as it was,
+ *          when the code cannot be typed (jsr/ret, mismatched stacks at a
+ *          merge, overflowing max_stack).
+ */
+bool jsc_bytecode_compute_stack_map(jsc_bytecode_context* ctx,
+                                    jsc_method* method)
+{
+  jsc_attribute* code_attr = NULL;
+
+  for (uint16_t i = 0; i < method->attribute_count; i++)
+  {
+    if (jsc_frame_utf8_equals(ctx, method->attributes[i].name_index, "Code"))
+    {
+      code_attr = &method->attributes[i];
+      break;
+    }
+  }
+
+  if (!code_attr || !code_attr->info || code_attr->length < 12)
+  {
+    return code_attr == NULL;
+  }
+
+  jsc_frame_analysis a;
+  memset(&a, 0, sizeof(jsc_frame_analysis));
+
+  a.ctx = ctx;
+  a.max_stack = jsc_read_u16(code_attr->info);
+  a.max_locals = jsc_read_u16(code_attr->info + 2);
+  a.code_length = (uint32_t)jsc_read_s32(code_attr->info + 4);
+  a.code = code_attr->info + 8;
+
+  /* the Code attribute must hold together before anything is rewritten */
+  uint64_t prefix_length = 8 + (uint64_t)a.code_length + 2;
+
+  if (a.code_length == 0 || a.code_length > JSC_MAX_CODE_SIZE ||
+      prefix_length + 2 > code_attr->length)
+  {
+    return false;
+  }
+
+  a.exception_table_length = jsc_read_u16(a.code + a.code_length);
+  a.exception_table = a.code + a.code_length + 2;
+  prefix_length += (uint64_t)a.exception_table_length * 8;
+
+  if (prefix_length + 2 > code_attr->length)
+  {
+    return false;
+  }
+
+  const uint8_t* attr = code_attr->info + prefix_length + 2;
+  const uint8_t* attributes_end = code_attr->info + code_attr->length;
+
+  for (uint16_t i = 0; i < jsc_read_u16(code_attr->info + prefix_length); i++)
+  {
+    if (attributes_end - attr < 6 ||
+        (uint64_t)(attributes_end - attr - 6) <
+            (uint32_t)jsc_read_s32(attr + 2))
+    {
+      return false;
+    }
+
+    attr += 6 + (uint32_t)jsc_read_s32(attr + 2);
+  }
+
+  size_t types = (size_t)a.max_locals + a.max_stack;
+
+  a.flags = (uint8_t*)calloc(a.code_length, 1);
+  a.frames = (jsc_frame**)calloc(a.code_length, sizeof(jsc_frame*));
+  a.worklist = (uint32_t*)malloc(a.code_length * sizeof(uint32_t));
+  a.current.locals =
+      (jsc_frame_type*)malloc((types + a.max_locals + 1) *
+                              sizeof(jsc_frame_type));
+  a.current.stack = a.current.locals ? a.current.locals + a.max_locals : NULL;
+
+  jsc_frame_type* initial =
+      a.current.locals ? a.current.stack + a.max_stack : NULL;
+  uint8_t* table = NULL;
+  uint16_t frame_count = 0;
+  bool typed = false;
+
+  if (a.flags && a.frames && a.worklist && a.current.locals &&
+      jsc_frame_find_leaders(&a) && jsc_frame_enter(&a, method))
+  {
+    uint16_t initial_count =
+        jsc_frame_compress(a.current.locals, a.max_locals, initial, true);
+
+    typed = jsc_frame_solve(&a) && jsc_frame_clear_dead_code(&a);
+
+    /* worst case: every frame a full_frame of three byte types */
+    size_t bound = 2;
+
+    for (uint32_t pc = 0; typed && pc < a.code_length; pc++)
+    {
+      if (a.flags[pc] & JSC_FRAME_LEADER)
+      {
+        bound += 7 + 3 * types + 3;
+      }
+    }
+
+    table = typed && bound <= UINT32_MAX ? (uint8_t*)malloc(bound) : NULL;
+    typed = table != NULL;
+
+    jsc_frame_type* locals =
+        typed ? (jsc_frame_type*)malloc((types + 1) * sizeof(jsc_frame_type))
+              : NULL;
+    jsc_frame_type* previous =
+        locals ? (jsc_frame_type*)malloc((a.max_locals + 1) *
+                                         sizeof(jsc_frame_type))
+               : NULL;
+    typed = previous != NULL;
+
+    uint8_t* p = table ? table + 2 : NULL;
+    uint16_t previous_count = initial_count;
+    int64_t last = -1;
+
+    if (typed)
+    {
+      memcpy(previous, initial, initial_count * sizeof(jsc_frame_type));
+    }
+
+    for (uint32_t pc = 0; typed && pc < a.code_length; pc++)
+    {
+      if (!(a.flags[pc] & JSC_FRAME_LEADER))
+      {
+        continue;
+      }
+
+      jsc_frame* frame = a.frames[pc];
+      uint16_t local_count = 0;
+      uint16_t stack_count;
+      jsc_frame_type* stack = locals + a.max_locals;
+
+      if (frame && (a.flags[pc] & JSC_FRAME_REACHED))
+      {
+        local_count =
+            jsc_frame_compress(frame->locals, a.max_locals, locals, true);
+        stack_count =
+            jsc_frame_compress(frame->stack, frame->stack_size, stack, false);
+      }
+      else
+      {
+        stack[0] = jsc_frame_object(&a, "java/lang/Throwable", 19);
+        stack_count = 1;
+      }
+
+      jsc_frame_encode(&p, (uint16_t)(last < 0 ? pc : pc - last - 1),
+                       previous, previous_count, locals, local_count, stack,
+                       stack_count);
+
+      memcpy(previous, locals, local_count * sizeof(jsc_frame_type));
+      previous_count = local_count;
+      last = pc;
+      frame_count++;
+    }
+
+    typed = typed && !a.failed;
+
+    if (typed)
+    {
+      uint8_t* count = table;
+      jsc_write_u16(&count, frame_count);
+    }
+
+    free(locals);
+    free(previous);
+
+    if (typed)
+    {
+      typed = jsc_frame_install(ctx, code_attr, (uint32_t)prefix_length, table,
+                                (uint32_t)(p - table), frame_count);
+    }
+  }
+
+  if (a.frames)
+  {
+    for (uint32_t pc = 0; pc < a.code_length; pc++)
+    {
+      free(a.frames[pc]);
+    }
+  }
+
+  free(table);
+  free(a.flags);
+  free(a.frames);
+  free(a.worklist);
+  free(a.current.locals);
+
+  return typed;
+}
+
+/* operand stack slots popped and pushed per opcode; -1 marks opcodes whose
+   effect depends on their operands, and unused opcodes */
+static const int8_t jsc_jvm_stack_pops[1 << 8] = {
+    /* 0x00 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 0x10 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 0x20 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 2,
+    /* 0x30 */ 2, 2, 2, 2, 2, 2, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2,
+    /* 0x40 */ 2, 2, 2, 1, 1, 1, 1, 2, 2, 2, 2, 1, 1, 1, 1, 3,
+    /* 0x50 */ 4, 3, 4, 3, 3, 3, 3, 1, 2, 1, 2, 3, 2, 3, 4, 2,
+    /* 0x60 */ 2, 4, 2, 4, 2, 4, 2, 4, 2, 4, 2, 4, 2, 4, 2, 4,
+    /* 0x70 */ 2, 4, 2, 4, 1, 2, 1, 2, 2, 3, 2, 3, 2, 3, 2, 4,
+    /* 0x80 */ 2, 4, 2, 4, 0, 1, 1, 1, 2, 2, 2, 1, 1, 1, 2, 2,
+    /* 0x90 */ 2, 1, 1, 1, 4, 2, 2, 4, 4, 1, 1, 1, 1, 1, 1, 2,
+    /* 0xa0 */ 2, 2, 2, 2, 2, 2, 2, 0, 0, 0, 1, 1, 1, 2, 1, 2,
+    /* 0xb0 */ 1, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 1, 1, 1, 1,
+    /* 0xc0 */ 1, 1, 1, 1, -1, -1, 1, 1, 0, 0, -1, -1, -1, -1, -1, -1,
+    /* 0xd0 */ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    /* 0xe0 */ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    /* 0xf0 */ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1};
+
+static const int8_t jsc_jvm_stack_pushes[1 << 8] = {
+    /* 0x00 */ 0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 1, 1, 1, 2, 2,
+    /* 0x10 */ 1, 1, 1, 1, 2, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 2,
+    /* 0x20 */ 2, 2, 1, 1, 1, 1, 2, 2, 2, 2, 1, 1, 1, 1, 1, 2,
+    /* 0x30 */ 1, 2, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 0x40 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 0x50 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 3, 4, 4, 5, 6, 2,
+    /* 0x60 */ 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2,
+    /* 0x70 */ 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2,
+    /* 0x80 */ 1, 2, 1, 2, 0, 2, 1, 2, 1, 1, 2, 1, 2, 2, 1, 2,
+    /* 0x90 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0,
+    /* 0xa0 */ 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0,
+    /* 0xb0 */ 0, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 1, 1, 1, 0,
+    /* 0xc0 */ 1, 1, 0, 0, -1, -1, 0, 0, 0, 1, -1, -1, -1, -1, -1, -1,
+    /* 0xd0 */ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    /* 0xe0 */ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    /* 0xf0 */ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1};
+
+/* the descriptor of the field, method or call site constant at index */
+static const uint8_t* jsc_bytecode_member_descriptor(
+    const jsc_bytecode_context* ctx, uint16_t index, uint16_t* length)
+{
+  if (index == 0 || index >= ctx->constant_pool_count)
+  {
+    return NULL;
+  }
+
+  const jsc_constant_pool_entry* entry = &ctx->constant_pool[index];
+  uint16_t name_and_type;
+
+  switch (entry->tag)
+  {
+  case JSC_CP_FIELDREF:
+  case JSC_CP_METHODREF:
+  case JSC_CP_INTERFACE_METHODREF:
+    name_and_type = entry->methodref_info.name_and_type_index;
+    break;
+  case JSC_CP_INVOKE_DYNAMIC:
+    name_and_type = entry->invoke_dynamic_info.name_and_type_index;
+    break;
+  default:
+    return NULL;
+  }
+
+  if (name_and_type == 0 || name_and_type >= ctx->constant_pool_count ||
+      ctx->constant_pool[name_and_type].tag != JSC_CP_NAME_AND_TYPE)
+  {
+    return NULL;
+  }
+
+  uint16_t descriptor =
+      ctx->constant_pool[name_and_type].name_and_type_info.descriptor_index;
+
+  if (descriptor == 0 || descriptor >= ctx->constant_pool_count ||
+      ctx->constant_pool[descriptor].tag != JSC_CP_UTF8)
+  {
+    return NULL;
+  }
+
+  *length = ctx->constant_pool[descriptor].utf8_info.length;
+  return ctx->constant_pool[descriptor].utf8_info.bytes;
+}
+
+/**
+ * @brief slots taken by the arguments and the result of a descriptor
+ *
+ * @details A field descriptor has no arguments. Returns false if the
+ *          descriptor is malformed.
+ */
+static bool jsc_bytecode_descriptor_slots(const uint8_t* descriptor,
+                                          uint16_t length, uint32_t* arguments,
+                                          uint32_t* result)
+{
+  const uint8_t* end = descriptor + length;
+  const uint8_t* p = descriptor;
+
+  *arguments = 0;
+
+  if (p < end && *p == '(')
+  {
+    for (p++; p < end && *p != ')';)
+    {
+      uint16_t slots = jsc_frame_skip_type(&p, end);
+
+      if (slots == 0)
+      {
+        return false;
+      }
+
+      *arguments += slots;
+    }
+
+    if (p++ >= end)
+    {
+      return false;
+    }
+
+    if (p < end && *p == 'V')
+    {
+      *result = 0;
+      return p + 1 == end;
+    }
+  }
+
+  *result = jsc_frame_skip_type(&p, end);
+  return *result > 0 && p == end;
+}
+
+/**
+ * @brief stack slots popped and pushed by the instruction at pc
+ */
+static bool jsc_bytecode_stack_effect(const jsc_bytecode_context* ctx,
+                                      const uint8_t* code, uint32_t pc,
+                                      uint32_t* pops, uint32_t* pushes)
+{
+  uint8_t opcode = code[pc];
+
+  if (jsc_jvm_stack_pops[opcode] >= 0)
+  {
+    *pops = (uint32_t)jsc_jvm_stack_pops[opcode];
+    *pushes = (uint32_t)jsc_jvm_stack_pushes[opcode];
+    return true;
+  }
+
+  if (opcode == JSC_JVM_WIDE)
+  {
+    /* the same effect as the narrow form, iinc and ret have none */
+    uint8_t narrow = code[pc + 1];
+
+    *pops = narrow == JSC_JVM_IINC ? 0 : (uint32_t)jsc_jvm_stack_pops[narrow];
+    *pushes =
+        narrow == JSC_JVM_IINC ? 0 : (uint32_t)jsc_jvm_stack_pushes[narrow];
+    return true;
+  }
+
+  if (opcode == JSC_JVM_MULTIANEWARRAY)
+  {
+    *pops = code[pc + 3];
+    *pushes = 1;
+    return true;
+  }
+
+  uint16_t length = 0;
+  uint32_t arguments;
+  uint32_t result;
+  const uint8_t* descriptor =
+      jsc_bytecode_member_descriptor(ctx, jsc_read_u16(code + pc + 1), &length);
+
+  if (!descriptor ||
+      !jsc_bytecode_descriptor_slots(descriptor, length, &arguments, &result))
+  {
+    return false;
+  }
+
+  switch (opcode)
+  {
+  case JSC_JVM_GETSTATIC:
+    *pops = 0;
+    *pushes = result;
+    break;
+  case JSC_JVM_PUTSTATIC:
+    *pops = result;
+    *pushes = 0;
+    break;
+  case JSC_JVM_GETFIELD:
+    *pops = 1;
+    *pushes = result;
+    break;
+  case JSC_JVM_PUTFIELD:
+    *pops = result + 1;
+    *pushes = 0;
+    break;
+  case JSC_JVM_INVOKESTATIC:
+  case JSC_JVM_INVOKEDYNAMIC:
+    *pops = arguments;
+    *pushes = result;
+    break;
+  default:
+    *pops = arguments + 1; /* the receiver */
+    *pushes = result;
+    break;
+  }
+
+  return true;
+}
+
+/* highest local slot touched by the instruction at pc, plus one */
+static uint32_t jsc_bytecode_local_limit(const uint8_t* code, uint32_t pc)
+{
+  uint8_t opcode = code[pc];
+  uint32_t index;
+
+  if (opcode == JSC_JVM_WIDE)
+  {
+    opcode = code[pc + 1];
+    index = jsc_read_u16(code + pc + 2);
+  }
+  else if ((opcode >= JSC_JVM_ILOAD && opcode <= JSC_JVM_ALOAD) ||
+           (opcode >= JSC_JVM_ISTORE && opcode <= JSC_JVM_ASTORE) ||
+           opcode == JSC_JVM_IINC || opcode == JSC_JVM_RET)
+  {
+    index = code[pc + 1];
+  }
+  else if (opcode >= JSC_JVM_ILOAD_0 && opcode <= JSC_JVM_ALOAD_3)
+  {
+    index = (opcode - JSC_JVM_ILOAD_0) % 4;
+    opcode = JSC_JVM_ILOAD + (opcode - JSC_JVM_ILOAD_0) / 4;
+  }
+  else if (opcode >= JSC_JVM_ISTORE_0 && opcode <= JSC_JVM_ASTORE_3)
+  {
+    index = (opcode - JSC_JVM_ISTORE_0) % 4;
+    opcode = JSC_JVM_ISTORE + (opcode - JSC_JVM_ISTORE_0) / 4;
+  }
+  else
+  {
+    return 0;
+  }
+
+  bool wide = opcode == JSC_JVM_LLOAD || opcode == JSC_JVM_DLOAD ||
+              opcode == JSC_JVM_LSTORE || opcode == JSC_JVM_DSTORE;
+
+  return index + (wide ? 2 : 1);
+}
+
+/**
+ * @brief set max_stack and max_locals of a method to what its code needs
+ *
+ * @details Stack depths are propagated along the control-flow graph, with
+ *          exception handlers entered at depth one; locals come from the
+ *          descriptor and every load, store and iinc, reachable or not.
+ *          Unreachable code is given room for the athrow it may be turned
+ *          into by jsc_bytecode_compute_stack_map. Returns false, leaving
+ *          the declared values, when depths disagree at a merge or the code
+ *          is malformed.
+ */
+bool jsc_bytecode_compute_maxs(jsc_bytecode_context* ctx, jsc_method* method)
+{
+  jsc_attribute* code_attr = NULL;
+
+  for (uint16_t i = 0; i < method->attribute_count; i++)
+  {
+    if (jsc_frame_utf8_equals(ctx, method->attributes[i].name_index, "Code"))
+    {
+      code_attr = &method->attributes[i];
+      break;
+    }
+  }
+
+  if (!code_attr || !code_attr->info || code_attr->length < 12)
+  {
+    return code_attr == NULL;
+  }
+
+  uint8_t* info = code_attr->info;
+  uint32_t code_length = (uint32_t)jsc_read_s32(info + 4);
+  const uint8_t* code = info + 8;
+
+  if (code_length == 0 || code_length > JSC_MAX_CODE_SIZE ||
+      12 + (uint64_t)code_length > code_attr->length)
+  {
+    return false;
+  }
+
+  uint16_t exception_table_length = jsc_read_u16(code + code_length);
+  const uint8_t* exception_table = code + code_length + 2;
+
+  if (12 + (uint64_t)code_length + exception_table_length * 8 >
+      code_attr->length)
+  {
+    return false;
+  }
+
+  /* depth + 1 before each instruction, 0 while unvisited */
+  int32_t* depths = (int32_t*)calloc(code_length, sizeof(int32_t));
+  uint32_t* worklist = (uint32_t*)malloc(code_length * sizeof(uint32_t));
+  uint8_t* starts = (uint8_t*)calloc(code_length, 1);
+  uint32_t worklist_size = 0;
+  uint32_t max_stack = 0;
+  uint32_t max_locals = 0;
+  bool ok = depths && worklist && starts;
+
+  /* instruction boundaries and locals, over all of the code */
+  for (uint32_t pc = 0, length = 0; ok && pc < code_length; pc += length)
+  {
+    length = jsc_bytecode_instruction_length(code, pc, code_length);
+    ok = length > 0;
+
+    if (ok)
+    {
+      uint32_t limit = jsc_bytecode_local_limit(code, pc);
+      starts[pc] = 1;
+      max_locals = limit > max_locals ? limit : max_locals;
+    }
+  }
+
+  uint16_t descriptor_length = 0;
+  const uint8_t* descriptor =
+      method->descriptor_index < ctx->constant_pool_count &&
+              ctx->constant_pool[method->descriptor_index].tag == JSC_CP_UTF8
+          ? ctx->constant_pool[method->descriptor_index].utf8_info.bytes
+          : NULL;
+  uint32_t parameters = 0;
+  uint32_t result = 0;
+
+  if (descriptor)
+  {
+    descriptor_length =
+        ctx->constant_pool[method->descriptor_index].utf8_info.length;
+  }
+
+  ok = ok && descriptor &&
+       jsc_bytecode_descriptor_slots(descriptor, descriptor_length,
+                                     &parameters, &result);
+  parameters += (method->access_flags & JSC_ACC_STATIC) ? 0 : 1;
+  max_locals = parameters > max_locals ? parameters : max_locals;
+
+  if (ok)
+  {
+    depths[0] = 1;
+    worklist[worklist_size++] = 0;
+  }
+
+  while (ok && worklist_size > 0)
+  {
+    uint32_t pc = worklist[--worklist_size];
+    uint32_t depth = (uint32_t)depths[pc] - 1;
+    uint32_t pops;
+    uint32_t pushes;
+
+    ok = jsc_bytecode_stack_effect(ctx, code, pc, &pops, &pushes) &&
+         pops <= depth && depth - pops + pushes <= JSC_MAX_OPERAND_STACK;
+
+    if (!ok)
+    {
+      break;
+    }
+
+    /* dup and friends peak at their final depth */
+    uint32_t after = depth - pops + pushes;
+    max_stack = after > max_stack ? after : max_stack;
+
+    /* successors: at most the fall-through, one branch target, or a
+       switch's targets, plus the handlers covering pc */
+    uint8_t opcode = code[pc];
+    uint32_t length = jsc_bytecode_instruction_length(code, pc, code_length);
+    int64_t targets[2];
+    uint32_t target_count = 0;
+    bool falls_through = true;
+    const uint8_t* switch_table = NULL;
+    uint32_t switch_count = 0;
+    uint32_t switch_stride = 0;
+
+    if ((opcode >= JSC_JVM_IFEQ && opcode <= JSC_JVM_JSR) ||
+        opcode == JSC_JVM_IFNULL || opcode == JSC_JVM_IFNONNULL)
+    {
+      int16_t offset = (int16_t)jsc_read_u16(code + pc + 1);
+
+      targets[target_count++] = (int64_t)pc + offset;
+      falls_through = opcode != JSC_JVM_GOTO;
+    }
+    else if (opcode == JSC_JVM_GOTO_W || opcode == JSC_JVM_JSR_W)
+    {
+      targets[target_count++] = (int64_t)pc + jsc_read_s32(code + pc + 1);
+      falls_through = opcode == JSC_JVM_JSR_W;
+    }
+    else if (opcode == JSC_JVM_TABLESWITCH || opcode == JSC_JVM_LOOKUPSWITCH)
+    {
+      uint32_t base = (pc + 4) & ~3u;
+
+      targets[target_count++] = (int64_t)pc + jsc_read_s32(code + base);
+      switch_table = code + base + 12;
+      switch_stride = opcode == JSC_JVM_TABLESWITCH ? 4 : 8;
+      switch_count = (pc + length - (base + 12)) / switch_stride;
+      falls_through = false;
+    }
+    else if ((opcode >= JSC_JVM_IRETURN && opcode <= JSC_JVM_RETURN) ||
+             opcode == JSC_JVM_ATHROW || opcode == JSC_JVM_RET ||
+             (opcode == JSC_JVM_WIDE && code[pc + 1] == JSC_JVM_RET))
+    {
+      falls_through = false;
+    }
+
+    if (falls_through)
+    {
+      targets[target_count++] = (int64_t)pc + length;
+    }
+
+    bool jsr = opcode == JSC_JVM_JSR || opcode == JSC_JVM_JSR_W;
+
+    for (uint32_t i = 0; ok && i < target_count + switch_count; i++)
+    {
+      int64_t target =
+          i < target_count
+              ? targets[i]
+              : (int64_t)pc +
+                    jsc_read_s32(switch_table + (i - target_count) *
+                                                    switch_stride);
+      /* a jsr's subroutine returns to its fall-through without the return
+         address it pushed */
+      bool returns_here = jsr && falls_through && i == target_count - 1;
+      int32_t entry = (int32_t)(returns_here ? depth + 1 : after + 1);
+
+      if (target < 0 || target >= code_length || !starts[target])
+      {
+        ok = false;
+      }
+      else if (depths[target] == 0)
+      {
+        depths[target] = entry;
+        worklist[worklist_size++] = (uint32_t)target;
+      }
+      else
+      {
+        ok = depths[target] == entry;
+      }
+    }
+
+    for (uint16_t i = 0; ok && i < exception_table_length; i++)
+    {
+      const uint8_t* entry = exception_table + i * 8;
+      uint16_t handler = jsc_read_u16(entry + 4);
+
+      if (pc < jsc_read_u16(entry) || pc >= jsc_read_u16(entry + 2))
+      {
+        continue;
+      }
+
+      if (handler >= code_length || !starts[handler])
+      {
+        ok = false;
+      }
+      else if (depths[handler] == 0)
+      {
+        depths[handler] = 2;
+        worklist[worklist_size++] = handler;
+        max_stack = max_stack > 1 ? max_stack : 1;
+      }
+      else
+      {
+        ok = depths[handler] == 2;
+      }
+    }
+  }
+
+  for (uint32_t pc = 0; ok && pc < code_length; pc++)
+  {
+    if (starts[pc] && depths[pc] == 0 && max_stack == 0)
+    {
+      max_stack = 1;
+    }
+  }
+
+  if (ok && max_stack <= JSC_MAX_OPERAND_STACK &&
+      max_locals <= JSC_MAX_LOCAL_VARS)
+  {
+    uint8_t* p = info;
+    jsc_write_u16(&p, (uint16_t)max_stack);
+    jsc_write_u16(&p, (uint16_t)max_locals);
+  }
+  else
+  {
+    ok = false;
+  }
+
+  free(depths);
+  free(worklist);
+  free(starts);
+
+  return ok;
+}
+
+/* one instruction of a decoded Code attribute; bytes holds the instruction
+   unless it is a switch, whose operands are re-read from the original code */
+typedef struct
+{
+  uint32_t pc;
+  uint32_t length;
+  uint8_t bytes[6];
+  int64_t target;
+  bool removed;
+  bool leader;
+  bool wide; /* a branch laid out through goto_w */
+} jsc_code_insn;
+
+/* a Code attribute decoded for rewriting by the peephole optimizer and the
+   branch relaxation of jsc_bytecode_resolve_branches */
+typedef struct
+{
+  jsc_bytecode_context* ctx;
+  jsc_attribute* attr;
+  const uint8_t* code;
+  uint32_t code_length;
+  const uint8_t* exception_table;
+  uint16_t exception_table_length;
+  const uint8_t* attributes;
+  uint16_t attributes_count;
+  jsc_code_insn* insns;
+  uint32_t count;
+  uint32_t* index;   /* instruction by original offset */
+  int64_t* targets;  /* scratch for the targets of one switch */
+  uint32_t* new_pcs; /* offsets of the laid-out instructions */
+  uint32_t* map;     /* laid-out offset by original offset */
+} jsc_code;
+
+static bool jsc_code_is_branch(uint8_t opcode)
+{
+  return (opcode >= JSC_JVM_IFEQ && opcode <= JSC_JVM_GOTO) ||
+         opcode == JSC_JVM_IFNULL || opcode == JSC_JVM_IFNONNULL ||
+         opcode == JSC_JVM_GOTO_W;
+}
+
+static bool jsc_code_is_switch(uint8_t opcode)
+{
+  return opcode == JSC_JVM_TABLESWITCH || opcode == JSC_JVM_LOOKUPSWITCH;
+}
+
+static bool jsc_code_is_goto(uint8_t opcode)
+{
+  return opcode == JSC_JVM_GOTO || opcode == JSC_JVM_GOTO_W;
+}
+
+static bool jsc_code_is_return(uint8_t opcode)
+{
+  return opcode >= JSC_JVM_IRETURN && opcode <= JSC_JVM_RETURN;
+}
+
+static bool jsc_code_falls_through(uint8_t opcode)
+{
+  return !jsc_code_is_goto(opcode) && !jsc_code_is_switch(opcode) &&
+         !jsc_code_is_return(opcode) && opcode != JSC_JVM_ATHROW;
+}
+
+/* first live instruction at or after i, or count */
+static uint32_t jsc_code_next(const jsc_code* p, uint32_t i)
+{
+  while (i < p->count && p->insns[i].removed)
+  {
+    i++;
+  }
+
+  return i;
+}
+
+/* the live instruction control reaches when jumping to original offset pc */
+static uint32_t jsc_code_resolve(const jsc_code* p, int64_t pc)
+{
+  return pc >= p->code_length ? p->count
+                              : jsc_code_next(p, p->index[pc]);
+}
+
+/* default and case targets of a switch, as original offsets */
+static uint32_t jsc_code_switch_targets(const jsc_code* p,
+                                            const jsc_code_insn* insn,
+                                            int64_t* targets)
+{
+  uint32_t base = (insn->pc + 4) & ~3u;
+  const uint8_t* code = p->code;
+  uint32_t count = 0;
+
+  targets[count++] = (int64_t)insn->pc + jsc_read_s32(code + base);
+
+  if (code[insn->pc] == JSC_JVM_TABLESWITCH)
+  {
+    int32_t low = jsc_read_s32(code + base + 4);
+    int32_t high = jsc_read_s32(code + base + 8);
+
+    for (int64_t k = 0; k <= (int64_t)high - low; k++)
+    {
+      targets[count++] =
+          (int64_t)insn->pc + jsc_read_s32(code + base + 12 + k * 4);
+    }
+  }
+  else
+  {
+    int32_t pairs = jsc_read_s32(code + base + 4);
+
+    for (int32_t k = 0; k < pairs; k++)
+    {
+      targets[count++] =
+          (int64_t)insn->pc + jsc_read_s32(code + base + 12 + k * 8);
+    }
+  }
+
+  return count;
+}
+
+/* instructions control can enter other than by falling through: branch and
+   switch targets, handlers, and the bounds of protected ranges */
+static void jsc_code_mark_leaders(jsc_code* p, int64_t* targets)
+{
+  for (uint32_t i = 0; i < p->count; i++)
+  {
+    p->insns[i].leader = false;
+  }
+
+  for (uint32_t i = 0; i < p->count; i++)
+  {
+    jsc_code_insn* insn = &p->insns[i];
+    uint32_t count = 0;
+
+    if (insn->removed)
+    {
+      continue;
+    }
+
+    if (insn->target >= 0)
+    {
+      targets[count++] = insn->target;
+    }
+    else if (jsc_code_is_switch(insn->bytes[0]))
+    {
+      count = jsc_code_switch_targets(p, insn, targets);
+    }
+
+    for (uint32_t k = 0; k < count; k++)
+    {
+      uint32_t j = jsc_code_resolve(p, targets[k]);
+
+      if (j < p->count)
+      {
+        p->insns[j].leader = true;
+      }
+    }
+  }
+
+  for (uint16_t e = 0; e < p->exception_table_length; e++)
+  {
+    const uint8_t* entry = p->exception_table + e * 8;
+
+    for (uint32_t k = 0; k < 6; k += 2)
+    {
+      uint32_t j = jsc_code_resolve(p, jsc_read_u16(entry + k));
+
+      if (j < p->count)
+      {
+        p->insns[j].leader = true;
+      }
+    }
+  }
+}
+
+static jsc_attribute* jsc_code_attribute(const jsc_bytecode_context* ctx,
+                                         jsc_method* method)
+{
+  for (uint16_t i = 0; i < method->attribute_count; i++)
+  {
+    if (jsc_frame_utf8_equals(ctx, method->attributes[i].name_index, "Code"))
+    {
+      return &method->attributes[i];
+    }
+  }
+
+  return NULL;
+}
+
+static void jsc_code_free(jsc_code* p)
+{
+  free(p->insns);
+  free(p->index);
+  free(p->targets);
+  free(p->new_pcs);
+  free(p->map);
+}
+
+/**
+ * @brief decode the Code attribute of method into p
+ *
+ * @details goto_w is decoded as goto, for jsc_code_install to widen again
+ *          only if its target is out of reach. Fails for jsr/ret, targets
+ *          inside instructions and sub-attributes other than the ones
+ *          jsc_code_install can remap.
+ */
+static bool jsc_code_decode(jsc_code* p, jsc_bytecode_context* ctx,
+                            jsc_method* method)
+{
+  memset(p, 0, sizeof(jsc_code));
+  p->ctx = ctx;
+  p->attr = jsc_code_attribute(ctx, method);
+
+  if (!p->attr || !p->attr->info || p->attr->length < 12)
+  {
+    return false;
+  }
+
+  const uint8_t* info = p->attr->info;
+  uint32_t code_length = (uint32_t)jsc_read_s32(info + 4);
+  const uint8_t* code = info + 8;
+
+  if (code_length == 0 || code_length > JSC_MAX_CODE_SIZE ||
+      12 + (uint64_t)code_length > p->attr->length)
+  {
+    return false;
+  }
+
+  uint16_t exception_table_length = jsc_read_u16(code + code_length);
+
+  if (12 + (uint64_t)code_length + exception_table_length * 8 >
+      p->attr->length)
+  {
+    return false;
+  }
+
+  p->code = code;
+  p->code_length = code_length;
+  p->exception_table = code + code_length + 2;
+  p->exception_table_length = exception_table_length;
+  p->attributes = p->exception_table + exception_table_length * 8;
+  p->attributes_count = jsc_read_u16(p->attributes);
+
+  /* every sub-attribute must be one that can be remapped or dropped */
+  const uint8_t* end = info + p->attr->length;
+  const uint8_t* attr = p->attributes + 2;
+
+  for (uint16_t i = 0; i < p->attributes_count; i++)
+  {
+    if (end - attr < 6 ||
+        (uint64_t)(end - attr) < 6 + (uint64_t)(uint32_t)jsc_read_s32(attr + 2))
+    {
+      return false;
+    }
+
+    uint16_t name = jsc_read_u16(attr);
+    uint32_t length = (uint32_t)jsc_read_s32(attr + 2);
+    uint32_t entry_size =
+        jsc_frame_utf8_equals(ctx, name, "LineNumberTable") ? 4
+        : jsc_frame_utf8_equals(ctx, name, "LocalVariableTable") ||
+                jsc_frame_utf8_equals(ctx, name, "LocalVariableTypeTable")
+            ? 10
+            : 0;
+
+    if (!jsc_frame_utf8_equals(ctx, name, "StackMapTable") &&
+        (entry_size == 0 || length < 2 ||
+         length != 2 + (uint32_t)jsc_read_u16(attr + 6) * entry_size))
+    {
+      return false;
+    }
+
+    attr += 6 + length;
+  }
+
+  p->insns = (jsc_code_insn*)malloc(code_length * sizeof(jsc_code_insn));
+  p->index = (uint32_t*)malloc((code_length + 1) * sizeof(uint32_t));
+  /* a switch has at most one target per four bytes of its length */
+  p->targets = (int64_t*)malloc((code_length / 4 + 2) * sizeof(int64_t));
+  p->new_pcs = (uint32_t*)malloc((code_length + 1) * sizeof(uint32_t));
+  p->map = (uint32_t*)malloc((code_length + 1) * sizeof(uint32_t));
+
+  if (!p->insns || !p->index || !p->targets || !p->new_pcs || !p->map)
+  {
+    return false;
+  }
+
+  for (uint32_t pc = 0; pc <= code_length; pc++)
+  {
+    p->index[pc] = UINT32_MAX;
+  }
+
+  for (uint32_t pc = 0, length = 0; pc < code_length; pc += length)
+  {
+    length = jsc_bytecode_instruction_length(code, pc, code_length);
+    uint8_t opcode = code[pc];
+
+    if (length == 0 || opcode == JSC_JVM_JSR || opcode == JSC_JVM_JSR_W ||
+        opcode == JSC_JVM_RET ||
+        (!jsc_code_is_switch(opcode) && length > 6))
+    {
+      return false;
+    }
+
+    jsc_code_insn* insn = &p->insns[p->count];
+    memset(insn, 0, sizeof(jsc_code_insn));
+    insn->pc = pc;
+    insn->length = length;
+    insn->target = -1;
+    memcpy(insn->bytes, code + pc, length < 6 ? length : 6);
+
+    if (opcode == JSC_JVM_GOTO_W)
+    {
+      insn->target = (int64_t)pc + jsc_read_s32(code + pc + 1);
+      insn->bytes[0] = JSC_JVM_GOTO;
+      insn->length = 3;
+    }
+    else if (jsc_code_is_branch(opcode))
+    {
+      insn->target = (int64_t)pc + (int16_t)jsc_read_u16(code + pc + 1);
+    }
+
+    p->index[pc] = p->count++;
+  }
+
+  /* every target must start an instruction */
+  for (uint32_t i = 0; i < p->count; i++)
+  {
+    uint32_t count = 0;
+
+    if (p->insns[i].target >= 0)
+    {
+      p->targets[count++] = p->insns[i].target;
+    }
+    else if (jsc_code_is_switch(p->insns[i].bytes[0]))
+    {
+      count = jsc_code_switch_targets(p, &p->insns[i], p->targets);
+    }
+
+    for (uint32_t k = 0; k < count; k++)
+    {
+      if (p->targets[k] < 0 || p->targets[k] >= code_length ||
+          p->index[p->targets[k]] == UINT32_MAX)
+      {
+        return false;
+      }
+    }
+  }
+
+  for (uint16_t e = 0; e < exception_table_length; e++)
+  {
+    const uint8_t* entry = p->exception_table + e * 8;
+    uint16_t start = jsc_read_u16(entry);
+    uint16_t stop = jsc_read_u16(entry + 2);
+    uint16_t handler = jsc_read_u16(entry + 4);
+
+    if (start >= stop || stop > code_length || handler >= code_length ||
+        p->index[start] == UINT32_MAX || p->index[handler] == UINT32_MAX ||
+        (stop < code_length && p->index[stop] == UINT32_MAX))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static uint8_t jsc_code_invert(uint8_t opcode)
+{
+  /* ifeq/ifne, iflt/ifge ... if_acmpeq/if_acmpne and ifnull/ifnonnull
+     differ in their lowest bit */
+  if (opcode >= JSC_JVM_IFEQ && opcode <= JSC_JVM_IF_ACMPNE)
+  {
+    return (uint8_t)(((opcode - JSC_JVM_IFEQ) ^ 1) + JSC_JVM_IFEQ);
+  }
+
+  return opcode ^ 1;
+}
+
+/* bytes insn takes when laid out at pc */
+static uint32_t jsc_code_size(const jsc_code_insn* insn, uint32_t pc)
+{
+  if (jsc_code_is_switch(insn->bytes[0]))
+  {
+    uint32_t padding = ((insn->pc + 4) & ~3u) - (insn->pc + 1);
+    return insn->length - padding + (((pc + 4) & ~3u) - (pc + 1));
+  }
+
+  if (insn->target >= 0 && insn->wide)
+  {
+    /* goto_w, or the inverted branch over a goto_w */
+    return jsc_code_is_goto(insn->bytes[0]) ? 5 : 8;
+  }
+
+  return insn->length;
+}
+
+/**
+ * @brief assign offsets to the live instructions, relaxing branches
+ *
+ * @details Branches start short; any whose displacement does not fit in
+ *          16 bits is widened and the layout redone. Widening only grows
+ *          the code, so this converges in at most one pass per branch.
+ */
+static bool jsc_code_layout(jsc_code* p, uint32_t* new_length)
+{
+  bool changed = true;
+
+  for (uint32_t i = 0; i < p->count; i++)
+  {
+    p->insns[i].wide = false;
+  }
+
+  while (changed)
+  {
+    uint32_t length = 0;
+    changed = false;
+
+    for (uint32_t i = 0; i < p->count; i++)
+    {
+      p->new_pcs[i] = length;
+
+      if (!p->insns[i].removed)
+      {
+        length += jsc_code_size(&p->insns[i], length);
+      }
+
+      if (length > JSC_MAX_CODE_SIZE)
+      {
+        return false;
+      }
+    }
+
+    p->new_pcs[p->count] = length;
+
+    for (uint32_t i = 0; i < p->count; i++)
+    {
+      uint32_t pc = p->new_pcs[jsc_code_next(p, i)];
+
+      for (uint32_t k = 0; k < p->insns[i].length; k++)
+      {
+        p->map[p->insns[i].pc + k] = pc;
+      }
+    }
+
+    p->map[p->code_length] = length;
+    *new_length = length;
+
+    for (uint32_t i = 0; i < p->count; i++)
+    {
+      jsc_code_insn* insn = &p->insns[i];
+      int64_t offset = (int64_t)p->map[insn->target < 0 ? 0 : insn->target] -
+                       p->new_pcs[i];
+
+      if (!insn->removed && insn->target >= 0 && !insn->wide &&
+          (offset < INT16_MIN || offset > INT16_MAX))
+      {
+        insn->wide = true;
+        changed = true;
+      }
+    }
+  }
+
+  return *new_length > 0;
+}
+
+/**
+ * @brief lay out the live instructions of p and replace the Code attribute
+ *
+ * @details Branch and switch offsets, the exception table, LineNumberTable
+ *          and LocalVariable(Type)Table are moved along; protected ranges
+ *          left empty go, and a StackMapTable is dropped for
+ *          jsc_bytecode_write to recompute.
+ */
+static bool jsc_code_install(jsc_code* p)
+{
+  jsc_bytecode_context* ctx = p->ctx;
+  const uint8_t* info = p->attr->info;
+  const uint32_t* map = p->map;
+  uint32_t new_length = 0;
+
+  if (!jsc_code_layout(p, &new_length))
+  {
+    return false;
+  }
+
+  uint32_t new_attr_length =
+      12 + new_length + p->exception_table_length * 8;
+  const uint8_t* attr = p->attributes + 2;
+
+  for (uint16_t i = 0; i < p->attributes_count; i++)
+  {
+    uint32_t length = (uint32_t)jsc_read_s32(attr + 2);
+
+    if (!jsc_frame_utf8_equals(ctx, jsc_read_u16(attr), "StackMapTable"))
+    {
+      new_attr_length += 6 + length;
+    }
+
+    attr += 6 + length;
+  }
+
+  uint8_t* new_info = (uint8_t*)malloc(new_attr_length);
+
+  if (!new_info)
+  {
+    return false;
+  }
+
+  uint8_t* out = new_info;
+
+  jsc_write_bytes(&out, info, 4);
+  jsc_write_u32(&out, new_length);
+
+  for (uint32_t i = 0; i < p->count; i++)
+  {
+    const jsc_code_insn* insn = &p->insns[i];
+    uint8_t opcode = insn->bytes[0];
+    uint32_t pc = p->new_pcs[i];
+
+    if (insn->removed)
+    {
+      continue;
+    }
+
+    if (jsc_code_is_switch(opcode))
+    {
+      uint32_t base = (insn->pc + 4) & ~3u;
+      int64_t* targets = p->targets;
+      uint32_t count = jsc_code_switch_targets(p, insn, targets);
+
+      jsc_write_u8(&out, opcode);
+
+      while ((uint32_t)(out - new_info - 8) % 4 != 0)
+      {
+        jsc_write_u8(&out, 0);
+      }
+
+      jsc_write_u32(&out, (uint32_t)((int64_t)map[targets[0]] - pc));
+
+      if (opcode == JSC_JVM_TABLESWITCH)
+      {
+        jsc_write_bytes(&out, p->code + base + 4, 8);
+
+        for (uint32_t k = 1; k < count; k++)
+        {
+          jsc_write_u32(&out, (uint32_t)((int64_t)map[targets[k]] - pc));
+        }
+      }
+      else
+      {
+        jsc_write_bytes(&out, p->code + base + 4, 4);
+
+        for (uint32_t k = 1; k < count; k++)
+        {
+          jsc_write_bytes(&out, p->code + base + 8 + (k - 1) * 8, 4);
+          jsc_write_u32(&out, (uint32_t)((int64_t)map[targets[k]] - pc));
+        }
+      }
+    }
+    else if (insn->target >= 0 && !insn->wide)
+    {
+      jsc_write_u8(&out, opcode);
+      jsc_write_u16(&out, (uint16_t)((int64_t)map[insn->target] - pc));
+    }
+    else if (insn->target >= 0)
+    {
+      if (!jsc_code_is_goto(opcode))
+      {
+        jsc_write_u8(&out, jsc_code_invert(opcode));
+        jsc_write_u16(&out, 8);
+        pc += 3;
+      }
+
+      jsc_write_u8(&out, JSC_JVM_GOTO_W);
+      jsc_write_u32(&out, (uint32_t)((int64_t)map[insn->target] - pc));
+    }
+    else
+    {
+      jsc_write_bytes(&out, insn->bytes, insn->length);
+    }
+  }
+
+  uint16_t kept = 0;
+  uint8_t* count_at = out;
+  out += 2;
+
+  for (uint16_t e = 0; e < p->exception_table_length; e++)
+  {
+    const uint8_t* entry = p->exception_table + e * 8;
+    uint32_t start = map[jsc_read_u16(entry)];
+    uint32_t stop = map[jsc_read_u16(entry + 2)];
+
+    if (start < stop)
+    {
+      jsc_write_u16(&out, (uint16_t)start);
+      jsc_write_u16(&out, (uint16_t)stop);
+      jsc_write_u16(&out, (uint16_t)map[jsc_read_u16(entry + 4)]);
+      jsc_write_bytes(&out, entry + 6, 2);
+      kept++;
+    }
+  }
+
+  jsc_write_u16(&count_at, kept);
+
+  uint8_t* attributes_at = out;
+  uint16_t kept_attributes = 0;
+  uint32_t code_length = p->code_length;
+  out += 2;
+  attr = p->attributes + 2;
+
+  for (uint16_t i = 0; i < p->attributes_count; i++)
+  {
+    uint16_t name = jsc_read_u16(attr);
+    uint32_t length = (uint32_t)jsc_read_s32(attr + 2);
+    uint16_t entries = length >= 2 ? jsc_read_u16(attr + 6) : 0;
+    const uint8_t* entry = attr + 8;
+
+    if (jsc_frame_utf8_equals(ctx, name, "StackMapTable"))
+    {
+      attr += 6 + length;
+      continue;
+    }
+
+    jsc_write_bytes(&out, attr, 8);
+    kept_attributes++;
+
+    for (uint16_t k = 0; k < entries; k++)
+    {
+      uint16_t start = jsc_read_u16(entry);
+
+      if (jsc_frame_utf8_equals(ctx, name, "LineNumberTable"))
+      {
+        jsc_write_u16(&out,
+                      (uint16_t)(start <= code_length ? map[start]
+                                                      : new_length));
+        jsc_write_bytes(&out, entry + 2, 2);
+        entry += 4;
+      }
+      else
+      {
+        uint32_t stop = start + (uint32_t)jsc_read_u16(entry + 2);
+        uint32_t new_start = start <= code_length ? map[start] : new_length;
+        uint32_t new_stop = stop <= code_length ? map[stop] : new_length;
+
+        jsc_write_u16(&out, (uint16_t)new_start);
+        jsc_write_u16(&out, (uint16_t)(new_stop - new_start));
+        jsc_write_bytes(&out, entry + 4, 6);
+        entry += 10;
+      }
+    }
+
+    attr += 6 + length;
+  }
+
+  jsc_write_u16(&attributes_at, kept_attributes);
+
+  free(p->attr->info);
+  p->attr->info = new_info;
+  p->attr->length = (uint32_t)(out - new_info);
+  return true;
+}
+
+/**
+ * @brief retarget branches that land on a goto to where that goto goes, and
+ *        turn a goto that lands on a return into the return itself
+ */
+static bool jsc_peephole_thread_jumps(jsc_code* p)
+{
+  bool changed = false;
+
+  for (uint32_t i = 0; i < p->count; i++)
+  {
+    jsc_code_insn* insn = &p->insns[i];
+
+    if (insn->removed || insn->target < 0)
+    {
+      continue;
+    }
+
+    for (uint32_t hops = 0; hops < p->count; hops++)
+    {
+      uint32_t j = jsc_code_resolve(p, insn->target);
+
+      if (j == p->count || !jsc_code_is_goto(p->insns[j].bytes[0]) ||
+          p->insns[j].target == insn->target)
+      {
+        break;
+      }
+
+      insn->target = p->insns[j].target;
+      changed = true;
+    }
+
+    uint32_t j = jsc_code_resolve(p, insn->target);
+
+    if (jsc_code_is_goto(insn->bytes[0]) && j < p->count &&
+        jsc_code_is_return(p->insns[j].bytes[0]))
+    {
+      insn->bytes[0] = p->insns[j].bytes[0];
+      insn->length = 1;
+      insn->target = -1;
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+/**
+ * @brief drop instructions no path from the entry or a handler reaches
+ */
+static bool jsc_peephole_remove_unreachable(jsc_code* p, int64_t* targets)
+{
+  uint8_t* reached = (uint8_t*)calloc(p->count + 1, 1);
+  uint32_t* worklist = (uint32_t*)malloc((p->count + 1) * sizeof(uint32_t));
+  uint32_t worklist_size = 0;
+  bool changed = false;
+
+  if (!reached || !worklist)
+  {
+    free(reached);
+    free(worklist);
+    return false;
+  }
+
+  /* reached is set on queueing, so each instruction is queued once; the
+     extra slot absorbs targets past the last instruction */
+  for (int32_t e = -1; e < (int32_t)p->exception_table_length; e++)
+  {
+    uint32_t j = jsc_code_resolve(
+        p, e < 0 ? 0 : jsc_read_u16(p->exception_table + e * 8 + 4));
+
+    if (!reached[j])
+    {
+      reached[j] = 1;
+      worklist[worklist_size++] = j;
+    }
+  }
+
+  while (worklist_size > 0)
+  {
+    uint32_t i = worklist[--worklist_size];
+
+    if (i >= p->count)
+    {
+      continue;
+    }
+
+    const jsc_code_insn* insn = &p->insns[i];
+    uint32_t count = 0;
+
+    if (insn->target >= 0)
+    {
+      targets[count++] = insn->target;
+    }
+    else if (jsc_code_is_switch(insn->bytes[0]))
+    {
+      count = jsc_code_switch_targets(p, insn, targets);
+    }
+
+    for (uint32_t k = 0; k < count; k++)
+    {
+      uint32_t j = jsc_code_resolve(p, targets[k]);
+
+      if (!reached[j])
+      {
+        reached[j] = 1;
+        worklist[worklist_size++] = j;
+      }
+    }
+
+    if (jsc_code_falls_through(insn->bytes[0]))
+    {
+      uint32_t j = jsc_code_next(p, i + 1);
+
+      if (!reached[j])
+      {
+        reached[j] = 1;
+        worklist[worklist_size++] = j;
+      }
+    }
+  }
+
+  for (uint32_t i = 0; i < p->count; i++)
+  {
+    if (!p->insns[i].removed && !reached[i])
+    {
+      p->insns[i].removed = true;
+      changed = true;
+    }
+  }
+
+  free(reached);
+  free(worklist);
+  return changed;
+}
+
+/**
+ * @brief drop nops and gotos to the next instruction; a conditional branch
+ *        to the next instruction only has to pop its operands
+ */
+static bool jsc_peephole_remove_trivial(jsc_code* p)
+{
+  bool changed = false;
+
+  for (uint32_t i = 0; i < p->count; i++)
+  {
+    jsc_code_insn* insn = &p->insns[i];
+    uint8_t opcode = insn->bytes[0];
+
+    if (insn->removed)
+    {
+      continue;
+    }
+
+    if (opcode == JSC_JVM_NOP)
+    {
+      insn->removed = true;
+      changed = true;
+      continue;
+    }
+
+    if (insn->target < 0 ||
+        jsc_code_resolve(p, insn->target) != jsc_code_next(p, i + 1))
+    {
+      continue;
+    }
+
+    if (jsc_code_is_goto(opcode))
+    {
+      insn->removed = true;
+    }
+    else
+    {
+      bool two = opcode >= JSC_JVM_IF_ICMPEQ && opcode <= JSC_JVM_IF_ACMPNE;
+
+      insn->bytes[0] = two ? JSC_JVM_POP2 : JSC_JVM_POP;
+      insn->length = 1;
+      insn->target = -1;
+    }
+
+    changed = true;
+  }
+
+  return changed;
+}
+
+/* kind (int, long, float, double, reference) and local of a load or store
+   instruction, -1 for anything else */
+static int jsc_peephole_local(const uint8_t* bytes, bool store,
+                              uint32_t* index)
+{
+  uint8_t opcode = bytes[0];
+  uint8_t base = store ? JSC_JVM_ISTORE : JSC_JVM_ILOAD;
+  uint8_t implicit = store ? JSC_JVM_ISTORE_0 : JSC_JVM_ILOAD_0;
+
+  if (opcode >= base && opcode <= base + 4)
+  {
+    *index = bytes[1];
+    return opcode - base;
+  }
+
+  if (opcode >= implicit && opcode < implicit + 20)
+  {
+    *index = (uint32_t)(opcode - implicit) % 4;
+    return (opcode - implicit) / 4;
+  }
+
+  return -1;
+}
+
+/**
+ * @brief rewrite a store immediately reloaded from the same local into
+ *        dup (dup2 for long and double) followed by the store
+ */
+static bool jsc_peephole_fold_store_load(jsc_code* p)
+{
+  bool changed = false;
+
+  for (uint32_t i = 0; i < p->count; i++)
+  {
+    jsc_code_insn* store = &p->insns[i];
+    uint32_t store_index = 0;
+    uint32_t load_index = 0;
+
+    if (store->removed)
+    {
+      continue;
+    }
+
+    int kind = jsc_peephole_local(store->bytes, true, &store_index);
+    uint32_t j = jsc_code_next(p, i + 1);
+
+    if (kind < 0 || j == p->count || p->insns[j].leader ||
+        jsc_peephole_local(p->insns[j].bytes, false, &load_index) != kind ||
+        load_index != store_index)
+    {
+      continue;
+    }
+
+    jsc_code_insn* load = &p->insns[j];
+
+    memcpy(load->bytes, store->bytes, sizeof(store->bytes));
+    load->length = store->length;
+    store->bytes[0] = kind == 1 || kind == 3 ? JSC_JVM_DUP2 : JSC_JVM_DUP;
+    store->length = 1;
+    changed = true;
+  }
+
+  return changed;
+}
+
+/* local a wide-prefixed or otherwise unusual instruction may read, counted
+   as a read so the stores of that local are kept */
+static bool jsc_peephole_reads_local(const uint8_t* bytes, uint32_t* index)
+{
+  switch (bytes[0])
+  {
+  case JSC_JVM_WIDE:
+    *index = jsc_read_u16(bytes + 2);
+    return true;
+  case JSC_JVM_IINC:
+  case JSC_JVM_RET:
+    *index = bytes[1];
+    return true;
+  default:
+    return jsc_peephole_local(bytes, false, index) >= 0;
+  }
+}
+
+/**
+ * @brief turn stores to locals nothing ever loads into pop (pop2 for long
+ *        and double), which jsc_peephole_remove_dead_values may then take
+ *        together with the value stored
+ */
+static bool jsc_peephole_remove_dead_stores(jsc_code* p)
+{
+  uint32_t locals = 0;
+  uint32_t index = 0;
+
+  for (uint32_t i = 0; i < p->count; i++)
+  {
+    if (!p->insns[i].removed &&
+        (jsc_peephole_reads_local(p->insns[i].bytes, &index) ||
+         jsc_peephole_local(p->insns[i].bytes, true, &index) >= 0) &&
+        index >= locals)
+    {
+      locals = index + 1;
+    }
+  }
+
+  bool* read = (bool*)calloc(locals ? locals : 1, sizeof(bool));
+
+  if (!read)
+  {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < p->count; i++)
+  {
+    if (!p->insns[i].removed &&
+        jsc_peephole_reads_local(p->insns[i].bytes, &index))
+    {
+      read[index] = true;
+    }
+  }
+
+  bool changed = false;
+
+  for (uint32_t i = 0; i < p->count; i++)
+  {
+    jsc_code_insn* insn = &p->insns[i];
+    int kind = insn->removed ? -1
+                             : jsc_peephole_local(insn->bytes, true, &index);
+
+    if (kind < 0 || read[index])
+    {
+      continue;
+    }
+
+    insn->bytes[0] = kind == 1 || kind == 3 ? JSC_JVM_POP2 : JSC_JVM_POP;
+    insn->length = 1;
+    changed = true;
+  }
+
+  free(read);
+  return changed;
+}
+
+/* slots a push without side effects leaves on the stack, 0 for anything
+   else; ldc of a class or method handle may fail to resolve */
+static int jsc_peephole_pure_push(const jsc_bytecode_context* ctx,
+                                  const uint8_t* bytes)
+{
+  uint8_t opcode = bytes[0];
+  uint32_t local = 0;
+  int kind = jsc_peephole_local(bytes, false, &local);
+
+  if (kind >= 0)
+  {
+    return kind == 1 || kind == 3 ? 2 : 1;
+  }
+
+  if (opcode >= JSC_JVM_ACONST_NULL && opcode <= JSC_JVM_SIPUSH)
+  {
+    return (opcode >= JSC_JVM_LCONST_0 && opcode <= JSC_JVM_LCONST_1) ||
+                   (opcode >= JSC_JVM_DCONST_0 && opcode <= JSC_JVM_DCONST_1)
+               ? 2
+               : 1;
+  }
+
+  if (opcode == JSC_JVM_DUP || opcode == JSC_JVM_DUP2)
+  {
+    return opcode == JSC_JVM_DUP ? 1 : 2;
+  }
+
+  if (opcode < JSC_JVM_LDC || opcode > JSC_JVM_LDC2_W)
+  {
+    return 0;
+  }
+
+  uint16_t index = opcode == JSC_JVM_LDC ? bytes[1] : jsc_read_u16(bytes + 1);
+
+  if (index == 0 || index >= ctx->constant_pool_count)
+  {
+    return 0;
+  }
+
+  uint8_t tag = ctx->constant_pool[index].tag;
+
+  if (opcode == JSC_JVM_LDC2_W)
+  {
+    return tag == JSC_CP_LONG || tag == JSC_CP_DOUBLE ? 2 : 0;
+  }
+
+  return tag == JSC_CP_INTEGER || tag == JSC_CP_FLOAT ||
+                 tag == JSC_CP_STRING
+             ? 1
+             : 0;
+}
+
+/**
+ * @brief drop a push without side effects together with the pop (pop2 for
+ *        two slots) right after it
+ */
+static bool jsc_peephole_remove_dead_values(jsc_code* p)
+{
+  bool changed = false;
+
+  for (uint32_t i = 0; i < p->count; i++)
+  {
+    jsc_code_insn* push = &p->insns[i];
+
+    if (push->removed)
+    {
+      continue;
+    }
+
+    int slots = jsc_peephole_pure_push(p->ctx, push->bytes);
+    uint32_t j = jsc_code_next(p, i + 1);
+
+    if (slots == 0 || j == p->count || p->insns[j].leader ||
+        p->insns[j].bytes[0] != (slots == 2 ? JSC_JVM_POP2 : JSC_JVM_POP))
+    {
+      continue;
+    }
+
+    push->removed = true;
+    p->insns[j].removed = true;
+    changed = true;
+  }
+
+  return changed;
+}
+
+/* whether bytes invoke class_name.name with the given descriptor */
+static bool jsc_peephole_invokes(const jsc_bytecode_context* ctx,
+                                 const uint8_t* bytes, uint8_t opcode,
+                                 const char* class_name, const char* name,
+                                 const char* descriptor)
+{
+  if (bytes[0] != opcode)
+  {
+    return false;
+  }
+
+  uint16_t index = jsc_read_u16(bytes + 1);
+
+  if (index == 0 || index >= ctx->constant_pool_count ||
+      ctx->constant_pool[index].tag != JSC_CP_METHODREF)
+  {
+    return false;
+  }
+
+  uint16_t class_index = ctx->constant_pool[index].methodref_info.class_index;
+  uint16_t name_and_type =
+      ctx->constant_pool[index].methodref_info.name_and_type_index;
+
+  if (class_index == 0 || class_index >= ctx->constant_pool_count ||
+      ctx->constant_pool[class_index].tag != JSC_CP_CLASS ||
+      name_and_type == 0 || name_and_type >= ctx->constant_pool_count ||
+      ctx->constant_pool[name_and_type].tag != JSC_CP_NAME_AND_TYPE)
+  {
+    return false;
+  }
+
+  const jsc_constant_pool_entry* entry = &ctx->constant_pool[name_and_type];
+
+  return jsc_frame_utf8_equals(
+             ctx, ctx->constant_pool[class_index].class_info.name_index,
+             class_name) &&
+         jsc_frame_utf8_equals(ctx, entry->name_and_type_info.name_index,
+                               name) &&
+         jsc_frame_utf8_equals(ctx, entry->name_and_type_info.descriptor_index,
+                               descriptor);
+}
+
+/* the primitive a single operand-free instruction pushes, 0 otherwise */
+static char jsc_peephole_push_type(const jsc_bytecode_context* ctx,
+                                   const uint8_t* bytes)
+{
+  uint8_t opcode = bytes[0];
+  uint32_t local;
+  uint16_t index;
+
+  if ((opcode >= JSC_JVM_ICONST_M1 && opcode <= JSC_JVM_ICONST_5) ||
+      opcode == JSC_JVM_BIPUSH || opcode == JSC_JVM_SIPUSH)
+  {
+    return 'I';
+  }
+
+  if (opcode == JSC_JVM_LCONST_0 || opcode == JSC_JVM_LCONST_1)
+  {
+    return 'J';
+  }
+
+  if (opcode >= JSC_JVM_FCONST_0 && opcode <= JSC_JVM_FCONST_2)
+  {
+    return 'F';
+  }
+
+  if (opcode == JSC_JVM_DCONST_0 || opcode == JSC_JVM_DCONST_1)
+  {
+    return 'D';
+  }
+
+  switch (jsc_peephole_local(bytes, false, &local))
+  {
+  case 0:
+    return 'I';
+  case 1:
+    return 'J';
+  case 2:
+    return 'F';
+  case 3:
+    return 'D';
+  default:
+    break;
+  }
+
+  if (opcode == JSC_JVM_LDC)
+  {
+    index = bytes[1];
+  }
+  else if (opcode == JSC_JVM_LDC_W || opcode == JSC_JVM_LDC2_W)
+  {
+    index = jsc_read_u16(bytes + 1);
+  }
+  else
+  {
+    return 0;
+  }
+
+  if (index == 0 || index >= ctx->constant_pool_count)
+  {
+    return 0;
+  }
+
+  switch (ctx->constant_pool[index].tag)
+  {
+  case JSC_CP_INTEGER:
+    return opcode == JSC_JVM_LDC2_W ? 0 : 'I';
+  case JSC_CP_FLOAT:
+    return opcode == JSC_JVM_LDC2_W ? 0 : 'F';
+  case JSC_CP_LONG:
+    return opcode == JSC_JVM_LDC2_W ? 'J' : 0;
+  case JSC_CP_DOUBLE:
+    return opcode == JSC_JVM_LDC2_W ? 'D' : 0;
+  default:
+    return 0;
+  }
+}
+
+/* whether the class constant of new instruction bytes is class_name */
+static bool jsc_peephole_news(const jsc_bytecode_context* ctx,
+                              const uint8_t* bytes, const char* class_name)
+{
+  uint16_t index = jsc_read_u16(bytes + 1);
+
+  return bytes[0] == JSC_JVM_NEW && index > 0 &&
+         index < ctx->constant_pool_count &&
+         ctx->constant_pool[index].tag == JSC_CP_CLASS &&
+         jsc_frame_utf8_equals(
+             ctx, ctx->constant_pool[index].class_info.name_index, class_name);
+}
+
+/* box classes whose constructor, valueOf and unboxing call cancel out */
+static const struct
+{
+  const char* class_name;
+  char primitive;
+  const char* unbox;
+} jsc_peephole_boxes[] = {
+    {"java/lang/Integer", 'I', "intValue"},
+    {"java/lang/Long", 'J', "longValue"},
+    {"java/lang/Float", 'F', "floatValue"},
+    {"java/lang/Double", 'D', "doubleValue"},
+    {"java/lang/Boolean", 'Z', "booleanValue"},
+};
+
+/**
+ * @brief collapse boxing that is unboxed or popped right away
+ *
+ * @details Matches new C; dup; <push>; invokespecial C.<init> and
+ *          invokestatic C.valueOf for the box classes. Followed by the
+ *          matching xValue call only the pushed primitive is kept;
+ *          followed by pop the box is never built. Nothing inside a
+ *          sequence may be a branch target.
+ */
+static bool jsc_peephole_fold_boxing(jsc_code* p)
+{
+  const jsc_bytecode_context* ctx = p->ctx;
+  bool changed = false;
+  size_t box_count = sizeof(jsc_peephole_boxes) / sizeof(jsc_peephole_boxes[0]);
+
+  for (uint32_t i = 0; i < p->count; i++)
+  {
+    if (p->insns[i].removed)
+    {
+      continue;
+    }
+
+    for (size_t b = 0; b < box_count; b++)
+    {
+      const char* class_name = jsc_peephole_boxes[b].class_name;
+      char primitive = jsc_peephole_boxes[b].primitive;
+      bool wide = primitive == 'J' || primitive == 'D';
+      char init[8];
+      char value_of[32];
+      char unbox[8];
+
+      snprintf(init, sizeof(init), "(%c)V", primitive);
+      snprintf(value_of, sizeof(value_of), "(%c)L%s;", primitive, class_name);
+      snprintf(unbox, sizeof(unbox), "()%c", primitive);
+
+      uint32_t chain[5];
+      uint32_t length = 0;
+      uint32_t j = i;
+
+      /* new C; dup; <push>; invokespecial C.<init>, or C.valueOf */
+      if (jsc_peephole_news(ctx, p->insns[i].bytes, class_name))
+      {
+        for (length = 0; length < 5 && j < p->count; length++)
+        {
+          chain[length] = j;
+          j = jsc_code_next(p, j + 1);
+        }
+
+        char pushed = length == 5 ? jsc_peephole_push_type(
+                                        ctx, p->insns[chain[2]].bytes)
+                                  : 0;
+
+        if (length < 5 || p->insns[chain[1]].bytes[0] != JSC_JVM_DUP ||
+            !(pushed == primitive || (pushed == 'I' && primitive == 'Z')) ||
+            !jsc_peephole_invokes(ctx, p->insns[chain[3]].bytes,
+                                  JSC_JVM_INVOKESPECIAL, class_name, "<init>",
+                                  init))
+        {
+          continue;
+        }
+      }
+      else if (jsc_peephole_invokes(ctx, p->insns[i].bytes,
+                                    JSC_JVM_INVOKESTATIC, class_name,
+                                    "valueOf", value_of))
+      {
+        chain[length++] = i;
+        j = jsc_code_next(p, i + 1);
+
+        if (j == p->count)
+        {
+          continue;
+        }
+
+        chain[length++] = j;
+      }
+      else
+      {
+        continue;
+      }
+
+      bool entered = false;
+
+      for (uint32_t k = 1; k < length; k++)
+      {
+        entered = entered || p->insns[chain[k]].leader;
+      }
+
+      const uint8_t* last = p->insns[chain[length - 1]].bytes;
+
+      if (entered)
+      {
+        continue;
+      }
+
+      if (jsc_peephole_invokes(ctx, last, JSC_JVM_INVOKEVIRTUAL, class_name,
+                               jsc_peephole_boxes[b].unbox, unbox))
+      {
+        /* only the push survives */
+        for (uint32_t k = 0; k < length; k++)
+        {
+          p->insns[chain[k]].removed = !(length == 5 && k == 2);
+        }
+      }
+      else if (last[0] == JSC_JVM_POP && length == 5)
+      {
+        /* a freshly built box has no observers */
+        for (uint32_t k = 0; k < length; k++)
+        {
+          p->insns[chain[k]].removed = true;
+        }
+      }
+      else if (last[0] == JSC_JVM_POP)
+      {
+        p->insns[chain[0]].bytes[0] = wide ? JSC_JVM_POP2 : JSC_JVM_POP;
+        p->insns[chain[0]].length = 1;
+        p->insns[chain[1]].removed = true;
+      }
+      else
+      {
+        continue;
+      }
+
+      changed = true;
+      break;
+    }
+  }
+
+  return changed;
+}
+
+/**
+ * @brief peephole-optimize the code of a method in place
+ *
+ * @details Until nothing changes: threads jumps to jumps, drops unreachable
+ *          code, nops and jumps to the next instruction, folds store/load
+ *          pairs of one local and redundant boxing, turns stores to locals
+ *          never loaded into pops and drops pure pushes that are popped.
+ *          The result is laid out again by jsc_code_install. Returns false,
+ *          leaving the method as it was, for code jsc_code_decode rejects.
+ */
+bool jsc_bytecode_optimize_method(jsc_bytecode_context* ctx,
+                                  jsc_method* method)
+{
+  jsc_code p;
+  bool ok = jsc_code_decode(&p, ctx, method);
+
+  /* rewrite to a fixpoint, bounded in case jumps chase each other */
+  bool changed = ok;
+
+  for (uint32_t round = 0; changed && round < 16; round++)
+  {
+    changed = false;
+    jsc_code_mark_leaders(&p, p.targets);
+    changed |= jsc_peephole_thread_jumps(&p);
+    changed |= jsc_peephole_remove_unreachable(&p, p.targets);
+    changed |= jsc_peephole_remove_trivial(&p);
+    jsc_code_mark_leaders(&p, p.targets);
+    changed |= jsc_peephole_fold_store_load(&p);
+    changed |= jsc_peephole_remove_dead_stores(&p);
+    jsc_code_mark_leaders(&p, p.targets);
+    changed |= jsc_peephole_fold_boxing(&p);
+    jsc_code_mark_leaders(&p, p.targets);
+    changed |= jsc_peephole_remove_dead_values(&p);
+  }
+
+  ok = ok && jsc_code_install(&p);
+  jsc_code_free(&p);
+  return ok;
+}
+
+/**
+ * @brief create a label for jsc_bytecode_emit_branch, not yet placed
+ *
+ * @details Returns the label, or -1.
+ */
+int32_t jsc_bytecode_new_label(jsc_bytecode_context* ctx)
+{
+  if (ctx->label_count == INT32_MAX)
+  {
+    return -1;
+  }
+
+  jsc_label* labels = (jsc_label*)realloc(
+      ctx->labels, (ctx->label_count + 1) * sizeof(jsc_label));
+
+  if (!labels)
+  {
+    return -1;
+  }
+
+  ctx->labels = labels;
+  ctx->labels[ctx->label_count].method = 0;
+  ctx->labels[ctx->label_count].offset = -1;
+
+  return (int32_t)ctx->label_count++;
+}
+
+/**
+ * @brief place label at the end of the code emitted so far for method
+ */
+void jsc_bytecode_place_label(jsc_bytecode_context* ctx, jsc_method* method,
+                              int32_t label)
+{
+  if (label < 0 || (uint32_t)label >= ctx->label_count)
+  {
+    return;
+  }
+
+  ctx->labels[label].method = (uint16_t)(method - ctx->methods);
+  ctx->labels[label].offset = jsc_bytecode_get_method_code_length(method);
+}
+
+/**
+ * @brief emit a branch to label, placed before or after it
+ *
+ * @details The branch is emitted in its short form with a placeholder
+ *          offset; jsc_bytecode_resolve_branches fills it in, or relaxes
+ *          it to goto_w when the target is out of reach.
+ */
+void jsc_bytecode_emit_branch(jsc_bytecode_context* ctx, jsc_method* method,
+                              uint8_t opcode, int32_t label)
+{
+  if (label < 0 || (uint32_t)label >= ctx->label_count)
+  {
+    return;
+  }
+
+  jsc_branch_fixup* fixups = (jsc_branch_fixup*)realloc(
+      ctx->branch_fixups,
+      (ctx->branch_fixup_count + 1) * sizeof(jsc_branch_fixup));
+
+  if (!fixups)
+  {
+    return;
+  }
+
+  ctx->branch_fixups = fixups;
+
+  jsc_branch_fixup* fixup = &ctx->branch_fixups[ctx->branch_fixup_count++];
+  fixup->method = (uint16_t)(method - ctx->methods);
+  fixup->pc = jsc_bytecode_get_method_code_length(method);
+  fixup->label = (uint32_t)label;
+  fixup->slot = 0;
+
+  jsc_bytecode_emit_u16(ctx, method, opcode, 0);
+}
+
+/* append length bytes to the code of method */
+static void jsc_bytecode_emit_raw(jsc_bytecode_context* ctx,
+                                  jsc_method* method, const uint8_t* bytes,
+                                  uint32_t length)
+{
+  jsc_attribute* attr = method ? jsc_code_attribute(ctx, method) : NULL;
+
+  if (!attr || !attr->info)
+  {
+    return;
+  }
+
+  uint32_t code_length = jsc_bytecode_get_method_code_length(method);
+  uint8_t* info = (uint8_t*)realloc(attr->info, attr->length + length);
+
+  if (!info)
+  {
+    return;
+  }
+
+  memmove(info + 8 + code_length + length, info + 8 + code_length,
+          attr->length - 8 - code_length);
+  memcpy(info + 8 + code_length, bytes, length);
+
+  uint32_t code_length_be = htobe32(code_length + length);
+  memcpy(info + 4, &code_length_be, 4);
+
+  attr->info = info;
+  attr->length += length;
+}
+
+typedef struct
+{
+  int32_t key;
+  int32_t label;
+} jsc_switch_case;
+
+static int jsc_switch_case_compare(const void* a, const void* b)
+{
+  int32_t x = ((const jsc_switch_case*)a)->key;
+  int32_t y = ((const jsc_switch_case*)b)->key;
+
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief emit a switch on the int on the stack, branching to the label of
+ *        the key it equals or else to default_label
+ *
+ * @details keys must be distinct but need not be sorted. Dense keys get a
+ *          tableswitch, its holes going to default_label, and sparse ones a
+ *          lookupswitch, by the space and time estimate javac uses. The
+ *          offsets are filled in like those of jsc_bytecode_emit_branch.
+ */
+void jsc_bytecode_emit_switch(jsc_bytecode_context* ctx, jsc_method* method,
+                              const int32_t* keys, const int32_t* labels,
+                              uint32_t count, int32_t default_label)
+{
+  jsc_switch_case* cases =
+      (jsc_switch_case*)malloc((count ? count : 1) * sizeof(jsc_switch_case));
+
+  if (!cases)
+  {
+    return;
+  }
+
+  for (uint32_t i = 0; i < count; i++)
+  {
+    cases[i].key = keys[i];
+    cases[i].label = labels[i];
+  }
+
+  if (count > 1)
+  {
+    qsort(cases, count, sizeof(jsc_switch_case), jsc_switch_case_compare);
+  }
+
+  int64_t low = count ? cases[0].key : 0;
+  int64_t high = count ? cases[count - 1].key : -1;
+  uint64_t table_cost = 4 + (uint64_t)(high - low + 1) + 3 * 3;
+  uint64_t lookup_cost = 3 + 2 * (uint64_t)count + 3 * (uint64_t)count;
+  bool table = count > 0 && table_cost <= lookup_cost;
+
+  uint32_t pc = jsc_bytecode_get_method_code_length(method);
+  uint32_t padding = 3 - pc % 4;
+  uint32_t slots = table ? (uint32_t)(high - low + 1) : count;
+  uint32_t length = 1 + padding + (table ? 12 + slots * 4 : 8 + slots * 8);
+
+  uint8_t* bytes = (uint8_t*)calloc(length, 1);
+  jsc_branch_fixup* fixups = (jsc_branch_fixup*)realloc(
+      ctx->branch_fixups,
+      (ctx->branch_fixup_count + slots + 1) * sizeof(jsc_branch_fixup));
+
+  if (!bytes || !fixups)
+  {
+    free(bytes);
+    free(cases);
+    ctx->branch_fixups = fixups ? fixups : ctx->branch_fixups;
+    return;
+  }
+
+  ctx->branch_fixups = fixups;
+
+  uint8_t* out = bytes;
+  jsc_write_u8(&out, table ? JSC_JVM_TABLESWITCH : JSC_JVM_LOOKUPSWITCH);
+  out += padding;
+
+  uint32_t operands = (uint32_t)(out - bytes);
+  uint16_t method_index = (uint16_t)(method - ctx->methods);
+
+  for (uint32_t i = 0; i <= slots; i++)
+  {
+    /* the default first, then one offset per table entry or pair */
+    jsc_branch_fixup* fixup = &ctx->branch_fixups[ctx->branch_fixup_count++];
+    fixup->method = method_index;
+    fixup->pc = pc;
+    fixup->label = (uint32_t)default_label;
+    fixup->slot = operands + (i == 0 ? 0 : table ? 8 + i * 4 : i * 8 + 4);
+  }
+
+  jsc_branch_fixup* entries =
+      &ctx->branch_fixups[ctx->branch_fixup_count - slots];
+
+  if (table)
+  {
+    out += 4;
+    jsc_write_u32(&out, (uint32_t)low);
+    jsc_write_u32(&out, (uint32_t)high);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+      entries[cases[i].key - low].label = (uint32_t)cases[i].label;
+    }
+  }
+  else
+  {
+    out += 4;
+    jsc_write_u32(&out, count);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+      jsc_write_u32(&out, (uint32_t)cases[i].key);
+      out += 4;
+      entries[i].label = (uint32_t)cases[i].label;
+    }
+  }
+
+  jsc_bytecode_emit_raw(ctx, method, bytes, length);
+
+  free(bytes);
+  free(cases);
+}
+
+/**
+ * @brief point the branches emitted for method at their labels
+ *
+ * @details When every displacement fits in 16 bits the offsets are
+ *          patched in place. Otherwise the code is decoded and laid out
+ *          again, far gotos becoming goto_w and far conditional branches
+ *          the inverted condition over a goto_w. Returns false if a label
+ *          was never placed in method or the code cannot be relaid out.
+ */
+bool jsc_bytecode_resolve_branches(jsc_bytecode_context* ctx,
+                                   jsc_method* method)
+{
+  uint16_t method_index = (uint16_t)(method - ctx->methods);
+  uint32_t code_length = jsc_bytecode_get_method_code_length(method);
+  uint8_t* code = jsc_bytecode_get_method_code(method);
+  bool near = true;
+  bool ok = true;
+
+  for (uint32_t i = 0; i < ctx->branch_fixup_count; i++)
+  {
+    const jsc_branch_fixup* fixup = &ctx->branch_fixups[i];
+    const jsc_label* label = &ctx->labels[fixup->label];
+
+    if (fixup->method != method_index)
+    {
+      continue;
+    }
+
+    int64_t offset = label->offset - (int64_t)fixup->pc;
+
+    ok = ok && label->method == method_index && label->offset >= 0 &&
+         label->offset < code_length;
+    near = near && (fixup->slot || (offset >= INT16_MIN &&
+                                    offset <= INT16_MAX));
+  }
+
+  /* switch offsets always fit, and relaxation reads them from the code */
+  for (uint32_t i = 0; ok && i < ctx->branch_fixup_count; i++)
+  {
+    const jsc_branch_fixup* fixup = &ctx->branch_fixups[i];
+    uint32_t offset_be = htobe32(
+        (uint32_t)(ctx->labels[fixup->label].offset - (int64_t)fixup->pc));
+
+    if (fixup->method == method_index && fixup->slot)
+    {
+      memcpy(code + fixup->pc + fixup->slot, &offset_be, 4);
+    }
+  }
+
+  if (ok && near)
+  {
+    for (uint32_t i = 0; i < ctx->branch_fixup_count; i++)
+    {
+      const jsc_branch_fixup* fixup = &ctx->branch_fixups[i];
+      uint16_t offset_be = htobe16(
+          (uint16_t)(ctx->labels[fixup->label].offset - (int64_t)fixup->pc));
+
+      if (fixup->method == method_index && !fixup->slot)
+      {
+        memcpy(code + fixup->pc + 1, &offset_be, 2);
+      }
+    }
+  }
+  else if (ok)
+  {
+    jsc_code p;
+    ok = jsc_code_decode(&p, ctx, method);
+
+    for (uint32_t i = 0; ok && i < ctx->branch_fixup_count; i++)
+    {
+      const jsc_branch_fixup* fixup = &ctx->branch_fixups[i];
+      int64_t target = ctx->labels[fixup->label].offset;
+
+      if (fixup->method != method_index || fixup->slot)
+      {
+        continue;
+      }
+
+      ok = p.index[fixup->pc] != UINT32_MAX && p.index[target] != UINT32_MAX;
+
+      if (ok)
+      {
+        p.insns[p.index[fixup->pc]].target = target;
+      }
+    }
+
+    ok = ok && jsc_code_install(&p);
+    jsc_code_free(&p);
+  }
+
+  /* the method's fixups are done with, resolved or not */
+  uint32_t kept = 0;
+
+  for (uint32_t i = 0; i < ctx->branch_fixup_count; i++)
+  {
+    if (ctx->branch_fixups[i].method != method_index)
+    {
+      ctx->branch_fixups[kept++] = ctx->branch_fixups[i];
+    }
+  }
+
+  ctx->branch_fixup_count = kept;
+  return ok;
+}
+
+static bool jsc_reader_fail(jsc_class_reader* reader, const char* error)
+{
+  reader->error = error;
+  return false;
+}
+
+/* the end of size bytes at pos, or 0 if they run past the class file */
+static uint32_t jsc_reader_take(const jsc_class_reader* reader, uint32_t pos,
+                                uint32_t size)
+{
+  return (uint64_t)pos + size <= reader->size ? pos + size : 0;
+}
+
+/* walks count attributes from *pos, leaving *pos after the last */
+static bool jsc_reader_skip_attributes(jsc_class_reader* reader,
+                                       uint32_t* pos, uint16_t count)
+{
+  for (uint16_t i = 0; i < count; i++)
+  {
+    if (!jsc_reader_take(reader, *pos, 6))
+    {
+      return jsc_reader_fail(reader, "truncated attribute");
+    }
+
+    uint32_t end = jsc_reader_take(reader, *pos + 6,
+                                   jsc_read_u32(reader->data + *pos + 2));
+
+    if (!end)
+    {
+      return jsc_reader_fail(reader, "attribute runs past the class file");
+    }
+
+    *pos = end;
+  }
+
+  return true;
+}
+
+/* fields or methods from *pos: records where each starts */
+static bool jsc_reader_members(jsc_class_reader* reader, uint32_t* pos,
+                               uint16_t* count, uint32_t** offsets)
+{
+  if (!jsc_reader_take(reader, *pos, 2))
+  {
+    return jsc_reader_fail(reader, "truncated member count");
+  }
+
+  *count = jsc_read_u16(reader->data + *pos);
+  *pos += 2;
+  *offsets = (uint32_t*)malloc((*count + 1) * sizeof(uint32_t));
+
+  if (!*offsets)
+  {
+    return jsc_reader_fail(reader, "out of memory");
+  }
+
+  for (uint16_t i = 0; i < *count; i++)
+  {
+    (*offsets)[i] = *pos;
+
+    if (!jsc_reader_take(reader, *pos, 8))
+    {
+      return jsc_reader_fail(reader, "truncated member");
+    }
+
+    uint16_t attribute_count = jsc_read_u16(reader->data + *pos + 6);
+    *pos += 8;
+
+    if (!jsc_reader_skip_attributes(reader, pos, attribute_count))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * @brief read the class file in data without copying it
+ *
+ * @details Only the layout is checked here: that the class file is a class
+ *          file and every table and attribute lies within it. The offsets of
+ *          constants and members are indexed so they can be decoded on
+ *          access; data must outlive the reader. On failure reader->error
+ *          says why, and the reader must still be freed.
+ */
+bool jsc_class_reader_init(jsc_class_reader* reader, const uint8_t* data,
+                           uint32_t size)
+{
+  memset(reader, 0, sizeof(jsc_class_reader));
+  reader->data = data;
+  reader->size = size;
+
+  if (size < 10 || jsc_read_u32(data) != 0xCAFEBABE)
+  {
+    return jsc_reader_fail(reader, "not a class file");
+  }
+
+  reader->minor_version = jsc_read_u16(data + 4);
+  reader->major_version = jsc_read_u16(data + 6);
+  reader->constant_pool_count = jsc_read_u16(data + 8);
+
+  if (reader->constant_pool_count == 0)
+  {
+    return jsc_reader_fail(reader, "empty constant pool");
+  }
+
+  reader->constants =
+      (uint32_t*)calloc(reader->constant_pool_count, sizeof(uint32_t));
+
+  if (!reader->constants)
+  {
+    return jsc_reader_fail(reader, "out of memory");
+  }
+
+  uint32_t pos = 10;
+
+  for (uint16_t i = 1; i < reader->constant_pool_count; i++)
+  {
+    uint32_t length;
+
+    if (!jsc_reader_take(reader, pos, 1))
+    {
+      return jsc_reader_fail(reader, "truncated constant pool");
+    }
+
+    reader->constants[i] = pos;
+
+    switch (data[pos])
+    {
+    case JSC_CP_UTF8:
+      length = jsc_reader_take(reader, pos + 1, 2)
+                   ? 2 + jsc_read_u16(data + pos + 1)
+                   : 2;
+      break;
+    case JSC_CP_CLASS:
+    case JSC_CP_STRING:
+    case JSC_CP_METHOD_TYPE:
+    case JSC_CP_MODULE:
+    case JSC_CP_PACKAGE:
+      length = 2;
+      break;
+    case JSC_CP_METHOD_HANDLE:
+      length = 3;
+      break;
+    case JSC_CP_INTEGER:
+    case JSC_CP_FLOAT:
+    case JSC_CP_FIELDREF:
+    case JSC_CP_METHODREF:
+    case JSC_CP_INTERFACE_METHODREF:
+    case JSC_CP_NAME_AND_TYPE:
+    case JSC_CP_DYNAMIC:
+    case JSC_CP_INVOKE_DYNAMIC:
+      length = 4;
+      break;
+    case JSC_CP_LONG:
+    case JSC_CP_DOUBLE:
+      /* takes two slots, the second unusable */
+      if (++i == reader->constant_pool_count)
+      {
+        return jsc_reader_fail(reader, "wide constant in the last slot");
+      }
+
+      length = 8;
+      break;
+    default:
+      return jsc_reader_fail(reader, "unknown constant tag");
+    }
+
+    pos = jsc_reader_take(reader, pos + 1, length);
+
+    if (!pos)
+    {
+      return jsc_reader_fail(reader, "truncated constant pool");
+    }
+  }
+
+  if (!jsc_reader_take(reader, pos, 8))
+  {
+    return jsc_reader_fail(reader, "truncated class header");
+  }
+
+  reader->access_flags = jsc_read_u16(data + pos);
+  reader->this_class = jsc_read_u16(data + pos + 2);
+  reader->super_class = jsc_read_u16(data + pos + 4);
+  reader->interface_count = jsc_read_u16(data + pos + 6);
+  reader->interfaces = pos + 8;
+  pos = jsc_reader_take(reader, reader->interfaces,
+                        2 * (uint32_t)reader->interface_count);
+
+  if (!pos)
+  {
+    return jsc_reader_fail(reader, "truncated interfaces");
+  }
+
+  if (!jsc_reader_members(reader, &pos, &reader->field_count,
+                          &reader->fields) ||
+      !jsc_reader_members(reader, &pos, &reader->method_count,
+                          &reader->methods))
+  {
+    return false;
+  }
+
+  if (!jsc_reader_take(reader, pos, 2))
+  {
+    return jsc_reader_fail(reader, "truncated class attributes");
+  }
+
+  reader->attribute_count = jsc_read_u16(data + pos);
+  reader->attributes = pos + 2;
+  pos += 2;
+
+  if (!jsc_reader_skip_attributes(reader, &pos, reader->attribute_count))
+  {
+    return false;
+  }
+
+  if (pos != size)
+  {
+    return jsc_reader_fail(reader, "trailing bytes after the class");
+  }
+
+  return true;
+}
+
+void jsc_class_reader_free(jsc_class_reader* reader)
+{
+  free(reader->constants);
+  free(reader->fields);
+  free(reader->methods);
+  reader->constants = NULL;
+  reader->fields = NULL;
+  reader->methods = NULL;
+}
+
+/**
+ * @brief tag of constant index, or 0 if there is no such constant
+ */
+uint8_t jsc_class_reader_tag(const jsc_class_reader* reader, uint16_t index)
+{
+  if (index == 0 || index >= reader->constant_pool_count ||
+      reader->constants[index] == 0)
+  {
+    return 0;
+  }
+
+  return reader->data[reader->constants[index]];
+}
+
+/**
+ * @brief the bytes of constant index after its tag, or NULL
+ */
+const uint8_t* jsc_class_reader_constant(const jsc_class_reader* reader,
+                                         uint16_t index)
+{
+  return jsc_class_reader_tag(reader, index)
+             ? reader->data + reader->constants[index] + 1
+             : NULL;
+}
+
+/**
+ * @brief bytes of the Utf8 constant index, not NUL-terminated, or NULL
+ */
+const char* jsc_class_reader_utf8(const jsc_class_reader* reader,
+                                  uint16_t index, uint16_t* length)
+{
+  if (jsc_class_reader_tag(reader, index) != JSC_CP_UTF8)
+  {
+    return NULL;
+  }
+
+  const uint8_t* info = jsc_class_reader_constant(reader, index);
+  *length = jsc_read_u16(info);
+  return (const char*)info + 2;
+}
+
+bool jsc_class_reader_utf8_equals(const jsc_class_reader* reader,
+                                  uint16_t index, const char* str)
+{
+  uint16_t length;
+  const char* bytes = jsc_class_reader_utf8(reader, index, &length);
+
+  return bytes && strlen(str) == length && memcmp(bytes, str, length) == 0;
+}
+
+static void jsc_reader_member(const jsc_class_reader* reader, uint32_t pos,
+                              jsc_class_member_view* member)
+{
+  const uint8_t* p = reader->data + pos;
+
+  member->access_flags = jsc_read_u16(p);
+  member->name_index = jsc_read_u16(p + 2);
+  member->descriptor_index = jsc_read_u16(p + 4);
+  member->attribute_count = jsc_read_u16(p + 6);
+  member->attributes = pos + 8;
+}
+
+bool jsc_class_reader_field(const jsc_class_reader* reader, uint16_t index,
+                            jsc_class_member_view* field)
+{
+  if (index >= reader->field_count)
+  {
+    return false;
+  }
+
+  jsc_reader_member(reader, reader->fields[index], field);
+  return true;
+}
+
+bool jsc_class_reader_method(const jsc_class_reader* reader, uint16_t index,
+                             jsc_class_member_view* method)
+{
+  if (index >= reader->method_count)
+  {
+    return false;
+  }
+
+  jsc_reader_member(reader, reader->methods[index], method);
+  return true;
+}
+
+/**
+ * @brief decode the attribute at offset
+ *
+ * @details offset is one the reader handed out: the attributes field of a
+ *          member view, reader->attributes, or a value this returned.
+ *          Returns the offset of the attribute that follows.
+ */
+uint32_t jsc_class_reader_attribute(const jsc_class_reader* reader,
+                                    uint32_t offset,
+                                    jsc_class_attribute_view* attribute)
+{
+  const uint8_t* p = reader->data + offset;
+
+  attribute->name_index = jsc_read_u16(p);
+  attribute->length = jsc_read_u32(p + 2);
+  attribute->info = p + 6;
+
+  return offset + 6 + attribute->length;
+}
+
+/**
+ * @brief find the attribute called name among count starting at offset
+ */
+bool jsc_class_reader_find_attribute(const jsc_class_reader* reader,
+                                     uint32_t offset, uint16_t count,
+                                     const char* name,
+                                     jsc_class_attribute_view* attribute)
+{
+  for (uint16_t i = 0; i < count; i++)
+  {
+    offset = jsc_class_reader_attribute(reader, offset, attribute);
+
+    if (jsc_class_reader_utf8_equals(reader, attribute->name_index, name))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static bool jsc_reader_is(const jsc_class_reader* reader, uint16_t index,
+                          uint8_t tag)
+{
+  return jsc_class_reader_tag(reader, index) == tag;
+}
+
+/* constants ldc, ldc_w and bootstrap arguments may load */
+static bool jsc_reader_is_loadable(const jsc_class_reader* reader,
+                                   uint16_t index, bool wide)
+{
+  switch (jsc_class_reader_tag(reader, index))
+  {
+  case JSC_CP_LONG:
+  case JSC_CP_DOUBLE:
+    return wide;
+  case JSC_CP_INTEGER:
+  case JSC_CP_FLOAT:
+  case JSC_CP_CLASS:
+  case JSC_CP_STRING:
+  case JSC_CP_METHOD_HANDLE:
+  case JSC_CP_METHOD_TYPE:
+  case JSC_CP_DYNAMIC:
+    return !wide;
+  default:
+    return false;
+  }
+}
+
+static bool jsc_reader_validate_constant(jsc_class_reader* reader,
+                                         uint16_t index,
+                                         uint16_t bootstrap_count)
+{
+  const uint8_t* info = jsc_class_reader_constant(reader, index);
+  uint16_t first = jsc_read_u16(info);
+  uint16_t second = 0;
+  bool ok = true;
+
+  switch (info[-1])
+  {
+  case JSC_CP_UTF8:
+    /* modified UTF-8 has no NUL bytes and no four-byte forms */
+    for (uint16_t i = 0; i < first; i++)
+    {
+      ok = ok && info[2 + i] != 0 && info[2 + i] < 0xF0;
+    }
+    break;
+  case JSC_CP_CLASS:
+  case JSC_CP_STRING:
+  case JSC_CP_METHOD_TYPE:
+  case JSC_CP_MODULE:
+  case JSC_CP_PACKAGE:
+    ok = jsc_reader_is(reader, first, JSC_CP_UTF8);
+    break;
+  case JSC_CP_FIELDREF:
+  case JSC_CP_METHODREF:
+  case JSC_CP_INTERFACE_METHODREF:
+    second = jsc_read_u16(info + 2);
+    ok = jsc_reader_is(reader, first, JSC_CP_CLASS) &&
+         jsc_reader_is(reader, second, JSC_CP_NAME_AND_TYPE);
+    break;
+  case JSC_CP_NAME_AND_TYPE:
+    second = jsc_read_u16(info + 2);
+    ok = jsc_reader_is(reader, first, JSC_CP_UTF8) &&
+         jsc_reader_is(reader, second, JSC_CP_UTF8);
+    break;
+  case JSC_CP_METHOD_HANDLE:
+  {
+    uint8_t kind = info[0];
+    uint8_t tag = jsc_class_reader_tag(reader, jsc_read_u16(info + 1));
+
+    if (kind >= JSC_REF_GET_FIELD && kind <= JSC_REF_PUT_STATIC)
+    {
+      ok = tag == JSC_CP_FIELDREF;
+    }
+    else if (kind == JSC_REF_INVOKE_INTERFACE)
+    {
+      ok = tag == JSC_CP_INTERFACE_METHODREF;
+    }
+    else
+    {
+      ok = kind <= JSC_REF_NEW_INVOKE_SPECIAL &&
+           (tag == JSC_CP_METHODREF || tag == JSC_CP_INTERFACE_METHODREF);
+    }
+
+    ok = ok && reader->major_version >= 51;
+    break;
+  }
+  case JSC_CP_DYNAMIC:
+  case JSC_CP_INVOKE_DYNAMIC:
+    second = jsc_read_u16(info + 2);
+    ok = first < bootstrap_count &&
+         jsc_reader_is(reader, second, JSC_CP_NAME_AND_TYPE) &&
+         reader->major_version >= 51;
+    break;
+  default:
+    break;
+  }
+
+  return ok || jsc_reader_fail(reader, "bad constant");
+}
+
+/* the constant pool operand of the instruction at pc has the right kind */
+static bool jsc_reader_validate_operand(const jsc_class_reader* reader,
+                                        const uint8_t* code, uint32_t pc)
+{
+  uint16_t index = jsc_read_u16(code + pc + 1);
+  uint8_t tag = jsc_class_reader_tag(reader, index);
+
+  switch (code[pc])
+  {
+  case JSC_JVM_LDC:
+    return jsc_reader_is_loadable(reader, code[pc + 1], false);
+  case JSC_JVM_LDC_W:
+    return jsc_reader_is_loadable(reader, index, false);
+  case JSC_JVM_LDC2_W:
+    return jsc_reader_is_loadable(reader, index, true);
+  case JSC_JVM_GETSTATIC:
+  case JSC_JVM_PUTSTATIC:
+  case JSC_JVM_GETFIELD:
+  case JSC_JVM_PUTFIELD:
+    return tag == JSC_CP_FIELDREF;
+  case JSC_JVM_INVOKEVIRTUAL:
+    return tag == JSC_CP_METHODREF;
+  case JSC_JVM_INVOKESPECIAL:
+  case JSC_JVM_INVOKESTATIC:
+    return tag == JSC_CP_METHODREF || tag == JSC_CP_INTERFACE_METHODREF;
+  case JSC_JVM_INVOKEINTERFACE:
+    return tag == JSC_CP_INTERFACE_METHODREF && code[pc + 3] != 0 &&
+           code[pc + 4] == 0;
+  case JSC_JVM_INVOKEDYNAMIC:
+    return tag == JSC_CP_INVOKE_DYNAMIC && code[pc + 3] == 0 &&
+           code[pc + 4] == 0;
+  case JSC_JVM_NEW:
+  case JSC_JVM_ANEWARRAY:
+  case JSC_JVM_CHECKCAST:
+  case JSC_JVM_INSTANCEOF:
+  case JSC_JVM_MULTIANEWARRAY:
+    return tag == JSC_CP_CLASS;
+  case JSC_JVM_WIDE:
+  {
+    uint8_t opcode = code[pc + 1];
+
+    return (opcode >= JSC_JVM_ILOAD && opcode <= JSC_JVM_ALOAD) ||
+           (opcode >= JSC_JVM_ISTORE && opcode <= JSC_JVM_ASTORE) ||
+           opcode == JSC_JVM_IINC || opcode == JSC_JVM_RET;
+  }
+  default:
+    return true;
+  }
+}
+
+/* every branch and switch of the instruction at pc lands on an
+   instruction; starts flags the offsets instructions begin at */
+static bool jsc_reader_validate_targets(const uint8_t* code,
+                                        uint32_t code_length,
+                                        const uint8_t* starts, uint32_t pc)
+{
+  uint8_t opcode = code[pc];
+  int64_t target;
+
+  if (opcode == JSC_JVM_GOTO_W || opcode == JSC_JVM_JSR_W)
+  {
+    target = (int64_t)pc + jsc_read_s32(code + pc + 1);
+  }
+  else if (jsc_code_is_branch(opcode) || opcode == JSC_JVM_JSR)
+  {
+    target = (int64_t)pc + (int16_t)jsc_read_u16(code + pc + 1);
+  }
+  else if (jsc_code_is_switch(opcode))
+  {
+    uint32_t base = (pc + 4) & ~3u;
+    bool table = opcode == JSC_JVM_TABLESWITCH;
+    int64_t count = table ? (int64_t)jsc_read_s32(code + base + 8) -
+                                jsc_read_s32(code + base + 4) + 1
+                          : jsc_read_s32(code + base + 4);
+    uint32_t stride = table ? 4 : 8;
+
+    /* the default, then each case; the length was checked, so the table
+       is within the code */
+    for (int64_t k = -1; k < count; k++)
+    {
+      uint32_t at = k < 0 ? base : base + 12 + (uint32_t)k * stride;
+      target = (int64_t)pc + jsc_read_s32(code + at);
+
+      if (target < 0 || target >= code_length || !starts[target])
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+  else
+  {
+    return true;
+  }
+
+  return target >= 0 && target < code_length && starts[target];
+}
+
+static bool jsc_reader_validate_code(jsc_class_reader* reader,
+                                     const jsc_class_attribute_view* attribute)
+{
+  const uint8_t* info = attribute->info;
+  uint32_t length = attribute->length;
+
+  if (length < 12)
+  {
+    return jsc_reader_fail(reader, "truncated Code attribute");
+  }
+
+  uint32_t code_length = jsc_read_u32(info + 4);
+
+  if (code_length == 0 || code_length >= 65536 ||
+      (uint64_t)code_length + 12 > length)
+  {
+    return jsc_reader_fail(reader, "bad code length");
+  }
+
+  const uint8_t* code = info + 8;
+  uint32_t pos = 8 + code_length;
+  uint16_t exception_table_length = jsc_read_u16(info + pos);
+  pos += 2;
+
+  if ((uint64_t)pos + 8 * exception_table_length + 2 > length)
+  {
+    return jsc_reader_fail(reader, "truncated exception table");
+  }
+
+  uint8_t* starts = (uint8_t*)calloc(code_length + 1, 1);
+
+  if (!starts)
+  {
+    return jsc_reader_fail(reader, "out of memory");
+  }
+
+  const char* error = NULL;
+
+  for (uint32_t pc = 0; !error && pc < code_length;)
+  {
+    uint32_t size = jsc_bytecode_instruction_length(code, pc, code_length);
+
+    if (size == 0)
+    {
+      error = "malformed instruction";
+    }
+    else if (!jsc_reader_validate_operand(reader, code, pc))
+    {
+      error = "bad instruction operand";
+    }
+
+    starts[pc] = 1;
+    pc += size;
+  }
+
+  /* an exception range may end at the end of the code */
+  starts[code_length] = 1;
+
+  for (uint32_t pc = 0; !error && pc < code_length;
+       pc += jsc_bytecode_instruction_length(code, pc, code_length))
+  {
+    if (!jsc_reader_validate_targets(code, code_length, starts, pc))
+    {
+      error = "branch target is not an instruction";
+    }
+  }
+
+  for (uint16_t i = 0; !error && i < exception_table_length; i++, pos += 8)
+  {
+    uint16_t start_pc = jsc_read_u16(info + pos);
+    uint16_t end_pc = jsc_read_u16(info + pos + 2);
+    uint16_t handler_pc = jsc_read_u16(info + pos + 4);
+    uint16_t catch_type = jsc_read_u16(info + pos + 6);
+
+    if (start_pc >= end_pc || end_pc > code_length || !starts[start_pc] ||
+        !starts[end_pc] || handler_pc >= code_length || !starts[handler_pc] ||
+        (catch_type != 0 && !jsc_reader_is(reader, catch_type, JSC_CP_CLASS)))
+    {
+      error = "bad exception table entry";
+    }
+  }
+
+  uint16_t attributes_count = error ? 0 : jsc_read_u16(info + pos);
+  pos += 2;
+
+  for (uint16_t i = 0; !error && i < attributes_count; i++)
+  {
+    if ((uint64_t)pos + 6 > length ||
+        (uint64_t)pos + 6 + jsc_read_u32(info + pos + 2) > length)
+    {
+      error = "Code attribute runs past its length";
+      break;
+    }
+
+    uint16_t name_index = jsc_read_u16(info + pos);
+    uint32_t nested_length = jsc_read_u32(info + pos + 2);
+
+    if (!jsc_reader_is(reader, name_index, JSC_CP_UTF8))
+    {
+      error = "bad attribute name";
+    }
+    else if (jsc_class_reader_utf8_equals(reader, name_index,
+                                          "LineNumberTable"))
+    {
+      uint16_t count = nested_length >= 2 ? jsc_read_u16(info + pos + 6) : 0;
+
+      if (nested_length != 2 + 4 * (uint32_t)count)
+      {
+        error = "bad LineNumberTable length";
+      }
+
+      for (uint16_t j = 0; !error && j < count; j++)
+      {
+        uint16_t start_pc = jsc_read_u16(info + pos + 8 + 4 * j);
+
+        if (start_pc >= code_length || !starts[start_pc])
+        {
+          error = "line number of no instruction";
+        }
+      }
+    }
+
+    pos += 6 + nested_length;
+  }
+
+  if (!error && pos != length)
+  {
+    error = "bad Code attribute length";
+  }
+
+  free(starts);
+  return !error || jsc_reader_fail(reader, error);
+}
+
+/* the BootstrapMethods attribute of the class, if any, and its entry
+   count; 0 when it is missing */
+static bool jsc_reader_validate_bootstrap(jsc_class_reader* reader,
+                                          uint16_t* bootstrap_count)
+{
+  jsc_class_attribute_view attribute;
+  *bootstrap_count = 0;
+
+  if (!jsc_class_reader_find_attribute(reader, reader->attributes,
+                                       reader->attribute_count,
+                                       "BootstrapMethods", &attribute))
+  {
+    return true;
+  }
+
+  if (attribute.length < 2)
+  {
+    return jsc_reader_fail(reader, "truncated BootstrapMethods");
+  }
+
+  uint16_t count = jsc_read_u16(attribute.info);
+  uint32_t pos = 2;
+
+  for (uint16_t i = 0; i < count; i++)
+  {
+    if ((uint64_t)pos + 4 > attribute.length)
+    {
+      return jsc_reader_fail(reader, "truncated BootstrapMethods");
+    }
+
+    uint16_t handle = jsc_read_u16(attribute.info + pos);
+    uint16_t argument_count = jsc_read_u16(attribute.info + pos + 2);
+    pos += 4;
+
+    if (!jsc_reader_is(reader, handle, JSC_CP_METHOD_HANDLE) ||
+        (uint64_t)pos + 2 * argument_count > attribute.length)
+    {
+      return jsc_reader_fail(reader, "bad bootstrap method");
+    }
+
+    for (uint16_t j = 0; j < argument_count; j++, pos += 2)
+    {
+      uint16_t argument = jsc_read_u16(attribute.info + pos);
+
+      if (!jsc_reader_is_loadable(reader, argument, false) &&
+          !jsc_reader_is_loadable(reader, argument, true))
+      {
+        return jsc_reader_fail(reader, "bad bootstrap argument");
+      }
+    }
+  }
+
+  if (pos != attribute.length)
+  {
+    return jsc_reader_fail(reader, "bad BootstrapMethods length");
+  }
+
+  *bootstrap_count = count;
+  return true;
+}
+
+static bool jsc_reader_validate_attributes(jsc_class_reader* reader,
+                                           uint32_t offset, uint16_t count)
+{
+  jsc_class_attribute_view attribute;
+
+  for (uint16_t i = 0; i < count; i++)
+  {
+    offset = jsc_class_reader_attribute(reader, offset, &attribute);
+
+    if (!jsc_reader_is(reader, attribute.name_index, JSC_CP_UTF8))
+    {
+      return jsc_reader_fail(reader, "bad attribute name");
+    }
+
+    if ((jsc_class_reader_utf8_equals(reader, attribute.name_index,
+                                      "SourceFile") ||
+         jsc_class_reader_utf8_equals(reader, attribute.name_index,
+                                      "ConstantValue")) &&
+        (attribute.length != 2 ||
+         jsc_class_reader_tag(reader, jsc_read_u16(attribute.info)) == 0))
+    {
+      return jsc_reader_fail(reader, "bad attribute length");
+    }
+  }
+
+  return true;
+}
+
+/**
+ * @brief check that a class file read by jsc_class_reader_init is
+ *        structurally sound
+ *
+ * @details Checks what jsc_bytecode_write is expected to get right, in one
+ *          pass over the bytes: constant pool references and their kinds,
+ *          the class and member names and descriptors, Code attributes
+ *          (code length, instruction boundaries, operand constants, branch
+ *          and switch targets, exception ranges), and the sizes of the
+ *          attributes it knows. Type-level verification is left to the
+ *          JVM. On failure reader->error says what is wrong.
+ */
+bool jsc_class_reader_validate(jsc_class_reader* reader)
+{
+  uint16_t bootstrap_count;
+
+  if (!jsc_reader_validate_bootstrap(reader, &bootstrap_count))
+  {
+    return false;
+  }
+
+  for (uint16_t i = 1; i < reader->constant_pool_count; i++)
+  {
+    if (jsc_class_reader_tag(reader, i) &&
+        !jsc_reader_validate_constant(reader, i, bootstrap_count))
+    {
+      return false;
+    }
+  }
+
+  if (!jsc_reader_is(reader, reader->this_class, JSC_CP_CLASS) ||
+      (reader->super_class != 0 &&
+       !jsc_reader_is(reader, reader->super_class, JSC_CP_CLASS)))
+  {
+    return jsc_reader_fail(reader, "bad this or super class");
+  }
+
+  for (uint16_t i = 0; i < reader->interface_count; i++)
+  {
+    uint16_t index = jsc_read_u16(reader->data + reader->interfaces + 2 * i);
+
+    if (!jsc_reader_is(reader, index, JSC_CP_CLASS))
+    {
+      return jsc_reader_fail(reader, "bad interface");
+    }
+  }
+
+  for (uint32_t i = 0; i < (uint32_t)reader->field_count +
+                               reader->method_count;
+       i++)
+  {
+    jsc_class_member_view member;
+    bool is_method = i >= reader->field_count;
+
+    jsc_reader_member(reader,
+                      is_method ? reader->methods[i - reader->field_count]
+                                : reader->fields[i],
+                      &member);
+
+    if (!jsc_reader_is(reader, member.name_index, JSC_CP_UTF8) ||
+        !jsc_reader_is(reader, member.descriptor_index, JSC_CP_UTF8))
+    {
+      return jsc_reader_fail(reader, "bad member name or descriptor");
+    }
+
+    if (!jsc_reader_validate_attributes(reader, member.attributes,
+                                        member.attribute_count))
+    {
+      return false;
+    }
+
+    if (!is_method)
+    {
+      continue;
+    }
+
+    jsc_class_attribute_view code;
+    bool has_code = jsc_class_reader_find_attribute(
+        reader, member.attributes, member.attribute_count, "Code", &code);
+    bool needs_code =
+        !(member.access_flags & (JSC_ACC_ABSTRACT | JSC_ACC_NATIVE));
+
+    if (has_code != needs_code)
+    {
+      return jsc_reader_fail(reader, has_code ? "unexpected Code attribute"
+                                              : "missing Code attribute");
+    }
+
+    if (has_code && !jsc_reader_validate_code(reader, &code))
+    {
+      return false;
+    }
+  }
+
+  return jsc_reader_validate_attributes(reader, reader->attributes,
+                                        reader->attribute_count);
+}
+
+/* mnemonics by opcode, NULL for the unassigned ones */
+static const char* const jsc_jvm_opcode_names[1 << 8] = {
+    /* 0x00 */ "nop", "aconst_null", "iconst_m1", "iconst_0",
+    /* 0x04 */ "iconst_1", "iconst_2", "iconst_3", "iconst_4",
+    /* 0x08 */ "iconst_5", "lconst_0", "lconst_1", "fconst_0",
+    /* 0x0c */ "fconst_1", "fconst_2", "dconst_0", "dconst_1",
+    /* 0x10 */ "bipush", "sipush", "ldc", "ldc_w",
+    /* 0x14 */ "ldc2_w", "iload", "lload", "fload",
+    /* 0x18 */ "dload", "aload", "iload_0", "iload_1",
+    /* 0x1c */ "iload_2", "iload_3", "lload_0", "lload_1",
+    /* 0x20 */ "lload_2", "lload_3", "fload_0", "fload_1",
+    /* 0x24 */ "fload_2", "fload_3", "dload_0", "dload_1",
+    /* 0x28 */ "dload_2", "dload_3", "aload_0", "aload_1",
+    /* 0x2c */ "aload_2", "aload_3", "iaload", "laload",
+    /* 0x30 */ "faload", "daload", "aaload", "baload",
+    /* 0x34 */ "caload", "saload", "istore", "lstore",
+    /* 0x38 */ "fstore", "dstore", "astore", "istore_0",
+    /* 0x3c */ "istore_1", "istore_2", "istore_3", "lstore_0",
+    /* 0x40 */ "lstore_1", "lstore_2", "lstore_3", "fstore_0",
+    /* 0x44 */ "fstore_1", "fstore_2", "fstore_3", "dstore_0",
+    /* 0x48 */ "dstore_1", "dstore_2", "dstore_3", "astore_0",
+    /* 0x4c */ "astore_1", "astore_2", "astore_3", "iastore",
+    /* 0x50 */ "lastore", "fastore", "dastore", "aastore",
+    /* 0x54 */ "bastore", "castore", "sastore", "pop",
+    /* 0x58 */ "pop2", "dup", "dup_x1", "dup_x2",
+    /* 0x5c */ "dup2", "dup2_x1", "dup2_x2", "swap",
+    /* 0x60 */ "iadd", "ladd", "fadd", "dadd",
+    /* 0x64 */ "isub", "lsub", "fsub", "dsub",
+    /* 0x68 */ "imul", "lmul", "fmul", "dmul",
+    /* 0x6c */ "idiv", "ldiv", "fdiv", "ddiv",
+    /* 0x70 */ "irem", "lrem", "frem", "drem",
+    /* 0x74 */ "ineg", "lneg", "fneg", "dneg",
+    /* 0x78 */ "ishl", "lshl", "ishr", "lshr",
+    /* 0x7c */ "iushr", "lushr", "iand", "land",
+    /* 0x80 */ "ior", "lor", "ixor", "lxor",
+    /* 0x84 */ "iinc", "i2l", "i2f", "i2d",
+    /* 0x88 */ "l2i", "l2f", "l2d", "f2i",
+    /* 0x8c */ "f2l", "f2d", "d2i", "d2l",
+    /* 0x90 */ "d2f", "i2b", "i2c", "i2s",
+    /* 0x94 */ "lcmp", "fcmpl", "fcmpg", "dcmpl",
+    /* 0x98 */ "dcmpg", "ifeq", "ifne", "iflt",
+    /* 0x9c */ "ifge", "ifgt", "ifle", "if_icmpeq",
+    /* 0xa0 */ "if_icmpne", "if_icmplt", "if_icmpge", "if_icmpgt",
+    /* 0xa4 */ "if_icmple", "if_acmpeq", "if_acmpne", "goto",
+    /* 0xa8 */ "jsr", "ret", "tableswitch", "lookupswitch",
+    /* 0xac */ "ireturn", "lreturn", "freturn", "dreturn",
+    /* 0xb0 */ "areturn", "return", "getstatic", "putstatic",
+    /* 0xb4 */ "getfield", "putfield", "invokevirtual", "invokespecial",
+    /* 0xb8 */ "invokestatic", "invokeinterface", "invokedynamic", "new",
+    /* 0xbc */ "newarray", "anewarray", "arraylength", "athrow",
+    /* 0xc0 */ "checkcast", "instanceof", "monitorenter", "monitorexit",
+    /* 0xc4 */ "wide", "multianewarray", "ifnull", "ifnonnull",
+    /* 0xc8 */ "goto_w", "jsr_w", NULL, NULL,
+    /* 0xcc */ NULL, NULL, NULL, NULL,
+    /* 0xd0 */ NULL, NULL, NULL, NULL,
+    /* 0xd4 */ NULL, NULL, NULL, NULL,
+    /* 0xd8 */ NULL, NULL, NULL, NULL,
+    /* 0xdc */ NULL, NULL, NULL, NULL,
+    /* 0xe0 */ NULL, NULL, NULL, NULL,
+    /* 0xe4 */ NULL, NULL, NULL, NULL,
+    /* 0xe8 */ NULL, NULL, NULL, NULL,
+    /* 0xec */ NULL, NULL, NULL, NULL,
+    /* 0xf0 */ NULL, NULL, NULL, NULL,
+    /* 0xf4 */ NULL, NULL, NULL, NULL,
+    /* 0xf8 */ NULL, NULL, NULL, NULL,
+    /* 0xfc */ NULL, NULL, NULL, NULL};
+
+/**
+ * @brief mnemonic of opcode, or NULL if no instruction has it
+ */
+const char* jsc_bytecode_opcode_name(uint8_t opcode)
+{
+  return jsc_jvm_opcode_names[opcode];
+}
+
+static void jsc_disasm_utf8(const jsc_class_reader* reader, uint16_t index,
+                            FILE* out)
+{
+  uint16_t length;
+  const char* bytes = jsc_class_reader_utf8(reader, index, &length);
+
+  if (bytes)
+  {
+    fwrite(bytes, 1, length, out);
+  }
+  else
+  {
+    fprintf(out, "<invalid #%u>", index);
+  }
+}
+
+/* the utf8 behind a constant that names one, such as a Class */
+static void jsc_disasm_named(const jsc_class_reader* reader, uint16_t index,
+                             uint8_t tag, FILE* out)
+{
+  const uint8_t* info = jsc_class_reader_constant(reader, index);
+
+  if (info && info[-1] == tag)
+  {
+    jsc_disasm_utf8(reader, jsc_read_u16(info), out);
+  }
+  else
+  {
+    fprintf(out, "<invalid #%u>", index);
+  }
+}
+
+static void jsc_disasm_name_and_type(const jsc_class_reader* reader,
+                                     uint16_t index, FILE* out)
+{
+  const uint8_t* info = jsc_class_reader_constant(reader, index);
+
+  if (!info || info[-1] != JSC_CP_NAME_AND_TYPE)
+  {
+    fprintf(out, "<invalid #%u>", index);
+    return;
+  }
+
+  jsc_disasm_utf8(reader, jsc_read_u16(info), out);
+  fputc(':', out);
+  jsc_disasm_utf8(reader, jsc_read_u16(info + 2), out);
+}
+
+static void jsc_disasm_string(const jsc_class_reader* reader, uint16_t index,
+                              FILE* out)
+{
+  uint16_t length;
+  const char* bytes = jsc_class_reader_utf8(reader, index, &length);
+
+  if (!bytes)
+  {
+    fprintf(out, "<invalid #%u>", index);
+    return;
+  }
+
+  fputc('"', out);
+
+  for (uint16_t i = 0; i < length; i++)
+  {
+    uint8_t c = (uint8_t)bytes[i];
+
+    if (c == '"' || c == '\\')
+    {
+      fprintf(out, "\\%c", c);
+    }
+    else if (c < 0x20 || c == 0x7f)
+    {
+      fprintf(out, "\\x%02x", c);
+    }
+    else
+    {
+      fputc(c, out);
+    }
+  }
+
+  fputc('"', out);
+}
+
+/* a constant as javap would comment it */
+static void jsc_disasm_constant(const jsc_class_reader* reader,
+                                uint16_t index, FILE* out)
+{
+  const uint8_t* info = jsc_class_reader_constant(reader, index);
+
+  if (!info)
+  {
+    fprintf(out, "<invalid #%u>", index);
+    return;
+  }
+
+  switch (info[-1])
+  {
+  case JSC_CP_UTF8:
+    fprintf(out, "Utf8 ");
+    jsc_disasm_string(reader, index, out);
+    break;
+  case JSC_CP_INTEGER:
+    fprintf(out, "int %d", jsc_read_s32(info));
+    break;
+  case JSC_CP_FLOAT:
+  {
+    uint32_t bits = jsc_read_u32(info);
+    float value;
+    memcpy(&value, &bits, 4);
+    fprintf(out, "float %.9gf", value);
+    break;
+  }
+  case JSC_CP_LONG:
+    fprintf(out, "long %lldl",
+            (long long)(((uint64_t)jsc_read_u32(info) << 32) |
+                        jsc_read_u32(info + 4)));
+    break;
+  case JSC_CP_DOUBLE:
+  {
+    uint64_t bits =
+        ((uint64_t)jsc_read_u32(info) << 32) | jsc_read_u32(info + 4);
+    double value;
+    memcpy(&value, &bits, 8);
+    fprintf(out, "double %.17gd", value);
+    break;
+  }
+  case JSC_CP_CLASS:
+    fprintf(out, "class ");
+    jsc_disasm_utf8(reader, jsc_read_u16(info), out);
+    break;
+  case JSC_CP_STRING:
+    fprintf(out, "String ");
+    jsc_disasm_string(reader, jsc_read_u16(info), out);
+    break;
+  case JSC_CP_FIELDREF:
+  case JSC_CP_METHODREF:
+  case JSC_CP_INTERFACE_METHODREF:
+    fprintf(out, "%s ",
+            info[-1] == JSC_CP_FIELDREF
+                ? "Field"
+                : (info[-1] == JSC_CP_METHODREF ? "Method"
+                                                : "InterfaceMethod"));
+    jsc_disasm_named(reader, jsc_read_u16(info), JSC_CP_CLASS, out);
+    fputc('.', out);
+    jsc_disasm_name_and_type(reader, jsc_read_u16(info + 2), out);
+    break;
+  case JSC_CP_NAME_AND_TYPE:
+    fprintf(out, "NameAndType ");
+    jsc_disasm_name_and_type(reader, index, out);
+    break;
+  case JSC_CP_METHOD_HANDLE:
+    fprintf(out, "MethodHandle %u:", info[0]);
+    jsc_disasm_constant(reader, jsc_read_u16(info + 1), out);
+    break;
+  case JSC_CP_METHOD_TYPE:
+    fprintf(out, "MethodType ");
+    jsc_disasm_utf8(reader, jsc_read_u16(info), out);
+    break;
+  case JSC_CP_DYNAMIC:
+  case JSC_CP_INVOKE_DYNAMIC:
+    fprintf(out, "%s #%u:",
+            info[-1] == JSC_CP_DYNAMIC ? "Dynamic" : "InvokeDynamic",
+            jsc_read_u16(info));
+    jsc_disasm_name_and_type(reader, jsc_read_u16(info + 2), out);
+    break;
+  default:
+    fprintf(out, "<tag %u>", info[-1]);
+    break;
+  }
+}
+
+/* the operands of the instruction at pc, which is length bytes long */
+static void jsc_disasm_operands(const jsc_class_reader* reader,
+                                const uint8_t* code, uint32_t pc,
+                                uint32_t length, FILE* out)
+{
+  static const char* const array_types[] = {
+      "boolean", "char", "float", "double", "byte", "short", "int", "long"};
+  uint8_t opcode = code[pc];
+  const uint8_t* operands = code + pc + 1;
+
+  switch (opcode)
+  {
+  case JSC_JVM_BIPUSH:
+    fprintf(out, " %d", (int8_t)operands[0]);
+    return;
+  case JSC_JVM_SIPUSH:
+    fprintf(out, " %d", (int16_t)jsc_read_u16(operands));
+    return;
+  case JSC_JVM_NEWARRAY:
+    if (operands[0] >= 4 && operands[0] <= 11)
+    {
+      fprintf(out, " %s", array_types[operands[0] - 4]);
+    }
+    else
+    {
+      fprintf(out, " <type %u>", operands[0]);
+    }
+    return;
+  case JSC_JVM_IINC:
+    fprintf(out, " %u, %d", operands[0], (int8_t)operands[1]);
+    return;
+  case JSC_JVM_LDC:
+    fprintf(out, " #%u // ", operands[0]);
+    jsc_disasm_constant(reader, operands[0], out);
+    return;
+  case JSC_JVM_INVOKEINTERFACE:
+    fprintf(out, " #%u, %u // ", jsc_read_u16(operands), operands[2]);
+    jsc_disasm_constant(reader, jsc_read_u16(operands), out);
+    return;
+  case JSC_JVM_MULTIANEWARRAY:
+    fprintf(out, " #%u, %u // ", jsc_read_u16(operands), operands[2]);
+    jsc_disasm_constant(reader, jsc_read_u16(operands), out);
+    return;
+  case JSC_JVM_GOTO_W:
+  case JSC_JVM_JSR_W:
+    fprintf(out, " %lld", (long long)pc + jsc_read_s32(operands));
+    return;
+  case JSC_JVM_WIDE:
+    fprintf(out, " %s %u", jsc_jvm_opcode_names[operands[0]]
+                               ? jsc_jvm_opcode_names[operands[0]]
+                               : "?",
+            jsc_read_u16(operands + 1));
+
+    if (operands[0] == JSC_JVM_IINC)
+    {
+      fprintf(out, ", %d", (int16_t)jsc_read_u16(operands + 3));
+    }
+    return;
+  case JSC_JVM_TABLESWITCH:
+  case JSC_JVM_LOOKUPSWITCH:
+  {
+    uint32_t base = (pc + 4) & ~3u;
+    bool table = opcode == JSC_JVM_TABLESWITCH;
+    int32_t low = table ? jsc_read_s32(code + base + 4) : 0;
+    int64_t count = table ? (int64_t)jsc_read_s32(code + base + 8) - low + 1
+                          : jsc_read_s32(code + base + 4);
+
+    fprintf(out, " { // %lld", (long long)count);
+
+    for (int64_t k = 0; k < count; k++)
+    {
+      const uint8_t* entry = code + base + 12 + k * (table ? 4 : 8);
+      int32_t match = table ? (int32_t)(low + k) : jsc_read_s32(entry - 4);
+
+      fprintf(out, "\n    %11d: %lld", match,
+              (long long)pc + jsc_read_s32(entry));
+    }
+
+    fprintf(out, "\n        default: %lld\n    }",
+            (long long)pc + jsc_read_s32(code + base));
+    return;
+  }
+  default:
+    break;
+  }
+
+  if (jsc_code_is_branch(opcode) || opcode == JSC_JVM_JSR)
+  {
+    fprintf(out, " %lld", (long long)pc + (int16_t)jsc_read_u16(operands));
+  }
+  else if (length == 3 || length == 5) /* 5: invokedynamic */
+  {
+    fprintf(out, " #%u // ", jsc_read_u16(operands));
+    jsc_disasm_constant(reader, jsc_read_u16(operands), out);
+  }
+  else if (length == 2) /* a local variable index */
+  {
+    fprintf(out, " %u", operands[0]);
+  }
+}
+
+typedef struct
+{
+  uint8_t opcode;
+  uint32_t count;
+} jsc_disasm_bucket;
+
+static int jsc_disasm_bucket_compare(const void* a, const void* b)
+{
+  const jsc_disasm_bucket* x = (const jsc_disasm_bucket*)a;
+  const jsc_disasm_bucket* y = (const jsc_disasm_bucket*)b;
+
+  if (x->count != y->count)
+  {
+    return x->count > y->count ? -1 : 1;
+  }
+
+  return (int)x->opcode - (int)y->opcode;
+}
+
+/* opcode counts, most frequent first */
+static void jsc_disasm_histogram(const uint32_t* counts, const char* title,
+                                 FILE* out)
+{
+  jsc_disasm_bucket buckets[1 << 8];
+  uint32_t used = 0;
+  uint64_t total = 0;
+
+  for (uint32_t opcode = 0; opcode < (1 << 8); opcode++)
+  {
+    if (counts[opcode] > 0)
+    {
+      buckets[used].opcode = (uint8_t)opcode;
+      buckets[used++].count = counts[opcode];
+      total += counts[opcode];
+    }
+  }
+
+  qsort(buckets, used, sizeof(jsc_disasm_bucket), jsc_disasm_bucket_compare);
+  fprintf(out, "%s (%llu instructions):\n", title, (unsigned long long)total);
+
+  for (uint32_t i = 0; i < used; i++)
+  {
+    const char* name = jsc_jvm_opcode_names[buckets[i].opcode];
+
+    fprintf(out, "    %-16s %8u %6.2f%%\n", name ? name : "?",
+            buckets[i].count, 100.0 * buckets[i].count / (double)total);
+  }
+}
+
+/* one method; adds its opcodes to class_counts */
+static void jsc_disasm_method(const jsc_class_reader* reader,
+                              const jsc_class_member_view* method,
+                              uint32_t options, uint32_t* class_counts,
+                              uint64_t* class_code_size, FILE* out)
+{
+  jsc_class_attribute_view attribute;
+
+  fprintf(out, "\nmethod ");
+  jsc_disasm_utf8(reader, method->name_index, out);
+  fputc(' ', out);
+  jsc_disasm_utf8(reader, method->descriptor_index, out);
+  fprintf(out, " flags 0x%04x\n", method->access_flags);
+
+  if (!jsc_class_reader_find_attribute(reader, method->attributes,
+                                       method->attribute_count, "Code",
+                                       &attribute))
+  {
+    fprintf(out, "  no code\n");
+    return;
+  }
+
+  const uint8_t* info = attribute.info;
+  uint32_t code_length = attribute.length >= 8 ? jsc_read_u32(info + 4) : 0;
+
+  if (attribute.length < 12 || code_length > attribute.length - 12)
+  {
+    fprintf(out, "  <malformed Code attribute>\n");
+    return;
+  }
+
+  const uint8_t* code = info + 8;
+  uint32_t counts[1 << 8] = {0};
+
+  fprintf(out, "  code %u bytes, max_stack %u, max_locals %u\n", code_length,
+          jsc_read_u16(info), jsc_read_u16(info + 2));
+  *class_code_size += code_length;
+
+  for (uint32_t pc = 0; pc < code_length;)
+  {
+    uint32_t length = jsc_bytecode_instruction_length(code, pc, code_length);
+    const char* name = jsc_jvm_opcode_names[code[pc]];
+
+    if (length == 0)
+    {
+      fprintf(out, "  %5u: <malformed 0x%02x>\n", pc, code[pc]);
+      break;
+    }
+
+    counts[code[pc]]++;
+    class_counts[code[pc]]++;
+
+    if (options & JSC_DISASSEMBLE_CODE)
+    {
+      fprintf(out, "  %5u: %s", pc, name);
+      jsc_disasm_operands(reader, code, pc, length, out);
+      fputc('\n', out);
+    }
+
+    pc += length;
+  }
+
+  uint32_t pos = 8 + code_length;
+  uint16_t exception_table_length = jsc_read_u16(info + pos);
+
+  for (uint16_t i = 0; (options & JSC_DISASSEMBLE_CODE) &&
+                       i < exception_table_length &&
+                       pos + 2 + 8 * (i + 1) <= attribute.length;
+       i++)
+  {
+    const uint8_t* entry = info + pos + 2 + 8 * i;
+    uint16_t catch_type = jsc_read_u16(entry + 6);
+
+    fprintf(out, "  try %u-%u handler %u catch ", jsc_read_u16(entry),
+            jsc_read_u16(entry + 2), jsc_read_u16(entry + 4));
+
+    if (catch_type == 0)
+    {
+      fprintf(out, "any\n");
+    }
+    else
+    {
+      jsc_disasm_named(reader, catch_type, JSC_CP_CLASS, out);
+      fputc('\n', out);
+    }
+  }
+
+  if (options & JSC_DISASSEMBLE_HISTOGRAM)
+  {
+    jsc_disasm_histogram(counts, "  histogram", out);
+  }
+}
+
+/**
+ * @brief print the class file in data in a form meant for diffing
+ *
+ * @details Every method is listed with its code size, max_stack and
+ *          max_locals; JSC_DISASSEMBLE_CODE adds its instructions with
+ *          constant pool operands resolved, and JSC_DISASSEMBLE_HISTOGRAM
+ *          opcode counts per method and for the class. A class that fails
+ *          jsc_class_reader_validate is still printed, after a note saying
+ *          why. Returns false only if data is not laid out as a class file.
+ */
+bool jsc_bytecode_disassemble(const uint8_t* data, uint32_t size, FILE* out,
+                              uint32_t options)
+{
+  jsc_class_reader reader;
+
+  if (!jsc_class_reader_init(&reader, data, size))
+  {
+    fprintf(out, "// not a readable class file: %s\n", reader.error);
+    jsc_class_reader_free(&reader);
+    return false;
+  }
+
+  fprintf(out, "class ");
+  jsc_disasm_named(&reader, reader.this_class, JSC_CP_CLASS, out);
+
+  if (reader.super_class != 0)
+  {
+    fprintf(out, " extends ");
+    jsc_disasm_named(&reader, reader.super_class, JSC_CP_CLASS, out);
+  }
+
+  fprintf(out, "\n  version %u.%u, flags 0x%04x, %u bytes, %u constants\n",
+          reader.major_version, reader.minor_version, reader.access_flags,
+          size, reader.constant_pool_count);
+
+  if (!jsc_class_reader_validate(&reader))
+  {
+    fprintf(out, "  // invalid: %s\n", reader.error);
+  }
+
+  for (uint16_t i = 0; i < reader.field_count; i++)
+  {
+    jsc_class_member_view field;
+    jsc_class_reader_field(&reader, i, &field);
+
+    fprintf(out, "field ");
+    jsc_disasm_utf8(&reader, field.name_index, out);
+    fputc(' ', out);
+    jsc_disasm_utf8(&reader, field.descriptor_index, out);
+    fprintf(out, " flags 0x%04x\n", field.access_flags);
+  }
+
+  uint32_t counts[1 << 8] = {0};
+  uint64_t code_size = 0;
+
+  for (uint16_t i = 0; i < reader.method_count; i++)
+  {
+    jsc_class_member_view method;
+    jsc_class_reader_method(&reader, i, &method);
+    jsc_disasm_method(&reader, &method, options, counts, &code_size, out);
+  }
+
+  fprintf(out, "\n%u methods, %llu bytes of code\n", reader.method_count,
+          (unsigned long long)code_size);
+
+  if (options & JSC_DISASSEMBLE_HISTOGRAM)
+  {
+    jsc_disasm_histogram(counts, "class histogram", out);
+  }
+
+  jsc_class_reader_free(&reader);
+  return true;
+}
@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdio.h>
 
 #define JSC_CP_UTF8 1
 #define JSC_CP_INTEGER 3
@@ -18,7 +19,35 @@
 #define JSC_CP_NAME_AND_TYPE 12
 #define JSC_CP_METHOD_HANDLE 15
 #define JSC_CP_METHOD_TYPE 16
+#define JSC_CP_DYNAMIC 17
 #define JSC_CP_INVOKE_DYNAMIC 18
+#define JSC_CP_MODULE 19
+#define JSC_CP_PACKAGE 20
+
+/* what jsc_bytecode_disassemble prints besides method sizes */
+#define JSC_DISASSEMBLE_CODE (1 << 0)
+#define JSC_DISASSEMBLE_HISTOGRAM (1 << 1)
+
+#define JSC_REF_GET_FIELD 1
+#define JSC_REF_GET_STATIC 2
+#define JSC_REF_PUT_FIELD 3
+#define JSC_REF_PUT_STATIC 4
+#define JSC_REF_INVOKE_VIRTUAL 5
+#define JSC_REF_INVOKE_STATIC 6
+#define JSC_REF_INVOKE_SPECIAL 7
+#define JSC_REF_NEW_INVOKE_SPECIAL 8
+#define JSC_REF_INVOKE_INTERFACE 9
+
+/* verification_type_info tags of StackMapTable frames */
+#define JSC_ITEM_TOP 0
+#define JSC_ITEM_INTEGER 1
+#define JSC_ITEM_FLOAT 2
+#define JSC_ITEM_DOUBLE 3
+#define JSC_ITEM_LONG 4
+#define JSC_ITEM_NULL 5
+#define JSC_ITEM_UNINITIALIZED_THIS 6
+#define JSC_ITEM_OBJECT 7
+#define JSC_ITEM_UNINITIALIZED 8
 
 #define JSC_ACC_PUBLIC 0x0001
 #define JSC_ACC_PRIVATE 0x0002
@@ -49,6 +78,14 @@ typedef struct jsc_method jsc_method;
 typedef struct jsc_field jsc_field;
 typedef struct jsc_attribute jsc_attribute;
 typedef struct jsc_exception_table_entry jsc_exception_table_entry;
+typedef struct jsc_bootstrap_method jsc_bootstrap_method;
+typedef struct jsc_label jsc_label;
+typedef struct jsc_branch_fixup jsc_branch_fixup;
+typedef struct jsc_class_segment jsc_class_segment;
+typedef struct jsc_class_writer jsc_class_writer;
+typedef struct jsc_class_reader jsc_class_reader;
+typedef struct jsc_class_member_view jsc_class_member_view;
+typedef struct jsc_class_attribute_view jsc_class_attribute_view;
 
 typedef enum
 {
@@ -287,6 +324,107 @@ struct jsc_bytecode_context
 
   uint16_t major_version;
   uint16_t minor_version;
+
+  bool wide_constant_loads; /* always ldc_w, so constants can be re-indexed */
+
+  jsc_bootstrap_method* bootstrap_methods; /* the BootstrapMethods table */
+  uint16_t bootstrap_method_count;
+
+  jsc_label* labels; /* targets of jsc_bytecode_emit_branch */
+  uint32_t label_count;
+  jsc_branch_fixup* branch_fixups; /* branches awaiting their labels */
+  uint32_t branch_fixup_count;
+};
+
+struct jsc_label
+{
+  uint16_t method;
+  int64_t offset; /* -1 until placed */
+};
+
+struct jsc_branch_fixup
+{
+  uint16_t method;
+  uint32_t pc;
+  uint32_t label;
+  uint32_t slot; /* a switch's 4-byte offset at pc + slot, or 0 */
+};
+
+/* a run of the class file: bytes of the class itself, or of the scratch
+   area when data is NULL */
+struct jsc_class_segment
+{
+  const uint8_t* data;
+  uint32_t offset;
+  uint32_t length;
+};
+
+/* a class file serialized as segments, ready to be gathered or written */
+struct jsc_class_writer
+{
+  jsc_class_segment* segments;
+  uint32_t segment_count;
+  uint32_t segment_capacity;
+  uint8_t* scratch; /* small fields, in file order */
+  uint32_t scratch_size;
+  uint32_t scratch_capacity;
+  uint32_t size; /* exact size of the class file */
+  bool failed;
+};
+
+/* a read-only view of a class file: nothing is copied, and constants,
+   members and attributes are decoded from the bytes when asked for */
+struct jsc_class_reader
+{
+  const uint8_t* data;
+  uint32_t size;
+
+  uint16_t minor_version;
+  uint16_t major_version;
+
+  uint16_t constant_pool_count;
+  uint32_t* constants; /* offset of each tag, 0 for the slot after a long */
+
+  uint16_t access_flags;
+  uint16_t this_class;
+  uint16_t super_class;
+
+  uint16_t interface_count;
+  uint32_t interfaces; /* offset of the first interface index */
+
+  uint16_t field_count;
+  uint32_t* fields; /* offset of each field_info */
+
+  uint16_t method_count;
+  uint32_t* methods; /* offset of each method_info */
+
+  uint16_t attribute_count;
+  uint32_t attributes; /* offset of the first class attribute */
+
+  const char* error; /* why reading or validation failed */
+};
+
+struct jsc_class_member_view
+{
+  uint16_t access_flags;
+  uint16_t name_index;
+  uint16_t descriptor_index;
+  uint16_t attribute_count;
+  uint32_t attributes; /* offset of the first attribute */
+};
+
+struct jsc_class_attribute_view
+{
+  uint16_t name_index;
+  uint32_t length;
+  const uint8_t* info; /* points into the class file */
+};
+
+struct jsc_bootstrap_method
+{
+  uint16_t method_handle_index;
+  uint16_t* arguments; /* loadable constant pool entries */
+  uint16_t argument_count;
 };
 
 struct jsc_constant_pool_entry
@@ -451,6 +589,21 @@ uint16_t jsc_bytecode_add_method_reference(jsc_bytecode_context* state,
 uint16_t jsc_bytecode_add_interface_method_reference(
     jsc_bytecode_context* state, const char* interface_name,
     const char* method_name, const char* method_descriptor);
+uint16_t jsc_bytecode_add_method_handle(jsc_bytecode_context* state,
+                                       uint8_t reference_kind,
+                                       const char* class_name,
+                                       const char* name,
+                                       const char* descriptor);
+uint16_t jsc_bytecode_add_method_type(jsc_bytecode_context* state,
+                                     const char* descriptor);
+int32_t jsc_bytecode_add_bootstrap_method(jsc_bytecode_context* state,
+                                          uint16_t method_handle_index,
+                                          const uint16_t* arguments,
+                                          uint16_t argument_count);
+uint16_t jsc_bytecode_add_invoke_dynamic(jsc_bytecode_context* state,
+                                         uint16_t bootstrap_index,
+                                         const char* name,
+                                         const char* descriptor);
 
 jsc_method* jsc_bytecode_add_method(jsc_bytecode_context* state,
                                     const char* name, const char* descriptor,
@@ -482,11 +635,76 @@ void jsc_bytecode_add_exception_table_entry(jsc_bytecode_context* state,
 void jsc_bytecode_add_stackmap_frame(jsc_bytecode_context* state,
                                      jsc_attribute* code_attr,
                                      uint16_t byte_offset, uint8_t frame_type);
+bool jsc_bytecode_compute_maxs(jsc_bytecode_context* state,
+                               jsc_method* method);
+bool jsc_bytecode_compute_stack_map(jsc_bytecode_context* state,
+                                    jsc_method* method);
+bool jsc_bytecode_optimize_method(jsc_bytecode_context* state,
+                                  jsc_method* method);
+
+int32_t jsc_bytecode_new_label(jsc_bytecode_context* state);
+void jsc_bytecode_place_label(jsc_bytecode_context* state, jsc_method* method,
+                              int32_t label);
+void jsc_bytecode_emit_branch(jsc_bytecode_context* state, jsc_method* method,
+                              uint8_t opcode, int32_t label);
+void jsc_bytecode_emit_switch(jsc_bytecode_context* state, jsc_method* method,
+                              const int32_t* keys, const int32_t* labels,
+                              uint32_t count, int32_t default_label);
+bool jsc_bytecode_resolve_branches(jsc_bytecode_context* state,
+                                   jsc_method* method);
+
+uint32_t jsc_bytecode_instruction_length(const uint8_t* code, uint32_t pc,
+                                         uint32_t code_length);
+uint16_t jsc_bytecode_import_constant(jsc_bytecode_context* state,
+                                      const jsc_bytecode_context* source,
+                                      uint16_t index);
+jsc_method* jsc_bytecode_import_method(jsc_bytecode_context* state,
+                                       const jsc_bytecode_context* source,
+                                       const jsc_method* method);
+
+void jsc_class_writer_init(jsc_class_writer* writer);
+void jsc_class_writer_free(jsc_class_writer* writer);
+bool jsc_bytecode_serialize(jsc_bytecode_context* state,
+                            jsc_class_writer* writer);
+void jsc_class_writer_gather(const jsc_class_writer* writer, uint8_t* out);
+bool jsc_class_writer_writev(const jsc_class_writer* writer, int fd);
+bool jsc_class_writer_write_file(const jsc_class_writer* writer,
+                                 const char* filename);
 
 uint32_t jsc_bytecode_write(jsc_bytecode_context* state, uint8_t** out_buffer);
+uint32_t jsc_bytecode_write_buffer(jsc_bytecode_context* state,
+                                   jsc_class_writer* writer, uint8_t** buffer,
+                                   uint32_t* capacity);
 bool jsc_bytecode_write_to_file(jsc_bytecode_context* state,
                                 const char* filename);
 
+bool jsc_class_reader_init(jsc_class_reader* reader, const uint8_t* data,
+                           uint32_t size);
+void jsc_class_reader_free(jsc_class_reader* reader);
+uint8_t jsc_class_reader_tag(const jsc_class_reader* reader, uint16_t index);
+const uint8_t* jsc_class_reader_constant(const jsc_class_reader* reader,
+                                         uint16_t index);
+const char* jsc_class_reader_utf8(const jsc_class_reader* reader,
+                                  uint16_t index, uint16_t* length);
+bool jsc_class_reader_utf8_equals(const jsc_class_reader* reader,
+                                  uint16_t index, const char* str);
+bool jsc_class_reader_field(const jsc_class_reader* reader, uint16_t index,
+                            jsc_class_member_view* field);
+bool jsc_class_reader_method(const jsc_class_reader* reader, uint16_t index,
+                             jsc_class_member_view* method);
+uint32_t jsc_class_reader_attribute(const jsc_class_reader* reader,
+                                    uint32_t offset,
+                                    jsc_class_attribute_view* attribute);
+bool jsc_class_reader_find_attribute(const jsc_class_reader* reader,
+                                     uint32_t offset, uint16_t count,
+                                     const char* name,
+                                     jsc_class_attribute_view* attribute);
+bool jsc_class_reader_validate(jsc_class_reader* reader);
+
+const char* jsc_bytecode_opcode_name(uint8_t opcode);
+bool jsc_bytecode_disassemble(const uint8_t* data, uint32_t size, FILE* out,
+                              uint32_t options);
+
 jsc_bytecode_context* jsc_bytecode_create_class(const char* class_name,
                                                 const char* super_class_name,
                                                 uint16_t access_flags);
@@ -506,6 +724,8 @@ void jsc_bytecode_emit_jump(jsc_bytecode_context* state, jsc_method* method,
 void jsc_bytecode_emit_local_var(jsc_bytecode_context* state,
                                  jsc_method* method, uint8_t opcode,
                                  uint16_t index);
+void jsc_bytecode_emit_iinc(jsc_bytecode_context* state, jsc_method* method,
+                            uint16_t index, int16_t increment);
 void jsc_bytecode_emit_const_load(jsc_bytecode_context* state,
                                   jsc_method* method, uint16_t index);
 void jsc_bytecode_emit_invoke_virtual(jsc_bytecode_context* state,
@@ -527,6 +747,10 @@ void jsc_bytecode_emit_invoke_interface(jsc_bytecode_context* state,
                                         const char* interface_name,
                                         const char* method_name,
                                         const char* descriptor, uint8_t count);
+void jsc_bytecode_emit_invokedynamic(jsc_bytecode_context* state,
+                                     jsc_method* method,
+                                     uint16_t bootstrap_index, const char* name,
+                                     const char* descriptor);
 void jsc_bytecode_emit_field_access(jsc_bytecode_context* state,
                                     jsc_method* method, uint8_t opcode,
                                     const char* class_name,
@@ -545,6 +769,11 @@ void jsc_bytecode_emit_return(jsc_bytecode_context* state, jsc_method* method,
 uint32_t jsc_bytecode_get_method_code_length(jsc_method* method);
 uint8_t* jsc_bytecode_get_method_code(jsc_method* method);
 uint32_t jsc_bytecode_get_method_code_offset(jsc_method* method);
+void jsc_bytecode_truncate_method_code(jsc_bytecode_context* state,
+                                       jsc_method* method, uint32_t length);
+bool jsc_bytecode_replace_method_code(jsc_bytecode_context* state,
+                                      jsc_method* method, const uint8_t* code,
+                                      uint32_t length);
 
 void jsc_bytecode_emit_constructor(jsc_bytecode_context* state,
                                    jsc_method* method, const char* super_class);
@@ -571,6 +800,9 @@ void jsc_bytecode_emit_load_constant_string(jsc_bytecode_context* state,
 void jsc_bytecode_emit_load_constant_int_boxed(jsc_bytecode_context* state,
                                                jsc_method* method,
                                                int32_t value);
+void jsc_bytecode_emit_load_constant_boolean_boxed(jsc_bytecode_context* state,
+                                                   jsc_method* method,
+                                                   bool value);
 void jsc_bytecode_emit_load_constant_long_boxed(jsc_bytecode_context* state,
                                                 jsc_method* method,
                                                 int64_t value);
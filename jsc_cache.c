@@ -0,0 +1,1064 @@
+#include "jsc_cache.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <endian.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define PATH_SEPARATOR "/"
+
+#define JSC_CACHE_INDEX_MAGIC 0x4A534349 /* "JSCI" */
+#define JSC_CACHE_INDEX_HEADER_SIZE 16
+#define JSC_CACHE_INDEX_RECORD_SIZE (JSC_CACHE_KEY_SIZE + 8)
+
+typedef struct
+{
+  uint32_t state[8];
+  uint64_t length;
+  uint8_t block[1 << 6];
+  size_t block_size;
+} jsc_sha256_context;
+
+static const uint32_t jsc_sha256_k[1 << 6] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+#define JSC_ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void jsc_sha256_transform(jsc_sha256_context* ctx, const uint8_t* block)
+{
+  uint32_t w[1 << 6];
+
+  for (int i = 0; i < 16; i++)
+  {
+    uint32_t word;
+    memcpy(&word, block + i * 4, 4);
+    w[i] = be32toh(word);
+  }
+
+  for (int i = 16; i < 64; i++)
+  {
+    uint32_t s0 = JSC_ROTR32(w[i - 15], 7) ^ JSC_ROTR32(w[i - 15], 18) ^
+                  (w[i - 15] >> 3);
+    uint32_t s1 = JSC_ROTR32(w[i - 2], 17) ^ JSC_ROTR32(w[i - 2], 19) ^
+                  (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  uint32_t a = ctx->state[0], b = ctx->state[1], c = ctx->state[2],
+           d = ctx->state[3], e = ctx->state[4], f = ctx->state[5],
+           g = ctx->state[6], h = ctx->state[7];
+
+  for (int i = 0; i < 64; i++)
+  {
+    uint32_t s1 = JSC_ROTR32(e, 6) ^ JSC_ROTR32(e, 11) ^ JSC_ROTR32(e, 25);
+    uint32_t ch = (e & f) ^ (~e & g);
+    uint32_t t1 = h + s1 + ch + jsc_sha256_k[i] + w[i];
+    uint32_t s0 = JSC_ROTR32(a, 2) ^ JSC_ROTR32(a, 13) ^ JSC_ROTR32(a, 22);
+    uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+    uint32_t t2 = s0 + maj;
+
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+
+  ctx->state[0] += a;
+  ctx->state[1] += b;
+  ctx->state[2] += c;
+  ctx->state[3] += d;
+  ctx->state[4] += e;
+  ctx->state[5] += f;
+  ctx->state[6] += g;
+  ctx->state[7] += h;
+}
+
+static void jsc_sha256_init(jsc_sha256_context* ctx)
+{
+  ctx->state[0] = 0x6a09e667;
+  ctx->state[1] = 0xbb67ae85;
+  ctx->state[2] = 0x3c6ef372;
+  ctx->state[3] = 0xa54ff53a;
+  ctx->state[4] = 0x510e527f;
+  ctx->state[5] = 0x9b05688c;
+  ctx->state[6] = 0x1f83d9ab;
+  ctx->state[7] = 0x5be0cd19;
+  ctx->length = 0;
+  ctx->block_size = 0;
+}
+
+static void jsc_sha256_update(jsc_sha256_context* ctx, const void* data,
+                              size_t length)
+{
+  const uint8_t* p = (const uint8_t*)data;
+
+  ctx->length += length;
+
+  if (ctx->block_size > 0)
+  {
+    size_t take = sizeof(ctx->block) - ctx->block_size;
+
+    if (take > length)
+    {
+      take = length;
+    }
+
+    memcpy(ctx->block + ctx->block_size, p, take);
+    ctx->block_size += take;
+    p += take;
+    length -= take;
+
+    if (ctx->block_size < sizeof(ctx->block))
+    {
+      return;
+    }
+
+    jsc_sha256_transform(ctx, ctx->block);
+    ctx->block_size = 0;
+  }
+
+  while (length >= sizeof(ctx->block))
+  {
+    jsc_sha256_transform(ctx, p);
+    p += sizeof(ctx->block);
+    length -= sizeof(ctx->block);
+  }
+
+  memcpy(ctx->block, p, length);
+  ctx->block_size = length;
+}
+
+static void jsc_sha256_final(jsc_sha256_context* ctx,
+                             uint8_t out[JSC_CACHE_KEY_SIZE])
+{
+  uint64_t bit_length = ctx->length * 8;
+
+  ctx->block[ctx->block_size++] = 0x80;
+
+  if (ctx->block_size > 56)
+  {
+    memset(ctx->block + ctx->block_size, 0,
+           sizeof(ctx->block) - ctx->block_size);
+    jsc_sha256_transform(ctx, ctx->block);
+    ctx->block_size = 0;
+  }
+
+  memset(ctx->block + ctx->block_size, 0, 56 - ctx->block_size);
+
+  uint64_t bit_length_be = htobe64(bit_length);
+  memcpy(ctx->block + 56, &bit_length_be, 8);
+  jsc_sha256_transform(ctx, ctx->block);
+
+  for (int i = 0; i < 8; i++)
+  {
+    uint32_t word_be = htobe32(ctx->state[i]);
+    memcpy(out + i * 4, &word_be, 4);
+  }
+}
+
+/**
+ * @brief derive the content address of a compiled script
+ *
+ * @details The key covers the cache format version, the class name baked
+ *          into the constant pool and the source text. options stands for
+ *          the rest of what shapes the class bytes, which the cache does not
+ *          interpret: the compiler passes its flags, class version and
+ *          codegen version there. Fields are length-prefixed so that no two
+ *          (class name, source) pairs hash the same input.
+ */
+void jsc_cache_compute_key(jsc_cache_key* key, const char* source,
+                           size_t length, const char* class_name,
+                           uint64_t options)
+{
+  jsc_sha256_context sha;
+  jsc_sha256_init(&sha);
+
+  uint32_t version_be = htobe32(JSC_CACHE_FORMAT_VERSION);
+  jsc_sha256_update(&sha, &version_be, 4);
+
+  uint64_t options_be = htobe64(options);
+  jsc_sha256_update(&sha, &options_be, 8);
+
+  uint32_t class_name_length = class_name ? (uint32_t)strlen(class_name) : 0;
+  uint32_t class_name_length_be = htobe32(class_name_length);
+  jsc_sha256_update(&sha, &class_name_length_be, 4);
+  jsc_sha256_update(&sha, class_name, class_name_length);
+
+  uint64_t source_length_be = htobe64((uint64_t)length);
+  jsc_sha256_update(&sha, &source_length_be, 8);
+  jsc_sha256_update(&sha, source, length);
+
+  jsc_sha256_final(&sha, key->bytes);
+}
+
+void jsc_cache_key_to_hex(const jsc_cache_key* key,
+                          char out[JSC_CACHE_KEY_SIZE * 2 + 1])
+{
+  static const char digits[] = "0123456789abcdef";
+
+  for (int i = 0; i < JSC_CACHE_KEY_SIZE; i++)
+  {
+    out[i * 2] = digits[key->bytes[i] >> 4];
+    out[i * 2 + 1] = digits[key->bytes[i] & 0x0F];
+  }
+
+  out[JSC_CACHE_KEY_SIZE * 2] = '\0';
+}
+
+jsc_cache* jsc_cache_init(size_t max_bytes, const char* directory)
+{
+  jsc_cache* cache = (jsc_cache*)malloc(sizeof(jsc_cache));
+
+  if (!cache)
+  {
+    return NULL;
+  }
+
+  memset(cache, 0, sizeof(jsc_cache));
+
+  cache->bucket_count = 1 << 6;
+  cache->buckets =
+      (jsc_cache_entry**)calloc(cache->bucket_count, sizeof(jsc_cache_entry*));
+
+  if (!cache->buckets)
+  {
+    free(cache);
+    return NULL;
+  }
+
+  cache->max_bytes = max_bytes ? max_bytes : JSC_CACHE_DEFAULT_MAX_BYTES;
+  cache->max_disk_bytes = JSC_CACHE_DEFAULT_MAX_DISK_BYTES;
+
+  if (directory)
+  {
+    cache->directory = strdup(directory);
+
+    if (!cache->directory)
+    {
+      free(cache->buckets);
+      free(cache);
+      return NULL;
+    }
+  }
+
+  return cache;
+}
+
+void jsc_cache_free(jsc_cache* cache)
+{
+  if (!cache)
+  {
+    return;
+  }
+
+  jsc_cache_entry* entry = cache->lru_head;
+
+  while (entry)
+  {
+    jsc_cache_entry* next = entry->lru_next;
+    free(entry->data);
+    free(entry);
+    entry = next;
+  }
+
+  if (cache->directory)
+  {
+    free(cache->directory);
+  }
+
+  if (cache->index)
+  {
+    free(cache->index);
+  }
+
+  free(cache->buckets);
+  free(cache);
+}
+
+static size_t jsc_cache_bucket(const jsc_cache* cache, const jsc_cache_key* key)
+{
+  uint64_t hash;
+  memcpy(&hash, key->bytes, sizeof(hash)); /* already uniformly distributed */
+
+  return (size_t)(hash & (cache->bucket_count - 1));
+}
+
+static void jsc_cache_lru_unlink(jsc_cache* cache, jsc_cache_entry* entry)
+{
+  if (entry->lru_prev)
+  {
+    entry->lru_prev->lru_next = entry->lru_next;
+  }
+  else
+  {
+    cache->lru_head = entry->lru_next;
+  }
+
+  if (entry->lru_next)
+  {
+    entry->lru_next->lru_prev = entry->lru_prev;
+  }
+  else
+  {
+    cache->lru_tail = entry->lru_prev;
+  }
+
+  entry->lru_prev = NULL;
+  entry->lru_next = NULL;
+}
+
+static void jsc_cache_lru_push_front(jsc_cache* cache, jsc_cache_entry* entry)
+{
+  entry->lru_prev = NULL;
+  entry->lru_next = cache->lru_head;
+
+  if (cache->lru_head)
+  {
+    cache->lru_head->lru_prev = entry;
+  }
+
+  cache->lru_head = entry;
+
+  if (!cache->lru_tail)
+  {
+    cache->lru_tail = entry;
+  }
+}
+
+static jsc_cache_entry* jsc_cache_find(jsc_cache* cache,
+                                       const jsc_cache_key* key)
+{
+  jsc_cache_entry* entry = cache->buckets[jsc_cache_bucket(cache, key)];
+
+  while (entry)
+  {
+    if (memcmp(entry->key.bytes, key->bytes, JSC_CACHE_KEY_SIZE) == 0)
+    {
+      return entry;
+    }
+
+    entry = entry->hash_next;
+  }
+
+  return NULL;
+}
+
+static void jsc_cache_remove(jsc_cache* cache, jsc_cache_entry* entry)
+{
+  jsc_cache_entry** link = &cache->buckets[jsc_cache_bucket(cache, &entry->key)];
+
+  while (*link && *link != entry)
+  {
+    link = &(*link)->hash_next;
+  }
+
+  if (*link)
+  {
+    *link = entry->hash_next;
+  }
+
+  jsc_cache_lru_unlink(cache, entry);
+
+  cache->total_bytes -= entry->size;
+  cache->entry_count--;
+
+  free(entry->data);
+  free(entry);
+}
+
+static void jsc_cache_grow(jsc_cache* cache)
+{
+  size_t new_count = cache->bucket_count << 1;
+  jsc_cache_entry** new_buckets =
+      (jsc_cache_entry**)calloc(new_count, sizeof(jsc_cache_entry*));
+
+  if (!new_buckets)
+  {
+    return; /* keep the old table, chains just get longer */
+  }
+
+  for (size_t i = 0; i < cache->bucket_count; i++)
+  {
+    jsc_cache_entry* entry = cache->buckets[i];
+
+    while (entry)
+    {
+      jsc_cache_entry* next = entry->hash_next;
+      uint64_t hash;
+      memcpy(&hash, entry->key.bytes, sizeof(hash));
+
+      size_t bucket = (size_t)(hash & (new_count - 1));
+      entry->hash_next = new_buckets[bucket];
+      new_buckets[bucket] = entry;
+
+      entry = next;
+    }
+  }
+
+  free(cache->buckets);
+  cache->buckets = new_buckets;
+  cache->bucket_count = new_count;
+}
+
+static bool jsc_cache_insert(jsc_cache* cache, const jsc_cache_key* key,
+                             const uint8_t* data, uint32_t size)
+{
+  if (size > cache->max_bytes)
+  {
+    return false;
+  }
+
+  jsc_cache_entry* existing = jsc_cache_find(cache, key);
+
+  if (existing)
+  {
+    jsc_cache_remove(cache, existing);
+  }
+
+  while (cache->lru_tail && cache->total_bytes + size > cache->max_bytes)
+  {
+    jsc_cache_remove(cache, cache->lru_tail);
+    cache->stats.evictions++;
+  }
+
+  jsc_cache_entry* entry = (jsc_cache_entry*)malloc(sizeof(jsc_cache_entry));
+
+  if (!entry)
+  {
+    return false;
+  }
+
+  memset(entry, 0, sizeof(jsc_cache_entry));
+
+  entry->data = (uint8_t*)malloc(size);
+
+  if (!entry->data)
+  {
+    free(entry);
+    return false;
+  }
+
+  memcpy(entry->data, data, size);
+  entry->key = *key;
+  entry->size = size;
+
+  if (cache->entry_count + 1 > cache->bucket_count)
+  {
+    jsc_cache_grow(cache);
+  }
+
+  size_t bucket = jsc_cache_bucket(cache, key);
+  entry->hash_next = cache->buckets[bucket];
+  cache->buckets[bucket] = entry;
+
+  jsc_cache_lru_push_front(cache, entry);
+
+  cache->total_bytes += size;
+  cache->entry_count++;
+
+  return true;
+}
+
+static char* jsc_cache_path(jsc_cache* cache, const char* name)
+{
+  char* path = malloc(strlen(cache->directory) + strlen(name) + 2);
+
+  if (!path)
+  {
+    return NULL;
+  }
+
+  sprintf(path, "%s%s%s", cache->directory, PATH_SEPARATOR, name);
+
+  return path;
+}
+
+static char* jsc_cache_blob_path(jsc_cache* cache, const jsc_cache_key* key)
+{
+  char name[JSC_CACHE_KEY_SIZE * 2 + 8];
+  jsc_cache_key_to_hex(key, name);
+  strcat(name, ".class");
+
+  return jsc_cache_path(cache, name);
+}
+
+static int jsc_cache_compare_records(const void* a, const void* b)
+{
+  return memcmp(((const jsc_cache_index_record*)a)->key.bytes,
+                ((const jsc_cache_index_record*)b)->key.bytes,
+                JSC_CACHE_KEY_SIZE);
+}
+
+/**
+ * @brief parse a serialized index into (key, size, sequence) records
+ *
+ * @details layout: magic(4) version(4) count(4) next_sequence(4), then count
+ *          records of key(32) size(4) sequence(4), all big-endian. Records
+ *          are stored in publish order, which is also eviction order.
+ */
+static jsc_cache_index_record* jsc_cache_parse_index(const uint8_t* data,
+                                                     size_t size,
+                                                     uint32_t* out_count,
+                                                     uint32_t* out_sequence)
+{
+  *out_count = 0;
+  *out_sequence = 0;
+
+  if (size < JSC_CACHE_INDEX_HEADER_SIZE)
+  {
+    return NULL;
+  }
+
+  uint32_t header[4];
+  memcpy(header, data, sizeof(header));
+
+  uint32_t count = be32toh(header[2]);
+
+  if (be32toh(header[0]) != JSC_CACHE_INDEX_MAGIC ||
+      be32toh(header[1]) != JSC_CACHE_FORMAT_VERSION ||
+      size < JSC_CACHE_INDEX_HEADER_SIZE +
+                 (size_t)count * JSC_CACHE_INDEX_RECORD_SIZE)
+  {
+    return NULL;
+  }
+
+  jsc_cache_index_record* records = (jsc_cache_index_record*)malloc(
+      (count ? count : 1) * sizeof(jsc_cache_index_record));
+
+  if (!records)
+  {
+    return NULL;
+  }
+
+  const uint8_t* p = data + JSC_CACHE_INDEX_HEADER_SIZE;
+
+  for (uint32_t i = 0; i < count; i++)
+  {
+    uint32_t fields[2];
+
+    memcpy(records[i].key.bytes, p, JSC_CACHE_KEY_SIZE);
+    memcpy(fields, p + JSC_CACHE_KEY_SIZE, sizeof(fields));
+
+    records[i].size = be32toh(fields[0]);
+    records[i].sequence = be32toh(fields[1]);
+
+    p += JSC_CACHE_INDEX_RECORD_SIZE;
+  }
+
+  *out_count = count;
+  *out_sequence = be32toh(header[3]);
+
+  return records;
+}
+
+static jsc_cache_index_record* jsc_cache_read_index_file(int fd,
+                                                         uint32_t* out_count,
+                                                         uint32_t* out_sequence)
+{
+  struct stat st;
+
+  *out_count = 0;
+  *out_sequence = 0;
+
+  if (fstat(fd, &st) != 0 || st.st_size < JSC_CACHE_INDEX_HEADER_SIZE)
+  {
+    return NULL;
+  }
+
+  void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  if (map == MAP_FAILED)
+  {
+    return NULL;
+  }
+
+  jsc_cache_index_record* records = jsc_cache_parse_index(
+      (const uint8_t*)map, st.st_size, out_count, out_sequence);
+
+  munmap(map, st.st_size);
+
+  return records;
+}
+
+/**
+ * @brief refresh the sorted in-memory view of the shared index
+ *
+ * @details Other processes replace the index by rename, so a changed inode,
+ *          size or mtime means a new generation; otherwise the cached view
+ *          is still current and no I/O beyond stat(2) is done.
+ */
+static void jsc_cache_refresh_index(jsc_cache* cache)
+{
+  char* path = jsc_cache_path(cache, "index");
+
+  if (!path)
+  {
+    return;
+  }
+
+  struct stat st;
+
+  if (stat(path, &st) != 0)
+  {
+    free(path);
+
+    free(cache->index);
+    cache->index = NULL;
+    cache->index_count = 0;
+    memset(&cache->index_stat, 0, sizeof(cache->index_stat));
+
+    return;
+  }
+
+  if (cache->index && st.st_ino == cache->index_stat.inode &&
+      st.st_size == cache->index_stat.size &&
+      st.st_mtime == cache->index_stat.mtime)
+  {
+    free(path);
+    return;
+  }
+
+  int fd = open(path, O_RDONLY);
+  free(path);
+
+  if (fd < 0)
+  {
+    return;
+  }
+
+  uint32_t count, sequence;
+  jsc_cache_index_record* records =
+      jsc_cache_read_index_file(fd, &count, &sequence);
+
+  close(fd);
+
+  free(cache->index);
+  cache->index = records;
+  cache->index_count = records ? count : 0;
+
+  if (cache->index)
+  {
+    qsort(cache->index, cache->index_count, sizeof(jsc_cache_index_record),
+          jsc_cache_compare_records);
+  }
+
+  cache->index_stat.inode = st.st_ino;
+  cache->index_stat.size = st.st_size;
+  cache->index_stat.mtime = st.st_mtime;
+}
+
+static const jsc_cache_index_record*
+jsc_cache_find_record(jsc_cache* cache, const jsc_cache_key* key)
+{
+  if (!cache->index)
+  {
+    return NULL;
+  }
+
+  jsc_cache_index_record probe;
+  probe.key = *key;
+
+  return (const jsc_cache_index_record*)bsearch(
+      &probe, cache->index, cache->index_count, sizeof(jsc_cache_index_record),
+      jsc_cache_compare_records);
+}
+
+/**
+ * @brief write a file so that readers only ever see it complete
+ *
+ * @details The bytes go to a unique temporary in the same directory, are
+ *          flushed to stable storage and then renamed over the final name;
+ *          rename(2) within a file system is atomic for concurrent readers.
+ */
+static bool jsc_cache_publish_file(jsc_cache* cache, const char* name,
+                                   const uint8_t* data, size_t size)
+{
+  char* final_path = jsc_cache_path(cache, name);
+  char* temp_path = jsc_cache_path(cache, ".tmp.XXXXXX");
+
+  if (!final_path || !temp_path)
+  {
+    free(final_path);
+    free(temp_path);
+    return false;
+  }
+
+  int fd = mkstemp(temp_path);
+
+  if (fd < 0)
+  {
+    free(final_path);
+    free(temp_path);
+    return false;
+  }
+
+  bool ok = true;
+  size_t offset = 0;
+
+  while (ok && offset < size)
+  {
+    ssize_t written = write(fd, data + offset, size - offset);
+
+    if (written <= 0)
+    {
+      ok = false;
+      break;
+    }
+
+    offset += (size_t)written;
+  }
+
+  ok = ok && fchmod(fd, 0644) == 0 && fsync(fd) == 0;
+  ok = close(fd) == 0 && ok;
+  ok = ok && rename(temp_path, final_path) == 0;
+
+  if (!ok)
+  {
+    unlink(temp_path);
+  }
+
+  free(final_path);
+  free(temp_path);
+
+  return ok;
+}
+
+static uint8_t* jsc_cache_serialize_index(const jsc_cache_index_record* records,
+                                          uint32_t count, uint32_t sequence,
+                                          size_t* out_size)
+{
+  size_t size =
+      JSC_CACHE_INDEX_HEADER_SIZE + (size_t)count * JSC_CACHE_INDEX_RECORD_SIZE;
+  uint8_t* data = (uint8_t*)malloc(size);
+
+  if (!data)
+  {
+    return NULL;
+  }
+
+  uint32_t header[4] = {htobe32(JSC_CACHE_INDEX_MAGIC),
+                        htobe32(JSC_CACHE_FORMAT_VERSION), htobe32(count),
+                        htobe32(sequence)};
+  memcpy(data, header, sizeof(header));
+
+  uint8_t* p = data + JSC_CACHE_INDEX_HEADER_SIZE;
+
+  for (uint32_t i = 0; i < count; i++)
+  {
+    uint32_t fields[2] = {htobe32(records[i].size),
+                          htobe32(records[i].sequence)};
+
+    memcpy(p, records[i].key.bytes, JSC_CACHE_KEY_SIZE);
+    memcpy(p + JSC_CACHE_KEY_SIZE, fields, sizeof(fields));
+
+    p += JSC_CACHE_INDEX_RECORD_SIZE;
+  }
+
+  *out_size = size;
+
+  return data;
+}
+
+/**
+ * @brief add key to the shared index, evicting the oldest blobs over budget
+ *
+ * @details The read-modify-write of the index is serialized between
+ *          processes with an flock(2) on a sidecar lock file; readers never
+ *          take the lock because the index itself is only ever replaced by
+ *          rename.
+ */
+static bool jsc_cache_index_add(jsc_cache* cache, const jsc_cache_key* key,
+                                uint32_t size)
+{
+  char* lock_path = jsc_cache_path(cache, "index.lock");
+  char* index_path = jsc_cache_path(cache, "index");
+
+  if (!lock_path || !index_path)
+  {
+    free(lock_path);
+    free(index_path);
+    return false;
+  }
+
+  int lock_fd = open(lock_path, O_RDWR | O_CREAT, 0644);
+  free(lock_path);
+
+  if (lock_fd < 0 || flock(lock_fd, LOCK_EX) != 0)
+  {
+    if (lock_fd >= 0)
+    {
+      close(lock_fd);
+    }
+
+    free(index_path);
+    return false;
+  }
+
+  uint32_t count = 0, sequence = 0;
+  jsc_cache_index_record* records = NULL;
+  int index_fd = open(index_path, O_RDONLY);
+  free(index_path);
+
+  if (index_fd >= 0)
+  {
+    records = jsc_cache_read_index_file(index_fd, &count, &sequence);
+    close(index_fd);
+  }
+
+  jsc_cache_index_record* grown = (jsc_cache_index_record*)realloc(
+      records, (count + 1) * sizeof(jsc_cache_index_record));
+
+  if (!grown)
+  {
+    free(records);
+    flock(lock_fd, LOCK_UN);
+    close(lock_fd);
+    return false;
+  }
+
+  records = grown;
+
+  uint64_t total_bytes = 0;
+  uint32_t kept = 0;
+
+  for (uint32_t i = 0; i < count; i++)
+  {
+    if (memcmp(records[i].key.bytes, key->bytes, JSC_CACHE_KEY_SIZE) != 0)
+    {
+      total_bytes += records[i].size;
+      records[kept++] = records[i];
+    }
+  }
+
+  records[kept].key = *key;
+  records[kept].size = size;
+  records[kept].sequence = sequence++;
+  total_bytes += size;
+  count = kept + 1;
+
+  uint32_t first = 0;
+
+  while (first + 1 < count && total_bytes > cache->max_disk_bytes)
+  {
+    char* blob_path = jsc_cache_blob_path(cache, &records[first].key);
+
+    if (blob_path)
+    {
+      unlink(blob_path); /* mapped readers keep their pages */
+      free(blob_path);
+    }
+
+    total_bytes -= records[first].size;
+    cache->stats.disk_evictions++;
+    first++;
+  }
+
+  size_t data_size = 0;
+  uint8_t* data = jsc_cache_serialize_index(records + first, count - first,
+                                            sequence, &data_size);
+  bool ok = data && jsc_cache_publish_file(cache, "index", data, data_size);
+
+  free(data);
+  free(records);
+
+  flock(lock_fd, LOCK_UN);
+  close(lock_fd);
+
+  return ok;
+}
+
+static bool jsc_cache_map_blob(jsc_cache* cache, const jsc_cache_key* key,
+                               jsc_cache_blob* blob)
+{
+  jsc_cache_refresh_index(cache);
+
+  const jsc_cache_index_record* record = jsc_cache_find_record(cache, key);
+
+  if (!record)
+  {
+    return false;
+  }
+
+  char* path = jsc_cache_blob_path(cache, key);
+
+  if (!path)
+  {
+    return false;
+  }
+
+  int fd = open(path, O_RDONLY);
+  free(path);
+
+  if (fd < 0)
+  {
+    return false; /* evicted by another process since the index was read */
+  }
+
+  struct stat st;
+
+  if (fstat(fd, &st) != 0 || (uint64_t)st.st_size != record->size ||
+      record->size == 0)
+  {
+    close(fd);
+    return false;
+  }
+
+  void* map = mmap(NULL, record->size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (map == MAP_FAILED)
+  {
+    return false;
+  }
+
+  blob->data = (const uint8_t*)map;
+  blob->size = record->size;
+  blob->mapping = map;
+  blob->mapping_size = record->size;
+
+  return true;
+}
+
+/**
+ * @brief borrow the class bytes compiled for key without copying them
+ *
+ * @details Memory is consulted first, then the shared directory, whose blobs
+ *          are mapped read-only so every process on the host shares the same
+ *          page-cache pages. Release the blob with jsc_cache_release; a
+ *          memory-backed blob is only valid until the next store.
+ */
+bool jsc_cache_acquire(jsc_cache* cache, const jsc_cache_key* key,
+                       jsc_cache_blob* blob)
+{
+  memset(blob, 0, sizeof(jsc_cache_blob));
+
+  jsc_cache_entry* entry = jsc_cache_find(cache, key);
+
+  if (entry)
+  {
+    if (entry != cache->lru_head)
+    {
+      jsc_cache_lru_unlink(cache, entry);
+      jsc_cache_lru_push_front(cache, entry);
+    }
+
+    blob->data = entry->data;
+    blob->size = entry->size;
+    cache->stats.hits++;
+
+    return true;
+  }
+
+  if (cache->directory && jsc_cache_map_blob(cache, key, blob))
+  {
+    cache->stats.disk_hits++;
+    return true;
+  }
+
+  cache->stats.misses++;
+
+  return false;
+}
+
+void jsc_cache_release(jsc_cache_blob* blob)
+{
+  if (blob->mapping)
+  {
+    munmap(blob->mapping, blob->mapping_size);
+  }
+
+  memset(blob, 0, sizeof(jsc_cache_blob));
+}
+
+/**
+ * @brief find the class bytes compiled for key
+ *
+ * @details Like jsc_cache_acquire, but a directory hit is copied into the
+ *          memory tier. The returned pointer is owned by the cache and stays
+ *          valid until the next store. A directory hit the memory tier
+ *          cannot hold, such as a blob larger than max_bytes, is reported
+ *          and counted as a miss.
+ */
+const uint8_t* jsc_cache_lookup(jsc_cache* cache, const jsc_cache_key* key,
+                                uint32_t* out_size)
+{
+  jsc_cache_blob blob;
+
+  if (!jsc_cache_acquire(cache, key, &blob))
+  {
+    return NULL;
+  }
+
+  if (blob.mapping)
+  {
+    bool promoted = jsc_cache_insert(cache, key, blob.data, blob.size);
+    jsc_cache_release(&blob);
+
+    /* the caller gets nothing, so the lookup was a miss after all */
+    if (!promoted)
+    {
+      cache->stats.disk_hits--;
+      cache->stats.misses++;
+      return NULL;
+    }
+
+    *out_size = cache->lru_head->size;
+
+    return cache->lru_head->data;
+  }
+
+  *out_size = blob.size;
+
+  return blob.data;
+}
+
+bool jsc_cache_store(jsc_cache* cache, const jsc_cache_key* key,
+                     const uint8_t* data, uint32_t size)
+{
+  if (!data || size == 0)
+  {
+    return false;
+  }
+
+  bool stored = jsc_cache_insert(cache, key, data, size);
+
+  if (cache->directory)
+  {
+    char name[JSC_CACHE_KEY_SIZE * 2 + 8];
+    jsc_cache_key_to_hex(key, name);
+    strcat(name, ".class");
+
+    /* the blob is published before the index entry that points at it */
+    bool published = jsc_cache_publish_file(cache, name, data, size) &&
+                     jsc_cache_index_add(cache, key, size);
+
+    stored = published || stored;
+  }
+
+  if (stored)
+  {
+    cache->stats.stores++;
+  }
+
+  return stored;
+}
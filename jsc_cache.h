@@ -0,0 +1,107 @@
+#ifndef JSC_CACHE_H
+#define JSC_CACHE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#define JSC_CACHE_KEY_SIZE 32
+#define JSC_CACHE_DEFAULT_MAX_BYTES (1 << 24)
+#define JSC_CACHE_DEFAULT_MAX_DISK_BYTES (1 << 28)
+#define JSC_CACHE_FORMAT_VERSION 2
+
+typedef struct jsc_cache jsc_cache;
+typedef struct jsc_cache_entry jsc_cache_entry;
+typedef struct jsc_cache_key jsc_cache_key;
+typedef struct jsc_cache_blob jsc_cache_blob;
+typedef struct jsc_cache_stats jsc_cache_stats;
+typedef struct jsc_cache_index_record jsc_cache_index_record;
+
+struct jsc_cache_key
+{
+  uint8_t bytes[JSC_CACHE_KEY_SIZE];
+};
+
+struct jsc_cache_entry
+{
+  jsc_cache_key key;
+  uint8_t* data;
+  uint32_t size;
+
+  jsc_cache_entry* hash_next;
+  jsc_cache_entry* lru_prev;
+  jsc_cache_entry* lru_next;
+};
+
+struct jsc_cache_blob
+{
+  const uint8_t* data;
+  uint32_t size;
+
+  void* mapping; /* non-NULL when data points into a mapped blob file */
+  size_t mapping_size;
+};
+
+struct jsc_cache_stats
+{
+  uint64_t hits;      /* served from memory */
+  uint64_t disk_hits; /* served from the shared directory */
+  uint64_t misses;
+  uint64_t stores;
+  uint64_t evictions;      /* dropped from memory to honour max_bytes */
+  uint64_t disk_evictions; /* unlinked from the directory by this process */
+};
+
+struct jsc_cache_index_record
+{
+  jsc_cache_key key;
+  uint32_t size;
+  uint32_t sequence;
+};
+
+struct jsc_cache
+{
+  jsc_cache_entry** buckets;
+  size_t bucket_count;
+  size_t entry_count;
+
+  jsc_cache_entry* lru_head; /* most recently used */
+  jsc_cache_entry* lru_tail; /* least recently used */
+
+  size_t total_bytes;
+  size_t max_bytes;
+
+  char* directory;
+  size_t max_disk_bytes;
+
+  jsc_cache_index_record* index; /* sorted by key */
+  uint32_t index_count;
+
+  struct
+  {
+    uint64_t inode;
+    int64_t size;
+    int64_t mtime;
+  } index_stat;
+
+  jsc_cache_stats stats;
+};
+
+jsc_cache* jsc_cache_init(size_t max_bytes, const char* directory);
+void jsc_cache_free(jsc_cache* cache);
+
+void jsc_cache_compute_key(jsc_cache_key* key, const char* source,
+                           size_t length, const char* class_name,
+                           uint64_t options);
+void jsc_cache_key_to_hex(const jsc_cache_key* key,
+                          char out[JSC_CACHE_KEY_SIZE * 2 + 1]);
+
+const uint8_t* jsc_cache_lookup(jsc_cache* cache, const jsc_cache_key* key,
+                                uint32_t* out_size);
+bool jsc_cache_acquire(jsc_cache* cache, const jsc_cache_key* key,
+                       jsc_cache_blob* blob);
+void jsc_cache_release(jsc_cache_blob* blob);
+bool jsc_cache_store(jsc_cache* cache, const jsc_cache_key* key,
+                     const uint8_t* data, uint32_t size);
+
+#endif
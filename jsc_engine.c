@@ -1,12 +1,19 @@
 #include "jsc_engine.h"
+#include "jsc_runtime.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <math.h>
 #include <time.h>
 #include <sys/stat.h>
 
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+#include <malloc.h>
+#define JSC_ENGINE_HAVE_MALLINFO2
+#endif
+
 #if defined(_WIN32) || defined(_WIN64)
 #include <windows.h>
 #include <direct.h>
@@ -14,15 +21,18 @@
 #define PATH_SEPARATOR "\\"
 #else
 #include <unistd.h>
+#include <pthread.h>
 #define PATH_SEPARATOR "/"
 #endif
 
-static JavaVMOption jvm_options[] = {{.optionString = "-Djava.class.path=."}};
-
-static JavaVMInitArgs jvm_args = {.version = JNI_VERSION_1_8,
-                                  .nOptions = 1,
-                                  .options = jvm_options,
-                                  .ignoreUnrecognized = JNI_FALSE};
+/* members of a class with lazy functions, see jsc_engine_emit_lazy_linker */
+#define JSC_ENGINE_LINK_DESCRIPTOR                                             \
+  "(Ljava/lang/invoke/MutableCallSite;I)Ljava/lang/invoke/MethodHandle;"
+#define JSC_ENGINE_RELINK_DESCRIPTOR                                           \
+  "(Ljava/lang/invoke/MutableCallSite;I[Ljava/lang/Object;)Ljava/lang/Object;"
+#define JSC_ENGINE_LAZY_BOOTSTRAP_DESCRIPTOR                                   \
+  "(Ljava/lang/invoke/MethodHandles$Lookup;Ljava/lang/String;"                 \
+  "Ljava/lang/invoke/MethodType;I)Ljava/lang/invoke/CallSite;"
 
 jsc_engine_context* jsc_engine_init(const char* class_name)
 {
@@ -56,33 +66,6 @@ jsc_engine_context* jsc_engine_init(const char* class_name)
   memset(ctx->global_scope, 0, sizeof(jsc_scope));
   ctx->current_scope = ctx->global_scope;
 
-  char temp_path[1 << 10];
-
-#if defined(_WIN32) || defined(_WIN64)
-  GetTempPath(1 << 10, temp_path);
-#else
-  strcpy(temp_path, "/tmp/");
-#endif
-
-  char dir_name[1 << 10];
-  sprintf(dir_name, "%sjsc_engine_%ld", temp_path, (long)time(NULL));
-
-  if (mkdir(dir_name, 0755) != 0)
-  {
-    free(ctx->global_scope);
-    free(ctx->class_name);
-    free(ctx);
-    return NULL;
-  }
-
-  ctx->temp_dir = strdup(dir_name);
-
-  ctx->class_path = malloc(strlen(dir_name) + 2);
-  sprintf(ctx->class_path, "%s", dir_name);
-
-  jvm_options[0].optionString = malloc(strlen(ctx->class_path) + 20);
-  sprintf(jvm_options[0].optionString, "-Djava.class.path=%s", ctx->class_path);
-
   return ctx;
 }
 
@@ -93,6 +76,7 @@ void jsc_engine_free(jsc_engine_context* ctx)
     return;
   }
 
+#ifndef JSC_NO_JVM
   if (ctx->env)
   {
     if (ctx->runtime_instance)
@@ -102,6 +86,20 @@ void jsc_engine_free(jsc_engine_context* ctx)
 
     if (ctx->runtime_class)
     {
+      /* a lazy function first called from now on must not reach ctx */
+      jfieldID context_field = (*ctx->env)->GetStaticFieldID(
+          ctx->env, ctx->runtime_class, "jsc_context", "J");
+
+      if (context_field)
+      {
+        (*ctx->env)->SetStaticLongField(ctx->env, ctx->runtime_class,
+                                        context_field, 0);
+      }
+      else
+      {
+        (*ctx->env)->ExceptionClear(ctx->env);
+      }
+
       (*ctx->env)->DeleteGlobalRef(ctx->env, ctx->runtime_class);
     }
 
@@ -115,6 +113,7 @@ void jsc_engine_free(jsc_engine_context* ctx)
   {
     (*ctx->jvm)->DestroyJavaVM(ctx->jvm);
   }
+#endif
 
   if (ctx->tokenizer)
   {
@@ -136,6 +135,39 @@ void jsc_engine_free(jsc_engine_context* ctx)
     free(ctx->error_message);
   }
 
+  for (uint32_t i = 0; i < ctx->deferred_count; i++)
+  {
+    free(ctx->deferred_functions[i].name);
+    free(ctx->deferred_functions[i].error_message);
+    jsc_bytecode_free(ctx->deferred_functions[i].bytecode);
+  }
+
+  free(ctx->deferred_functions);
+  free(ctx->source);
+
+  for (uint32_t i = 0; i < ctx->assigned_count; i++)
+  {
+    free(ctx->assigned_names[i]);
+  }
+
+  free(ctx->assigned_names);
+
+  for (uint32_t i = 0; i < ctx->unused_count; i++)
+  {
+    free(ctx->unused_names[i]);
+  }
+
+  free(ctx->unused_names);
+  free(ctx->jump_targets);
+  jsc_class_writer_free(&ctx->writer);
+
+  if (ctx->constant.type == JSC_VALUE_STRING)
+  {
+    free(ctx->constant.string_value);
+  }
+
+  free(ctx->class_buffer);
+
   if (ctx->temp_dir)
   {
     free(ctx->temp_dir);
@@ -146,11 +178,6 @@ void jsc_engine_free(jsc_engine_context* ctx)
     free(ctx->class_path);
   }
 
-  if (jvm_options[0].optionString)
-  {
-    free(jvm_options[0].optionString);
-  }
-
   jsc_scope* scope = ctx->global_scope;
 
   while (scope)
@@ -161,6 +188,12 @@ void jsc_engine_free(jsc_engine_context* ctx)
     {
       jsc_symbol* next = symbol->next;
       free(symbol->name);
+
+      if (symbol->value.type == JSC_VALUE_STRING)
+      {
+        free(symbol->value.string_value);
+      }
+
       free(symbol);
       symbol = next;
     }
@@ -179,1416 +212,6662 @@ void jsc_engine_free(jsc_engine_context* ctx)
   free(ctx);
 }
 
-bool jsc_engine_compile(jsc_engine_context* ctx, const char* source)
+static bool jsc_engine_is_assignment(jsc_token_type type)
 {
-  ctx->tokenizer = jsc_tokenizer_init(source, strlen(source));
-
-  if (!ctx->tokenizer)
-  {
-    jsc_engine_error(ctx, "failed to initialize tokenizer");
+  switch (type)
+  {
+  case JSC_TOKEN_ASSIGN:
+  case JSC_TOKEN_PLUS_ASSIGN:
+  case JSC_TOKEN_MINUS_ASSIGN:
+  case JSC_TOKEN_MULTIPLY_ASSIGN:
+  case JSC_TOKEN_DIVIDE_ASSIGN:
+  case JSC_TOKEN_MODULO_ASSIGN:
+  case JSC_TOKEN_LEFT_SHIFT_ASSIGN:
+  case JSC_TOKEN_RIGHT_SHIFT_ASSIGN:
+  case JSC_TOKEN_UNSIGNED_RIGHT_SHIFT_ASSIGN:
+  case JSC_TOKEN_BITWISE_AND_ASSIGN:
+  case JSC_TOKEN_BITWISE_OR_ASSIGN:
+  case JSC_TOKEN_BITWISE_XOR_ASSIGN:
+  case JSC_TOKEN_LOGICAL_AND_ASSIGN:
+  case JSC_TOKEN_LOGICAL_OR_ASSIGN:
+  case JSC_TOKEN_NULLISH_COALESCING_ASSIGN:
+  case JSC_TOKEN_EXPONENTIATION_ASSIGN:
+  case JSC_TOKEN_INCREMENT:
+  case JSC_TOKEN_DECREMENT:
+    return true;
+  default:
     return false;
   }
+}
 
-  ctx->bytecode = jsc_bytecode_create_class(ctx->class_name, "java/lang/Object",
-                                            JSC_ACC_PUBLIC | JSC_ACC_SUPER);
+static int jsc_engine_compare_names(const void* a, const void* b)
+{
+  return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
 
-  if (!ctx->bytecode)
+/**
+ * @brief record every name the program assigns to, sorted for bsearch
+ *
+ * @details A call may precede the assignment that rebinds a function, so the
+ *          token stream is scanned once before parsing. Scopes are ignored,
+ *          which can only send a call down the generic path.
+ */
+static bool jsc_engine_collect_assigned_names(jsc_engine_context* ctx,
+                                              const char* source)
+{
+  jsc_tokenizer_context* tokenizer =
+      jsc_tokenizer_init(source, strlen(source));
+
+  if (!tokenizer)
   {
-    jsc_engine_error(ctx, "failed to initialize bytecode");
     return false;
   }
 
-  jsc_engine_advance(ctx);
-
-  jsc_engine_parse_program(ctx);
+  uint32_t capacity = 0;
+  jsc_token previous = {.type = JSC_TOKEN_EOF};
 
-  if (ctx->had_error)
+  for (;;)
   {
-    return false;
-  }
+    jsc_token token = jsc_next_token(tokenizer);
+    const jsc_token* target = NULL;
 
-  char* class_file =
-      malloc(strlen(ctx->temp_dir) + strlen(ctx->class_name) + 8);
+    if (previous.type == JSC_TOKEN_IDENTIFIER &&
+        jsc_engine_is_assignment(token.type))
+    {
+      target = &previous;
+    }
+    else if (token.type == JSC_TOKEN_IDENTIFIER &&
+             (previous.type == JSC_TOKEN_INCREMENT ||
+              previous.type == JSC_TOKEN_DECREMENT))
+    {
+      target = &token;
+    }
 
-  if (!class_file)
+    if (target)
+    {
+      if (ctx->assigned_count == capacity)
+      {
+        capacity = capacity ? capacity * 2 : 16;
+        char** names = (char**)realloc(ctx->assigned_names,
+                                       capacity * sizeof(char*));
+
+        if (!names)
+        {
+          jsc_tokenizer_free(tokenizer);
+          return false;
+        }
+
+        ctx->assigned_names = names;
+      }
+
+      ctx->assigned_names[ctx->assigned_count++] =
+          strndup(target->start, target->length);
+    }
+
+    if (previous.type == JSC_TOKEN_STRING ||
+        previous.type == JSC_TOKEN_TEMPLATE)
+    {
+      free(previous.string_value.data);
+    }
+
+    previous = token;
+
+    if (token.type == JSC_TOKEN_EOF || token.type == JSC_TOKEN_ERROR ||
+        jsc_tokenizer_has_error(tokenizer))
+    {
+      break;
+    }
+  }
+
+  if (previous.type == JSC_TOKEN_STRING ||
+      previous.type == JSC_TOKEN_TEMPLATE)
   {
-    jsc_engine_error(ctx, "jsc_engine_compile malloc");
-    return false;
+    free(previous.string_value.data);
   }
 
-  sprintf(class_file, "%s%s%s.class", ctx->temp_dir, PATH_SEPARATOR,
-          ctx->class_name);
+  jsc_tokenizer_free(tokenizer);
 
-  if (!jsc_bytecode_write_to_file(ctx->bytecode, class_file))
+  if (ctx->assigned_count > 0)
   {
-    jsc_engine_error(ctx, "failed to write class file");
-    free(class_file);
-    return false;
+    qsort(ctx->assigned_names, ctx->assigned_count, sizeof(char*),
+          jsc_engine_compare_names);
   }
 
-  free(class_file);
-
   return true;
 }
 
-bool jsc_engine_init_jvm(jsc_engine_context* ctx)
+/* a top-level declaration met by jsc_engine_collect_unused_names */
+typedef struct
 {
-  if (ctx->jvm != NULL)
-  {
+  const char* name;
+  uint32_t length;
+  uint32_t first_reference; /* names its initializer or body mentions */
+  uint32_t reference_count;
+  bool pure; /* declaring it has no effect besides the binding */
+  bool live;
+} jsc_engine_binding;
+
+typedef struct
+{
+  const char* name;
+  uint32_t length;
+  bool root; /* outside every top-level declaration */
+} jsc_engine_reference;
+
+static int jsc_engine_compare_spans(const char* a, uint32_t a_length,
+                                    const char* b, uint32_t b_length)
+{
+  int order = memcmp(a, b, a_length < b_length ? a_length : b_length);
+
+  return order ? order : (a_length > b_length) - (a_length < b_length);
+}
+
+static int jsc_engine_compare_bindings(const void* a, const void* b)
+{
+  const jsc_engine_binding* x = (const jsc_engine_binding*)a;
+  const jsc_engine_binding* y = (const jsc_engine_binding*)b;
+
+  return jsc_engine_compare_spans(x->name, x->length, y->name, y->length);
+}
+
+/* tokens an initializer may consist of without any effect */
+static bool jsc_engine_is_pure_token(jsc_token_type type)
+{
+  switch (type)
+  {
+  case JSC_TOKEN_IDENTIFIER:
+  case JSC_TOKEN_STRING:
+  case JSC_TOKEN_NUMBER:
+  case JSC_TOKEN_TRUE:
+  case JSC_TOKEN_FALSE:
+  case JSC_TOKEN_NULL:
+  case JSC_TOKEN_UNDEFINED:
+  case JSC_TOKEN_TYPEOF:
+  case JSC_TOKEN_VOID:
+  case JSC_TOKEN_LEFT_PAREN:
+  case JSC_TOKEN_RIGHT_PAREN:
+  case JSC_TOKEN_QUESTION_MARK:
+  case JSC_TOKEN_COLON:
     return true;
+  default:
+    return type >= JSC_TOKEN_PLUS && type <= JSC_TOKEN_UNSIGNED_RIGHT_SHIFT &&
+           type != JSC_TOKEN_INCREMENT && type != JSC_TOKEN_DECREMENT;
   }
+}
 
-  JNIEnv* env;
-
-  jint result = JNI_CreateJavaVM(&ctx->jvm, (void**)&env, &jvm_args);
+/* the top-level binding reference names, if any */
+static jsc_engine_binding*
+jsc_engine_find_binding(jsc_engine_binding* bindings, uint32_t count,
+                        const jsc_engine_reference* reference)
+{
+  uint32_t low = 0;
+  uint32_t high = count;
 
-  if (result != JNI_OK)
+  while (low < high)
   {
-    jsc_engine_error(ctx, "failed to create JVM");
-    return false;
+    uint32_t middle = low + (high - low) / 2;
+    int order = jsc_engine_compare_spans(
+        reference->name, reference->length, bindings[middle].name,
+        bindings[middle].length);
+
+    if (order == 0)
+    {
+      return &bindings[middle];
+    }
+
+    if (order < 0)
+    {
+      high = middle;
+    }
+    else
+    {
+      low = middle + 1;
+    }
   }
 
-  ctx->env = env;
+  return NULL;
+}
 
-  jclass runtime_class = (*env)->FindClass(env, ctx->class_name);
+/* mark binding live along with everything it reaches */
+static void jsc_engine_mark_live(jsc_engine_binding* bindings, uint32_t count,
+                                 const jsc_engine_reference* references,
+                                 jsc_engine_binding** stack,
+                                 jsc_engine_binding* binding)
+{
+  uint32_t stack_size = 0;
 
-  if (runtime_class == NULL)
+  if (binding && !binding->live)
   {
-    (*env)->ExceptionClear(env);
-    jsc_engine_error(ctx, "failed to find compiled class");
-    return false;
+    binding->live = true;
+    stack[stack_size++] = binding;
   }
 
-  ctx->runtime_class = (*env)->NewGlobalRef(env, runtime_class);
-  (*env)->DeleteLocalRef(env, runtime_class);
+  while (stack_size > 0)
+  {
+    const jsc_engine_binding* live = stack[--stack_size];
 
-  jmethodID main_method = (*env)->GetStaticMethodID(
-      env, ctx->runtime_class, "main", "([Ljava/lang/String;)V");
+    for (uint32_t i = 0; i < live->reference_count; i++)
+    {
+      jsc_engine_binding* next = jsc_engine_find_binding(
+          bindings, count, &references[live->first_reference + i]);
 
-  if (main_method == NULL)
-  {
-    (*env)->ExceptionClear(env);
-    jsc_engine_error(ctx, "failed to find main method");
-    return false;
+      if (next && !next->live)
+      {
+        next->live = true;
+        stack[stack_size++] = next;
+      }
+    }
   }
+}
 
-  ctx->execute_method = main_method;
+/**
+ * @brief record the top-level bindings nothing live ever reads, sorted
+ *
+ * @details Another token pass ahead of parsing. Each top-level let, const,
+ *          var or function declaration owns the names its initializer or
+ *          body mentions; every other name is a root. Bindings are live
+ *          when reachable from a root, or when their initializer may have
+ *          an effect, i.e. has anything but literals, names and operators.
+ *          Names are matched regardless of scope, which only keeps more.
+ */
+static bool jsc_engine_collect_unused_names(jsc_engine_context* ctx,
+                                            const char* source)
+{
+  jsc_tokenizer_context* tokenizer =
+      jsc_tokenizer_init(source, strlen(source));
 
-  jclass string_class = (*env)->FindClass(env, "java/lang/String");
-  if (string_class == NULL)
+  if (!tokenizer)
   {
-    (*env)->ExceptionClear(env);
-    jsc_engine_error(ctx, "failed to find String class");
     return false;
   }
 
-  jobjectArray args = (*env)->NewObjectArray(env, 0, string_class, NULL);
+  jsc_engine_binding* bindings = NULL;
+  jsc_engine_reference* references = NULL;
+  uint32_t binding_count = 0;
+  uint32_t binding_capacity = 0;
+  uint32_t reference_count = 0;
+  uint32_t reference_capacity = 0;
+  bool ok = true;
 
-  if (args == NULL)
+  jsc_engine_binding* binding = NULL; /* whose declaration is being read */
+  bool function = false;
+  bool initializer = false;
+  int depth = 0;
+  jsc_token previous = {.type = JSC_TOKEN_EOF};
+
+  while (ok)
   {
-    (*env)->ExceptionClear(env);
-    (*env)->DeleteLocalRef(env, string_class);
-    jsc_engine_error(ctx, "failed to create arguments array");
-    return false;
-  }
+    jsc_token token = jsc_next_token(tokenizer);
+    bool declares = previous.type == JSC_TOKEN_LET ||
+                    previous.type == JSC_TOKEN_CONST ||
+                    previous.type == JSC_TOKEN_VAR ||
+                    previous.type == JSC_TOKEN_FUNCTION;
 
-  ctx->args = (*env)->NewGlobalRef(env, args);
-  (*env)->DeleteLocalRef(env, args);
-  (*env)->DeleteLocalRef(env, string_class);
+    if (token.type == JSC_TOKEN_IDENTIFIER && declares && depth == 0 &&
+        !binding)
+    {
+      if (binding_count == binding_capacity)
+      {
+        binding_capacity = binding_capacity ? binding_capacity * 2 : 16;
+        jsc_engine_binding* grown = (jsc_engine_binding*)realloc(
+            bindings, binding_capacity * sizeof(jsc_engine_binding));
+        ok = grown != NULL;
+        bindings = grown ? grown : bindings;
+      }
 
-  return true;
-}
+      if (ok)
+      {
+        binding = &bindings[binding_count++];
+        binding->name = token.start;
+        binding->length = token.length;
+        binding->first_reference = reference_count;
+        binding->reference_count = 0;
+        binding->pure = true;
+        binding->live = false;
+        function = previous.type == JSC_TOKEN_FUNCTION;
+        initializer = false;
+      }
+    }
+    else if (token.type == JSC_TOKEN_IDENTIFIER && !declares)
+    {
+      if (reference_count == reference_capacity)
+      {
+        reference_capacity = reference_capacity ? reference_capacity * 2 : 64;
+        jsc_engine_reference* grown = (jsc_engine_reference*)realloc(
+            references, reference_capacity * sizeof(jsc_engine_reference));
+        ok = grown != NULL;
+        references = grown ? grown : references;
+      }
 
-bool jsc_engine_load_class(jsc_engine_context* ctx, const char* class_file)
-{
-  if (ctx->env == NULL)
-  {
-    if (!jsc_engine_init_jvm(ctx))
+      if (ok)
+      {
+        jsc_engine_reference* reference = &references[reference_count++];
+        reference->name = token.start;
+        reference->length = token.length;
+        reference->root = binding == NULL;
+
+        if (binding)
+        {
+          binding->reference_count++;
+        }
+      }
+    }
+
+    if (binding && !function && token.type != JSC_TOKEN_IDENTIFIER)
     {
-      return false;
+      bool call = token.type == JSC_TOKEN_LEFT_PAREN &&
+                  (previous.type == JSC_TOKEN_IDENTIFIER ||
+                   previous.type == JSC_TOKEN_RIGHT_PAREN);
+
+      if (!initializer && token.type == JSC_TOKEN_ASSIGN)
+      {
+        initializer = true;
+      }
+      else if (token.type == JSC_TOKEN_SEMICOLON && depth == 0)
+      {
+        binding = NULL;
+      }
+      else if (!initializer || call || !jsc_engine_is_pure_token(token.type))
+      {
+        binding->pure = false;
+      }
+    }
+
+    if (token.type == JSC_TOKEN_LEFT_PAREN ||
+        token.type == JSC_TOKEN_LEFT_BRACKET ||
+        token.type == JSC_TOKEN_LEFT_BRACE)
+    {
+      depth++;
+    }
+    else if (token.type == JSC_TOKEN_RIGHT_PAREN ||
+             token.type == JSC_TOKEN_RIGHT_BRACKET ||
+             token.type == JSC_TOKEN_RIGHT_BRACE)
+    {
+      depth--;
+
+      if (binding && function && depth == 0 &&
+          token.type == JSC_TOKEN_RIGHT_BRACE)
+      {
+        binding = NULL;
+      }
+    }
+
+    if (previous.type == JSC_TOKEN_STRING ||
+        previous.type == JSC_TOKEN_TEMPLATE)
+    {
+      free(previous.string_value.data);
+    }
+
+    previous = token;
+
+    if (token.type == JSC_TOKEN_EOF || token.type == JSC_TOKEN_ERROR ||
+        jsc_tokenizer_has_error(tokenizer))
+    {
+      break;
     }
   }
 
-  jclass class_loader_class =
-      (*ctx->env)->FindClass(ctx->env, "java/lang/ClassLoader");
-  if (class_loader_class == NULL)
+  if (previous.type == JSC_TOKEN_STRING ||
+      previous.type == JSC_TOKEN_TEMPLATE)
   {
-    (*ctx->env)->ExceptionClear(ctx->env);
-    jsc_engine_error(ctx, "failed to find ClassLoader class");
-    return false;
+    free(previous.string_value.data);
   }
 
-  jmethodID get_system_class_loader = (*ctx->env)->GetStaticMethodID(
-      ctx->env, class_loader_class, "getSystemClassLoader",
-      "()Ljava/lang/ClassLoader;");
+  jsc_tokenizer_free(tokenizer);
 
-  if (get_system_class_loader == NULL)
+  if (binding && !function)
   {
-    (*ctx->env)->ExceptionClear(ctx->env);
-    (*ctx->env)->DeleteLocalRef(ctx->env, class_loader_class);
-    jsc_engine_error(ctx, "failed to find getSystemClassLoader method");
-    return false;
+    binding->pure = false; /* cut off by the end of the program */
   }
 
-  jobject class_loader = (*ctx->env)->CallStaticObjectMethod(
-      ctx->env, class_loader_class, get_system_class_loader);
-
-  if (class_loader == NULL)
+  if (binding_count > 0)
   {
-    (*ctx->env)->ExceptionClear(ctx->env);
-    (*ctx->env)->DeleteLocalRef(ctx->env, class_loader_class);
-    jsc_engine_error(ctx, "failed to get system class loader");
-    return false;
+    qsort(bindings, binding_count, sizeof(jsc_engine_binding),
+          jsc_engine_compare_bindings);
   }
 
-  jmethodID load_class =
-      (*ctx->env)->GetMethodID(ctx->env, class_loader_class, "loadClass",
-                               "(Ljava/lang/String;)Ljava/lang/Class;");
+  /* mark from the roots, the bindings still to visit on a stack */
+  jsc_engine_binding** stack = (jsc_engine_binding**)malloc(
+      (binding_count + 1) * sizeof(jsc_engine_binding*));
+  ok = ok && stack;
 
-  if (load_class == NULL)
+  for (uint32_t i = 0; ok && i < binding_count; i++)
   {
-    (*ctx->env)->ExceptionClear(ctx->env);
-    (*ctx->env)->DeleteLocalRef(ctx->env, class_loader);
-    (*ctx->env)->DeleteLocalRef(ctx->env, class_loader_class);
-    jsc_engine_error(ctx, "failed to find loadClass method");
-    return false;
-  }
+    if (!bindings[i].pure)
+    {
+      jsc_engine_mark_live(bindings, binding_count, references, stack,
+                           &bindings[i]);
+    }
+  }
 
-  jstring class_name_jstr =
-      (*ctx->env)->NewStringUTF(ctx->env, ctx->class_name);
-  if (class_name_jstr == NULL)
+  for (uint32_t i = 0; ok && i < reference_count; i++)
   {
-    (*ctx->env)->ExceptionClear(ctx->env);
-    (*ctx->env)->DeleteLocalRef(ctx->env, class_loader);
-    (*ctx->env)->DeleteLocalRef(ctx->env, class_loader_class);
-    jsc_engine_error(ctx, "failed to create class name string");
-    return false;
+    if (references[i].root)
+    {
+      jsc_engine_mark_live(
+          bindings, binding_count, references, stack,
+          jsc_engine_find_binding(bindings, binding_count, &references[i]));
+    }
   }
 
-  jclass loaded_class = (*ctx->env)->CallObjectMethod(
-      ctx->env, class_loader, load_class, class_name_jstr);
-
-  (*ctx->env)->DeleteLocalRef(ctx->env, class_name_jstr);
+  free(stack);
+  free(references);
 
-  if (loaded_class == NULL || (*ctx->env)->ExceptionCheck(ctx->env))
+  for (uint32_t i = 0; ok && i < binding_count; i++)
   {
-    (*ctx->env)->ExceptionClear(ctx->env);
-    (*ctx->env)->DeleteLocalRef(ctx->env, class_loader);
-    (*ctx->env)->DeleteLocalRef(ctx->env, class_loader_class);
-    jsc_engine_error(ctx, "failed to load class");
-    return false;
-  }
+    if (bindings[i].live)
+    {
+      continue;
+    }
 
-  ctx->runtime_class = (*ctx->env)->NewGlobalRef(ctx->env, loaded_class);
-  (*ctx->env)->DeleteLocalRef(ctx->env, loaded_class);
+    char* name = strndup(bindings[i].name, bindings[i].length);
+    char** names = (char**)realloc(ctx->unused_names,
+                                   (ctx->unused_count + 1) * sizeof(char*));
+    ok = name && names;
 
-  jmethodID main_method = (*ctx->env)->GetStaticMethodID(
-      ctx->env, ctx->runtime_class, "main", "([Ljava/lang/String;)V");
+    if (names)
+    {
+      ctx->unused_names = names;
+    }
 
-  if (main_method == NULL)
-  {
-    (*ctx->env)->ExceptionClear(ctx->env);
-    (*ctx->env)->DeleteLocalRef(ctx->env, class_loader);
-    (*ctx->env)->DeleteLocalRef(ctx->env, class_loader_class);
-    jsc_engine_error(ctx, "failed to find main method");
-    return false;
+    if (ok)
+    {
+      ctx->unused_names[ctx->unused_count++] = name;
+    }
+    else
+    {
+      free(name);
+    }
   }
 
-  ctx->execute_method = main_method;
+  free(bindings);
+  return ok;
+}
 
-  (*ctx->env)->DeleteLocalRef(ctx->env, class_loader);
-  (*ctx->env)->DeleteLocalRef(ctx->env, class_loader_class);
+/* whether the program never reads the top-level binding name */
+static bool jsc_engine_is_unused(jsc_engine_context* ctx, const char* name)
+{
+  return (ctx->flags & JSC_ENGINE_FLAG_DROP_UNUSED) &&
+         jsc_engine_is_global_scope(ctx) && ctx->unused_count > 0 &&
+         bsearch(&name, ctx->unused_names, ctx->unused_count, sizeof(char*),
+                 jsc_engine_compare_names) != NULL;
+}
 
-  return true;
+/* nanoseconds on a monotonic clock */
+static uint64_t jsc_engine_clock(void)
+{
+#if defined(_WIN32) || defined(_WIN64)
+  LARGE_INTEGER counter, frequency;
+  QueryPerformanceCounter(&counter);
+  QueryPerformanceFrequency(&frequency);
+  return (uint64_t)((double)counter.QuadPart * 1e9 / frequency.QuadPart);
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+#endif
 }
 
-jsc_value jsc_engine_run(jsc_engine_context* ctx)
+/**
+ * @brief time phase from now on
+ *
+ * @details The time since the last switch goes to the phase that was being
+ *          timed, which is returned so that the caller can switch back to
+ *          it when phase is over.
+ */
+static jsc_engine_phase jsc_engine_enter_phase(jsc_engine_context* ctx,
+                                               jsc_engine_phase phase)
 {
-  if (ctx->had_error)
-  {
-    return jsc_value_create_undefined();
-  }
+  jsc_engine_phase previous = ctx->phase;
+  uint64_t now = jsc_engine_clock();
 
-  if (!jsc_engine_init_jvm(ctx))
+  if (previous != JSC_ENGINE_PHASE_NONE)
   {
-    return jsc_value_create_undefined();
+    ctx->stats.phase_ns[previous] += now - ctx->phase_start;
   }
 
-  (*ctx->env)->CallStaticVoidMethod(ctx->env, ctx->runtime_class,
-                                    ctx->execute_method, ctx->args);
-
-  if ((*ctx->env)->ExceptionCheck(ctx->env))
-  {
-    jthrowable exception = (*ctx->env)->ExceptionOccurred(ctx->env);
-    (*ctx->env)->ExceptionClear(ctx->env);
-
-    jclass throwable_class =
-        (*ctx->env)->FindClass(ctx->env, "java/lang/Throwable");
-    jmethodID get_message = (*ctx->env)->GetMethodID(
-        ctx->env, throwable_class, "getMessage", "()Ljava/lang/String;");
+  ctx->phase = phase;
+  ctx->phase_start = now;
+  return previous;
+}
 
-    jstring message =
-        (*ctx->env)->CallObjectMethod(ctx->env, exception, get_message);
+/* bytes of heap in use by the whole process, or 0 where the C library
+   cannot tell */
+static size_t jsc_engine_heap_in_use(void)
+{
+#ifdef JSC_ENGINE_HAVE_MALLINFO2
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+#else
+  return 0;
+#endif
+}
 
-    const char* error_message =
-        (*ctx->env)->GetStringUTFChars(ctx->env, message, NULL);
-    jsc_engine_error(ctx, error_message);
-    (*ctx->env)->ReleaseStringUTFChars(ctx->env, message, error_message);
+/* count a class serialized to size bytes, none if it failed */
+static void jsc_engine_count_class(jsc_engine_context* ctx,
+                                   jsc_bytecode_context* bytecode,
+                                   uint32_t size)
+{
+  if (size == 0)
+  {
+    return;
+  }
 
-    (*ctx->env)->DeleteLocalRef(ctx->env, message);
-    (*ctx->env)->DeleteLocalRef(ctx->env, throwable_class);
-    (*ctx->env)->DeleteLocalRef(ctx->env, exception);
+  ctx->stats.methods += bytecode->method_count;
+  ctx->stats.constants += bytecode->constant_pool_count - 1u;
+  ctx->stats.class_bytes += size;
 
-    return jsc_value_create_undefined();
+  for (uint16_t i = 0; i < bytecode->method_count; i++)
+  {
+    ctx->stats.code_bytes +=
+        jsc_bytecode_get_method_code_length(&bytecode->methods[i]);
   }
-
-  return jsc_value_create_undefined();
 }
 
-jsc_value jsc_engine_call_method(jsc_engine_context* ctx,
-                                 const char* method_name, jsc_value* args,
-                                 int arg_count)
+static bool jsc_engine_parse_text(jsc_engine_context* ctx, const char* source)
 {
-  if (ctx->env == NULL)
+  if (ctx->flags & JSC_ENGINE_FLAG_LAZY_FUNCTIONS)
   {
-    if (!jsc_engine_init_jvm(ctx))
+    /* deferred bodies point into the text until their first call */
+    char* copy = strdup(source);
+
+    if (!copy)
     {
-      return jsc_value_create_undefined();
+      jsc_engine_error(ctx, "out of memory");
+      return false;
     }
+
+    free(ctx->source);
+    ctx->source = copy;
+    source = copy;
   }
 
-  jmethodID method_id = NULL;
+  /* the scans only tokenize; jsc_engine_parse_source switches back */
+  jsc_engine_enter_phase(ctx, JSC_ENGINE_PHASE_TOKENIZE);
 
-  char descriptor[1 << 10] = "(";
+  if (!jsc_engine_collect_assigned_names(ctx, source))
+  {
+    jsc_engine_error(ctx, "failed to scan assignments");
+    return false;
+  }
 
-  for (int i = 0; i < arg_count; i++)
+  if ((ctx->flags & JSC_ENGINE_FLAG_DROP_UNUSED) && !ctx->unused_names &&
+      !jsc_engine_collect_unused_names(ctx, source))
   {
-    strcat(descriptor, "Ljava/lang/Object;");
+    jsc_engine_error(ctx, "failed to scan unused bindings");
+    return false;
   }
 
-  strcat(descriptor, ")Ljava/lang/Object;");
+  jsc_engine_enter_phase(ctx, JSC_ENGINE_PHASE_PARSE);
 
-  method_id = (*ctx->env)->GetStaticMethodID(ctx->env, ctx->runtime_class,
-                                             method_name, descriptor);
+  ctx->tokenizer = jsc_tokenizer_init(source, strlen(source));
 
-  if (method_id == NULL)
+  if (!ctx->tokenizer)
   {
-    (*ctx->env)->ExceptionClear(ctx->env);
-    jsc_engine_error(ctx, "method not found");
-    return jsc_value_create_undefined();
+    jsc_engine_error(ctx, "failed to initialize tokenizer");
+    return false;
   }
 
-  jobjectArray jargs = NULL;
+  ctx->bytecode = jsc_bytecode_create_class(ctx->class_name, "java/lang/Object",
+                                            JSC_ACC_PUBLIC | JSC_ACC_SUPER);
 
-  if (arg_count > 0)
+  if (!ctx->bytecode)
   {
-    jclass object_class = (*ctx->env)->FindClass(ctx->env, "java/lang/Object");
-    jargs =
-        (*ctx->env)->NewObjectArray(ctx->env, arg_count, object_class, NULL);
-    (*ctx->env)->DeleteLocalRef(ctx->env, object_class);
-
-    for (int i = 0; i < arg_count; i++)
-    {
-      jobject arg_obj = jsc_value_to_jobject(ctx->env, args[i]);
-      (*ctx->env)->SetObjectArrayElement(ctx->env, jargs, i, arg_obj);
-      (*ctx->env)->DeleteLocalRef(ctx->env, arg_obj);
-    }
+    jsc_engine_error(ctx, "failed to initialize bytecode");
+    return false;
   }
 
-  jobject result = (*ctx->env)->CallStaticObjectMethod(
-      ctx->env, ctx->runtime_class, method_id, jargs);
+  jsc_engine_advance(ctx);
 
-  if (jargs != NULL)
-  {
-    (*ctx->env)->DeleteLocalRef(ctx->env, jargs);
-  }
+  jsc_engine_parse_program(ctx);
 
-  if ((*ctx->env)->ExceptionCheck(ctx->env))
+  if (ctx->deferred_count > 0 && !ctx->had_error &&
+      !(ctx->flags & JSC_ENGINE_FLAG_LAZY_FUNCTIONS))
   {
-    jthrowable exception = (*ctx->env)->ExceptionOccurred(ctx->env);
-    (*ctx->env)->ExceptionClear(ctx->env);
+    jsc_engine_compile_deferred_functions(ctx);
+  }
 
-    jclass throwable_class =
-        (*ctx->env)->FindClass(ctx->env, "java/lang/Throwable");
-    jmethodID get_message = (*ctx->env)->GetMethodID(
-        ctx->env, throwable_class, "getMessage", "()Ljava/lang/String;");
+  return !ctx->had_error;
+}
 
-    jstring message =
-        (*ctx->env)->CallObjectMethod(ctx->env, exception, get_message);
+/* jsc_engine_parse_text, timed and, under FLAG_STATS, measured */
+static bool jsc_engine_parse_source(jsc_engine_context* ctx, const char* source)
+{
+  bool measured = (ctx->flags & JSC_ENGINE_FLAG_STATS) != 0;
+  size_t heap = measured ? jsc_engine_heap_in_use() : 0;
 
-    const char* error_message =
-        (*ctx->env)->GetStringUTFChars(ctx->env, message, NULL);
-    jsc_engine_error(ctx, error_message);
-    (*ctx->env)->ReleaseStringUTFChars(ctx->env, message, error_message);
+  jsc_engine_phase previous =
+      jsc_engine_enter_phase(ctx, JSC_ENGINE_PHASE_PARSE);
+  bool parsed = jsc_engine_parse_text(ctx, source);
+  jsc_engine_enter_phase(ctx, previous);
 
-    (*ctx->env)->DeleteLocalRef(ctx->env, message);
-    (*ctx->env)->DeleteLocalRef(ctx->env, throwable_class);
-    (*ctx->env)->DeleteLocalRef(ctx->env, exception);
+  size_t grown = measured ? jsc_engine_heap_in_use() : 0;
 
-    return jsc_value_create_undefined();
+  if (grown > heap)
+  {
+    ctx->stats.heap_growth_bytes += grown - heap;
   }
 
-  jsc_value ret_val = jsc_value_from_jobject(ctx->env, result);
+  return parsed;
+}
 
-  if (result != NULL)
+/**
+ * @brief recover the deferred function table of a lazy program
+ *
+ * @details After a cache hit only the program text is known, so the first
+ *          lazy call repeats the first pass; function bodies are still
+ *          skipped.
+ */
+static bool jsc_engine_prepare_lazy_functions(jsc_engine_context* ctx)
+{
+  if (!ctx->bytecode && ctx->source)
   {
-    (*ctx->env)->DeleteLocalRef(ctx->env, result);
+    char* source = ctx->source;
+    ctx->source = NULL;
+
+    bool parsed = jsc_engine_parse_source(ctx, source);
+    free(source);
+
+    return parsed;
   }
 
-  return ret_val;
+  return !ctx->had_error;
 }
 
-jsc_value jsc_engine_eval(const char* source)
+/**
+ * @brief create the per-context class directory on first use
+ *
+ * @details Contexts that only compile to memory (e.g. the batch compiler's
+ *          workers) never touch the file system. The directory name comes
+ *          from mkdtemp so that any number of contexts can coexist.
+ */
+static bool jsc_engine_ensure_temp_dir(jsc_engine_context* ctx)
 {
-  jsc_engine_context* ctx = jsc_engine_init("JSCScript");
-
-  if (!ctx)
+  if (ctx->temp_dir)
   {
-    jsc_value undefined = jsc_value_create_undefined();
-    return undefined;
+    return true;
   }
 
-  if (!jsc_engine_compile(ctx, source))
-  {
-    // jsc_value undefined = jsc_value_create_undefined();
-    // jsc_engine_free(ctx);
-    // return undefined;
-  }
+  char dir_name[1 << 10];
+
+#if defined(_WIN32) || defined(_WIN64)
+  char temp_path[1 << 10];
+  GetTempPath(1 << 10, temp_path);
 
-  if (!jsc_bytecode_write_to_file(ctx->bytecode, "JSCScript.class"))
+  static long counter = 0;
+  sprintf(dir_name, "%sjsc_engine_%ld_%lu_%ld", temp_path, (long)time(NULL),
+          (unsigned long)GetCurrentProcessId(), counter++);
+
+  if (mkdir(dir_name, 0755) != 0)
   {
-    jsc_value undefined = jsc_value_create_undefined();
-    jsc_engine_free(ctx);
-    return undefined;
+    jsc_engine_error(ctx, "failed to create class directory");
+    return false;
   }
+#else
+  strcpy(dir_name, "/tmp/jsc_engine_XXXXXX");
 
-  if (!jsc_engine_init_jvm(ctx))
+  if (!mkdtemp(dir_name))
   {
-    jsc_value undefined = jsc_value_create_undefined();
-    jsc_engine_free(ctx);
-    return undefined;
+    jsc_engine_error(ctx, "failed to create class directory");
+    return false;
   }
+#endif
 
-  jsc_value result = jsc_engine_run(ctx);
+  ctx->temp_dir = strdup(dir_name);
+  ctx->class_path = strdup(dir_name);
 
-  jsc_engine_free(ctx);
+  if (!ctx->temp_dir || !ctx->class_path)
+  {
+    jsc_engine_error(ctx, "jsc_engine_ensure_temp_dir strdup");
+    return false;
+  }
 
-  return result;
+  return true;
 }
 
-jsc_symbol* jsc_engine_add_symbol(jsc_engine_context* ctx, const char* name,
-                                  jsc_symbol_type type)
+static char* jsc_engine_class_file_path(jsc_engine_context* ctx)
 {
-  jsc_symbol* existing = jsc_engine_lookup_symbol(ctx, name);
-
-  if (existing && existing->scope_depth == ctx->current_scope->depth)
+  if (!jsc_engine_ensure_temp_dir(ctx))
   {
-    jsc_engine_error(ctx, "variable already declared in this scope");
     return NULL;
   }
 
-  jsc_symbol* symbol = (jsc_symbol*)malloc(sizeof(jsc_symbol));
+  char* class_file =
+      malloc(strlen(ctx->temp_dir) + strlen(ctx->class_name) + 8);
 
-  if (!symbol)
+  if (!class_file)
   {
-    jsc_engine_error(ctx, "jsc_engine_add_symbol malloc");
+    jsc_engine_error(ctx, "jsc_engine_class_file_path malloc");
     return NULL;
   }
 
-  memset(symbol, 0, sizeof(jsc_symbol));
+  sprintf(class_file, "%s%s%s.class", ctx->temp_dir, PATH_SEPARATOR,
+          ctx->class_name);
 
-  symbol->name = strdup(name);
-  symbol->type = type;
-  symbol->initialized = false;
-  symbol->scope_depth = ctx->current_scope->depth;
+  return class_file;
+}
 
-  if (jsc_engine_is_global_scope(ctx))
-  {
-    symbol->index = 0;
-  }
-  else
+static bool jsc_engine_write_class_file(jsc_engine_context* ctx,
+                                        const uint8_t* data, uint32_t size)
+{
+  char* class_file = jsc_engine_class_file_path(ctx);
+
+  if (!class_file)
   {
-    symbol->index = ctx->local_index++;
-    ctx->current_scope->local_count++;
+    return false;
   }
 
-  symbol->next = ctx->current_scope->symbols;
-  ctx->current_scope->symbols = symbol;
+  jsc_engine_phase previous =
+      jsc_engine_enter_phase(ctx, JSC_ENGINE_PHASE_CLASS_WRITE);
 
-  return symbol;
-}
+  FILE* file = fopen(class_file, "wb");
+  free(class_file);
 
-jsc_symbol* jsc_engine_lookup_symbol(jsc_engine_context* ctx, const char* name)
-{
-  jsc_scope* scope = ctx->current_scope;
+  size_t written = file ? fwrite(data, 1, size, file) : 0;
 
-  while (scope)
+  if (file && fclose(file) != 0)
   {
-    jsc_symbol* symbol = scope->symbols;
+    written = 0;
+  }
 
-    while (symbol)
-    {
-      if (strcmp(symbol->name, name) == 0)
-      {
-        return symbol;
-      }
+  jsc_engine_enter_phase(ctx, previous);
 
-      symbol = symbol->next;
-    }
+  if (written != size)
+  {
+    jsc_engine_error(ctx, "failed to write class file");
+    return false;
+  }
 
-    scope = scope->parent;
+  return true;
+}
+
+bool jsc_engine_compile(jsc_engine_context* ctx, const char* source)
+{
+  if (!jsc_engine_parse_source(ctx, source))
+  {
+    return false;
   }
 
-  return NULL;
+  char* class_file = jsc_engine_class_file_path(ctx);
+
+  if (!class_file)
+  {
+    return false;
+  }
+
+  /* written as segments, without gathering the class into one buffer */
+  jsc_engine_phase previous =
+      jsc_engine_enter_phase(ctx, JSC_ENGINE_PHASE_SERIALIZE);
+  bool written = jsc_bytecode_serialize(ctx->bytecode, &ctx->writer);
+
+  jsc_engine_enter_phase(ctx, JSC_ENGINE_PHASE_CLASS_WRITE);
+  written = written && jsc_class_writer_write_file(&ctx->writer, class_file);
+  jsc_engine_enter_phase(ctx, previous);
+
+  free(class_file);
+
+  if (!written)
+  {
+    jsc_engine_error(ctx, "failed to write class file");
+    return false;
+  }
+
+  jsc_engine_count_class(ctx, ctx->bytecode, ctx->writer.size);
+  return true;
 }
 
-bool jsc_engine_match(jsc_engine_context* ctx, jsc_token_type type)
+bool jsc_engine_compile_to_buffer(jsc_engine_context* ctx, const char* source,
+                                  uint8_t** out_buffer, uint32_t* out_size)
 {
-  if (!jsc_engine_check(ctx, type))
+  if (!jsc_engine_parse_source(ctx, source))
   {
     return false;
   }
 
-  jsc_engine_advance(ctx);
+  jsc_engine_phase previous =
+      jsc_engine_enter_phase(ctx, JSC_ENGINE_PHASE_SERIALIZE);
+  *out_size = jsc_bytecode_write(ctx->bytecode, out_buffer);
+  jsc_engine_enter_phase(ctx, previous);
+  jsc_engine_count_class(ctx, ctx->bytecode, *out_size);
+
+  if (*out_size == 0)
+  {
+    jsc_engine_error(ctx, "failed to serialize class");
+    return false;
+  }
 
   return true;
 }
 
-bool jsc_engine_check(jsc_engine_context* ctx, jsc_token_type type)
+/**
+ * @brief whether a class taken from the cache is fit to be loaded
+ *
+ * @details A blob shared through the cache directory may have been
+ *          truncated or damaged on disk; one that fails is compiled again,
+ *          and the store that follows replaces it.
+ */
+static bool jsc_engine_cached_class_is_valid(const jsc_cache_blob* blob)
 {
-  return ctx->current_token.type == type;
+  jsc_class_reader reader;
+  bool valid = jsc_class_reader_init(&reader, blob->data, blob->size) &&
+               jsc_class_reader_validate(&reader);
+
+  jsc_class_reader_free(&reader);
+  return valid;
 }
 
-void jsc_engine_advance(jsc_engine_context* ctx)
+/**
+ * @brief compile source into ctx->class_buffer
+ *
+ * @details The writer and buffer of ctx are reused from one compile to the
+ *          next, so the class is serialized without a fresh allocation
+ *          once the buffer has grown to fit. *out_buffer belongs to ctx and
+ *          is valid until the next compile.
+ */
+static bool jsc_engine_compile_to_class_buffer(jsc_engine_context* ctx,
+                                               const char* source,
+                                               const uint8_t** out_buffer,
+                                               uint32_t* out_size)
 {
-  ctx->current_token = jsc_next_token(ctx->tokenizer);
+  if (!jsc_engine_parse_source(ctx, source))
+  {
+    return false;
+  }
 
-  if (jsc_tokenizer_has_error(ctx->tokenizer))
+  jsc_engine_phase previous =
+      jsc_engine_enter_phase(ctx, JSC_ENGINE_PHASE_SERIALIZE);
+  *out_size = jsc_bytecode_write_buffer(ctx->bytecode, &ctx->writer,
+                                        &ctx->class_buffer,
+                                        &ctx->class_buffer_capacity);
+  jsc_engine_enter_phase(ctx, previous);
+  jsc_engine_count_class(ctx, ctx->bytecode, *out_size);
+
+  if (*out_size == 0)
   {
-    jsc_engine_error(ctx, jsc_tokenizer_get_error(ctx->tokenizer));
+    jsc_engine_error(ctx, "failed to serialize class");
+    return false;
   }
+
+  *out_buffer = ctx->class_buffer;
+  return true;
 }
 
-void jsc_engine_error(jsc_engine_context* ctx, const char* message)
+/**
+ * @brief the options a cache key must cover besides source and class name
+ *
+ * @details Every flag that changes the class bytes, the class version and
+ *          the codegen version. Worker count and FLAG_PARALLEL_FUNCTIONS
+ *          leave the output as it is, and FLAG_STATS only measures.
+ */
+static uint64_t jsc_engine_cache_options(const jsc_engine_context* ctx)
 {
-  if (ctx->had_error)
+  uint32_t flags = ctx->flags & ~(uint32_t)(JSC_ENGINE_FLAG_PARALLEL_FUNCTIONS |
+                                            JSC_ENGINE_FLAG_STATS);
+
+  return (uint64_t)JSC_ENGINE_CODEGEN_VERSION << 48 |
+         (uint64_t)jsc_engine_class_version(ctx) << 32 | flags;
+}
+
+/**
+ * @brief compile source through a content-addressed class cache
+ *
+ * @details On a hit the cached class bytes are validated and published to
+ *          the class path directly, and the tokenizer, parser and emitter
+ *          never run; ctx->bytecode stays NULL in that case. On a miss, or
+ *          a hit that fails validation, the class is compiled, serialized
+ *          once and shared between the cache and the class file.
+ */
+bool jsc_engine_compile_cached(jsc_engine_context* ctx, jsc_cache* cache,
+                               const char* source)
+{
+  if (!cache)
   {
-    return;
+    return jsc_engine_compile(ctx, source);
   }
 
-  ctx->had_error = true;
+  jsc_cache_key key;
+  jsc_cache_compute_key(&key, source, strlen(source), ctx->class_name,
+                        jsc_engine_cache_options(ctx));
 
-  if (ctx->error_message)
+  jsc_cache_blob blob;
+
+  bool hit = jsc_cache_acquire(cache, &key, &blob);
+
+  if (hit && !jsc_engine_cached_class_is_valid(&blob))
   {
-    free(ctx->error_message);
+    jsc_cache_release(&blob);
+    hit = false;
   }
 
-  ctx->error_message = strdup(message);
+  if (hit)
+  {
+    bool written = jsc_engine_write_class_file(ctx, blob.data, blob.size);
+    jsc_cache_release(&blob);
+
+    if (written && (ctx->flags & JSC_ENGINE_FLAG_LAZY_FUNCTIONS))
+    {
+      free(ctx->source);
+      ctx->source = strdup(source); /* for jsc_engine_compile_lazy_function */
+    }
+
+    return written;
+  }
+
+  const uint8_t* buffer = NULL;
+  uint32_t size = 0;
+
+  if (!jsc_engine_compile_to_class_buffer(ctx, source, &buffer, &size))
+  {
+    return false;
+  }
+
+  jsc_cache_store(cache, &key, buffer, size);
+
+  return jsc_engine_write_class_file(ctx, buffer, size);
 }
 
-void jsc_engine_emit_byte(jsc_engine_context* ctx, uint8_t byte)
+static jsc_cache* jsc_engine_default_cache = NULL;
+
+void jsc_engine_set_default_cache(jsc_cache* cache)
 {
-  jsc_bytecode_emit(ctx->bytecode, ctx->current_method, byte);
+  jsc_engine_default_cache = cache;
+}
 
-  switch (byte)
+jsc_cache* jsc_engine_get_default_cache(void)
+{
+  if (!jsc_engine_default_cache)
   {
-  case JSC_JVM_POP:
-    ctx->stack_size -= 1;
-    break;
-  case JSC_JVM_POP2:
-    ctx->stack_size -= 2;
-    break;
-  case JSC_JVM_IADD:
-  case JSC_JVM_ISUB:
-  case JSC_JVM_IMUL:
-  case JSC_JVM_IDIV:
-  case JSC_JVM_IREM:
-  case JSC_JVM_ISHL:
-  case JSC_JVM_ISHR:
-  case JSC_JVM_IUSHR:
-  case JSC_JVM_IAND:
-  case JSC_JVM_IOR:
-  case JSC_JVM_IXOR:
-  case JSC_JVM_FADD:
-  case JSC_JVM_FSUB:
-  case JSC_JVM_FMUL:
-  case JSC_JVM_FDIV:
-  case JSC_JVM_FREM:
-    ctx->stack_size -= 1;
-    break;
-  case JSC_JVM_LADD:
-  case JSC_JVM_LSUB:
-  case JSC_JVM_LMUL:
-  case JSC_JVM_LDIV:
-  case JSC_JVM_LREM:
-  case JSC_JVM_LSHL:
-  case JSC_JVM_LSHR:
-  case JSC_JVM_LUSHR:
-  case JSC_JVM_LAND:
-  case JSC_JVM_LOR:
-  case JSC_JVM_LXOR:
-  case JSC_JVM_DADD:
-  case JSC_JVM_DSUB:
-  case JSC_JVM_DMUL:
-  case JSC_JVM_DDIV:
-  case JSC_JVM_DREM:
-    ctx->stack_size -= 2;
-    break;
-  case JSC_JVM_PUTSTATIC:
-    ctx->stack_size -= 1;
-    break;
-  case JSC_JVM_PUTFIELD:
-    ctx->stack_size -= 2;
-    break;
-  case JSC_JVM_IRETURN:
-  case JSC_JVM_FRETURN:
-  case JSC_JVM_ARETURN:
-    ctx->stack_size -= 1;
-    break;
-  case JSC_JVM_LRETURN:
-  case JSC_JVM_DRETURN:
-    ctx->stack_size -= 2;
-    break;
-  case JSC_JVM_NEW:
-    ctx->stack_size += 1;
-    break;
-  case JSC_JVM_DUP:
-    ctx->stack_size += 1;
-    break;
-  case JSC_JVM_INVOKESPECIAL:
-    ctx->stack_size -= 2;
-    break;
-  case JSC_JVM_INVOKEVIRTUAL:
-  case JSC_JVM_INVOKESTATIC:
-    ctx->stack_size -= 1;
-    break;
-  case JSC_JVM_GETSTATIC:
-    ctx->stack_size += 1;
-    break;
-  case JSC_JVM_ACONST_NULL:
-  case JSC_JVM_ICONST_M1:
-  case JSC_JVM_ICONST_0:
-  case JSC_JVM_ICONST_1:
-  case JSC_JVM_ICONST_2:
-  case JSC_JVM_ICONST_3:
-  case JSC_JVM_ICONST_4:
-  case JSC_JVM_ICONST_5:
-  case JSC_JVM_FCONST_0:
-  case JSC_JVM_FCONST_1:
-  case JSC_JVM_FCONST_2:
-  case JSC_JVM_BIPUSH:
-  case JSC_JVM_SIPUSH:
-  case JSC_JVM_LDC:
-  case JSC_JVM_LDC_W:
-    ctx->stack_size += 1;
-    break;
-  case JSC_JVM_LCONST_0:
-  case JSC_JVM_LCONST_1:
-  case JSC_JVM_DCONST_0:
-  case JSC_JVM_DCONST_1:
-  case JSC_JVM_LDC2_W:
-    ctx->stack_size += 2;
-    break;
-  case JSC_JVM_ALOAD_0:
-  case JSC_JVM_ALOAD_1:
-  case JSC_JVM_ALOAD_2:
-  case JSC_JVM_ALOAD_3:
-  case JSC_JVM_ALOAD:
-    ctx->stack_size += 1;
-    break;
-  case JSC_JVM_ASTORE_0:
-  case JSC_JVM_ASTORE_1:
-  case JSC_JVM_ASTORE_2:
-  case JSC_JVM_ASTORE_3:
-  case JSC_JVM_ASTORE:
-    ctx->stack_size -= 1;
-    break;
+    jsc_engine_default_cache =
+        jsc_cache_init(JSC_CACHE_DEFAULT_MAX_BYTES, NULL);
+  }
+
+  return jsc_engine_default_cache;
+}
+
+const jsc_engine_stats* jsc_engine_get_stats(const jsc_engine_context* ctx)
+{
+  return &ctx->stats;
+}
+
+/* add stats to total, e.g. to sum the contexts of a batch compile */
+void jsc_engine_add_stats(jsc_engine_stats* total,
+                          const jsc_engine_stats* stats)
+{
+  for (int i = 0; i < JSC_ENGINE_PHASE_COUNT; i++)
+  {
+    total->phase_ns[i] += stats->phase_ns[i];
+  }
+
+  total->tokens += stats->tokens;
+  total->methods += stats->methods;
+  total->constants += stats->constants;
+  total->code_bytes += stats->code_bytes;
+  total->class_bytes += stats->class_bytes;
+  total->heap_growth_bytes += stats->heap_growth_bytes;
+}
+
+const char* jsc_engine_phase_name(jsc_engine_phase phase)
+{
+  static const char* names[JSC_ENGINE_PHASE_COUNT] = {
+      "none", "tokenize", "parse",      "serialize",
+      "class_write", "jvm_init", "class_load", "run"};
+
+  return (unsigned)phase < JSC_ENGINE_PHASE_COUNT ? names[phase] : NULL;
+}
+
+/**
+ * @brief print stats as one JSON object
+ *
+ * @details Phases are "<name>_ns" members, in jsc_engine_phase order.
+ */
+void jsc_engine_print_stats(const jsc_engine_stats* stats, FILE* out)
+{
+  fprintf(out, "{");
+
+  for (int i = JSC_ENGINE_PHASE_NONE + 1; i < JSC_ENGINE_PHASE_COUNT; i++)
+  {
+    fprintf(out, "\"%s_ns\": %llu, ", jsc_engine_phase_name(i),
+            (unsigned long long)stats->phase_ns[i]);
+  }
+
+  fprintf(out,
+          "\"tokens\": %llu, \"methods\": %llu, \"constants\": %llu, "
+          "\"code_bytes\": %llu, \"class_bytes\": %llu, "
+          "\"heap_growth_bytes\": %llu}\n",
+          (unsigned long long)stats->tokens,
+          (unsigned long long)stats->methods,
+          (unsigned long long)stats->constants,
+          (unsigned long long)stats->code_bytes,
+          (unsigned long long)stats->class_bytes,
+          (unsigned long long)stats->heap_growth_bytes);
+}
+
+#ifndef JSC_NO_JVM
+/**
+ * @brief native half of a lazy function stub
+ *
+ * @details Runs on the first call of a lazy function: compiles its body,
+ *          defines the class next to the program class, stores a handle to
+ *          the method in the stub's field and points the stub's call site at
+ *          it. Threads racing on a first call are serialized on the class
+ *          monitor; failures, and calls after the owning context is freed,
+ *          are thrown.
+ */
+static jobject JNICALL jsc_engine_lazy_link(JNIEnv* env, jclass cls,
+                                            jobject site, jint index)
+{
+  jfieldID context_field = (*env)->GetStaticFieldID(env, cls, "jsc_context",
+                                                    "J");
+  jsc_engine_context* ctx =
+      context_field ? (jsc_engine_context*)(intptr_t)(*env)->GetStaticLongField(
+                          env, cls, context_field)
+                    : NULL;
+
+  if (!ctx)
+  {
+    (*env)->ExceptionClear(env);
+    jclass error_class =
+        (*env)->FindClass(env, "java/lang/IllegalStateException");
+    (*env)->ThrowNew(env, error_class, "lazy function has no compiler");
+    return NULL;
+  }
+
+  if ((*env)->MonitorEnter(env, cls) != JNI_OK)
+  {
+    return NULL;
+  }
+
+  if (!jsc_engine_prepare_lazy_functions(ctx) || index < 0 ||
+      (uint32_t)index >= ctx->deferred_count)
+  {
+    jclass error_class =
+        (*env)->FindClass(env, "java/lang/IllegalStateException");
+    (*env)->ThrowNew(env, error_class, "no such lazy function");
+    (*env)->MonitorExit(env, cls);
+    return NULL;
+  }
+
+  jsc_deferred_function* function = &ctx->deferred_functions[index];
+
+  char field_name[300];
+  sprintf(field_name, "lazy_%s", function->name);
+
+  /* a racing thread may have linked the function while this one waited */
+  jfieldID handle_field = (*env)->GetStaticFieldID(
+      env, cls, field_name, "Ljava/lang/invoke/MethodHandle;");
+  jobject handle = handle_field
+                       ? (*env)->GetStaticObjectField(env, cls, handle_field)
+                       : NULL;
+  uint8_t* buffer = NULL;
+  uint32_t size = 0;
+
+  if (handle_field && !handle &&
+      !jsc_engine_compile_lazy_function(ctx, (uint32_t)index, &buffer, &size))
+  {
+    jclass error_class =
+        (*env)->FindClass(env, "java/lang/IllegalStateException");
+    (*env)->ThrowNew(env, error_class, ctx->error_message);
+    (*env)->MonitorExit(env, cls);
+    return NULL;
+  }
+
+  if (buffer)
+  {
+    char* class_name =
+        malloc(strlen(ctx->class_name) + strlen(function->name) + 2);
+    sprintf(class_name, "%s$%s", ctx->class_name, function->name);
+
+    jclass class_class = (*env)->FindClass(env, "java/lang/Class");
+    jmethodID get_class_loader = (*env)->GetMethodID(
+        env, class_class, "getClassLoader", "()Ljava/lang/ClassLoader;");
+    jobject class_loader =
+        (*env)->CallObjectMethod(env, cls, get_class_loader);
+
+    jclass function_class = (*env)->DefineClass(
+        env, class_name, class_loader, (const jbyte*)buffer, (jsize)size);
+    free(class_name);
+
+    jclass handles_class =
+        (*env)->FindClass(env, "java/lang/invoke/MethodHandles");
+    jclass lookup_class =
+        (*env)->FindClass(env, "java/lang/invoke/MethodHandles$Lookup");
+    jclass type_class = (*env)->FindClass(env, "java/lang/invoke/MethodType");
+
+    char* descriptor =
+        jsc_engine_generate_descriptor(ctx, function->param_count);
+    jstring name = (*env)->NewStringUTF(env, function->name);
+    jstring descriptor_string = (*env)->NewStringUTF(env, descriptor);
+    free(descriptor);
+
+    if (function_class && handles_class && lookup_class && type_class &&
+        !(*env)->ExceptionCheck(env))
+    {
+      jobject lookup = (*env)->CallStaticObjectMethod(
+          env, handles_class,
+          (*env)->GetStaticMethodID(env, handles_class, "publicLookup",
+                                    "()Ljava/lang/invoke/MethodHandles$Lookup;"));
+      jobject type = (*env)->CallStaticObjectMethod(
+          env, type_class,
+          (*env)->GetStaticMethodID(
+              env, type_class, "fromMethodDescriptorString",
+              "(Ljava/lang/String;Ljava/lang/ClassLoader;)"
+              "Ljava/lang/invoke/MethodType;"),
+          descriptor_string, class_loader);
+
+      if (!(*env)->ExceptionCheck(env))
+      {
+        handle = (*env)->CallObjectMethod(
+            env, lookup,
+            (*env)->GetMethodID(env, lookup_class, "findStatic",
+                                "(Ljava/lang/Class;Ljava/lang/String;"
+                                "Ljava/lang/invoke/MethodType;)"
+                                "Ljava/lang/invoke/MethodHandle;"),
+            function_class, name, type);
+      }
+
+      if (handle && !(*env)->ExceptionCheck(env))
+      {
+        (*env)->SetStaticObjectField(env, cls, handle_field, handle);
+      }
+    }
+  }
+
+  if (handle && !(*env)->ExceptionCheck(env))
+  {
+    jclass site_class =
+        (*env)->FindClass(env, "java/lang/invoke/MutableCallSite");
+    jmethodID set_target =
+        site_class ? (*env)->GetMethodID(env, site_class, "setTarget",
+                                         "(Ljava/lang/invoke/MethodHandle;)V")
+                   : NULL;
+
+    if (set_target)
+    {
+      (*env)->CallVoidMethod(env, site, set_target, handle);
+    }
+  }
+
+  free(buffer);
+  (*env)->MonitorExit(env, cls);
+
+  return handle;
+}
+
+/**
+ * @brief bind the jsc_link native of a class compiled with lazy functions
+ */
+static bool jsc_engine_bind_lazy_functions(jsc_engine_context* ctx)
+{
+  JNIEnv* env = ctx->env;
+  jfieldID context_field =
+      (*env)->GetStaticFieldID(env, ctx->runtime_class, "jsc_context", "J");
+
+  if (!context_field)
+  {
+    (*env)->ExceptionClear(env); /* no lazy functions in this program */
+    return true;
+  }
+
+  JNINativeMethod link = {(char*)"jsc_link",
+                          (char*)JSC_ENGINE_LINK_DESCRIPTOR,
+                          (void*)jsc_engine_lazy_link};
+
+  if ((*env)->RegisterNatives(env, ctx->runtime_class, &link, 1) != JNI_OK)
+  {
+    (*env)->ExceptionClear(env);
+    jsc_engine_error(ctx, "failed to bind lazy functions");
+    return false;
+  }
+
+  (*env)->SetStaticLongField(env, ctx->runtime_class, context_field,
+                             (jlong)(intptr_t)ctx);
+
+  return true;
+}
+
+/**
+ * @brief define JSC_RUNTIME_CLASS in the system class loader
+ *
+ * @details Skipped when an earlier context, or the class path, already
+ *          provides it.
+ */
+static bool jsc_engine_define_runtime(jsc_engine_context* ctx)
+{
+  JNIEnv* env = ctx->env;
+  jclass runtime_class = (*env)->FindClass(env, JSC_RUNTIME_CLASS);
+
+  if (runtime_class != NULL)
+  {
+    (*env)->DeleteLocalRef(env, runtime_class);
+    return true;
+  }
+
+  (*env)->ExceptionClear(env);
+
+  jclass class_loader_class = (*env)->FindClass(env, "java/lang/ClassLoader");
+  jmethodID get_system_class_loader =
+      class_loader_class
+          ? (*env)->GetStaticMethodID(env, class_loader_class,
+                                      "getSystemClassLoader",
+                                      "()Ljava/lang/ClassLoader;")
+          : NULL;
+  jobject class_loader =
+      get_system_class_loader
+          ? (*env)->CallStaticObjectMethod(env, class_loader_class,
+                                           get_system_class_loader)
+          : NULL;
+
+  if (class_loader_class)
+  {
+    (*env)->DeleteLocalRef(env, class_loader_class);
+  }
+
+  if (class_loader == NULL)
+  {
+    (*env)->ExceptionClear(env);
+    jsc_engine_error(ctx, "failed to get system class loader");
+    return false;
+  }
+
+  uint8_t* buffer = NULL;
+  uint32_t size = jsc_runtime_build(&buffer);
+
+  runtime_class =
+      size ? (*env)->DefineClass(env, JSC_RUNTIME_CLASS, class_loader,
+                                 (const jbyte*)buffer, (jsize)size)
+           : NULL;
+
+  free(buffer);
+  (*env)->DeleteLocalRef(env, class_loader);
+
+  if (runtime_class == NULL || (*env)->ExceptionCheck(env))
+  {
+    (*env)->ExceptionClear(env);
+    jsc_engine_error(ctx, "failed to define runtime class");
+    return false;
+  }
+
+  (*env)->DeleteLocalRef(env, runtime_class);
+
+  return true;
+}
+
+static bool jsc_engine_start_jvm(jsc_engine_context* ctx)
+{
+  if (!jsc_engine_ensure_temp_dir(ctx))
+  {
+    return false;
+  }
+
+  char* class_path_option = malloc(strlen(ctx->class_path) + 20);
+
+  if (!class_path_option)
+  {
+    jsc_engine_error(ctx, "jsc_engine_create_jvm malloc");
+    return false;
+  }
+
+  sprintf(class_path_option, "-Djava.class.path=%s", ctx->class_path);
+
+  JavaVMOption jvm_options[] = {{.optionString = class_path_option}};
+
+  JavaVMInitArgs jvm_args = {.version = JNI_VERSION_1_8,
+                             .nOptions = 1,
+                             .options = jvm_options,
+                             .ignoreUnrecognized = JNI_FALSE};
+
+  JNIEnv* env;
+
+  jint result = JNI_CreateJavaVM(&ctx->jvm, (void**)&env, &jvm_args);
+  free(class_path_option);
+
+  if (result != JNI_OK)
+  {
+    jsc_engine_error(ctx, "failed to create JVM");
+    return false;
+  }
+
+  ctx->env = env;
+
+  jclass string_class = (*env)->FindClass(env, "java/lang/String");
+  if (string_class == NULL)
+  {
+    (*env)->ExceptionClear(env);
+    jsc_engine_error(ctx, "failed to find String class");
+    return false;
+  }
+
+  jobjectArray args = (*env)->NewObjectArray(env, 0, string_class, NULL);
+
+  if (args == NULL)
+  {
+    (*env)->ExceptionClear(env);
+    (*env)->DeleteLocalRef(env, string_class);
+    jsc_engine_error(ctx, "failed to create arguments array");
+    return false;
+  }
+
+  ctx->args = (*env)->NewGlobalRef(env, args);
+  (*env)->DeleteLocalRef(env, args);
+  (*env)->DeleteLocalRef(env, string_class);
+
+  /* conditions call its conversions whatever the flags */
+  return jsc_engine_define_runtime(ctx);
+}
+
+static bool jsc_engine_create_jvm(jsc_engine_context* ctx)
+{
+  if (ctx->jvm != NULL)
+  {
+    return true;
+  }
+
+  jsc_engine_phase previous =
+      jsc_engine_enter_phase(ctx, JSC_ENGINE_PHASE_JVM_INIT);
+  bool started = jsc_engine_start_jvm(ctx);
+  jsc_engine_enter_phase(ctx, previous);
+
+  return started;
+}
+
+/* find the compiled class on the class path, and its main method */
+static bool jsc_engine_find_class(jsc_engine_context* ctx)
+{
+  JNIEnv* env = ctx->env;
+
+  jclass runtime_class = (*env)->FindClass(env, ctx->class_name);
+
+  if (runtime_class == NULL)
+  {
+    (*env)->ExceptionClear(env);
+    jsc_engine_error(ctx, "failed to find compiled class");
+    return false;
+  }
+
+  ctx->runtime_class = (*env)->NewGlobalRef(env, runtime_class);
+  (*env)->DeleteLocalRef(env, runtime_class);
+
+  jmethodID main_method = (*env)->GetStaticMethodID(
+      env, ctx->runtime_class, "main", "([Ljava/lang/String;)V");
+
+  if (main_method == NULL)
+  {
+    (*env)->ExceptionClear(env);
+    jsc_engine_error(ctx, "failed to find main method");
+    return false;
+  }
+
+  ctx->execute_method = main_method;
+
+  return jsc_engine_bind_lazy_functions(ctx);
+}
+
+bool jsc_engine_init_jvm(jsc_engine_context* ctx)
+{
+  if (!jsc_engine_create_jvm(ctx))
+  {
+    return false;
+  }
+
+  if (ctx->runtime_class != NULL)
+  {
+    return true;
+  }
+
+  jsc_engine_phase previous =
+      jsc_engine_enter_phase(ctx, JSC_ENGINE_PHASE_CLASS_LOAD);
+  bool found = jsc_engine_find_class(ctx);
+  jsc_engine_enter_phase(ctx, previous);
+
+  return found;
+}
+
+/**
+ * @brief define the compiled class straight from memory
+ *
+ * @details Used with cache blobs so that a mapped class file reaches the JVM
+ *          without being copied to the class path and read back.
+ */
+static bool jsc_engine_define_system_class(jsc_engine_context* ctx,
+                                           const uint8_t* data, uint32_t size)
+{
+  JNIEnv* env = ctx->env;
+
+  jclass class_loader_class = (*env)->FindClass(env, "java/lang/ClassLoader");
+  if (class_loader_class == NULL)
+  {
+    (*env)->ExceptionClear(env);
+    jsc_engine_error(ctx, "failed to find ClassLoader class");
+    return false;
+  }
+
+  jmethodID get_system_class_loader =
+      (*env)->GetStaticMethodID(env, class_loader_class, "getSystemClassLoader",
+                                "()Ljava/lang/ClassLoader;");
+
+  jobject class_loader =
+      get_system_class_loader
+          ? (*env)->CallStaticObjectMethod(env, class_loader_class,
+                                           get_system_class_loader)
+          : NULL;
+
+  (*env)->DeleteLocalRef(env, class_loader_class);
+
+  if (class_loader == NULL)
+  {
+    (*env)->ExceptionClear(env);
+    jsc_engine_error(ctx, "failed to get system class loader");
+    return false;
+  }
+
+  jclass defined_class = (*env)->DefineClass(env, ctx->class_name, class_loader,
+                                             (const jbyte*)data, (jsize)size);
+
+  (*env)->DeleteLocalRef(env, class_loader);
+
+  if (defined_class == NULL || (*env)->ExceptionCheck(env))
+  {
+    (*env)->ExceptionClear(env);
+    jsc_engine_error(ctx, "failed to define class");
+    return false;
+  }
+
+  ctx->runtime_class = (*env)->NewGlobalRef(env, defined_class);
+  (*env)->DeleteLocalRef(env, defined_class);
+
+  ctx->execute_method = (*env)->GetStaticMethodID(
+      env, ctx->runtime_class, "main", "([Ljava/lang/String;)V");
+
+  if (ctx->execute_method == NULL)
+  {
+    (*env)->ExceptionClear(env);
+    jsc_engine_error(ctx, "failed to find main method");
+    return false;
+  }
+
+  return jsc_engine_bind_lazy_functions(ctx);
+}
+
+bool jsc_engine_define_class(jsc_engine_context* ctx, const uint8_t* data,
+                             uint32_t size)
+{
+  if (!jsc_engine_create_jvm(ctx))
+  {
+    return false;
+  }
+
+  jsc_engine_phase previous =
+      jsc_engine_enter_phase(ctx, JSC_ENGINE_PHASE_CLASS_LOAD);
+  bool defined = jsc_engine_define_system_class(ctx, data, size);
+  jsc_engine_enter_phase(ctx, previous);
+
+  return defined;
+}
+
+/* load the compiled class through the system class loader */
+static bool jsc_engine_load_system_class(jsc_engine_context* ctx)
+{
+  jclass class_loader_class =
+      (*ctx->env)->FindClass(ctx->env, "java/lang/ClassLoader");
+  if (class_loader_class == NULL)
+  {
+    (*ctx->env)->ExceptionClear(ctx->env);
+    jsc_engine_error(ctx, "failed to find ClassLoader class");
+    return false;
+  }
+
+  jmethodID get_system_class_loader = (*ctx->env)->GetStaticMethodID(
+      ctx->env, class_loader_class, "getSystemClassLoader",
+      "()Ljava/lang/ClassLoader;");
+
+  if (get_system_class_loader == NULL)
+  {
+    (*ctx->env)->ExceptionClear(ctx->env);
+    (*ctx->env)->DeleteLocalRef(ctx->env, class_loader_class);
+    jsc_engine_error(ctx, "failed to find getSystemClassLoader method");
+    return false;
+  }
+
+  jobject class_loader = (*ctx->env)->CallStaticObjectMethod(
+      ctx->env, class_loader_class, get_system_class_loader);
+
+  if (class_loader == NULL)
+  {
+    (*ctx->env)->ExceptionClear(ctx->env);
+    (*ctx->env)->DeleteLocalRef(ctx->env, class_loader_class);
+    jsc_engine_error(ctx, "failed to get system class loader");
+    return false;
+  }
+
+  jmethodID load_class =
+      (*ctx->env)->GetMethodID(ctx->env, class_loader_class, "loadClass",
+                               "(Ljava/lang/String;)Ljava/lang/Class;");
+
+  if (load_class == NULL)
+  {
+    (*ctx->env)->ExceptionClear(ctx->env);
+    (*ctx->env)->DeleteLocalRef(ctx->env, class_loader);
+    (*ctx->env)->DeleteLocalRef(ctx->env, class_loader_class);
+    jsc_engine_error(ctx, "failed to find loadClass method");
+    return false;
+  }
+
+  jstring class_name_jstr =
+      (*ctx->env)->NewStringUTF(ctx->env, ctx->class_name);
+  if (class_name_jstr == NULL)
+  {
+    (*ctx->env)->ExceptionClear(ctx->env);
+    (*ctx->env)->DeleteLocalRef(ctx->env, class_loader);
+    (*ctx->env)->DeleteLocalRef(ctx->env, class_loader_class);
+    jsc_engine_error(ctx, "failed to create class name string");
+    return false;
+  }
+
+  jclass loaded_class = (*ctx->env)->CallObjectMethod(
+      ctx->env, class_loader, load_class, class_name_jstr);
+
+  (*ctx->env)->DeleteLocalRef(ctx->env, class_name_jstr);
+
+  if (loaded_class == NULL || (*ctx->env)->ExceptionCheck(ctx->env))
+  {
+    (*ctx->env)->ExceptionClear(ctx->env);
+    (*ctx->env)->DeleteLocalRef(ctx->env, class_loader);
+    (*ctx->env)->DeleteLocalRef(ctx->env, class_loader_class);
+    jsc_engine_error(ctx, "failed to load class");
+    return false;
+  }
+
+  ctx->runtime_class = (*ctx->env)->NewGlobalRef(ctx->env, loaded_class);
+  (*ctx->env)->DeleteLocalRef(ctx->env, loaded_class);
+
+  jmethodID main_method = (*ctx->env)->GetStaticMethodID(
+      ctx->env, ctx->runtime_class, "main", "([Ljava/lang/String;)V");
+
+  if (main_method == NULL)
+  {
+    (*ctx->env)->ExceptionClear(ctx->env);
+    (*ctx->env)->DeleteLocalRef(ctx->env, class_loader);
+    (*ctx->env)->DeleteLocalRef(ctx->env, class_loader_class);
+    jsc_engine_error(ctx, "failed to find main method");
+    return false;
+  }
+
+  ctx->execute_method = main_method;
+
+  (*ctx->env)->DeleteLocalRef(ctx->env, class_loader);
+  (*ctx->env)->DeleteLocalRef(ctx->env, class_loader_class);
+
+  return jsc_engine_bind_lazy_functions(ctx);
+}
+
+bool jsc_engine_load_class(jsc_engine_context* ctx, const char* class_file)
+{
+  if (ctx->env == NULL)
+  {
+    if (!jsc_engine_init_jvm(ctx))
+    {
+      return false;
+    }
+  }
+
+  jsc_engine_phase previous =
+      jsc_engine_enter_phase(ctx, JSC_ENGINE_PHASE_CLASS_LOAD);
+  bool loaded = jsc_engine_load_system_class(ctx);
+  jsc_engine_enter_phase(ctx, previous);
+
+  return loaded;
+}
+
+jsc_value jsc_engine_run(jsc_engine_context* ctx)
+{
+  if (ctx->had_error)
+  {
+    return jsc_value_create_undefined();
+  }
+
+  if (!jsc_engine_init_jvm(ctx))
+  {
+    return jsc_value_create_undefined();
+  }
+
+  jsc_engine_phase previous = jsc_engine_enter_phase(ctx, JSC_ENGINE_PHASE_RUN);
+  (*ctx->env)->CallStaticVoidMethod(ctx->env, ctx->runtime_class,
+                                    ctx->execute_method, ctx->args);
+  jsc_engine_enter_phase(ctx, previous);
+
+  if ((*ctx->env)->ExceptionCheck(ctx->env))
+  {
+    jthrowable exception = (*ctx->env)->ExceptionOccurred(ctx->env);
+    (*ctx->env)->ExceptionClear(ctx->env);
+
+    jclass throwable_class =
+        (*ctx->env)->FindClass(ctx->env, "java/lang/Throwable");
+    jmethodID get_message = (*ctx->env)->GetMethodID(
+        ctx->env, throwable_class, "getMessage", "()Ljava/lang/String;");
+
+    jstring message =
+        (*ctx->env)->CallObjectMethod(ctx->env, exception, get_message);
+
+    const char* error_message =
+        (*ctx->env)->GetStringUTFChars(ctx->env, message, NULL);
+    jsc_engine_error(ctx, error_message);
+    (*ctx->env)->ReleaseStringUTFChars(ctx->env, message, error_message);
+
+    (*ctx->env)->DeleteLocalRef(ctx->env, message);
+    (*ctx->env)->DeleteLocalRef(ctx->env, throwable_class);
+    (*ctx->env)->DeleteLocalRef(ctx->env, exception);
+
+    return jsc_value_create_undefined();
+  }
+
+  return jsc_value_create_undefined();
+}
+
+jsc_value jsc_engine_call_method(jsc_engine_context* ctx,
+                                 const char* method_name, jsc_value* args,
+                                 int arg_count)
+{
+  if (ctx->env == NULL)
+  {
+    if (!jsc_engine_init_jvm(ctx))
+    {
+      return jsc_value_create_undefined();
+    }
+  }
+
+  jmethodID method_id = NULL;
+
+  char descriptor[1 << 10] = "(";
+
+  for (int i = 0; i < arg_count; i++)
+  {
+    strcat(descriptor, "Ljava/lang/Object;");
+  }
+
+  strcat(descriptor, ")Ljava/lang/Object;");
+
+  method_id = (*ctx->env)->GetStaticMethodID(ctx->env, ctx->runtime_class,
+                                             method_name, descriptor);
+
+  if (method_id == NULL)
+  {
+    (*ctx->env)->ExceptionClear(ctx->env);
+    jsc_engine_error(ctx, "method not found");
+    return jsc_value_create_undefined();
+  }
+
+  jobjectArray jargs = NULL;
+
+  if (arg_count > 0)
+  {
+    jclass object_class = (*ctx->env)->FindClass(ctx->env, "java/lang/Object");
+    jargs =
+        (*ctx->env)->NewObjectArray(ctx->env, arg_count, object_class, NULL);
+    (*ctx->env)->DeleteLocalRef(ctx->env, object_class);
+
+    for (int i = 0; i < arg_count; i++)
+    {
+      jobject arg_obj = jsc_value_to_jobject(ctx->env, args[i]);
+      (*ctx->env)->SetObjectArrayElement(ctx->env, jargs, i, arg_obj);
+      (*ctx->env)->DeleteLocalRef(ctx->env, arg_obj);
+    }
+  }
+
+  jsc_engine_phase previous = jsc_engine_enter_phase(ctx, JSC_ENGINE_PHASE_RUN);
+  jobject result = (*ctx->env)->CallStaticObjectMethod(
+      ctx->env, ctx->runtime_class, method_id, jargs);
+  jsc_engine_enter_phase(ctx, previous);
+
+  if (jargs != NULL)
+  {
+    (*ctx->env)->DeleteLocalRef(ctx->env, jargs);
+  }
+
+  if ((*ctx->env)->ExceptionCheck(ctx->env))
+  {
+    jthrowable exception = (*ctx->env)->ExceptionOccurred(ctx->env);
+    (*ctx->env)->ExceptionClear(ctx->env);
+
+    jclass throwable_class =
+        (*ctx->env)->FindClass(ctx->env, "java/lang/Throwable");
+    jmethodID get_message = (*ctx->env)->GetMethodID(
+        ctx->env, throwable_class, "getMessage", "()Ljava/lang/String;");
+
+    jstring message =
+        (*ctx->env)->CallObjectMethod(ctx->env, exception, get_message);
+
+    const char* error_message =
+        (*ctx->env)->GetStringUTFChars(ctx->env, message, NULL);
+    jsc_engine_error(ctx, error_message);
+    (*ctx->env)->ReleaseStringUTFChars(ctx->env, message, error_message);
+
+    (*ctx->env)->DeleteLocalRef(ctx->env, message);
+    (*ctx->env)->DeleteLocalRef(ctx->env, throwable_class);
+    (*ctx->env)->DeleteLocalRef(ctx->env, exception);
+
+    return jsc_value_create_undefined();
+  }
+
+  jsc_value ret_val = jsc_value_from_jobject(ctx->env, result);
+
+  if (result != NULL)
+  {
+    (*ctx->env)->DeleteLocalRef(ctx->env, result);
+  }
+
+  return ret_val;
+}
+
+jsc_value jsc_engine_eval(const char* source)
+{
+  jsc_engine_context* ctx = jsc_engine_init("JSCScript");
+
+  if (!ctx)
+  {
+    jsc_value undefined = jsc_value_create_undefined();
+    return undefined;
+  }
+
+  jsc_cache* cache = jsc_engine_get_default_cache();
+  jsc_cache_key key;
+  jsc_cache_blob blob;
+  bool defined = false;
+
+  jsc_cache_compute_key(&key, source, strlen(source), ctx->class_name,
+                        jsc_engine_cache_options(ctx));
+
+  bool hit = cache && jsc_cache_acquire(cache, &key, &blob);
+
+  if (hit && !jsc_engine_cached_class_is_valid(&blob))
+  {
+    jsc_cache_release(&blob);
+    hit = false;
+  }
+
+  if (hit)
+  {
+    defined = jsc_engine_define_class(ctx, blob.data, blob.size);
+    jsc_cache_release(&blob);
+  }
+  else
+  {
+    const uint8_t* buffer = NULL;
+    uint32_t size = 0;
+
+    if (jsc_engine_compile_to_class_buffer(ctx, source, &buffer, &size))
+    {
+      if (cache)
+      {
+        jsc_cache_store(cache, &key, buffer, size);
+      }
+
+      defined = jsc_engine_define_class(ctx, buffer, size);
+    }
+  }
+
+  if (!defined)
+  {
+    jsc_value undefined = jsc_value_create_undefined();
+    jsc_engine_free(ctx);
+    return undefined;
+  }
+
+  jsc_value result = jsc_engine_run(ctx);
+
+  jsc_engine_free(ctx);
+
+  return result;
+}
+#endif
+
+jsc_symbol* jsc_engine_add_symbol(jsc_engine_context* ctx, const char* name,
+                                  jsc_symbol_type type)
+{
+  jsc_symbol* existing = jsc_engine_lookup_symbol(ctx, name);
+
+  if (existing && existing->scope_depth == ctx->current_scope->depth)
+  {
+    jsc_engine_error(ctx, "variable already declared in this scope");
+    return NULL;
+  }
+
+  jsc_symbol* symbol = (jsc_symbol*)malloc(sizeof(jsc_symbol));
+
+  if (!symbol)
+  {
+    jsc_engine_error(ctx, "jsc_engine_add_symbol malloc");
+    return NULL;
+  }
+
+  memset(symbol, 0, sizeof(jsc_symbol));
+
+  symbol->name = strdup(name);
+  symbol->type = type;
+  symbol->initialized = false;
+  symbol->scope_depth = ctx->current_scope->depth;
+
+  if (type == JSC_SYMBOL_FUNCTION && ctx->assigned_count > 0)
+  {
+    const char* key = name;
+    symbol->reassigned =
+        bsearch(&key, ctx->assigned_names, ctx->assigned_count, sizeof(char*),
+                jsc_engine_compare_names) != NULL;
+  }
+
+  if (jsc_engine_is_global_scope(ctx))
+  {
+    symbol->index = 0;
+  }
+  else
+  {
+    symbol->index = ctx->local_index++;
+    ctx->current_scope->local_count++;
+  }
+
+  symbol->next = ctx->current_scope->symbols;
+  ctx->current_scope->symbols = symbol;
+
+  return symbol;
+}
+
+jsc_symbol* jsc_engine_lookup_symbol(jsc_engine_context* ctx, const char* name)
+{
+  jsc_scope* scope = ctx->current_scope;
+
+  while (scope)
+  {
+    jsc_symbol* symbol = scope->symbols;
+
+    while (symbol)
+    {
+      if (strcmp(symbol->name, name) == 0)
+      {
+        return symbol;
+      }
+
+      symbol = symbol->next;
+    }
+
+    scope = scope->parent;
+  }
+
+  return NULL;
+}
+
+bool jsc_engine_match(jsc_engine_context* ctx, jsc_token_type type)
+{
+  if (!jsc_engine_check(ctx, type))
+  {
+    return false;
+  }
+
+  jsc_engine_advance(ctx);
+
+  return true;
+}
+
+bool jsc_engine_check(jsc_engine_context* ctx, jsc_token_type type)
+{
+  return ctx->current_token.type == type;
+}
+
+void jsc_engine_advance(jsc_engine_context* ctx)
+{
+  if (ctx->flags & JSC_ENGINE_FLAG_STATS)
+  {
+    jsc_engine_phase previous =
+        jsc_engine_enter_phase(ctx, JSC_ENGINE_PHASE_TOKENIZE);
+    ctx->current_token = jsc_next_token(ctx->tokenizer);
+    jsc_engine_enter_phase(ctx, previous);
+  }
+  else
+  {
+    ctx->current_token = jsc_next_token(ctx->tokenizer);
+  }
+
+  ctx->stats.tokens++;
+
+  if (jsc_tokenizer_has_error(ctx->tokenizer))
+  {
+    jsc_engine_error(ctx, jsc_tokenizer_get_error(ctx->tokenizer));
+  }
+}
+
+void jsc_engine_error(jsc_engine_context* ctx, const char* message)
+{
+  if (ctx->had_error)
+  {
+    return;
+  }
+
+  ctx->had_error = true;
+
+  if (ctx->error_message)
+  {
+    free(ctx->error_message);
+  }
+
+  ctx->error_message = strdup(message);
+}
+
+void jsc_engine_emit_byte(jsc_engine_context* ctx, uint8_t byte)
+{
+  jsc_bytecode_emit(ctx->bytecode, ctx->current_method, byte);
+
+  switch (byte)
+  {
+  case JSC_JVM_POP:
+    ctx->stack_size -= 1;
+    break;
+  case JSC_JVM_POP2:
+    ctx->stack_size -= 2;
+    break;
+  case JSC_JVM_IADD:
+  case JSC_JVM_ISUB:
+  case JSC_JVM_IMUL:
+  case JSC_JVM_IDIV:
+  case JSC_JVM_IREM:
+  case JSC_JVM_ISHL:
+  case JSC_JVM_ISHR:
+  case JSC_JVM_IUSHR:
+  case JSC_JVM_IAND:
+  case JSC_JVM_IOR:
+  case JSC_JVM_IXOR:
+  case JSC_JVM_FADD:
+  case JSC_JVM_FSUB:
+  case JSC_JVM_FMUL:
+  case JSC_JVM_FDIV:
+  case JSC_JVM_FREM:
+    ctx->stack_size -= 1;
+    break;
+  case JSC_JVM_LADD:
+  case JSC_JVM_LSUB:
+  case JSC_JVM_LMUL:
+  case JSC_JVM_LDIV:
+  case JSC_JVM_LREM:
+  case JSC_JVM_LSHL:
+  case JSC_JVM_LSHR:
+  case JSC_JVM_LUSHR:
+  case JSC_JVM_LAND:
+  case JSC_JVM_LOR:
+  case JSC_JVM_LXOR:
+  case JSC_JVM_DADD:
+  case JSC_JVM_DSUB:
+  case JSC_JVM_DMUL:
+  case JSC_JVM_DDIV:
+  case JSC_JVM_DREM:
+    ctx->stack_size -= 2;
+    break;
+  case JSC_JVM_PUTSTATIC:
+    ctx->stack_size -= 1;
+    break;
+  case JSC_JVM_PUTFIELD:
+    ctx->stack_size -= 2;
+    break;
+  case JSC_JVM_IRETURN:
+  case JSC_JVM_FRETURN:
+  case JSC_JVM_ARETURN:
+    ctx->stack_size -= 1;
+    break;
+  case JSC_JVM_LRETURN:
+  case JSC_JVM_DRETURN:
+    ctx->stack_size -= 2;
+    break;
+  case JSC_JVM_NEW:
+    ctx->stack_size += 1;
+    break;
+  case JSC_JVM_DUP:
+    ctx->stack_size += 1;
+    break;
+  case JSC_JVM_INVOKESPECIAL:
+    ctx->stack_size -= 2;
+    break;
+  case JSC_JVM_INVOKEVIRTUAL:
+  case JSC_JVM_INVOKESTATIC:
+    ctx->stack_size -= 1;
+    break;
+  case JSC_JVM_GETSTATIC:
+    ctx->stack_size += 1;
+    break;
+  case JSC_JVM_ACONST_NULL:
+  case JSC_JVM_ICONST_M1:
+  case JSC_JVM_ICONST_0:
+  case JSC_JVM_ICONST_1:
+  case JSC_JVM_ICONST_2:
+  case JSC_JVM_ICONST_3:
+  case JSC_JVM_ICONST_4:
+  case JSC_JVM_ICONST_5:
+  case JSC_JVM_FCONST_0:
+  case JSC_JVM_FCONST_1:
+  case JSC_JVM_FCONST_2:
+  case JSC_JVM_BIPUSH:
+  case JSC_JVM_SIPUSH:
+  case JSC_JVM_LDC:
+  case JSC_JVM_LDC_W:
+    ctx->stack_size += 1;
+    break;
+  case JSC_JVM_LCONST_0:
+  case JSC_JVM_LCONST_1:
+  case JSC_JVM_DCONST_0:
+  case JSC_JVM_DCONST_1:
+  case JSC_JVM_LDC2_W:
+    ctx->stack_size += 2;
+    break;
+  case JSC_JVM_ALOAD_0:
+  case JSC_JVM_ALOAD_1:
+  case JSC_JVM_ALOAD_2:
+  case JSC_JVM_ALOAD_3:
+  case JSC_JVM_ALOAD:
+    ctx->stack_size += 1;
+    break;
+  case JSC_JVM_ASTORE_0:
+  case JSC_JVM_ASTORE_1:
+  case JSC_JVM_ASTORE_2:
+  case JSC_JVM_ASTORE_3:
+  case JSC_JVM_ASTORE:
+    ctx->stack_size -= 1;
+    break;
+  }
+
+  if (ctx->stack_size < 0)
+    ctx->stack_size = 0;
+
+  if (ctx->stack_size > ctx->max_stack)
+  {
+    ctx->max_stack = ctx->stack_size;
+  }
+}
+
+void jsc_engine_emit_bytes(jsc_engine_context* ctx, uint8_t byte1,
+                           uint8_t byte2)
+{
+  jsc_engine_emit_byte(ctx, byte1);
+  jsc_engine_emit_byte(ctx, byte2);
+}
+
+/**
+ * @brief emit a forward branch, returning the label jsc_engine_patch_jump
+ *        places at its target
+ */
+int32_t jsc_engine_emit_jump(jsc_engine_context* ctx, uint8_t instruction)
+{
+  int32_t label = jsc_bytecode_new_label(ctx->bytecode);
+
+  jsc_bytecode_emit_branch(ctx->bytecode, ctx->current_method, instruction,
+                           label);
+
+  return label;
+}
+
+/**
+ * @brief point the branches to label at the current end of the code
+ *
+ * @details The offsets are filled in by jsc_bytecode_resolve_branches once
+ *          the method is complete, widening branches that end up too far.
+ */
+void jsc_engine_patch_jump(jsc_engine_context* ctx, int32_t label)
+{
+  jsc_bytecode_place_label(ctx->bytecode, ctx->current_method, label);
+}
+
+/* longest string a constant expression may fold to */
+#define JSC_ENGINE_MAX_FOLDED_STRING (1 << 15)
+
+/* an operand whose code starts at start; when it is a single constant
+   load, value holds a copy of the constant */
+typedef struct
+{
+  jsc_value value;
+  uint32_t start;
+  uint16_t stack;  /* stack size before the operand */
+  int32_t counter; /* local of the loop counter it only reads, or -1 */
+  bool constant;
+} jsc_engine_operand;
+
+static void jsc_engine_release_value(jsc_value* value)
+{
+  if (value->type == JSC_VALUE_STRING)
+  {
+    free(value->string_value);
+  }
+
+  memset(value, 0, sizeof(jsc_value));
+}
+
+static uint32_t jsc_engine_code_length(jsc_engine_context* ctx)
+{
+  return ctx->current_method
+             ? jsc_bytecode_get_method_code_length(ctx->current_method)
+             : 0;
+}
+
+static void jsc_engine_forget_constant(jsc_engine_context* ctx)
+{
+  jsc_engine_release_value(&ctx->constant);
+  ctx->constant_method = NULL;
+}
+
+/**
+ * @brief load a compile-time value, the way its literal would be loaded
+ *
+ * @details Takes ownership of value and remembers it as ctx->constant, so
+ *          an enclosing operator can fold it in turn.
+ */
+static void jsc_engine_emit_constant(jsc_engine_context* ctx, jsc_value value)
+{
+  uint32_t start = jsc_engine_code_length(ctx);
+
+  switch (value.type)
+  {
+  case JSC_VALUE_NUMBER:
+    jsc_bytecode_emit_load_constant_double_boxed(
+        ctx->bytecode, ctx->current_method, value.number_value);
+    break;
+  case JSC_VALUE_STRING:
+    jsc_bytecode_emit_load_constant_string(ctx->bytecode, ctx->current_method,
+                                           value.string_value);
+    break;
+  case JSC_VALUE_BOOLEAN:
+    jsc_bytecode_emit_load_constant_boolean_boxed(
+        ctx->bytecode, ctx->current_method, value.boolean_value);
+    break;
+  default:
+    jsc_engine_emit_byte(ctx, JSC_JVM_ACONST_NULL);
+    break;
+  }
+
+  jsc_engine_forget_constant(ctx);
+  ctx->constant = value;
+  ctx->constant_method = ctx->current_method;
+  ctx->constant_start = start;
+  ctx->constant_end = jsc_engine_code_length(ctx);
+}
+
+static void jsc_engine_begin_operand(jsc_engine_context* ctx,
+                                     jsc_engine_operand* operand)
+{
+  memset(operand, 0, sizeof(jsc_engine_operand));
+  operand->start = jsc_engine_code_length(ctx);
+  operand->stack = ctx->stack_size;
+  operand->counter = -1;
+}
+
+/**
+ * @brief note whether the code emitted for operand is exactly the load of
+ *        ctx->constant, or else the read of a loop counter
+ */
+static bool jsc_engine_end_operand(jsc_engine_context* ctx,
+                                   jsc_engine_operand* operand)
+{
+  jsc_engine_release_value(&operand->value);
+
+  bool counter = !ctx->had_error && ctx->current_method &&
+                 ctx->counter_method == ctx->current_method &&
+                 ctx->counter_start == operand->start &&
+                 ctx->counter_end == jsc_engine_code_length(ctx);
+  operand->counter = counter ? ctx->counter_index : -1;
+
+  operand->constant = !ctx->had_error && ctx->current_method &&
+                      ctx->constant_method == ctx->current_method &&
+                      ctx->constant_start == operand->start &&
+                      ctx->constant_end == jsc_engine_code_length(ctx);
+
+  if (operand->constant)
+  {
+    operand->value = ctx->constant;
+
+    if (operand->value.type == JSC_VALUE_STRING)
+    {
+      operand->value.string_value = strdup(ctx->constant.string_value);
+      operand->constant = operand->value.string_value != NULL;
+    }
+  }
+
+  return operand->constant;
+}
+
+/* drop the code of operand and everything after it */
+static void jsc_engine_discard_operand(jsc_engine_context* ctx,
+                                       const jsc_engine_operand* operand)
+{
+  jsc_bytecode_truncate_method_code(ctx->bytecode, ctx->current_method,
+                                    operand->start);
+  ctx->stack_size = operand->stack;
+  ctx->counter_method = NULL;
+  jsc_engine_forget_constant(ctx);
+}
+
+/* replace the code of operand and everything after it by a load of value */
+static void jsc_engine_replace_operand(jsc_engine_context* ctx,
+                                       jsc_engine_operand* operand,
+                                       jsc_value value)
+{
+  jsc_engine_discard_operand(ctx, operand);
+  jsc_engine_emit_constant(ctx, value);
+  jsc_engine_end_operand(ctx, operand);
+}
+
+/**
+ * @brief run parse, keeping none of the code it emits
+ *
+ * @details The code goes to a scratch method of a scratch class, so that
+ *          neither its constants nor the methods of functions declared in
+ *          it reach the program. Errors are still reported.
+ */
+static void jsc_engine_parse_discarded(jsc_engine_context* ctx,
+                                       void (*parse)(jsc_engine_context*))
+{
+  jsc_bytecode_context* bytecode = ctx->bytecode;
+  jsc_method* method = ctx->current_method;
+  uint16_t local_index = ctx->local_index;
+  uint16_t stack_size = ctx->stack_size;
+  uint16_t max_stack = ctx->max_stack;
+
+  ctx->bytecode = jsc_bytecode_create_class(
+      ctx->class_name, "java/lang/Object", JSC_ACC_PUBLIC | JSC_ACC_SUPER);
+  ctx->current_method =
+      ctx->bytecode ? jsc_bytecode_create_method(ctx->bytecode, "discarded",
+                                                 "()V", JSC_ACC_STATIC, 100,
+                                                 100)
+                    : NULL;
+
+  if (ctx->current_method)
+  {
+    parse(ctx);
+  }
+  else
+  {
+    jsc_engine_error(ctx, "failed to initialize discarded code");
+  }
+
+  jsc_engine_forget_constant(ctx);
+  jsc_bytecode_free(ctx->bytecode);
+
+  ctx->bytecode = bytecode;
+  ctx->current_method = method;
+  ctx->local_index = local_index;
+  ctx->stack_size = stack_size;
+  ctx->max_stack = max_stack;
+}
+
+/**
+ * @brief format a number as JS Number::toString does, into 32 bytes
+ *
+ * @details Uses the fewest significant digits that read back as the same
+ *          double, in plain notation for exponents from -7 to 21.
+ */
+static void jsc_engine_number_to_string(double value, char out[32])
+{
+  if (isnan(value) || isinf(value) || value == 0)
+  {
+    strcpy(out, isnan(value) ? "NaN"
+                : value == 0 ? "0" /* -0 too */
+                : value < 0  ? "-Infinity"
+                             : "Infinity");
+    return;
+  }
+
+  char scientific[32];
+
+  for (int precision = 1; precision <= 17; precision++)
+  {
+    snprintf(scientific, sizeof(scientific), "%.*e", precision - 1,
+             fabs(value));
+
+    if (strtod(scientific, NULL) == fabs(value))
+    {
+      break;
+    }
+  }
+
+  /* scientific is d.ddde[+-]xx: split it into the k digits and the n for
+     which the value is 0.digits * 10^n */
+  char digits[24];
+  int k = 0;
+  const char* p = scientific;
+
+  for (; *p && *p != 'e'; p++)
+  {
+    if (*p != '.')
+    {
+      digits[k++] = *p;
+    }
+  }
+
+  while (k > 1 && digits[k - 1] == '0')
+  {
+    k--;
+  }
+
+  int n = atoi(p + 1) + 1;
+  char* q = out;
+
+  if (value < 0)
+  {
+    *q++ = '-';
+  }
+
+  if (k <= n && n <= 21)
+  {
+    memcpy(q, digits, k);
+    memset(q + k, '0', n - k);
+    q += n;
+  }
+  else if (0 < n && n <= 21)
+  {
+    memcpy(q, digits, n);
+    q[n] = '.';
+    memcpy(q + n + 1, digits + n, k - n);
+    q += k + 1;
+  }
+  else if (-6 < n && n <= 0)
+  {
+    memcpy(q, "0.", 2);
+    memset(q + 2, '0', -n);
+    memcpy(q + 2 - n, digits, k);
+    q += 2 - n + k;
+  }
+  else
+  {
+    *q++ = digits[0];
+
+    if (k > 1)
+    {
+      *q++ = '.';
+      memcpy(q, digits + 1, k - 1);
+      q += k - 1;
+    }
+
+    q += sprintf(q, "e%c%d", n > 0 ? '+' : '-', abs(n - 1));
+  }
+
+  *q = '\0';
+}
+
+static bool jsc_engine_is_space(char c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' ||
+         c == '\r';
+}
+
+/**
+ * @brief JS ToNumber of a string
+ *
+ * @details Returns false for text with non-ASCII characters, whose
+ *          whitespace is left to the runtime.
+ */
+static bool jsc_engine_string_to_number(const char* text, double* out)
+{
+  const char* end = text + strlen(text);
+
+  while (text < end && jsc_engine_is_space(*text))
+  {
+    text++;
+  }
+
+  while (end > text && jsc_engine_is_space(end[-1]))
+  {
+    end--;
+  }
+
+  for (const char* p = text; p < end; p++)
+  {
+    if ((unsigned char)*p >= 0x80)
+    {
+      return false;
+    }
+  }
+
+  size_t length = end - text;
+  *out = NAN;
+
+  if (length == 0)
+  {
+    *out = 0;
+    return true;
+  }
+
+  if (length > 2 && text[0] == '0' && strchr("xXoObB", text[1]))
+  {
+    int radix = strchr("xX", text[1]) ? 16 : strchr("oO", text[1]) ? 8 : 2;
+    double value = 0;
+
+    for (const char* p = text + 2; p < end; p++)
+    {
+      int digit = *p >= '0' && *p <= '9'   ? *p - '0'
+                  : *p >= 'a' && *p <= 'z' ? *p - 'a' + 10
+                  : *p >= 'A' && *p <= 'Z' ? *p - 'A' + 10
+                                           : radix;
+
+      if (digit >= radix)
+      {
+        return true;
+      }
+
+      value = value * radix + digit;
+    }
+
+    *out = value;
+    return true;
+  }
+
+  const char* p = text + (*text == '+' || *text == '-');
+
+  if ((size_t)(end - p) == 8 && memcmp(p, "Infinity", 8) == 0)
+  {
+    *out = *text == '-' ? -INFINITY : INFINITY;
+    return true;
+  }
+
+  /* StrDecimalLiteral, which is stricter than strtod */
+  size_t digits = 0;
+
+  for (; p < end && *p >= '0' && *p <= '9'; p++)
+  {
+    digits++;
+  }
+
+  if (p < end && *p == '.')
+  {
+    for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+    {
+      digits++;
+    }
+  }
+
+  if (digits > 0 && p < end && (*p == 'e' || *p == 'E'))
+  {
+    p += p + 1 < end && (p[1] == '+' || p[1] == '-') ? 2 : 1;
+
+    if (p == end || *p < '0' || *p > '9')
+    {
+      return true;
+    }
+
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+      p++;
+    }
+  }
+
+  if (digits == 0 || p != end)
+  {
+    return true;
+  }
+
+  char* copy = strndup(text, length);
+
+  if (!copy)
+  {
+    return false;
+  }
+
+  *out = strtod(copy, NULL);
+  free(copy);
+  return true;
+}
+
+static bool jsc_engine_to_number(const jsc_value* value, double* out)
+{
+  switch (value->type)
+  {
+  case JSC_VALUE_NULL:
+    *out = 0;
+    return true;
+  case JSC_VALUE_BOOLEAN:
+    *out = value->boolean_value ? 1 : 0;
+    return true;
+  case JSC_VALUE_NUMBER:
+    *out = value->number_value;
+    return true;
+  case JSC_VALUE_STRING:
+    return jsc_engine_string_to_number(value->string_value, out);
+  default:
+    return false;
+  }
+}
+
+/* JS ToString of a primitive, NULL if it is not one */
+static char* jsc_engine_to_string(const jsc_value* value)
+{
+  char buffer[32];
+
+  switch (value->type)
+  {
+  case JSC_VALUE_NUMBER:
+    jsc_engine_number_to_string(value->number_value, buffer);
+    return strdup(buffer);
+  case JSC_VALUE_STRING:
+    return strdup(value->string_value);
+  case JSC_VALUE_NULL:
+  case JSC_VALUE_BOOLEAN:
+  case JSC_VALUE_UNDEFINED:
+    return jsc_value_to_string(*value);
+  default:
+    return NULL;
+  }
+}
+
+static bool jsc_engine_to_boolean(const jsc_value* value)
+{
+  switch (value->type)
+  {
+  case JSC_VALUE_BOOLEAN:
+    return value->boolean_value;
+  case JSC_VALUE_NUMBER:
+    return value->number_value != 0 && !isnan(value->number_value);
+  case JSC_VALUE_STRING:
+    return value->string_value[0] != '\0';
+  default:
+    return false;
+  }
+}
+
+static bool jsc_engine_strict_equals(const jsc_value* a, const jsc_value* b)
+{
+  if (a->type != b->type)
+  {
+    return false;
+  }
+
+  switch (a->type)
+  {
+  case JSC_VALUE_BOOLEAN:
+    return a->boolean_value == b->boolean_value;
+  case JSC_VALUE_NUMBER:
+    return a->number_value == b->number_value;
+  case JSC_VALUE_STRING:
+    return strcmp(a->string_value, b->string_value) == 0;
+  default:
+    return true;
+  }
+}
+
+/* JS ==, false if the strings involved cannot be converted here */
+static bool jsc_engine_loose_equals(const jsc_value* a, const jsc_value* b,
+                                    bool* out)
+{
+  bool a_nullish =
+      a->type == JSC_VALUE_NULL || a->type == JSC_VALUE_UNDEFINED;
+  bool b_nullish =
+      b->type == JSC_VALUE_NULL || b->type == JSC_VALUE_UNDEFINED;
+
+  if (a->type == b->type || a_nullish || b_nullish)
+  {
+    *out = a->type == b->type ? jsc_engine_strict_equals(a, b)
+                              : a_nullish && b_nullish;
+    return true;
+  }
+
+  /* the remaining mixes of number, string and boolean compare as numbers */
+  double x;
+  double y;
+
+  if (!jsc_engine_to_number(a, &x) || !jsc_engine_to_number(b, &y))
+  {
+    return false;
+  }
+
+  *out = x == y;
+  return true;
+}
+
+/**
+ * @brief evaluate a binary operator over two constants per JS semantics
+ *
+ * @details Returns false, leaving the operation to run time, when the
+ *          result cannot be computed exactly here.
+ */
+static bool jsc_engine_fold_binary(jsc_token_type operator_type,
+                                   const jsc_value* a, const jsc_value* b,
+                                   jsc_value* out)
+{
+  double x;
+  double y;
+  bool equal;
+
+  memset(out, 0, sizeof(jsc_value));
+
+  switch (operator_type)
+  {
+  case JSC_TOKEN_PLUS:
+    if (a->type == JSC_VALUE_STRING || b->type == JSC_VALUE_STRING)
+    {
+      char* left = jsc_engine_to_string(a);
+      char* right = jsc_engine_to_string(b);
+      size_t length = left && right ? strlen(left) + strlen(right) : 0;
+      char* text = length < JSC_ENGINE_MAX_FOLDED_STRING && left && right
+                       ? malloc(length + 1)
+                       : NULL;
+
+      if (text)
+      {
+        strcpy(text, left);
+        strcat(text, right);
+        out->type = JSC_VALUE_STRING;
+        out->string_value = text;
+      }
+
+      free(left);
+      free(right);
+      return text != NULL;
+    }
+    /* fallthrough */
+  case JSC_TOKEN_MINUS:
+  case JSC_TOKEN_MULTIPLY:
+  case JSC_TOKEN_DIVIDE:
+  case JSC_TOKEN_MODULO:
+    if (!jsc_engine_to_number(a, &x) || !jsc_engine_to_number(b, &y))
+    {
+      return false;
+    }
+
+    out->type = JSC_VALUE_NUMBER;
+    out->number_value = operator_type == JSC_TOKEN_PLUS       ? x + y
+                        : operator_type == JSC_TOKEN_MINUS    ? x - y
+                        : operator_type == JSC_TOKEN_MULTIPLY ? x * y
+                        : operator_type == JSC_TOKEN_DIVIDE   ? x / y
+                                                              : fmod(x, y);
+    return true;
+
+  case JSC_TOKEN_LESS_THAN:
+  case JSC_TOKEN_GREATER_THAN:
+  case JSC_TOKEN_LESS_THAN_EQUAL:
+  case JSC_TOKEN_GREATER_THAN_EQUAL:
+    out->type = JSC_VALUE_BOOLEAN;
+
+    if (a->type == JSC_VALUE_STRING && b->type == JSC_VALUE_STRING)
+    {
+      /* UTF-8 byte order is UTF-16 code unit order below U+10000 */
+      for (const char* p = a->string_value; *p; p++)
+      {
+        if ((unsigned char)*p >= 0xF0)
+        {
+          return false;
+        }
+      }
+
+      for (const char* p = b->string_value; *p; p++)
+      {
+        if ((unsigned char)*p >= 0xF0)
+        {
+          return false;
+        }
+      }
+
+      int order = strcmp(a->string_value, b->string_value);
+      x = order;
+      y = 0;
+    }
+    else if (!jsc_engine_to_number(a, &x) || !jsc_engine_to_number(b, &y))
+    {
+      return false;
+    }
+
+    /* any comparison with NaN is false */
+    out->boolean_value = operator_type == JSC_TOKEN_LESS_THAN ? x < y
+                         : operator_type == JSC_TOKEN_GREATER_THAN ? x > y
+                         : operator_type == JSC_TOKEN_LESS_THAN_EQUAL
+                             ? x <= y
+                             : x >= y;
+    return true;
+
+  case JSC_TOKEN_STRICT_EQUAL:
+  case JSC_TOKEN_STRICT_NOT_EQUAL:
+    out->type = JSC_VALUE_BOOLEAN;
+    out->boolean_value = jsc_engine_strict_equals(a, b) ==
+                         (operator_type == JSC_TOKEN_STRICT_EQUAL);
+    return true;
+
+  case JSC_TOKEN_EQUAL:
+  case JSC_TOKEN_NOT_EQUAL:
+    if (!jsc_engine_loose_equals(a, b, &equal))
+    {
+      return false;
+    }
+
+    out->type = JSC_VALUE_BOOLEAN;
+    out->boolean_value = equal == (operator_type == JSC_TOKEN_EQUAL);
+    return true;
+
+  default:
+    return false;
+  }
+}
+
+static bool jsc_engine_fold_unary(jsc_token_type operator_type,
+                                  const jsc_value* a, jsc_value* out)
+{
+  static const char* const type_names[] = {
+      [JSC_VALUE_UNDEFINED] = "undefined", [JSC_VALUE_NULL] = "object",
+      [JSC_VALUE_BOOLEAN] = "boolean",     [JSC_VALUE_NUMBER] = "number",
+      [JSC_VALUE_STRING] = "string",
+  };
+
+  memset(out, 0, sizeof(jsc_value));
+
+  switch (operator_type)
+  {
+  case JSC_TOKEN_LOGICAL_NOT:
+    out->type = JSC_VALUE_BOOLEAN;
+    out->boolean_value = !jsc_engine_to_boolean(a);
+    return true;
+
+  case JSC_TOKEN_MINUS:
+    if (!jsc_engine_to_number(a, &out->number_value))
+    {
+      return false;
+    }
+
+    out->type = JSC_VALUE_NUMBER;
+    out->number_value = -out->number_value;
+    return true;
+
+  case JSC_TOKEN_TYPEOF:
+    if (a->type > JSC_VALUE_STRING)
+    {
+      return false;
+    }
+
+    *out = jsc_value_create_string(type_names[a->type]);
+    return out->string_value != NULL;
+
+  default:
+    return false;
+  }
+}
+
+/**
+ * @brief fold left operator right into a constant when both operands are
+ *        constants, leaving left describing the result
+ *
+ * @details Returns false if the operator still has to be emitted.
+ */
+static bool jsc_engine_fold_operands(jsc_engine_context* ctx,
+                                     jsc_token_type operator_type,
+                                     jsc_engine_operand* left,
+                                     jsc_engine_operand* right)
+{
+  jsc_value result;
+  bool folded = left->constant && right->constant &&
+                jsc_engine_fold_binary(operator_type, &left->value,
+                                       &right->value, &result);
+
+  jsc_engine_release_value(&right->value);
+  right->constant = false;
+
+  if (!folded)
+  {
+    jsc_engine_release_value(&left->value);
+    left->constant = false;
+    return false;
+  }
+
+  jsc_engine_replace_operand(ctx, left, result);
+  return true;
+}
+
+/**
+ * @brief class file version needed by the features enabled in ctx->flags
+ *
+ * @details StringConcatFactory needs 53; everything else targets 52, with
+ *          the StackMapTable frames computed by jsc_bytecode_write.
+ */
+uint16_t jsc_engine_class_version(const jsc_engine_context* ctx)
+{
+  if (ctx->flags & JSC_ENGINE_FLAG_STRING_CONCAT)
+  {
+    return 53;
+  }
+
+  return 52;
+}
+
+/**
+ * @brief end the current top-level method with a call to main$index and
+ *        continue emitting into that new helper
+ *
+ * @details Top-level bindings are static fields and block scopes close
+ *          with their statement, so no local is live at the split.
+ */
+static void jsc_engine_chain_main(jsc_engine_context* ctx, uint32_t index)
+{
+  char name[32];
+  snprintf(name, sizeof(name), "main$%u", index);
+
+  jsc_bytecode_emit_invoke_static(ctx->bytecode, ctx->current_method,
+                                  ctx->class_name, name, "()V");
+  jsc_engine_emit_byte(ctx, JSC_JVM_RETURN);
+  jsc_engine_end_function(ctx);
+
+  jsc_method* helper = jsc_bytecode_create_method(
+      ctx->bytecode, name, "()V", JSC_ACC_PRIVATE | JSC_ACC_STATIC, 10, 100);
+
+  if (!helper)
+  {
+    jsc_engine_error(ctx, "failed to create top-level helper method");
+    return;
+  }
+
+  ctx->current_method = helper;
+  ctx->stack_size = 0;
+}
+
+void jsc_engine_parse_program(jsc_engine_context* ctx)
+{
+  jsc_method* main_method = jsc_bytecode_create_method(
+      ctx->bytecode, "main", "([Ljava/lang/String;)V",
+      JSC_ACC_PUBLIC | JSC_ACC_STATIC, 10, 100);
+
+  jsc_bytecode_set_version(ctx->bytecode, jsc_engine_class_version(ctx), 0);
+  ctx->current_method = main_method;
+  ctx->stack_size = 0;
+  ctx->max_stack = 10;
+  ctx->local_index = 1;
+
+  uint32_t helper_count = 0;
+
+  while (!jsc_engine_check(ctx, JSC_TOKEN_EOF))
+  {
+    jsc_engine_parse_declaration(ctx);
+
+    /* the first error is the one reported, and a statement that failed
+       may not have consumed anything */
+    if (ctx->had_error)
+    {
+      break;
+    }
+
+    ctx->stack_size = 0;
+
+    if (!ctx->had_error && !jsc_engine_check(ctx, JSC_TOKEN_EOF) &&
+        jsc_bytecode_get_method_code_length(ctx->current_method) >=
+            JSC_ENGINE_MAX_TOP_LEVEL_CODE)
+    {
+      jsc_engine_chain_main(ctx, helper_count++);
+    }
+  }
+
+  jsc_engine_emit_byte(ctx, JSC_JVM_RETURN);
+
+  /* functions may have moved it, and past a split it is the last main$N */
+  main_method = ctx->current_method;
+
+  for (uint16_t i = 0; i < main_method->attribute_count; i++)
+  {
+    jsc_attribute* attr = &main_method->attributes[i];
+    uint16_t name_index = attr->name_index;
+
+    if (name_index > 0 &&
+        ctx->bytecode->constant_pool[name_index].tag == JSC_CP_UTF8 &&
+        ctx->bytecode->constant_pool[name_index].utf8_info.length == 4 &&
+        memcmp(ctx->bytecode->constant_pool[name_index].utf8_info.bytes, "Code",
+               4) == 0)
+    {
+      uint16_t max_stack_be = htobe16(ctx->max_stack);
+      memcpy(attr->info, &max_stack_be, 2);
+
+      uint16_t max_locals_be = htobe16(ctx->local_index);
+      memcpy(attr->info + 2, &max_locals_be, 2);
+
+      break;
+    }
+  }
+
+  jsc_engine_end_function(ctx);
+}
+
+void jsc_engine_parse_statement(jsc_engine_context* ctx)
+{
+  if (jsc_engine_match(ctx, JSC_TOKEN_IF))
+  {
+    jsc_engine_parse_if_statement(ctx);
+  }
+  else if (jsc_engine_match(ctx, JSC_TOKEN_WHILE))
+  {
+    jsc_engine_parse_while_statement(ctx);
+  }
+  else if (jsc_engine_match(ctx, JSC_TOKEN_DO))
+  {
+    jsc_engine_parse_do_statement(ctx);
+  }
+  else if (jsc_engine_match(ctx, JSC_TOKEN_FOR))
+  {
+    jsc_engine_parse_for_statement(ctx);
+  }
+  else if (jsc_engine_match(ctx, JSC_TOKEN_SWITCH))
+  {
+    jsc_engine_parse_switch_statement(ctx);
+  }
+  else if (jsc_engine_match(ctx, JSC_TOKEN_BREAK))
+  {
+    jsc_engine_parse_jump_statement(ctx, JSC_TOKEN_BREAK);
+  }
+  else if (jsc_engine_match(ctx, JSC_TOKEN_CONTINUE))
+  {
+    jsc_engine_parse_jump_statement(ctx, JSC_TOKEN_CONTINUE);
+  }
+  else if (jsc_engine_match(ctx, JSC_TOKEN_RETURN))
+  {
+    jsc_engine_parse_return_statement(ctx);
+  }
+  else if (jsc_engine_match(ctx, JSC_TOKEN_LEFT_BRACE))
+  {
+    jsc_engine_enter_scope(ctx);
+    jsc_engine_parse_block(ctx);
+    jsc_engine_exit_scope(ctx);
+  }
+  else if (jsc_engine_check(ctx, JSC_TOKEN_IDENTIFIER) &&
+           jsc_peek_token_type(ctx->tokenizer) == JSC_TOKEN_COLON)
+  {
+    jsc_engine_parse_labeled_statement(ctx);
+  }
+  else
+  {
+    jsc_engine_parse_expression_statement(ctx);
+  }
+}
+
+void jsc_engine_parse_declaration(jsc_engine_context* ctx)
+{
+  if (jsc_engine_match(ctx, JSC_TOKEN_VAR))
+  {
+    jsc_engine_parse_var_declaration(ctx, JSC_SYMBOL_VAR);
+  }
+  else if (jsc_engine_match(ctx, JSC_TOKEN_LET))
+  {
+    jsc_engine_parse_var_declaration(ctx, JSC_SYMBOL_LET);
+  }
+  else if (jsc_engine_match(ctx, JSC_TOKEN_CONST))
+  {
+    jsc_engine_parse_var_declaration(ctx, JSC_SYMBOL_CONST);
+  }
+  else if (jsc_engine_match(ctx, JSC_TOKEN_FUNCTION))
+  {
+    jsc_engine_parse_function_declaration(ctx);
+  }
+  else
+  {
+    jsc_engine_parse_statement(ctx);
+  }
+}
+
+void jsc_engine_parse_var_declaration(jsc_engine_context* ctx,
+                                      jsc_symbol_type type)
+{
+  if (!jsc_engine_check(ctx, JSC_TOKEN_IDENTIFIER))
+  {
+    jsc_engine_error(ctx, "expected variable name");
+    return;
+  }
+
+  char name_buffer[1 << 8];
+  strncpy(name_buffer, ctx->current_token.start, ctx->current_token.length);
+  name_buffer[ctx->current_token.length] = '\0';
+
+  jsc_engine_advance(ctx);
+
+  jsc_symbol* symbol = jsc_engine_add_symbol(ctx, name_buffer, type);
+
+  if (!symbol)
+  {
+    return;
+  }
+
+  bool unused = jsc_engine_is_unused(ctx, name_buffer);
+
+  if (unused && jsc_engine_match(ctx, JSC_TOKEN_ASSIGN))
+  {
+    /* nothing reads it and evaluating the initializer has no effect */
+    jsc_engine_parse_discarded(ctx, jsc_engine_parse_expr);
+    symbol->initialized = true;
+  }
+  else if (unused && type != JSC_SYMBOL_CONST)
+  {
+    symbol->initialized = true;
+  }
+  else if (jsc_engine_match(ctx, JSC_TOKEN_ASSIGN))
+  {
+    jsc_engine_operand initializer;
+    jsc_engine_begin_operand(ctx, &initializer);
+    jsc_engine_parse_expr(ctx);
+    symbol->initialized = true;
+
+    /* a const never changes, so later uses load the value itself */
+    if (jsc_engine_end_operand(ctx, &initializer) &&
+        type == JSC_SYMBOL_CONST)
+    {
+      symbol->folded = true;
+      symbol->value = initializer.value;
+    }
+    else
+    {
+      jsc_engine_release_value(&initializer.value);
+    }
+
+    if (jsc_engine_is_global_scope(ctx))
+    {
+      char field_name[300];
+      sprintf(field_name, "global_%s", name_buffer);
+
+      jsc_field* field = jsc_bytecode_add_field(
+          ctx->bytecode, field_name, "Ljava/lang/Object;",
+          JSC_ACC_PUBLIC | JSC_ACC_STATIC);
+
+      jsc_bytecode_emit_field_access(ctx->bytecode, ctx->current_method,
+                                     JSC_JVM_PUTSTATIC, ctx->class_name,
+                                     field_name, "Ljava/lang/Object;");
+    }
+    else
+    {
+      jsc_bytecode_emit_local_var(ctx->bytecode, ctx->current_method,
+                                  JSC_JVM_ASTORE, symbol->index);
+    }
+  }
+  else
+  {
+    if (type == JSC_SYMBOL_CONST)
+    {
+      jsc_engine_error(ctx, "const variable must be initialized");
+      return;
+    }
+
+    jsc_bytecode_emit(ctx->bytecode, ctx->current_method, JSC_JVM_ACONST_NULL);
+
+    if (jsc_engine_is_global_scope(ctx))
+    {
+      char field_name[300];
+      sprintf(field_name, "global_%s", name_buffer);
+
+      jsc_field* field = jsc_bytecode_add_field(
+          ctx->bytecode, field_name, "Ljava/lang/Object;",
+          JSC_ACC_PUBLIC | JSC_ACC_STATIC);
+
+      jsc_bytecode_emit_field_access(ctx->bytecode, ctx->current_method,
+                                     JSC_JVM_PUTSTATIC, ctx->class_name,
+                                     field_name, "Ljava/lang/Object;");
+    }
+    else
+    {
+      jsc_bytecode_emit_local_var(ctx->bytecode, ctx->current_method,
+                                  JSC_JVM_ASTORE, symbol->index);
+    }
+  }
+
+  if (!jsc_engine_match(ctx, JSC_TOKEN_SEMICOLON))
+  {
+    jsc_engine_error(ctx, "expected ';' after variable declaration");
+  }
+}
+
+/**
+ * @brief skip a function's parameters and body, found by brace matching
+ *
+ * @details The parameter list is checked as jsc_engine_parse_function
+ *          would, so skipping a function rejects what parsing it does. Sets
+ *          *end past the closing brace and *param_count to the number of
+ *          parameters when they are given. Returns false, with an error
+ *          reported, if either is malformed; tokens are consumed up to the
+ *          closing brace or EOF even then, so that the caller advances.
+ */
+static bool jsc_engine_skip_function(jsc_engine_context* ctx,
+                                     const char** end, uint16_t* param_count)
+{
+  uint16_t params = 0;
+  bool ok = jsc_engine_match(ctx, JSC_TOKEN_LEFT_PAREN);
+
+  if (!ok)
+  {
+    jsc_engine_error(ctx, "expected '(' after function name");
+  }
+  else if (!jsc_engine_check(ctx, JSC_TOKEN_RIGHT_PAREN))
+  {
+    do
+    {
+      ok = jsc_engine_match(ctx, JSC_TOKEN_IDENTIFIER);
+      params++;
+    } while (ok && jsc_engine_match(ctx, JSC_TOKEN_COMMA));
+
+    if (!ok)
+    {
+      jsc_engine_error(ctx, "expected parameter name");
+    }
+  }
+
+  if (ok && !jsc_engine_match(ctx, JSC_TOKEN_RIGHT_PAREN))
+  {
+    jsc_engine_error(ctx, "expected ')' after parameters");
+    ok = false;
+  }
+
+  if (ok && !jsc_engine_check(ctx, JSC_TOKEN_LEFT_BRACE))
+  {
+    jsc_engine_error(ctx, "expected '{' before function body");
+    ok = false;
+  }
+
+  int depth = 0;
+  bool in_body = false;
+
+  /* a token error, already reported by jsc_engine_advance, ends it too */
+  while (!jsc_engine_check(ctx, JSC_TOKEN_EOF) &&
+         !jsc_engine_check(ctx, JSC_TOKEN_ERROR))
+  {
+    if (jsc_engine_check(ctx, JSC_TOKEN_LEFT_BRACE))
+    {
+      depth++;
+      in_body = true;
+    }
+    else if (jsc_engine_check(ctx, JSC_TOKEN_RIGHT_BRACE))
+    {
+      depth--;
+    }
+
+    if (end)
+    {
+      *end = ctx->current_token.start + ctx->current_token.length;
+    }
+
+    jsc_engine_advance(ctx);
+
+    if (in_body && depth <= 0)
+    {
+      break;
+    }
+  }
+
+  if (ok && (!in_body || depth != 0))
+  {
+    jsc_engine_error(ctx, "expected '}' after block");
+    ok = false;
+  }
+
+  if (ok && param_count)
+  {
+    *param_count = params;
+  }
+
+  return ok;
+}
+
+/**
+ * @brief skip a top-level function's parameters and body for later
+ *
+ * @details Only the token range is recorded, found by brace matching, along
+ *          with the global symbols visible at this point. The body is
+ *          compiled by jsc_engine_compile_deferred_functions.
+ */
+static void jsc_engine_defer_function(jsc_engine_context* ctx,
+                                      const char* name)
+{
+  const char* start = ctx->current_token.start;
+  const char* end = start;
+  uint16_t param_count = 0;
+
+  if (!jsc_engine_skip_function(ctx, &end, &param_count))
+  {
+    return;
+  }
+
+  if (ctx->deferred_count == ctx->deferred_capacity)
+  {
+    uint32_t capacity =
+        ctx->deferred_capacity ? ctx->deferred_capacity * 2 : 16;
+    jsc_deferred_function* functions = (jsc_deferred_function*)realloc(
+        ctx->deferred_functions, capacity * sizeof(jsc_deferred_function));
+
+    if (!functions)
+    {
+      jsc_engine_error(ctx, "jsc_engine_defer_function realloc");
+      return;
+    }
+
+    ctx->deferred_functions = functions;
+    ctx->deferred_capacity = capacity;
+  }
+
+  jsc_deferred_function* function =
+      &ctx->deferred_functions[ctx->deferred_count++];
+  memset(function, 0, sizeof(jsc_deferred_function));
+
+  function->name = strdup(name);
+  function->source = start;
+  function->length = end - start;
+  function->param_count = param_count;
+
+  jsc_symbol* symbol = jsc_engine_lookup_symbol(ctx, name);
+
+  if (symbol && symbol->type == JSC_SYMBOL_FUNCTION)
+  {
+    symbol->param_count = param_count;
+  }
+
+  /* symbols are prepended, so the current head sees exactly the globals
+     declared so far and is never modified afterwards */
+  function->globals.symbols = ctx->global_scope->symbols;
+}
+
+/**
+ * @brief compile one deferred body into a class of its own
+ *
+ * @details Globals keep resolving to fields of the parent class. When
+ *          class_name is the parent's, the result is a shard to be merged.
+ */
+static void jsc_engine_compile_deferred_function(jsc_engine_context* parent,
+                                                 jsc_deferred_function* function,
+                                                 const char* class_name)
+{
+  jsc_engine_context* ctx = jsc_engine_init(parent->class_name);
+
+  if (!ctx)
+  {
+    function->error_message = strdup("out of memory");
+    return;
+  }
+
+  ctx->flags = parent->flags & (JSC_ENGINE_FLAG_INVOKEDYNAMIC |
+                                JSC_ENGINE_FLAG_STRING_CONCAT |
+                                JSC_ENGINE_FLAG_OPTIMIZE);
+  ctx->global_scope->parent = &function->globals;
+  ctx->assigned_names = parent->assigned_names;
+  ctx->assigned_count = parent->assigned_count;
+  ctx->tokenizer = jsc_tokenizer_init(function->source, function->length);
+  ctx->bytecode = jsc_bytecode_create_class(
+      class_name, "java/lang/Object", JSC_ACC_PUBLIC | JSC_ACC_SUPER);
+
+  if (!ctx->tokenizer || !ctx->bytecode)
+  {
+    jsc_engine_error(ctx, "failed to initialize function compiler");
+  }
+  else
+  {
+    /* operands are re-indexed when merged, so ldc must not be used */
+    ctx->bytecode->wide_constant_loads =
+        strcmp(class_name, parent->class_name) == 0;
+    jsc_bytecode_set_version(ctx->bytecode, jsc_engine_class_version(ctx), 0);
+    function->first_method = ctx->bytecode->method_count;
+
+    jsc_engine_advance(ctx);
+    jsc_engine_parse_function(ctx, function->name);
+  }
+
+  function->tokens = ctx->stats.tokens;
+
+  if (ctx->had_error)
+  {
+    function->error_message =
+        strdup(ctx->error_message ? ctx->error_message : "compile error");
+  }
+  else
+  {
+    function->bytecode = ctx->bytecode;
+    ctx->bytecode = NULL;
+  }
+
+  ctx->global_scope->parent = NULL;
+  ctx->assigned_names = NULL;
+  ctx->assigned_count = 0;
+  jsc_engine_free(ctx);
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+typedef struct
+{
+  jsc_engine_context* ctx;
+  uint32_t next;
+  pthread_mutex_t lock;
+} jsc_engine_function_queue;
+
+static void* jsc_engine_function_worker(void* arg)
+{
+  jsc_engine_function_queue* queue = (jsc_engine_function_queue*)arg;
+
+  for (;;)
+  {
+    pthread_mutex_lock(&queue->lock);
+    uint32_t index = queue->next++;
+    pthread_mutex_unlock(&queue->lock);
+
+    if (index >= queue->ctx->deferred_count)
+    {
+      return NULL;
+    }
+
+    jsc_engine_compile_deferred_function(queue->ctx,
+                                         &queue->ctx->deferred_functions[index],
+                                         queue->ctx->class_name);
+  }
+}
+#endif
+
+/**
+ * @brief compile deferred function bodies in parallel and merge them
+ *
+ * @details Each body is compiled by a worker into a class shard of its own,
+ *          with its own constant pool. The shards are then merged into
+ *          ctx->bytecode in declaration order on the calling thread, so the
+ *          output does not depend on the worker count or on scheduling.
+ */
+void jsc_engine_compile_deferred_functions(jsc_engine_context* ctx)
+{
+  for (jsc_symbol* symbol = ctx->global_scope->symbols; symbol;
+       symbol = symbol->next)
+  {
+    symbol->initialized = true; /* workers must only read shared symbols */
+  }
+
+#if defined(_WIN32) || defined(_WIN64)
+  for (uint32_t i = 0; i < ctx->deferred_count; i++)
+  {
+    jsc_engine_compile_deferred_function(ctx, &ctx->deferred_functions[i],
+                                         ctx->class_name);
+  }
+#else
+  long workers = ctx->worker_count ? ctx->worker_count
+                                   : sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (workers > (long)ctx->deferred_count)
+  {
+    workers = ctx->deferred_count;
+  }
+
+  jsc_engine_function_queue queue = {.ctx = ctx, .next = 0};
+  pthread_mutex_init(&queue.lock, NULL);
+
+  pthread_t threads[1 << 6];
+  long started = 0;
+
+  while (workers > 1 && started < workers && started < (1 << 6) &&
+         pthread_create(&threads[started], NULL, jsc_engine_function_worker,
+                        &queue) == 0)
+  {
+    started++;
+  }
+
+  jsc_engine_function_worker(&queue); /* the caller works too */
+
+  for (long i = 0; i < started; i++)
+  {
+    pthread_join(threads[i], NULL);
+  }
+
+  pthread_mutex_destroy(&queue.lock);
+#endif
+
+  for (uint32_t i = 0; i < ctx->deferred_count && !ctx->had_error; i++)
+  {
+    jsc_deferred_function* function = &ctx->deferred_functions[i];
+    ctx->stats.tokens += function->tokens;
+
+    if (function->error_message)
+    {
+      jsc_engine_error(ctx, function->error_message);
+      break;
+    }
+
+    for (uint16_t j = function->first_method;
+         j < function->bytecode->method_count; j++)
+    {
+      if (!jsc_bytecode_import_method(ctx->bytecode, function->bytecode,
+                                      &function->bytecode->methods[j]))
+      {
+        jsc_engine_error(ctx, "failed to merge compiled function");
+        break;
+      }
+    }
+
+    jsc_bytecode_free(function->bytecode);
+    function->bytecode = NULL;
+  }
+}
+
+/**
+ * @brief emit the members shared by the stubs of a program's lazy functions
+ *
+ * @details jsc_bootstrap(lookup, name, type, index) makes the call site of
+ *          one stub, a MutableCallSite first targeting jsc_relink bound to
+ *          the site and the function's index. jsc_relink calls the native
+ *          jsc_link, which compiles the body and points the site at it, then
+ *          makes this one call through the handle it returns; later calls go
+ *          straight to the compiled method.
+ */
+static bool jsc_engine_emit_lazy_linker(jsc_engine_context* ctx)
+{
+  jsc_bytecode_context* bytecode = ctx->bytecode;
+  const char* site_class = "java/lang/invoke/MutableCallSite";
+  const char* handle_class = "java/lang/invoke/MethodHandle";
+  const char* lookup_class = "java/lang/invoke/MethodHandles$Lookup";
+
+  /* set to the owning jsc_engine_context once the class is defined */
+  jsc_bytecode_add_field(bytecode, "jsc_context", "J",
+                         JSC_ACC_PRIVATE | JSC_ACC_STATIC);
+  jsc_bytecode_add_method(bytecode, "jsc_link", JSC_ENGINE_LINK_DESCRIPTOR,
+                          JSC_ACC_PRIVATE | JSC_ACC_STATIC | JSC_ACC_NATIVE);
+
+  jsc_method* relink = jsc_bytecode_create_method(
+      bytecode, "jsc_relink", JSC_ENGINE_RELINK_DESCRIPTOR,
+      JSC_ACC_PRIVATE | JSC_ACC_STATIC, 2, 3);
+
+  if (!relink)
+  {
+    return false;
+  }
+
+  jsc_bytecode_emit(bytecode, relink, JSC_JVM_ALOAD_0);
+  jsc_bytecode_emit(bytecode, relink, JSC_JVM_ILOAD_1);
+  jsc_bytecode_emit_invoke_static(bytecode, relink, ctx->class_name,
+                                  "jsc_link", JSC_ENGINE_LINK_DESCRIPTOR);
+  jsc_bytecode_emit(bytecode, relink, JSC_JVM_ALOAD_2);
+  jsc_bytecode_emit_invoke_virtual(bytecode, relink, handle_class,
+                                   "invokeWithArguments",
+                                   "([Ljava/lang/Object;)Ljava/lang/Object;");
+  jsc_bytecode_emit(bytecode, relink, JSC_JVM_ARETURN);
+
+  jsc_method* bootstrap = jsc_bytecode_create_method(
+      bytecode, "jsc_bootstrap", JSC_ENGINE_LAZY_BOOTSTRAP_DESCRIPTOR,
+      JSC_ACC_PRIVATE | JSC_ACC_STATIC, 8, 5);
+
+  if (!bootstrap)
+  {
+    return false;
+  }
+
+  /* locals: 0 lookup, 1 name, 2 type, 3 index, 4 the site */
+  jsc_bytecode_emit_new(bytecode, bootstrap, site_class);
+  jsc_bytecode_emit(bytecode, bootstrap, JSC_JVM_DUP);
+  jsc_bytecode_emit(bytecode, bootstrap, JSC_JVM_ALOAD_2);
+  jsc_bytecode_emit_invoke_special(bytecode, bootstrap, site_class, "<init>",
+                                   "(Ljava/lang/invoke/MethodType;)V");
+  jsc_bytecode_emit_local_var(bytecode, bootstrap, JSC_JVM_ASTORE, 4);
+  jsc_bytecode_emit_local_var(bytecode, bootstrap, JSC_JVM_ALOAD, 4);
+
+  /* lookup.findStatic(lookupClass, "jsc_relink", type of jsc_relink) */
+  jsc_bytecode_emit(bytecode, bootstrap, JSC_JVM_ALOAD_0);
+  jsc_bytecode_emit(bytecode, bootstrap, JSC_JVM_ALOAD_0);
+  jsc_bytecode_emit_invoke_virtual(bytecode, bootstrap, lookup_class,
+                                   "lookupClass", "()Ljava/lang/Class;");
+  jsc_bytecode_emit_load_constant_string(bytecode, bootstrap, "jsc_relink");
+  jsc_bytecode_emit_load_constant_string(bytecode, bootstrap,
+                                         JSC_ENGINE_RELINK_DESCRIPTOR);
+  jsc_bytecode_emit(bytecode, bootstrap, JSC_JVM_ALOAD_0);
+  jsc_bytecode_emit_invoke_virtual(bytecode, bootstrap, lookup_class,
+                                   "lookupClass", "()Ljava/lang/Class;");
+  jsc_bytecode_emit_invoke_virtual(bytecode, bootstrap, "java/lang/Class",
+                                   "getClassLoader",
+                                   "()Ljava/lang/ClassLoader;");
+  jsc_bytecode_emit_invoke_static(
+      bytecode, bootstrap, "java/lang/invoke/MethodType",
+      "fromMethodDescriptorString",
+      "(Ljava/lang/String;Ljava/lang/ClassLoader;)"
+      "Ljava/lang/invoke/MethodType;");
+  jsc_bytecode_emit_invoke_virtual(
+      bytecode, bootstrap, lookup_class, "findStatic",
+      "(Ljava/lang/Class;Ljava/lang/String;Ljava/lang/invoke/MethodType;)"
+      "Ljava/lang/invoke/MethodHandle;");
+
+  /* insertArguments(handle, 0, site, index) */
+  jsc_bytecode_emit(bytecode, bootstrap, JSC_JVM_ICONST_0);
+  jsc_bytecode_emit(bytecode, bootstrap, JSC_JVM_ICONST_2);
+  jsc_bytecode_emit_anewarray(bytecode, bootstrap, "java/lang/Object");
+  jsc_bytecode_emit(bytecode, bootstrap, JSC_JVM_DUP);
+  jsc_bytecode_emit(bytecode, bootstrap, JSC_JVM_ICONST_0);
+  jsc_bytecode_emit_local_var(bytecode, bootstrap, JSC_JVM_ALOAD, 4);
+  jsc_bytecode_emit(bytecode, bootstrap, JSC_JVM_AASTORE);
+  jsc_bytecode_emit(bytecode, bootstrap, JSC_JVM_DUP);
+  jsc_bytecode_emit(bytecode, bootstrap, JSC_JVM_ICONST_1);
+  jsc_bytecode_emit(bytecode, bootstrap, JSC_JVM_ILOAD_3);
+  jsc_bytecode_emit_invoke_static(bytecode, bootstrap, "java/lang/Integer",
+                                  "valueOf", "(I)Ljava/lang/Integer;");
+  jsc_bytecode_emit(bytecode, bootstrap, JSC_JVM_AASTORE);
+  jsc_bytecode_emit_invoke_static(
+      bytecode, bootstrap, "java/lang/invoke/MethodHandles", "insertArguments",
+      "(Ljava/lang/invoke/MethodHandle;I[Ljava/lang/Object;)"
+      "Ljava/lang/invoke/MethodHandle;");
+
+  /* .asCollector(Object[].class, type.parameterCount()).asType(type) */
+  jsc_bytecode_emit_const_load(
+      bytecode, bootstrap,
+      jsc_bytecode_add_class_constant(bytecode, "[Ljava/lang/Object;"));
+  jsc_bytecode_emit(bytecode, bootstrap, JSC_JVM_ALOAD_2);
+  jsc_bytecode_emit_invoke_virtual(bytecode, bootstrap,
+                                   "java/lang/invoke/MethodType",
+                                   "parameterCount", "()I");
+  jsc_bytecode_emit_invoke_virtual(
+      bytecode, bootstrap, handle_class, "asCollector",
+      "(Ljava/lang/Class;I)Ljava/lang/invoke/MethodHandle;");
+  jsc_bytecode_emit(bytecode, bootstrap, JSC_JVM_ALOAD_2);
+  jsc_bytecode_emit_invoke_virtual(
+      bytecode, bootstrap, handle_class, "asType",
+      "(Ljava/lang/invoke/MethodType;)Ljava/lang/invoke/MethodHandle;");
+  jsc_bytecode_emit_invoke_virtual(bytecode, bootstrap, site_class,
+                                   "setTarget",
+                                   "(Ljava/lang/invoke/MethodHandle;)V");
+
+  jsc_bytecode_emit_local_var(bytecode, bootstrap, JSC_JVM_ALOAD, 4);
+  jsc_bytecode_emit(bytecode, bootstrap, JSC_JVM_ARETURN);
+
+  return true;
+}
+
+/**
+ * @brief emit the method that stands in for a lazily compiled function
+ *
+ * @details The stub passes its arguments to an invokedynamic site of its
+ *          own, bootstrapped by jsc_bootstrap with the function's index. The
+ *          first call compiles the body through jsc_link, which retargets
+ *          the site at the compiled method, so later calls cost one call
+ *          through a MutableCallSite the JIT can inline; the body is never
+ *          parsed at all if the function is never called.
+ */
+static void jsc_engine_emit_lazy_stub(jsc_engine_context* ctx, uint32_t index)
+{
+  jsc_deferred_function* function = &ctx->deferred_functions[index];
+
+  char field_name[300];
+  sprintf(field_name, "lazy_%s", function->name);
+
+  int32_t previous_method =
+      ctx->current_method ? ctx->current_method - ctx->bytecode->methods : -1;
+
+  /* the compiled method's handle, once jsc_link has made it */
+  jsc_bytecode_add_field(ctx->bytecode, field_name,
+                         "Ljava/lang/invoke/MethodHandle;",
+                         JSC_ACC_PRIVATE | JSC_ACC_STATIC);
+
+  bool linker = index > 0 || jsc_engine_emit_lazy_linker(ctx);
+  uint16_t handle = jsc_bytecode_add_method_handle(
+      ctx->bytecode, JSC_REF_INVOKE_STATIC, ctx->class_name, "jsc_bootstrap",
+      JSC_ENGINE_LAZY_BOOTSTRAP_DESCRIPTOR);
+  uint16_t index_constant =
+      jsc_bytecode_add_integer_constant(ctx->bytecode, (int32_t)index);
+  int32_t bootstrap = jsc_bytecode_add_bootstrap_method(
+      ctx->bytecode, handle, &index_constant, 1);
+
+  char* descriptor = jsc_engine_generate_descriptor(ctx, function->param_count);
+  jsc_method* stub =
+      linker && bootstrap >= 0
+          ? jsc_bytecode_create_method(ctx->bytecode, function->name,
+                                       descriptor,
+                                       JSC_ACC_PUBLIC | JSC_ACC_STATIC,
+                                       function->param_count,
+                                       function->param_count)
+          : NULL;
+
+  if (!stub)
+  {
+    free(descriptor);
+    jsc_engine_error(ctx, "failed to create lazy function stub");
+    return;
+  }
+
+  for (uint16_t i = 0; i < function->param_count; i++)
+  {
+    jsc_bytecode_emit_local_var(ctx->bytecode, stub, JSC_JVM_ALOAD, i);
+  }
+
+  jsc_bytecode_emit_invokedynamic(ctx->bytecode, stub, (uint16_t)bootstrap,
+                                  function->name, descriptor);
+  jsc_bytecode_emit(ctx->bytecode, stub, JSC_JVM_ARETURN);
+  free(descriptor);
+
+  ctx->current_method =
+      previous_method >= 0 ? &ctx->bytecode->methods[previous_method] : NULL;
+}
+
+/**
+ * @brief compile the body behind a lazy stub into a class of its own
+ *
+ * @details The class is named <class>$<function> and holds one public static
+ *          method with the stub's descriptor; globals still resolve to the
+ *          fields of the program class.
+ */
+bool jsc_engine_compile_lazy_function(jsc_engine_context* ctx, uint32_t index,
+                                      uint8_t** out_buffer, uint32_t* out_size)
+{
+  if (!jsc_engine_prepare_lazy_functions(ctx))
+  {
+    return false;
+  }
+
+  if (index >= ctx->deferred_count)
+  {
+    jsc_engine_error(ctx, "no such lazy function");
+    return false;
+  }
+
+  jsc_deferred_function* function = &ctx->deferred_functions[index];
+
+  char* class_name =
+      malloc(strlen(ctx->class_name) + strlen(function->name) + 2);
+
+  if (!class_name)
+  {
+    jsc_engine_error(ctx, "out of memory");
+    return false;
+  }
+
+  sprintf(class_name, "%s$%s", ctx->class_name, function->name);
+
+  jsc_engine_phase previous =
+      jsc_engine_enter_phase(ctx, JSC_ENGINE_PHASE_PARSE);
+  jsc_engine_compile_deferred_function(ctx, function, class_name);
+  jsc_engine_enter_phase(ctx, previous);
+
+  free(class_name);
+  ctx->stats.tokens += function->tokens;
+
+  if (function->error_message)
+  {
+    jsc_engine_error(ctx, function->error_message);
+    free(function->error_message);
+    function->error_message = NULL;
+    return false;
+  }
+
+  jsc_engine_enter_phase(ctx, JSC_ENGINE_PHASE_SERIALIZE);
+  *out_size = jsc_bytecode_write(function->bytecode, out_buffer);
+  jsc_engine_enter_phase(ctx, previous);
+  jsc_engine_count_class(ctx, function->bytecode, *out_size);
+
+  jsc_bytecode_free(function->bytecode);
+  function->bytecode = NULL;
+
+  if (*out_size == 0)
+  {
+    jsc_engine_error(ctx, "failed to serialize lazy function");
+    return false;
+  }
+
+  return true;
+}
+
+void jsc_engine_parse_function(jsc_engine_context* ctx, const char* name)
+{
+  jsc_symbol* function = jsc_engine_lookup_symbol(ctx, name);
+
+  if (!jsc_engine_match(ctx, JSC_TOKEN_LEFT_PAREN))
+  {
+    jsc_engine_error(ctx, "expected '(' after function name");
+    return;
+  }
+
+  /* the enclosing method's frame is resumed once the body is emitted;
+     parameters arrive in locals 0..n-1 of the new one */
+  uint16_t previous_local_index = ctx->local_index;
+  uint16_t previous_stack_size = ctx->stack_size;
+  uint16_t previous_max_stack = ctx->max_stack;
+  ctx->local_index = 0;
+
+  jsc_engine_enter_scope(ctx);
+  ctx->current_scope->is_function = true;
+  ctx->current_scope->function_name = strdup(name);
+
+  int param_count = 0;
+  if (!jsc_engine_check(ctx, JSC_TOKEN_RIGHT_PAREN))
+  {
+    do
+    {
+      if (!jsc_engine_check(ctx, JSC_TOKEN_IDENTIFIER))
+      {
+        jsc_engine_error(ctx, "expected parameter name");
+        return;
+      }
+
+      char param_name[1 << 8];
+      strncpy(param_name, ctx->current_token.start, ctx->current_token.length);
+      param_name[ctx->current_token.length] = '\0';
+
+      jsc_engine_advance(ctx);
+
+      jsc_symbol* param =
+          jsc_engine_add_symbol(ctx, param_name, JSC_SYMBOL_PARAMETER);
+      if (!param)
+      {
+        return;
+      }
+
+      param_count++;
+    } while (jsc_engine_match(ctx, JSC_TOKEN_COMMA));
+  }
+
+  if (!jsc_engine_match(ctx, JSC_TOKEN_RIGHT_PAREN))
+  {
+    jsc_engine_error(ctx, "expected ')' after parameters");
+    return;
+  }
+
+  /* deferred bodies see the symbol shared with other workers, whose arity
+     the pre-scan already set */
+  if (function && function->type == JSC_SYMBOL_FUNCTION &&
+      function->param_count != param_count)
+  {
+    function->param_count = param_count;
+  }
+
+  char* descriptor = jsc_engine_generate_descriptor(ctx, param_count);
+  /* the method array is reallocated by begin_function, so only the index of
+     the enclosing method survives it; deferred bodies have none */
+  int32_t previous_method =
+      ctx->current_method ? ctx->current_method - ctx->bytecode->methods : -1;
+
+  jsc_engine_begin_function(ctx, name, descriptor);
+  free(descriptor);
+  ctx->local_index = param_count;
+
+  if (!jsc_engine_match(ctx, JSC_TOKEN_LEFT_BRACE))
+  {
+    jsc_engine_error(ctx, "expected '{' before function body");
+    return;
+  }
+
+  /* break and continue do not reach out of the function */
+  jsc_jump_target* jump_targets = ctx->jump_targets;
+  uint32_t jump_target_count = ctx->jump_target_count;
+  uint32_t jump_target_capacity = ctx->jump_target_capacity;
+  ctx->jump_targets = NULL;
+  ctx->jump_target_count = 0;
+  ctx->jump_target_capacity = 0;
+
+  jsc_engine_parse_block(ctx);
+
+  free(ctx->jump_targets);
+  ctx->jump_targets = jump_targets;
+  ctx->jump_target_count = jump_target_count;
+  ctx->jump_target_capacity = jump_target_capacity;
+
+  jsc_engine_emit_byte(ctx, JSC_JVM_ACONST_NULL);
+  jsc_engine_emit_byte(ctx, JSC_JVM_ARETURN);
+
+  jsc_engine_end_function(ctx);
+
+  jsc_engine_exit_scope(ctx);
+
+  ctx->current_method =
+      previous_method >= 0 ? &ctx->bytecode->methods[previous_method] : NULL;
+  ctx->local_index = previous_local_index;
+  ctx->stack_size = previous_stack_size;
+  ctx->max_stack = previous_max_stack;
+}
+
+/* the function whose symbol the current scope declared last, past its
+   name */
+static void jsc_engine_parse_declared_function(jsc_engine_context* ctx)
+{
+  jsc_engine_parse_function(ctx, ctx->current_scope->symbols->name);
+}
+
+void jsc_engine_parse_function_declaration(jsc_engine_context* ctx)
+{
+  if (!jsc_engine_check(ctx, JSC_TOKEN_IDENTIFIER))
+  {
+    jsc_engine_error(ctx, "expected function name");
+    return;
+  }
+
+  char name_buffer[1 << 8];
+  strncpy(name_buffer, ctx->current_token.start, ctx->current_token.length);
+  name_buffer[ctx->current_token.length] = '\0';
+
+  jsc_engine_advance(ctx);
+
+  jsc_symbol* symbol =
+      jsc_engine_add_symbol(ctx, name_buffer, JSC_SYMBOL_FUNCTION);
+  if (!symbol)
+  {
+    return;
+  }
+
+  if (jsc_engine_is_unused(ctx, name_buffer))
+  {
+    /* no method, field or name constant for a function never read, but
+       its body is still checked */
+    jsc_engine_parse_discarded(ctx, jsc_engine_parse_declared_function);
+    return;
+  }
+
+  if ((ctx->flags & JSC_ENGINE_FLAG_LAZY_FUNCTIONS) &&
+      jsc_engine_is_global_scope(ctx))
+  {
+    jsc_engine_defer_function(ctx, name_buffer);
+
+    if (!ctx->had_error)
+    {
+      jsc_engine_emit_lazy_stub(ctx, ctx->deferred_count - 1);
+    }
+  }
+  else if ((ctx->flags & JSC_ENGINE_FLAG_PARALLEL_FUNCTIONS) &&
+           jsc_engine_is_global_scope(ctx))
+  {
+    jsc_engine_defer_function(ctx, name_buffer);
+  }
+  else
+  {
+    jsc_engine_parse_function(ctx, name_buffer);
+  }
+
+  if (jsc_engine_is_global_scope(ctx))
+  {
+    char method_ref[300];
+    sprintf(method_ref, "%s.%s", ctx->class_name, name_buffer);
+
+    jsc_bytecode_emit_load_constant_string(ctx->bytecode, ctx->current_method,
+                                           method_ref);
+
+    char field_name[300];
+    sprintf(field_name, "global_%s", name_buffer);
+
+    jsc_field* field =
+        jsc_bytecode_add_field(ctx->bytecode, field_name, "Ljava/lang/Object;",
+                               JSC_ACC_PUBLIC | JSC_ACC_STATIC);
+
+    jsc_bytecode_emit_field_access(ctx->bytecode, ctx->current_method,
+                                   JSC_JVM_PUTSTATIC, ctx->class_name,
+                                   field_name, "Ljava/lang/Object;");
+  }
+}
+
+void jsc_engine_parse_expression_statement(jsc_engine_context* ctx)
+{
+  jsc_engine_parse_expr(ctx);
+
+  if (!jsc_engine_match(ctx, JSC_TOKEN_SEMICOLON))
+  {
+    jsc_engine_error(ctx, "expected ';' after expression");
+    return;
+  }
+
+  jsc_engine_emit_byte(ctx, JSC_JVM_POP);
+}
+
+/* account for code emitted past jsc_engine_emit_byte that moves the stack
+   by delta slots */
+static void jsc_engine_adjust_stack(jsc_engine_context* ctx, int32_t delta)
+{
+  ctx->stack_size = (uint16_t)(ctx->stack_size + delta);
+
+  if (ctx->stack_size > ctx->max_stack)
+  {
+    ctx->max_stack = ctx->stack_size;
+  }
+}
+
+/* call a static conversion of JSC_RUNTIME_CLASS, see jsc_runtime_build */
+static void jsc_engine_emit_runtime_call(jsc_engine_context* ctx,
+                                         const char* name,
+                                         const char* descriptor,
+                                         int32_t delta)
+{
+  jsc_bytecode_emit_invoke_static(ctx->bytecode, ctx->current_method,
+                                  JSC_RUNTIME_CLASS, name, descriptor);
+  jsc_engine_adjust_stack(ctx, delta);
+}
+
+static void jsc_engine_emit_branch(jsc_engine_context* ctx, uint8_t opcode,
+                                   int32_t label, int32_t delta)
+{
+  jsc_bytecode_emit_branch(ctx->bytecode, ctx->current_method, opcode, label);
+  jsc_engine_adjust_stack(ctx, delta);
+}
+
+/**
+ * @brief pop the value on the stack and branch to label when its truth is
+ *        when
+ *
+ * @details The value's type is only known at run time, so its truth is
+ *          found by the runtime's ToBoolean.
+ */
+static void jsc_engine_emit_truth_jump(jsc_engine_context* ctx, bool when,
+                                       int32_t label)
+{
+  jsc_engine_emit_runtime_call(ctx, JSC_RUNTIME_TO_BOOLEAN,
+                               JSC_RUNTIME_TO_BOOLEAN_DESCRIPTOR, 0);
+  jsc_engine_emit_branch(ctx, when ? JSC_JVM_IFNE : JSC_JVM_IFEQ, label, -1);
+}
+
+/**
+ * @brief push the boolean of a condition already compiled as a branch to
+ *        false_label when false, on a stack of stack entries
+ */
+static void jsc_engine_emit_boolean(jsc_engine_context* ctx,
+                                    int32_t false_label, uint16_t stack)
+{
+  int32_t end = jsc_bytecode_new_label(ctx->bytecode);
+
+  ctx->stack_size = stack;
+  jsc_bytecode_emit_load_constant_boolean_boxed(ctx->bytecode,
+                                                ctx->current_method, true);
+  jsc_engine_emit_branch(ctx, JSC_JVM_GOTO, end, 1);
+  jsc_engine_patch_jump(ctx, false_label);
+  jsc_bytecode_emit_load_constant_boolean_boxed(ctx->bytecode,
+                                                ctx->current_method, false);
+  jsc_engine_patch_jump(ctx, end);
+
+  ctx->stack_size = stack + 1;
+}
+
+/* an integral number within int32 range */
+static bool jsc_engine_to_int32(double number, int64_t* value)
+{
+  if (number != floor(number) || fabs(number) > INT32_MAX)
+  {
+    return false;
+  }
+
+  *value = (int64_t)number;
+  return true;
+}
+
+/* a compare operand whose number is known while compiling: a constant, or
+   a read of a loop counter kept in an int local */
+typedef struct
+{
+  double value;
+  int32_t counter; /* local of the counter, or -1 for a constant */
+  bool integral;   /* it fits an int compare */
+} jsc_engine_number;
+
+static bool jsc_engine_known_number(const jsc_engine_operand* operand,
+                                    jsc_engine_number* number)
+{
+  int64_t integer;
+
+  number->value = 0;
+  number->counter = operand->counter;
+  number->integral = true;
+
+  if (operand->counter >= 0)
+  {
+    return true;
+  }
+
+  if (!operand->constant || operand->value.type != JSC_VALUE_NUMBER)
+  {
+    return false;
+  }
+
+  number->value = operand->value.number_value;
+  number->integral = jsc_engine_to_int32(number->value, &integer);
+  return true;
+}
+
+static void jsc_engine_emit_number(jsc_engine_context* ctx,
+                                   const jsc_engine_number* number,
+                                   bool as_int)
+{
+  if (number->counter >= 0)
+  {
+    jsc_bytecode_emit_local_var(ctx->bytecode, ctx->current_method,
+                                JSC_JVM_ILOAD, (uint16_t)number->counter);
+
+    if (!as_int)
+    {
+      jsc_bytecode_emit(ctx->bytecode, ctx->current_method, JSC_JVM_I2D);
+    }
+  }
+  else if (as_int)
+  {
+    jsc_bytecode_emit_load_constant_int(ctx->bytecode, ctx->current_method,
+                                        (int32_t)number->value);
+  }
+  else
+  {
+    jsc_bytecode_emit_load_constant_double(ctx->bytecode, ctx->current_method,
+                                           number->value);
+  }
+
+  jsc_engine_adjust_stack(ctx, as_int ? 1 : 2);
+}
+
+static bool jsc_engine_is_relational(jsc_token_type type)
+{
+  return type == JSC_TOKEN_LESS_THAN || type == JSC_TOKEN_GREATER_THAN ||
+         type == JSC_TOKEN_LESS_THAN_EQUAL ||
+         type == JSC_TOKEN_GREATER_THAN_EQUAL;
+}
+
+static bool jsc_engine_is_equality(jsc_token_type type)
+{
+  return type == JSC_TOKEN_EQUAL || type == JSC_TOKEN_NOT_EQUAL ||
+         type == JSC_TOKEN_STRICT_EQUAL || type == JSC_TOKEN_STRICT_NOT_EQUAL;
+}
+
+/**
+ * @brief the if<cond> that branches when the result of a compare for
+ *        operator_type, held against zero, gives the truth when
+ *
+ * @details Add IF_ICMPEQ - IFEQ for the if_icmp<cond> comparing two ints.
+ */
+static uint8_t jsc_engine_compare_branch(jsc_token_type operator_type,
+                                         bool when)
+{
+  switch (operator_type)
+  {
+  case JSC_TOKEN_LESS_THAN:
+    return when ? JSC_JVM_IFLT : JSC_JVM_IFGE;
+  case JSC_TOKEN_GREATER_THAN:
+    return when ? JSC_JVM_IFGT : JSC_JVM_IFLE;
+  case JSC_TOKEN_LESS_THAN_EQUAL:
+    return when ? JSC_JVM_IFLE : JSC_JVM_IFGT;
+  case JSC_TOKEN_GREATER_THAN_EQUAL:
+    return when ? JSC_JVM_IFGE : JSC_JVM_IFLT;
+  case JSC_TOKEN_EQUAL:
+  case JSC_TOKEN_STRICT_EQUAL:
+    return when ? JSC_JVM_IFEQ : JSC_JVM_IFNE;
+  default:
+    return when ? JSC_JVM_IFNE : JSC_JVM_IFEQ;
+  }
+}
+
+/**
+ * @brief the double compare for operator_type
+ *
+ * @details A NaN operand makes every relational operator false, whichever
+ *          way the branch tests it: dcmpg turns NaN into 1, failing < and
+ *          <= and so taking the inverted branch, dcmpl into -1 for > and
+ *          >=. Equality takes dcmpl, NaN not being 0.
+ */
+static uint8_t jsc_engine_double_compare(jsc_token_type operator_type)
+{
+  return operator_type == JSC_TOKEN_LESS_THAN ||
+                 operator_type == JSC_TOKEN_LESS_THAN_EQUAL
+             ? JSC_JVM_DCMPG
+             : JSC_JVM_DCMPL;
+}
+
+/* a compiled condition: a branch, or a constant that left no code */
+typedef enum
+{
+  JSC_ENGINE_CONDITION_DYNAMIC,
+  JSC_ENGINE_CONDITION_FALSE,
+  JSC_ENGINE_CONDITION_TRUE
+} jsc_engine_condition;
+
+/**
+ * @brief ready the left operand of operator_type before the right one is
+ *        compiled
+ *
+ * @details A relational operand whose number is known is loaded as a double
+ *          instead, so that a right operand of unknown type can be
+ *          converted on top of it. Returns whether it was.
+ */
+static bool jsc_engine_begin_comparison(jsc_engine_context* ctx,
+                                        jsc_token_type operator_type,
+                                        const jsc_engine_operand* left)
+{
+  jsc_engine_number number;
+
+  if (!jsc_engine_is_relational(operator_type) ||
+      !jsc_engine_known_number(left, &number))
+  {
+    return false;
+  }
+
+  jsc_engine_discard_operand(ctx, left);
+  jsc_engine_emit_number(ctx, &number, false);
+  return true;
+}
+
+/**
+ * @brief compile left <operator_type> right as a branch to label taken when
+ *        the comparison's truth is when
+ *
+ * @details left went through jsc_engine_begin_comparison, loaded as a
+ *          double when loaded is set. Two known numbers compare with one
+ *          if_icmp<cond>, or with a double compare and an if<cond> when one
+ *          is not integral. Against a known number a value of unknown type
+ *          goes through the runtime's ToNumber first; between two of them
+ *          the runtime's compare, or its equality tests, decide. Constant
+ *          operands are folded, leaving their result loaded in place of
+ *          left and returning it instead of emitting a branch.
+ */
+static jsc_engine_condition
+jsc_engine_emit_comparison(jsc_engine_context* ctx,
+                           jsc_token_type operator_type,
+                           jsc_engine_operand* left, jsc_engine_operand* right,
+                           bool loaded, bool when, int32_t label)
+{
+  jsc_engine_number left_number;
+  jsc_engine_number right_number;
+  bool left_known = jsc_engine_known_number(left, &left_number);
+  bool right_known = jsc_engine_known_number(right, &right_number);
+  bool right_null = right->constant && (right->value.type == JSC_VALUE_NULL ||
+                                        right->value.type ==
+                                            JSC_VALUE_UNDEFINED);
+
+  if (jsc_engine_fold_operands(ctx, operator_type, left, right))
+  {
+    return jsc_engine_to_boolean(&left->value) ? JSC_ENGINE_CONDITION_TRUE
+                                               : JSC_ENGINE_CONDITION_FALSE;
+  }
+
+  bool equality = jsc_engine_is_equality(operator_type);
+  bool negated = operator_type == JSC_TOKEN_NOT_EQUAL ||
+                 operator_type == JSC_TOKEN_STRICT_NOT_EQUAL;
+  uint8_t opcode = jsc_engine_compare_branch(operator_type, when);
+
+  if (left_known && right_known && left_number.integral &&
+      right_number.integral)
+  {
+    /* against zero the if<cond> needs no second operand */
+    jsc_engine_discard_operand(ctx, left);
+    jsc_engine_emit_number(ctx, &left_number, true);
+
+    if (right_number.counter >= 0 || right_number.value != 0)
+    {
+      jsc_engine_emit_number(ctx, &right_number, true);
+      opcode += JSC_JVM_IF_ICMPEQ - JSC_JVM_IFEQ;
+    }
+  }
+  else if (left_known && right_known)
+  {
+    jsc_engine_discard_operand(ctx, left);
+    jsc_engine_emit_number(ctx, &left_number, false);
+    jsc_engine_emit_number(ctx, &right_number, false);
+    jsc_engine_emit_byte(ctx, jsc_engine_double_compare(operator_type));
+    jsc_engine_adjust_stack(ctx, -3);
+  }
+  else if (equality && right_null)
+  {
+    /* null also stands for undefined, so == and === agree on it */
+    jsc_engine_discard_operand(ctx, right);
+    opcode = when != negated ? JSC_JVM_IFNULL : JSC_JVM_IFNONNULL;
+  }
+  else if (equality)
+  {
+    bool strict = operator_type == JSC_TOKEN_STRICT_EQUAL ||
+                  operator_type == JSC_TOKEN_STRICT_NOT_EQUAL;
+
+    jsc_engine_emit_runtime_call(
+        ctx, strict ? JSC_RUNTIME_STRICT_EQUALS : JSC_RUNTIME_LOOSE_EQUALS,
+        JSC_RUNTIME_EQUALS_DESCRIPTOR, -1);
+    opcode = when != negated ? JSC_JVM_IFNE : JSC_JVM_IFEQ;
+  }
+  else if (loaded || right_known)
+  {
+    /* one side is a number, so the comparison is numeric */
+    if (right_known)
+    {
+      jsc_engine_discard_operand(ctx, right);
+      ctx->stack_size = left->stack + 1;
+      jsc_engine_emit_runtime_call(ctx, JSC_RUNTIME_TO_NUMBER,
+                                   JSC_RUNTIME_TO_NUMBER_DESCRIPTOR, 1);
+      jsc_engine_emit_number(ctx, &right_number, false);
+    }
+    else
+    {
+      jsc_engine_emit_runtime_call(ctx, JSC_RUNTIME_TO_NUMBER,
+                                   JSC_RUNTIME_TO_NUMBER_DESCRIPTOR, 1);
+    }
+
+    jsc_engine_emit_byte(ctx, jsc_engine_double_compare(operator_type));
+    jsc_engine_adjust_stack(ctx, -3);
+  }
+  else
+  {
+    /* the same NaN handling as the double compare, see compare() */
+    jsc_engine_emit_byte(ctx, jsc_engine_double_compare(operator_type) ==
+                                      JSC_JVM_DCMPG
+                                  ? JSC_JVM_ICONST_1
+                                  : JSC_JVM_ICONST_M1);
+    jsc_engine_emit_runtime_call(ctx, JSC_RUNTIME_COMPARE,
+                                 JSC_RUNTIME_COMPARE_DESCRIPTOR, -2);
+  }
+
+  jsc_engine_emit_branch(ctx, opcode, label, 0);
+  ctx->stack_size = left->stack;
+
+  return JSC_ENGINE_CONDITION_DYNAMIC;
+}
+
+/* a comparison used as a value: its boolean, or the constant it folds to */
+static void jsc_engine_emit_comparison_value(jsc_engine_context* ctx,
+                                             jsc_token_type operator_type,
+                                             jsc_engine_operand* left,
+                                             jsc_engine_operand* right,
+                                             bool loaded)
+{
+  int32_t false_label = jsc_bytecode_new_label(ctx->bytecode);
+
+  if (jsc_engine_emit_comparison(ctx, operator_type, left, right, loaded,
+                                 false, false_label) ==
+      JSC_ENGINE_CONDITION_DYNAMIC)
+  {
+    jsc_engine_emit_boolean(ctx, false_label, left->stack);
+    jsc_engine_end_operand(ctx, left);
+  }
+}
+
+/* the next token of a lookahead scan, without its string data */
+static jsc_token jsc_engine_scan_token(jsc_tokenizer_context* tokenizer)
+{
+  jsc_token token = jsc_next_token(tokenizer);
+
+  if (token.type == JSC_TOKEN_STRING || token.type == JSC_TOKEN_TEMPLATE)
+  {
+    free(token.string_value.data);
+  }
+  else if (token.type == JSC_TOKEN_REGEXP)
+  {
+    free(token.regexp_value.data);
+    free(token.regexp_value.flags);
+  }
+
+  if (jsc_tokenizer_has_error(tokenizer))
+  {
+    token.type = JSC_TOKEN_ERROR;
+  }
+
+  return token;
+}
+
+/* a stretch of the condition ahead, see jsc_engine_scan_condition */
+typedef struct
+{
+  jsc_token_type stop;  /* the token at nesting depth zero ending it */
+  uint32_t operators;   /* binary operators at depth zero */
+  uint32_t comparisons; /* of those, relational and equality ones */
+  bool group;           /* it is a single parenthesized expression */
+} jsc_engine_span;
+
+static bool jsc_engine_is_binary_operator(jsc_token_type type)
+{
+  switch (type)
+  {
+  case JSC_TOKEN_PLUS:
+  case JSC_TOKEN_MINUS:
+  case JSC_TOKEN_MULTIPLY:
+  case JSC_TOKEN_DIVIDE:
+  case JSC_TOKEN_MODULO:
+  case JSC_TOKEN_EXPONENTIATION:
+  case JSC_TOKEN_LOGICAL_AND:
+  case JSC_TOKEN_LOGICAL_OR:
+  case JSC_TOKEN_NULLISH_COALESCING:
+  case JSC_TOKEN_BITWISE_AND:
+  case JSC_TOKEN_BITWISE_OR:
+  case JSC_TOKEN_BITWISE_XOR:
+  case JSC_TOKEN_LEFT_SHIFT:
+  case JSC_TOKEN_RIGHT_SHIFT:
+  case JSC_TOKEN_UNSIGNED_RIGHT_SHIFT:
+  case JSC_TOKEN_IN:
+  case JSC_TOKEN_INSTANCEOF:
+    return true;
+  default:
+    return jsc_engine_is_relational(type) || jsc_engine_is_equality(type);
+  }
+}
+
+/* whether a binary operator right after the token applies to it */
+static bool jsc_engine_ends_operand(jsc_token_type type)
+{
+  switch (type)
+  {
+  case JSC_TOKEN_IDENTIFIER:
+  case JSC_TOKEN_STRING:
+  case JSC_TOKEN_NUMBER:
+  case JSC_TOKEN_REGEXP:
+  case JSC_TOKEN_TEMPLATE:
+  case JSC_TOKEN_TEMPLATE_END:
+  case JSC_TOKEN_TRUE:
+  case JSC_TOKEN_FALSE:
+  case JSC_TOKEN_NULL:
+  case JSC_TOKEN_UNDEFINED:
+  case JSC_TOKEN_THIS:
+  case JSC_TOKEN_INCREMENT:
+  case JSC_TOKEN_DECREMENT:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static bool jsc_engine_ends_expression(jsc_token_type type)
+{
+  switch (type)
+  {
+  case JSC_TOKEN_SEMICOLON:
+  case JSC_TOKEN_COMMA:
+  case JSC_TOKEN_COLON:
+  case JSC_TOKEN_QUESTION_MARK:
+  case JSC_TOKEN_RIGHT_PAREN:
+  case JSC_TOKEN_RIGHT_BRACKET:
+  case JSC_TOKEN_RIGHT_BRACE:
+  case JSC_TOKEN_EOF:
+  case JSC_TOKEN_ERROR:
+    return true;
+  default:
+    return jsc_engine_is_assignment(type);
+  }
+}
+
+/**
+ * @brief scan the condition ahead from the current token up to where its
+ *        expression ends, or up to a || or && at depth zero when stopping
+ *        at those
+ *
+ * @details Lets the condition compiler see what an operand belongs to
+ *          before compiling it. The program's tokenizer is put back where
+ *          it was.
+ */
+static jsc_engine_span jsc_engine_scan_condition(jsc_engine_context* ctx,
+                                                 bool or_stops,
+                                                 bool and_stops)
+{
+  jsc_engine_span span = {JSC_TOKEN_EOF, 0, 0, false};
+  jsc_tokenizer_mark mark;
+  jsc_tokenizer_save(ctx->tokenizer, &mark);
+
+  jsc_token_type first = ctx->current_token.type;
+  jsc_token_type type = first;
+  uint32_t count = 0;
+  uint32_t group_end = 0;
+  int depth = 0;
+  bool operand = false;
+
+  for (;; type = jsc_engine_scan_token(ctx->tokenizer).type)
+  {
+    if (type == JSC_TOKEN_EOF || type == JSC_TOKEN_ERROR ||
+        (depth == 0 && (jsc_engine_ends_expression(type) ||
+                        (or_stops && type == JSC_TOKEN_LOGICAL_OR) ||
+                        (and_stops && type == JSC_TOKEN_LOGICAL_AND))))
+    {
+      span.stop = type;
+      break;
+    }
+
+    count++;
+
+    if (type == JSC_TOKEN_LEFT_PAREN || type == JSC_TOKEN_LEFT_BRACKET ||
+        type == JSC_TOKEN_LEFT_BRACE)
+    {
+      depth++;
+    }
+    else if (type == JSC_TOKEN_RIGHT_PAREN || type == JSC_TOKEN_RIGHT_BRACKET ||
+             type == JSC_TOKEN_RIGHT_BRACE)
+    {
+      operand = --depth == 0;
+      group_end = group_end || depth > 0 ? group_end : count;
+    }
+    else if (depth == 0 && operand && jsc_engine_is_binary_operator(type))
+    {
+      span.operators++;
+      span.comparisons +=
+          jsc_engine_is_relational(type) || jsc_engine_is_equality(type);
+      operand = false;
+    }
+    else if (depth == 0)
+    {
+      operand = jsc_engine_ends_operand(type);
+    }
+  }
+
+  span.group = first == JSC_TOKEN_LEFT_PAREN && group_end == count;
+
+  jsc_tokenizer_restore(ctx->tokenizer, &mark);
+  return span;
+}
+
+static jsc_engine_condition jsc_engine_parse_or_condition(
+    jsc_engine_context* ctx, bool when, int32_t label);
+
+/* branch on an operand whose value, parsed by parse, only has a truth */
+static jsc_engine_condition
+jsc_engine_parse_value_condition(jsc_engine_context* ctx,
+                                 void (*parse)(jsc_engine_context*),
+                                 bool when, int32_t label)
+{
+  jsc_engine_operand operand;
+  jsc_engine_begin_operand(ctx, &operand);
+  parse(ctx);
+
+  if (!jsc_engine_end_operand(ctx, &operand))
+  {
+    jsc_engine_emit_truth_jump(ctx, when, label);
+    return JSC_ENGINE_CONDITION_DYNAMIC;
+  }
+
+  bool truth = jsc_engine_to_boolean(&operand.value);
+  jsc_engine_release_value(&operand.value);
+  jsc_engine_discard_operand(ctx, &operand);
+
+  return truth ? JSC_ENGINE_CONDITION_TRUE : JSC_ENGINE_CONDITION_FALSE;
+}
+
+/* a condition of a single comparison, its operands additive expressions */
+static jsc_engine_condition
+jsc_engine_parse_comparison_condition(jsc_engine_context* ctx, bool when,
+                                      int32_t label)
+{
+  jsc_engine_operand left;
+  jsc_engine_begin_operand(ctx, &left);
+  jsc_engine_parse_add(ctx);
+  jsc_engine_end_operand(ctx, &left);
+
+  jsc_token_type operator_type = ctx->current_token.type;
+  jsc_engine_advance(ctx);
+
+  bool loaded = jsc_engine_begin_comparison(ctx, operator_type, &left);
+
+  jsc_engine_operand right;
+  jsc_engine_begin_operand(ctx, &right);
+  jsc_engine_parse_add(ctx);
+  jsc_engine_end_operand(ctx, &right);
+
+  jsc_engine_condition condition = jsc_engine_emit_comparison(
+      ctx, operator_type, &left, &right, loaded, when, label);
+
+  if (condition != JSC_ENGINE_CONDITION_DYNAMIC)
+  {
+    jsc_engine_discard_operand(ctx, &left);
+  }
+
+  jsc_engine_release_value(&left.value);
+  jsc_engine_release_value(&right.value);
+  return condition;
+}
+
+/**
+ * @brief an operand of && and ||: a negation, a parenthesized condition, a
+ *        comparison or any other value
+ */
+static jsc_engine_condition jsc_engine_parse_atom_condition(
+    jsc_engine_context* ctx, bool when, int32_t label)
+{
+  jsc_engine_span span = jsc_engine_scan_condition(ctx, true, true);
+
+  if (jsc_engine_check(ctx, JSC_TOKEN_LOGICAL_NOT) && span.operators == 0)
+  {
+    /* ! of the whole operand just inverts the branch */
+    jsc_engine_advance(ctx);
+
+    jsc_engine_condition condition =
+        jsc_engine_parse_atom_condition(ctx, !when, label);
+
+    return condition == JSC_ENGINE_CONDITION_DYNAMIC ? condition
+           : condition == JSC_ENGINE_CONDITION_TRUE
+               ? JSC_ENGINE_CONDITION_FALSE
+               : JSC_ENGINE_CONDITION_TRUE;
+  }
+
+  if (jsc_engine_check(ctx, JSC_TOKEN_LEFT_PAREN) && span.group)
+  {
+    jsc_engine_advance(ctx);
+
+    jsc_engine_condition condition =
+        jsc_engine_parse_or_condition(ctx, when, label);
+
+    if (!jsc_engine_match(ctx, JSC_TOKEN_RIGHT_PAREN))
+    {
+      jsc_engine_error(ctx, "expected ')' after expression");
+    }
+
+    return condition;
+  }
+
+  if (span.comparisons == 1 && span.operators == 1)
+  {
+    return jsc_engine_parse_comparison_condition(ctx, when, label);
+  }
+
+  return jsc_engine_parse_value_condition(ctx, jsc_engine_parse_eq, when,
+                                          label);
+}
+
+/* emit the jump a constant operand of && or || stands for */
+static void jsc_engine_settle_condition(jsc_engine_context* ctx,
+                                        jsc_engine_condition condition,
+                                        bool when, int32_t label)
+{
+  if (condition == (when ? JSC_ENGINE_CONDITION_TRUE
+                         : JSC_ENGINE_CONDITION_FALSE))
+  {
+    jsc_engine_emit_branch(ctx, JSC_JVM_GOTO, label, 0);
+  }
+}
+
+/**
+ * @brief compile a chain of operands joined by operator_type, && or ||,
+ *        as jumps
+ *
+ * @details An operand other than the last one that decides the chain, true
+ *          for || and false for &&, jumps to label if that is the truth
+ *          branched on and past the chain otherwise; the last operand
+ *          branches as the whole chain would. Once a constant operand
+ *          decides it the rest is never evaluated, and is not compiled.
+ */
+static jsc_engine_condition jsc_engine_parse_chain_condition(
+    jsc_engine_context* ctx, jsc_token_type operator_type, bool when,
+    int32_t label)
+{
+  bool or_chain = operator_type == JSC_TOKEN_LOGICAL_OR;
+  jsc_engine_condition deciding =
+      or_chain ? JSC_ENGINE_CONDITION_TRUE : JSC_ENGINE_CONDITION_FALSE;
+  int32_t skip = -1;
+  bool constant = true; /* no operand so far emitted code */
+
+  for (;;)
+  {
+    bool last =
+        jsc_engine_scan_condition(ctx, true, !or_chain).stop != operator_type;
+
+    if (!last && when != or_chain && skip < 0)
+    {
+      skip = jsc_bytecode_new_label(ctx->bytecode);
+    }
+
+    bool truth = last ? when : or_chain;
+    int32_t target = last || when == or_chain ? label : skip;
+    jsc_engine_condition operand =
+        or_chain ? jsc_engine_parse_chain_condition(ctx, JSC_TOKEN_LOGICAL_AND,
+                                                    truth, target)
+                 : jsc_engine_parse_atom_condition(ctx, truth, target);
+
+    if (last || operand == deciding)
+    {
+      while (jsc_engine_match(ctx, operator_type))
+      {
+        jsc_engine_parse_discarded(ctx, or_chain ? jsc_engine_parse_land
+                                                 : jsc_engine_parse_eq);
+      }
+
+      if (constant)
+      {
+        return operand;
+      }
+
+      jsc_engine_settle_condition(ctx, operand, when, label);
+      break;
+    }
+
+    constant = constant && operand != JSC_ENGINE_CONDITION_DYNAMIC;
+
+    if (!jsc_engine_match(ctx, operator_type))
+    {
+      break;
+    }
+  }
+
+  if (skip >= 0)
+  {
+    jsc_engine_patch_jump(ctx, skip);
+  }
+
+  return JSC_ENGINE_CONDITION_DYNAMIC;
+}
+
+static jsc_engine_condition jsc_engine_parse_or_condition(
+    jsc_engine_context* ctx, bool when, int32_t label)
+{
+  return jsc_engine_parse_chain_condition(ctx, JSC_TOKEN_LOGICAL_OR, when,
+                                          label);
+}
+
+/**
+ * @brief compile the condition ahead as a branch to label, taken when its
+ *        truth is when and falling through otherwise
+ *
+ * @details && and || become chains of jumps and comparisons fused
+ *          compare-and-branch sequences, so no boolean is ever boxed; only
+ *          values of unknown type are tested by the runtime's ToBoolean. A
+ *          constant condition emits nothing and is returned as such.
+ */
+static jsc_engine_condition jsc_engine_parse_condition(jsc_engine_context* ctx,
+                                                       bool when,
+                                                       int32_t label)
+{
+  jsc_token_type stop = jsc_engine_scan_condition(ctx, false, false).stop;
+
+  if (stop == JSC_TOKEN_QUESTION_MARK || jsc_engine_is_assignment(stop))
+  {
+    return jsc_engine_parse_value_condition(ctx, jsc_engine_parse_expr, when,
+                                            label);
+  }
+
+  return jsc_engine_parse_or_condition(ctx, when, label);
+}
+
+void jsc_engine_parse_if_statement(jsc_engine_context* ctx)
+{
+  if (!jsc_engine_match(ctx, JSC_TOKEN_LEFT_PAREN))
+  {
+    jsc_engine_error(ctx, "expected '(' after 'if'");
+    return;
+  }
+
+  int32_t else_label = jsc_bytecode_new_label(ctx->bytecode);
+  jsc_engine_condition condition =
+      jsc_engine_parse_condition(ctx, false, else_label);
+
+  if (!jsc_engine_match(ctx, JSC_TOKEN_RIGHT_PAREN))
+  {
+    jsc_engine_error(ctx, "expected ')' after condition");
+    return;
+  }
+
+  if (condition != JSC_ENGINE_CONDITION_DYNAMIC)
+  {
+    /* only the branch a constant condition selects is ever run */
+    bool taken = condition == JSC_ENGINE_CONDITION_TRUE;
+
+    if (taken)
+    {
+      jsc_engine_parse_statement(ctx);
+    }
+    else
+    {
+      jsc_engine_parse_discarded(ctx, jsc_engine_parse_statement);
+    }
+
+    if (jsc_engine_match(ctx, JSC_TOKEN_ELSE))
+    {
+      if (taken)
+      {
+        jsc_engine_parse_discarded(ctx, jsc_engine_parse_statement);
+      }
+      else
+      {
+        jsc_engine_parse_statement(ctx);
+      }
+    }
+
+    return;
+  }
+
+  jsc_engine_parse_statement(ctx);
+
+  if (jsc_engine_match(ctx, JSC_TOKEN_ELSE))
+  {
+    int32_t end_label = jsc_engine_emit_jump(ctx, JSC_JVM_GOTO);
+
+    jsc_engine_patch_jump(ctx, else_label);
+    jsc_engine_parse_statement(ctx);
+    jsc_engine_patch_jump(ctx, end_label);
+  }
+  else
+  {
+    jsc_engine_patch_jump(ctx, else_label);
+  }
+}
+
+/* the text of a loop clause compiled out of order; start is NULL when the
+   clause is empty */
+typedef struct
+{
+  const char* start;
+  const char* end;
+} jsc_engine_clause;
+
+/**
+ * @brief step over a loop clause up to terminator, which is consumed
+ *
+ * @details Brackets are matched, so calls and groupings inside the clause
+ *          do not end it. Reports message when terminator is missing.
+ */
+static bool jsc_engine_skip_clause(jsc_engine_context* ctx,
+                                   jsc_token_type terminator,
+                                   jsc_engine_clause* clause,
+                                   const char* message)
+{
+  int depth = 0;
+
+  clause->start = NULL;
+  clause->end = NULL;
+
+  while (!jsc_engine_check(ctx, JSC_TOKEN_EOF) &&
+         (depth > 0 || !jsc_engine_check(ctx, terminator)))
+  {
+    jsc_token_type type = ctx->current_token.type;
+
+    if (type == JSC_TOKEN_LEFT_PAREN || type == JSC_TOKEN_LEFT_BRACKET ||
+        type == JSC_TOKEN_LEFT_BRACE)
+    {
+      depth++;
+    }
+    else if (type == JSC_TOKEN_RIGHT_PAREN ||
+             type == JSC_TOKEN_RIGHT_BRACKET || type == JSC_TOKEN_RIGHT_BRACE)
+    {
+      if (depth == 0)
+      {
+        break;
+      }
+
+      depth--;
+    }
+
+    if (!clause->start)
+    {
+      clause->start = ctx->current_token.start;
+    }
+
+    jsc_engine_advance(ctx);
+  }
+
+  if (clause->start)
+  {
+    clause->end = ctx->current_token.start;
+  }
+
+  if (!jsc_engine_match(ctx, terminator))
+  {
+    jsc_engine_error(ctx, message);
+    return false;
+  }
+
+  return true;
+}
+
+/* the program's place while a clause is compiled out of order */
+typedef struct
+{
+  jsc_tokenizer_context* tokenizer;
+  jsc_token current_token;
+} jsc_engine_clause_scope;
+
+/**
+ * @brief continue compiling at clause as if it stood at the current
+ *        position, until jsc_engine_close_clause
+ *
+ * @details The tokens come from a tokenizer over the clause's text, so they
+ *          point into the program as usual. Returns false if there is
+ *          nothing to compile.
+ */
+static bool jsc_engine_open_clause(jsc_engine_context* ctx,
+                                   const jsc_engine_clause* clause,
+                                   jsc_engine_clause_scope* scope)
+{
+  scope->tokenizer = ctx->tokenizer;
+  scope->current_token = ctx->current_token;
+
+  ctx->tokenizer = jsc_tokenizer_init(
+      clause->start, (size_t)(clause->end - clause->start));
+
+  if (!ctx->tokenizer)
+  {
+    jsc_engine_error(ctx, "jsc_engine_open_clause malloc");
+    ctx->tokenizer = scope->tokenizer;
+    return false;
+  }
+
+  jsc_engine_advance(ctx);
+  return true;
+}
+
+/* restore the program's tokenizer and current token after a clause */
+static void jsc_engine_close_clause(jsc_engine_context* ctx,
+                                    jsc_engine_clause_scope* scope)
+{
+  if (!jsc_engine_check(ctx, JSC_TOKEN_EOF))
+  {
+    jsc_engine_error(ctx, "unexpected token in loop clause");
+  }
+
+  jsc_tokenizer_free(ctx->tokenizer);
+
+  ctx->tokenizer = scope->tokenizer;
+  ctx->current_token = scope->current_token;
+}
+
+/* compile clause with parse as if it stood at the current position */
+static void jsc_engine_parse_clause(jsc_engine_context* ctx,
+                                    const jsc_engine_clause* clause,
+                                    void (*parse)(jsc_engine_context*))
+{
+  jsc_engine_clause_scope scope;
+
+  if (jsc_engine_open_clause(ctx, clause, &scope))
+  {
+    parse(ctx);
+    jsc_engine_close_clause(ctx, &scope);
+  }
+}
+
+/**
+ * @brief compile clause as a condition branching to label when its truth
+ *        is when, see jsc_engine_parse_condition
+ */
+static jsc_engine_condition
+jsc_engine_parse_clause_condition(jsc_engine_context* ctx,
+                                  const jsc_engine_clause* clause, bool when,
+                                  int32_t label)
+{
+  jsc_engine_clause_scope scope;
+  jsc_engine_condition condition = JSC_ENGINE_CONDITION_DYNAMIC;
+
+  if (jsc_engine_open_clause(ctx, clause, &scope))
+  {
+    condition = jsc_engine_parse_condition(ctx, when, label);
+    jsc_engine_close_clause(ctx, &scope);
+  }
+
+  return condition;
+}
+
+/**
+ * @brief whether clause is a constant condition, and if so its truth
+ *
+ * @details The clause is compiled and its code dropped again, so that the
+ *          loop can be laid out before its condition is emitted.
+ */
+static bool jsc_engine_clause_truth(jsc_engine_context* ctx,
+                                    const jsc_engine_clause* clause,
+                                    bool* truth)
+{
+  jsc_engine_operand operand;
+  jsc_engine_begin_operand(ctx, &operand);
+
+  int32_t label = jsc_bytecode_new_label(ctx->bytecode);
+  jsc_engine_condition condition =
+      jsc_engine_parse_clause_condition(ctx, clause, true, label);
+
+  *truth = condition == JSC_ENGINE_CONDITION_TRUE;
+  jsc_engine_discard_operand(ctx, &operand);
+
+  return condition != JSC_ENGINE_CONDITION_DYNAMIC;
+}
+
+/* an expression evaluated for its effect, such as the step of a for */
+static void jsc_engine_parse_effect(jsc_engine_context* ctx)
+{
+  jsc_engine_parse_expr(ctx);
+  jsc_engine_emit_byte(ctx, JSC_JVM_POP);
+}
+
+static bool jsc_engine_push_jump_target(jsc_engine_context* ctx,
+                                        const jsc_token* label,
+                                        int32_t break_label,
+                                        int32_t continue_label)
+{
+  if (ctx->jump_target_count == ctx->jump_target_capacity)
+  {
+    uint32_t capacity =
+        ctx->jump_target_capacity ? ctx->jump_target_capacity * 2 : 8;
+    jsc_jump_target* targets = (jsc_jump_target*)realloc(
+        ctx->jump_targets, capacity * sizeof(jsc_jump_target));
+
+    if (!targets)
+    {
+      jsc_engine_error(ctx, "jsc_engine_push_jump_target realloc");
+      return false;
+    }
+
+    ctx->jump_targets = targets;
+    ctx->jump_target_capacity = capacity;
+  }
+
+  jsc_jump_target* target = &ctx->jump_targets[ctx->jump_target_count++];
+  target->label = label ? label->start : NULL;
+  target->label_length = label ? label->length : 0;
+  target->break_label = break_label;
+  target->continue_label = continue_label;
+  target->open = false;
+
+  return true;
+}
+
+/* a loop is also the target of the labels directly in front of it */
+static bool jsc_engine_enter_loop(jsc_engine_context* ctx,
+                                  int32_t break_label, int32_t continue_label)
+{
+  for (uint32_t i = ctx->jump_target_count;
+       i > 0 && ctx->jump_targets[i - 1].open; i--)
+  {
+    ctx->jump_targets[i - 1].continue_label = continue_label;
+    ctx->jump_targets[i - 1].open = false;
+  }
+
+  return jsc_engine_push_jump_target(ctx, NULL, break_label, continue_label);
+}
+
+/**
+ * @brief emit the body of a while or for loop, with the test at the bottom
+ *
+ * @details The loop is laid out as
+ *
+ *              goto test
+ *            body: <statement>
+ *            next: <update>
+ *            test: <condition> branch to body when true
+ *            exit:
+ *
+ *          so that an iteration takes a single branch, the back-edge.
+ *          Without a condition, or with a constantly true one, the entry
+ *          jump is left out and the back-edge is a goto; a constantly false
+ *          condition leaves no code at all.
+ */
+static void jsc_engine_emit_loop(jsc_engine_context* ctx,
+                                 const jsc_engine_clause* condition,
+                                 const jsc_engine_clause* update)
+{
+  int32_t body = jsc_bytecode_new_label(ctx->bytecode);
+  int32_t next = jsc_bytecode_new_label(ctx->bytecode);
+  int32_t test = jsc_bytecode_new_label(ctx->bytecode);
+  int32_t exit = jsc_bytecode_new_label(ctx->bytecode);
+
+  bool truth = true;
+  bool constant =
+      !condition->start || jsc_engine_clause_truth(ctx, condition, &truth);
+  bool pushed = jsc_engine_enter_loop(ctx, exit, next);
+
+  if (constant && !truth)
+  {
+    jsc_engine_parse_discarded(ctx, jsc_engine_parse_statement);
+  }
+  else
+  {
+    if (!constant)
+    {
+      jsc_bytecode_emit_branch(ctx->bytecode, ctx->current_method,
+                               JSC_JVM_GOTO, test);
+    }
+
+    jsc_engine_patch_jump(ctx, body);
+    jsc_engine_parse_statement(ctx);
+    jsc_engine_patch_jump(ctx, next);
+
+    if (update->start)
+    {
+      jsc_engine_parse_clause(ctx, update, jsc_engine_parse_effect);
+    }
+
+    jsc_engine_patch_jump(ctx, test);
+
+    if (constant)
+    {
+      jsc_bytecode_emit_branch(ctx->bytecode, ctx->current_method,
+                               JSC_JVM_GOTO, body);
+    }
+    else
+    {
+      jsc_engine_parse_clause_condition(ctx, condition, true, body);
+    }
+  }
+
+  jsc_engine_patch_jump(ctx, exit);
+
+  if (pushed)
+  {
+    ctx->jump_target_count--;
+  }
+}
+
+void jsc_engine_parse_while_statement(jsc_engine_context* ctx)
+{
+  jsc_engine_clause condition;
+  jsc_engine_clause update = {NULL, NULL};
+
+  if (!jsc_engine_match(ctx, JSC_TOKEN_LEFT_PAREN))
+  {
+    jsc_engine_error(ctx, "expected '(' after 'while'");
+    return;
+  }
+
+  if (!jsc_engine_skip_clause(ctx, JSC_TOKEN_RIGHT_PAREN, &condition,
+                              "expected ')' after condition"))
+  {
+    return;
+  }
+
+  if (!condition.start)
+  {
+    jsc_engine_error(ctx, "expected expression");
+    return;
+  }
+
+  jsc_engine_emit_loop(ctx, &condition, &update);
+}
+
+void jsc_engine_parse_do_statement(jsc_engine_context* ctx)
+{
+  int32_t body = jsc_bytecode_new_label(ctx->bytecode);
+  int32_t next = jsc_bytecode_new_label(ctx->bytecode);
+  int32_t exit = jsc_bytecode_new_label(ctx->bytecode);
+  bool pushed = jsc_engine_enter_loop(ctx, exit, next);
+
+  jsc_engine_patch_jump(ctx, body);
+  jsc_engine_parse_statement(ctx);
+  jsc_engine_patch_jump(ctx, next);
+
+  if (!jsc_engine_match(ctx, JSC_TOKEN_WHILE) ||
+      !jsc_engine_match(ctx, JSC_TOKEN_LEFT_PAREN))
+  {
+    jsc_engine_error(ctx, "expected 'while (' after 'do' body");
+  }
+  else
+  {
+    /* a constantly false condition needs no code, a true one a goto */
+    jsc_engine_settle_condition(
+        ctx, jsc_engine_parse_condition(ctx, true, body), true, body);
+
+    if (!jsc_engine_match(ctx, JSC_TOKEN_RIGHT_PAREN))
+    {
+      jsc_engine_error(ctx, "expected ')' after condition");
+    }
+
+    jsc_engine_match(ctx, JSC_TOKEN_SEMICOLON);
+  }
+
+  jsc_engine_patch_jump(ctx, exit);
+
+  if (pushed)
+  {
+    ctx->jump_target_count--;
+  }
+}
+
+/* a for loop over an int counter, see jsc_engine_match_counted_loop */
+typedef struct
+{
+  const char* name;
+  size_t name_length;
+  int32_t start;
+  int32_t bound;
+  int16_t step;
+  jsc_token_type compare; /* test that continues the loop */
+} jsc_engine_counter;
+
+static bool jsc_engine_same_name(const jsc_token* token,
+                                 const jsc_token* name)
+{
+  return token->type == JSC_TOKEN_IDENTIFIER &&
+         token->length == name->length &&
+         memcmp(token->start, name->start, name->length) == 0;
+}
+
+/* an integer literal starting at token, possibly negated */
+static bool jsc_engine_scan_integer(jsc_tokenizer_context* tokenizer,
+                                    jsc_token token, int64_t* value)
+{
+  bool negative = token.type == JSC_TOKEN_MINUS;
+
+  if (negative)
+  {
+    token = jsc_engine_scan_token(tokenizer);
+  }
+
+  /* -0 is not an int */
+  if (token.type != JSC_TOKEN_NUMBER ||
+      !jsc_engine_to_int32(token.number_value, value) ||
+      (negative && *value == 0))
+  {
+    return false;
+  }
+
+  *value = negative ? -*value : *value;
+  return true;
+}
+
+/* whether the loop body ahead leaves the counter name alone */
+static bool jsc_engine_scan_counter_body(jsc_tokenizer_context* tokenizer,
+                                         const jsc_token* name)
+{
+  jsc_token previous = {.type = JSC_TOKEN_EOF};
+  jsc_token token = jsc_engine_scan_token(tokenizer);
+  bool braced = token.type == JSC_TOKEN_LEFT_BRACE;
+  int depth = 0;
+
+  /* a statement other than a block is only followed up to its ';' */
+  if (!braced && jsc_token_is_keyword(token.type))
+  {
+    return false;
+  }
+
+  for (;;)
+  {
+    if (token.type == JSC_TOKEN_EOF || token.type == JSC_TOKEN_ERROR ||
+        token.type == JSC_TOKEN_FUNCTION ||
+        (jsc_engine_same_name(&previous, name) &&
+         jsc_engine_is_assignment(token.type)) ||
+        (jsc_engine_same_name(&token, name) &&
+         (previous.type == JSC_TOKEN_INCREMENT ||
+          previous.type == JSC_TOKEN_DECREMENT)))
+    {
+      return false;
+    }
+
+    if (token.type == JSC_TOKEN_LEFT_PAREN ||
+        token.type == JSC_TOKEN_LEFT_BRACKET ||
+        token.type == JSC_TOKEN_LEFT_BRACE)
+    {
+      depth++;
+    }
+    else if (token.type == JSC_TOKEN_RIGHT_PAREN ||
+             token.type == JSC_TOKEN_RIGHT_BRACKET ||
+             token.type == JSC_TOKEN_RIGHT_BRACE)
+    {
+      depth--;
+    }
+
+    if (depth < 0 || (depth == 0 && (braced || token.type ==
+                                                   JSC_TOKEN_SEMICOLON)))
+    {
+      return depth == 0;
+    }
+
+    previous = token;
+    token = jsc_engine_scan_token(tokenizer);
+  }
+}
+
+static bool jsc_engine_scan_counted_loop(jsc_engine_context* ctx,
+                                         jsc_tokenizer_context* tokenizer,
+                                         jsc_engine_counter* counter)
+{
+  int64_t start = 0;
+  int64_t bound = 0;
+  int64_t step = 0;
+
+  jsc_token token = jsc_engine_scan_token(tokenizer);
+  jsc_token name = jsc_engine_scan_token(tokenizer);
+
+  if (token.type != JSC_TOKEN_LET || name.type != JSC_TOKEN_IDENTIFIER ||
+      name.length >= (1 << 8) ||
+      jsc_engine_scan_token(tokenizer).type != JSC_TOKEN_ASSIGN ||
+      !jsc_engine_scan_integer(tokenizer, jsc_engine_scan_token(tokenizer),
+                               &start) ||
+      jsc_engine_scan_token(tokenizer).type != JSC_TOKEN_SEMICOLON)
+  {
+    return false;
+  }
+
+  /* the test, against an integer or a const folded to one */
+  token = jsc_engine_scan_token(tokenizer);
+  jsc_token_type compare = jsc_engine_scan_token(tokenizer).type;
+
+  if (!jsc_engine_same_name(&token, &name) ||
+      (compare != JSC_TOKEN_LESS_THAN && compare != JSC_TOKEN_LESS_THAN_EQUAL &&
+       compare != JSC_TOKEN_GREATER_THAN &&
+       compare != JSC_TOKEN_GREATER_THAN_EQUAL))
+  {
+    return false;
+  }
+
+  token = jsc_engine_scan_token(tokenizer);
+
+  if (token.type == JSC_TOKEN_IDENTIFIER)
+  {
+    char bound_name[1 << 8];
+    jsc_symbol* symbol = NULL;
+
+    if (token.length < sizeof(bound_name) &&
+        !jsc_engine_same_name(&token, &name))
+    {
+      memcpy(bound_name, token.start, token.length);
+      bound_name[token.length] = '\0';
+      symbol = jsc_engine_lookup_symbol(ctx, bound_name);
+    }
+
+    if (!symbol || !symbol->folded ||
+        symbol->value.type != JSC_VALUE_NUMBER ||
+        !jsc_engine_to_int32(symbol->value.number_value, &bound))
+    {
+      return false;
+    }
+  }
+  else if (!jsc_engine_scan_integer(tokenizer, token, &bound))
+  {
+    return false;
+  }
+
+  if (jsc_engine_scan_token(tokenizer).type != JSC_TOKEN_SEMICOLON)
+  {
+    return false;
+  }
+
+  /* the step: ++, -- or a compound assignment of an integer */
+  token = jsc_engine_scan_token(tokenizer);
+
+  if (token.type == JSC_TOKEN_INCREMENT || token.type == JSC_TOKEN_DECREMENT)
+  {
+    step = token.type == JSC_TOKEN_INCREMENT ? 1 : -1;
+    token = jsc_engine_scan_token(tokenizer);
+
+    if (!jsc_engine_same_name(&token, &name))
+    {
+      return false;
+    }
+  }
+  else if (jsc_engine_same_name(&token, &name))
+  {
+    token = jsc_engine_scan_token(tokenizer);
+
+    if (token.type == JSC_TOKEN_INCREMENT ||
+        token.type == JSC_TOKEN_DECREMENT)
+    {
+      step = token.type == JSC_TOKEN_INCREMENT ? 1 : -1;
+    }
+    else if ((token.type != JSC_TOKEN_PLUS_ASSIGN &&
+              token.type != JSC_TOKEN_MINUS_ASSIGN) ||
+             !jsc_engine_scan_integer(
+                 tokenizer, jsc_engine_scan_token(tokenizer), &step))
+    {
+      return false;
+    }
+    else if (token.type == JSC_TOKEN_MINUS_ASSIGN)
+    {
+      step = -step;
+    }
+  }
+  else
+  {
+    return false;
   }
 
-  if (ctx->stack_size < 0)
-    ctx->stack_size = 0;
-
-  if (ctx->stack_size > ctx->max_stack)
+  if (jsc_engine_scan_token(tokenizer).type != JSC_TOKEN_RIGHT_PAREN)
   {
-    ctx->max_stack = ctx->stack_size;
+    return false;
   }
-}
 
-void jsc_engine_emit_bytes(jsc_engine_context* ctx, uint8_t byte1,
-                           uint8_t byte2)
-{
-  jsc_engine_emit_byte(ctx, byte1);
-  jsc_engine_emit_byte(ctx, byte2);
-}
+  /* it must head for the bound, and one step past it must be an int */
+  bool up = compare == JSC_TOKEN_LESS_THAN ||
+            compare == JSC_TOKEN_LESS_THAN_EQUAL;
 
-uint16_t jsc_engine_emit_jump(jsc_engine_context* ctx, uint8_t instruction)
-{
-  jsc_engine_emit_byte(ctx, instruction);
+  if (step == 0 || step < INT16_MIN || step > INT16_MAX || (step > 0) != up ||
+      bound + step < INT32_MIN || bound + step > INT32_MAX)
+  {
+    return false;
+  }
 
-  uint32_t code_offset =
-      jsc_bytecode_get_method_code_length(ctx->current_method);
+  if (!jsc_engine_scan_counter_body(tokenizer, &name))
+  {
+    return false;
+  }
 
-  jsc_bytecode_emit_u16(ctx->bytecode, ctx->current_method, 0, 0);
+  counter->name = name.start;
+  counter->name_length = name.length;
+  counter->start = (int32_t)start;
+  counter->bound = (int32_t)bound;
+  counter->step = (int16_t)step;
+  counter->compare = compare;
 
-  return code_offset;
+  return true;
 }
 
-void jsc_engine_patch_jump(jsc_engine_context* ctx, uint16_t offset)
+/**
+ * @brief recognise a for loop counting an integer towards a constant
+ *
+ * @details Matches for (let i = <int>; i <op> <int>; <step>) where the
+ *          bound may be a const folded to an integer, the step is ++, --,
+ *          += <int> or -= <int> towards the bound, and the body never
+ *          assigns i. Such a counter only takes integral values in int
+ *          range, so it can live in an int local. The current token must
+ *          follow the opening parenthesis; the scan uses a tokenizer of its
+ *          own.
+ */
+static bool jsc_engine_match_counted_loop(jsc_engine_context* ctx,
+                                          jsc_engine_counter* counter)
 {
-  uint8_t* code = jsc_bytecode_get_method_code(ctx->current_method);
-  uint32_t current = jsc_bytecode_get_method_code_length(ctx->current_method);
+  if (!jsc_engine_check(ctx, JSC_TOKEN_LET))
+  {
+    return false;
+  }
+
+  const char* start = ctx->current_token.start;
+  const char* end = ctx->tokenizer->source + ctx->tokenizer->source_length;
+  jsc_tokenizer_context* tokenizer =
+      jsc_tokenizer_init(start, (size_t)(end - start));
 
-  int16_t jump = current - offset - 2;
+  if (!tokenizer)
+  {
+    return false;
+  }
+
+  bool matched = jsc_engine_scan_counted_loop(ctx, tokenizer, counter);
+  jsc_tokenizer_free(tokenizer);
 
-  uint16_t jump_be = htobe16((uint16_t)jump); /* jump offset to big-endian */
-  memcpy(&code[offset], &jump_be, 2);
+  return matched;
 }
 
-void jsc_engine_parse_program(jsc_engine_context* ctx)
+/**
+ * @brief emit a counted for loop over an int local
+ *
+ * @details Laid out as jsc_engine_emit_loop does, with the counter stepped
+ *          by iinc and tested by one if_icmp against the bound, or by an
+ *          if<cond> when the bound is zero. Reads of the counter box it.
+ */
+static void jsc_engine_emit_counted_loop(jsc_engine_context* ctx,
+                                         const jsc_engine_counter* counter)
 {
-  jsc_method* main_method = jsc_bytecode_create_method(
-      ctx->bytecode, "main", "([Ljava/lang/String;)V",
-      JSC_ACC_PUBLIC | JSC_ACC_STATIC, 10, 100);
+  /* the head was matched as a whole, so its tokens are only stepped over */
+  while (!jsc_engine_check(ctx, JSC_TOKEN_EOF) &&
+         !jsc_engine_match(ctx, JSC_TOKEN_RIGHT_PAREN))
+  {
+    jsc_engine_advance(ctx);
+  }
 
-  ctx->bytecode->major_version = 49;
-  ctx->bytecode->minor_version = 0;
-  ctx->current_method = main_method;
-  ctx->stack_size = 0;
-  ctx->max_stack = 10;
-  ctx->local_index = 1;
+  char name_buffer[1 << 8];
+  memcpy(name_buffer, counter->name, counter->name_length);
+  name_buffer[counter->name_length] = '\0';
 
-  while (!jsc_engine_check(ctx, JSC_TOKEN_EOF))
+  jsc_symbol* symbol = jsc_engine_add_symbol(ctx, name_buffer, JSC_SYMBOL_LET);
+
+  if (!symbol)
   {
-    jsc_engine_parse_declaration(ctx);
+    return;
+  }
 
-    // @todo: propagate ctx->had_error elsewhere
+  symbol->initialized = true;
+  symbol->induction = true;
 
-    // if (ctx->had_error)
-    // {
-    //   return;
-    // }
+  jsc_bytecode_emit_load_constant_int(ctx->bytecode, ctx->current_method,
+                                      counter->start);
+  jsc_bytecode_emit_local_var(ctx->bytecode, ctx->current_method,
+                              JSC_JVM_ISTORE, symbol->index);
 
-    ctx->stack_size = 0;
+  if (ctx->stack_size + 2 > ctx->max_stack)
+  {
+    ctx->max_stack = ctx->stack_size + 2;
   }
 
-  jsc_engine_emit_byte(ctx, JSC_JVM_RETURN);
+  int32_t body = jsc_bytecode_new_label(ctx->bytecode);
+  int32_t next = jsc_bytecode_new_label(ctx->bytecode);
+  int32_t test = jsc_bytecode_new_label(ctx->bytecode);
+  int32_t exit = jsc_bytecode_new_label(ctx->bytecode);
+  bool pushed = jsc_engine_enter_loop(ctx, exit, next);
 
-  for (uint16_t i = 0; i < main_method->attribute_count; i++)
-  {
-    jsc_attribute* attr = &main_method->attributes[i];
-    uint16_t name_index = attr->name_index;
+  jsc_bytecode_emit_branch(ctx->bytecode, ctx->current_method, JSC_JVM_GOTO,
+                           test);
+  jsc_engine_patch_jump(ctx, body);
+  jsc_engine_parse_statement(ctx);
+  jsc_engine_patch_jump(ctx, next);
+  jsc_bytecode_emit_iinc(ctx->bytecode, ctx->current_method, symbol->index,
+                         counter->step);
+  jsc_engine_patch_jump(ctx, test);
+  jsc_bytecode_emit_local_var(ctx->bytecode, ctx->current_method,
+                              JSC_JVM_ILOAD, symbol->index);
 
-    if (name_index > 0 &&
-        ctx->bytecode->constant_pool[name_index].tag == JSC_CP_UTF8 &&
-        ctx->bytecode->constant_pool[name_index].utf8_info.length == 4 &&
-        memcmp(ctx->bytecode->constant_pool[name_index].utf8_info.bytes, "Code",
-               4) == 0)
-    {
-      uint16_t max_stack_be = htobe16(ctx->max_stack);
-      memcpy(attr->info, &max_stack_be, 2);
+  uint8_t opcode = counter->compare == JSC_TOKEN_LESS_THAN ? JSC_JVM_IFLT
+                   : counter->compare == JSC_TOKEN_LESS_THAN_EQUAL
+                       ? JSC_JVM_IFLE
+                   : counter->compare == JSC_TOKEN_GREATER_THAN ? JSC_JVM_IFGT
+                                                                : JSC_JVM_IFGE;
 
-      uint16_t max_locals_be = htobe16(ctx->local_index);
-      memcpy(attr->info + 2, &max_locals_be, 2);
+  if (counter->bound != 0)
+  {
+    /* if_icmp<cond> sits at a fixed distance from if<cond> */
+    jsc_bytecode_emit_load_constant_int(ctx->bytecode, ctx->current_method,
+                                        counter->bound);
+    opcode += JSC_JVM_IF_ICMPLT - JSC_JVM_IFLT;
+  }
 
-      break;
-    }
+  jsc_bytecode_emit_branch(ctx->bytecode, ctx->current_method, opcode, body);
+  jsc_engine_patch_jump(ctx, exit);
+
+  if (pushed)
+  {
+    ctx->jump_target_count--;
   }
 }
 
-void jsc_engine_parse_statement(jsc_engine_context* ctx)
+void jsc_engine_parse_for_statement(jsc_engine_context* ctx)
 {
-  if (jsc_engine_match(ctx, JSC_TOKEN_IF))
+  if (!jsc_engine_match(ctx, JSC_TOKEN_LEFT_PAREN))
   {
-    jsc_engine_parse_if_statement(ctx);
+    jsc_engine_error(ctx, "expected '(' after 'for'");
+    return;
   }
-  else if (jsc_engine_match(ctx, JSC_TOKEN_WHILE))
+
+  jsc_engine_enter_scope(ctx);
+
+  jsc_engine_counter counter;
+
+  if (jsc_engine_match_counted_loop(ctx, &counter))
   {
-    jsc_engine_parse_while_statement(ctx);
+    jsc_engine_emit_counted_loop(ctx, &counter);
+    jsc_engine_exit_scope(ctx);
+    return;
   }
-  else if (jsc_engine_match(ctx, JSC_TOKEN_FOR))
+
+  if (jsc_engine_match(ctx, JSC_TOKEN_SEMICOLON))
   {
-    jsc_engine_parse_for_statement(ctx);
   }
-  else if (jsc_engine_match(ctx, JSC_TOKEN_RETURN))
+  else if (jsc_engine_match(ctx, JSC_TOKEN_VAR))
   {
-    jsc_engine_parse_return_statement(ctx);
+    jsc_engine_parse_var_declaration(ctx, JSC_SYMBOL_VAR);
   }
-  else if (jsc_engine_match(ctx, JSC_TOKEN_LEFT_BRACE))
+  else if (jsc_engine_match(ctx, JSC_TOKEN_LET))
   {
-    jsc_engine_enter_scope(ctx);
-    jsc_engine_parse_block(ctx);
-    jsc_engine_exit_scope(ctx);
+    jsc_engine_parse_var_declaration(ctx, JSC_SYMBOL_LET);
   }
   else
   {
     jsc_engine_parse_expression_statement(ctx);
   }
+
+  jsc_engine_clause condition;
+  jsc_engine_clause update;
+
+  if (jsc_engine_skip_clause(ctx, JSC_TOKEN_SEMICOLON, &condition,
+                             "expected ';' after loop condition") &&
+      jsc_engine_skip_clause(ctx, JSC_TOKEN_RIGHT_PAREN, &update,
+                             "expected ')' after for clauses"))
+  {
+    jsc_engine_emit_loop(ctx, &condition, &update);
+  }
+
+  jsc_engine_exit_scope(ctx);
 }
 
-void jsc_engine_parse_declaration(jsc_engine_context* ctx)
+/* a case of a switch: its expression, compiled with the dispatch, and the
+   label of its statements */
+typedef struct
 {
-  if (jsc_engine_match(ctx, JSC_TOKEN_VAR))
+  jsc_engine_clause clause;
+  int32_t label;
+  jsc_value value; /* the expression's constant value, if it has one */
+  bool constant;
+} jsc_engine_case;
+
+/* String.hashCode of a string constant, over its UTF-16 code units */
+static int32_t jsc_engine_string_hash(const char* string)
+{
+  const uint8_t* p = (const uint8_t*)string;
+  uint32_t hash = 0;
+
+  while (*p)
   {
-    jsc_engine_parse_var_declaration(ctx, JSC_SYMBOL_VAR);
+    uint32_t code = *p++;
+    int extra = code >= 0xf0 ? 3 : code >= 0xe0 ? 2 : code >= 0xc0 ? 1 : 0;
+
+    code &= extra ? 0x3f >> extra : 0xff;
+
+    for (; extra > 0 && (*p & 0xc0) == 0x80; extra--)
+    {
+      code = (code << 6) | (*p++ & 0x3f);
+    }
+
+    if (code > 0xffff)
+    {
+      code -= 0x10000;
+      hash = hash * 31 + (0xd800 | (code >> 10));
+      code = 0xdc00 | (code & 0x3ff);
+    }
+
+    hash = hash * 31 + code;
   }
-  else if (jsc_engine_match(ctx, JSC_TOKEN_LET))
+
+  return (int32_t)hash;
+}
+
+/* an int that is none of the count keys */
+static int32_t jsc_engine_missing_key(const int32_t* keys, uint32_t count)
+{
+  int32_t key = -1;
+
+  for (bool changed = true; changed;)
   {
-    jsc_engine_parse_var_declaration(ctx, JSC_SYMBOL_LET);
+    changed = false;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+      if (keys[i] == key)
+      {
+        key--;
+        changed = true;
+      }
+    }
   }
-  else if (jsc_engine_match(ctx, JSC_TOKEN_CONST))
+
+  return key;
+}
+
+/**
+ * @brief dispatch on the switch value in local to the first of count cases
+ *        it strictly equals, or to default_label
+ *
+ * @details Cases that are all int32 constants become a tableswitch or
+ *          lookupswitch on the runtime's switchKey of the value, and cases
+ *          that are all string constants a switch on its hashCode followed
+ *          by an equals test per string of the bucket. Anything else tests
+ *          the cases one after another, evaluating their expressions in
+ *          order like JS does.
+ */
+static void jsc_engine_emit_switch_dispatch(jsc_engine_context* ctx,
+                                            uint16_t local,
+                                            jsc_engine_case* cases,
+                                            uint32_t count,
+                                            int32_t default_label)
+{
+  bool numbers = count > 0;
+  bool strings = count > 0;
+
+  for (uint32_t i = 0; i < count; i++)
   {
-    jsc_engine_parse_var_declaration(ctx, JSC_SYMBOL_CONST);
+    jsc_engine_case* c = &cases[i];
+    int64_t key;
+
+    jsc_engine_operand operand;
+    jsc_engine_begin_operand(ctx, &operand);
+    jsc_engine_parse_clause(ctx, &c->clause, jsc_engine_parse_expr);
+
+    c->constant = jsc_engine_end_operand(ctx, &operand);
+    c->value = operand.value;
+    jsc_engine_discard_operand(ctx, &operand);
+
+    numbers = numbers && c->constant && c->value.type == JSC_VALUE_NUMBER &&
+              jsc_engine_to_int32(c->value.number_value, &key);
+    strings = strings && c->constant && c->value.type == JSC_VALUE_STRING;
   }
-  else if (jsc_engine_match(ctx, JSC_TOKEN_FUNCTION))
+
+  int32_t* keys = (int32_t*)malloc((count ? count : 1) * sizeof(int32_t));
+  int32_t* labels = (int32_t*)malloc((count ? count : 1) * sizeof(int32_t));
+  uint32_t key_count = 0;
+
+  if (!keys || !labels)
   {
-    jsc_engine_parse_function_declaration(ctx);
+    jsc_engine_error(ctx, "jsc_engine_emit_switch_dispatch malloc");
+    numbers = strings = false;
+    count = 0;
+  }
+
+  /* one key per bucket, the first case of a key taking it */
+  for (uint32_t i = 0; (numbers || strings) && i < count; i++)
+  {
+    int64_t number = 0;
+    int32_t key = strings ? jsc_engine_string_hash(cases[i].value.string_value)
+                  : jsc_engine_to_int32(cases[i].value.number_value, &number)
+                      ? (int32_t)number
+                      : 0;
+    uint32_t k = 0;
+
+    while (k < key_count && keys[k] != key)
+    {
+      k++;
+    }
+
+    if (k == key_count)
+    {
+      keys[key_count] = key;
+      labels[key_count++] =
+          strings ? jsc_bytecode_new_label(ctx->bytecode) : cases[i].label;
+    }
+  }
+
+  if (numbers || strings)
+  {
+    jsc_bytecode_emit_local_var(ctx->bytecode, ctx->current_method,
+                                JSC_JVM_ALOAD, local);
+    jsc_engine_adjust_stack(ctx, 1);
+  }
+
+  if (numbers)
+  {
+    int32_t missing = jsc_engine_missing_key(keys, key_count);
+
+    jsc_bytecode_emit_load_constant_int(ctx->bytecode, ctx->current_method,
+                                        missing);
+    jsc_engine_emit_runtime_call(ctx, JSC_RUNTIME_SWITCH_KEY,
+                                 JSC_RUNTIME_SWITCH_KEY_DESCRIPTOR, 0);
+    jsc_bytecode_emit_switch(ctx->bytecode, ctx->current_method, keys, labels,
+                             key_count, default_label);
+    jsc_engine_adjust_stack(ctx, -1);
+  }
+  else if (strings)
+  {
+    jsc_bytecode_emit_u16(ctx->bytecode, ctx->current_method,
+                          JSC_JVM_INSTANCEOF,
+                          jsc_bytecode_add_class_constant(ctx->bytecode,
+                                                          "java/lang/String"));
+    jsc_engine_emit_branch(ctx, JSC_JVM_IFEQ, default_label, -1);
+    jsc_bytecode_emit_local_var(ctx->bytecode, ctx->current_method,
+                                JSC_JVM_ALOAD, local);
+    jsc_bytecode_emit_invoke_virtual(ctx->bytecode, ctx->current_method,
+                                     "java/lang/Object", "hashCode", "()I");
+    jsc_bytecode_emit_switch(ctx->bytecode, ctx->current_method, keys, labels,
+                             key_count, default_label);
+
+    for (uint32_t k = 0; k < key_count; k++)
+    {
+      jsc_engine_patch_jump(ctx, labels[k]);
+
+      for (uint32_t i = 0; i < count; i++)
+      {
+        if (jsc_engine_string_hash(cases[i].value.string_value) != keys[k])
+        {
+          continue;
+        }
+
+        jsc_bytecode_emit_load_constant_string(
+            ctx->bytecode, ctx->current_method, cases[i].value.string_value);
+        jsc_bytecode_emit_local_var(ctx->bytecode, ctx->current_method,
+                                    JSC_JVM_ALOAD, local);
+        jsc_bytecode_emit_invoke_virtual(ctx->bytecode, ctx->current_method,
+                                         "java/lang/String", "equals",
+                                         "(Ljava/lang/Object;)Z");
+        jsc_engine_adjust_stack(ctx, 2);
+        jsc_engine_emit_branch(ctx, JSC_JVM_IFNE, cases[i].label, -2);
+      }
+
+      jsc_engine_emit_branch(ctx, JSC_JVM_GOTO, default_label, 0);
+    }
   }
   else
   {
-    jsc_engine_parse_statement(ctx);
+    for (uint32_t i = 0; i < count; i++)
+    {
+      jsc_bytecode_emit_local_var(ctx->bytecode, ctx->current_method,
+                                  JSC_JVM_ALOAD, local);
+      jsc_engine_adjust_stack(ctx, 1);
+      jsc_engine_parse_clause(ctx, &cases[i].clause, jsc_engine_parse_expr);
+      jsc_engine_emit_runtime_call(ctx, JSC_RUNTIME_STRICT_EQUALS,
+                                   JSC_RUNTIME_EQUALS_DESCRIPTOR, -1);
+      jsc_engine_emit_branch(ctx, JSC_JVM_IFNE, cases[i].label, -1);
+    }
+
+    jsc_engine_emit_branch(ctx, JSC_JVM_GOTO, default_label, 0);
   }
+
+  free(keys);
+  free(labels);
 }
 
-void jsc_engine_parse_var_declaration(jsc_engine_context* ctx,
-                                      jsc_symbol_type type)
+/**
+ * @brief compile a switch statement
+ *
+ * @details Laid out like a loop, with the dispatch after the statements
+ *
+ *              goto dispatch
+ *            case: <statements>, falling through to the next case
+ *              goto exit
+ *            dispatch: <jump to the matching case or the default>
+ *            exit:
+ *
+ *          so that the case expressions, skipped on the way in, are all
+ *          known when the dispatch is chosen. break leaves the switch.
+ */
+void jsc_engine_parse_switch_statement(jsc_engine_context* ctx)
 {
-  if (!jsc_engine_check(ctx, JSC_TOKEN_IDENTIFIER))
+  if (!jsc_engine_match(ctx, JSC_TOKEN_LEFT_PAREN))
   {
-    jsc_engine_error(ctx, "expected variable name");
+    jsc_engine_error(ctx, "expected '(' after 'switch'");
     return;
   }
 
-  char name_buffer[1 << 8];
-  strncpy(name_buffer, ctx->current_token.start, ctx->current_token.length);
-  name_buffer[ctx->current_token.length] = '\0';
-
-  jsc_engine_advance(ctx);
-
-  jsc_symbol* symbol = jsc_engine_add_symbol(ctx, name_buffer, type);
+  jsc_engine_parse_expr(ctx);
 
-  if (!symbol)
+  if (!jsc_engine_match(ctx, JSC_TOKEN_RIGHT_PAREN) ||
+      !jsc_engine_match(ctx, JSC_TOKEN_LEFT_BRACE))
   {
+    jsc_engine_error(ctx, "expected ') {' after switch value");
     return;
   }
 
-  if (jsc_engine_match(ctx, JSC_TOKEN_ASSIGN))
-  {
-    jsc_engine_parse_expr(ctx);
-    symbol->initialized = true;
+  uint16_t local = ctx->local_index++;
+  jsc_bytecode_emit_local_var(ctx->bytecode, ctx->current_method,
+                              JSC_JVM_ASTORE, local);
+  jsc_engine_adjust_stack(ctx, -1);
 
-    if (jsc_engine_is_global_scope(ctx))
+  int32_t dispatch = jsc_bytecode_new_label(ctx->bytecode);
+  int32_t exit = jsc_bytecode_new_label(ctx->bytecode);
+  int32_t default_label = -1;
+  jsc_engine_case* cases = NULL;
+  uint32_t count = 0;
+  bool pushed = jsc_engine_push_jump_target(ctx, NULL, exit, -1);
+
+  jsc_engine_emit_branch(ctx, JSC_JVM_GOTO, dispatch, 0);
+  jsc_engine_enter_scope(ctx);
+
+  while (!ctx->had_error && !jsc_engine_check(ctx, JSC_TOKEN_EOF) &&
+         !jsc_engine_check(ctx, JSC_TOKEN_RIGHT_BRACE))
+  {
+    if (jsc_engine_match(ctx, JSC_TOKEN_CASE))
     {
-      char field_name[300];
-      sprintf(field_name, "global_%s", name_buffer);
+      jsc_engine_case* grown = (jsc_engine_case*)realloc(
+          cases, (count + 1) * sizeof(jsc_engine_case));
 
-      jsc_field* field = jsc_bytecode_add_field(
-          ctx->bytecode, field_name, "Ljava/lang/Object;",
-          JSC_ACC_PUBLIC | JSC_ACC_STATIC);
+      if (!grown)
+      {
+        jsc_engine_error(ctx, "jsc_engine_parse_switch_statement realloc");
+        break;
+      }
 
-      jsc_bytecode_emit_field_access(ctx->bytecode, ctx->current_method,
-                                     JSC_JVM_PUTSTATIC, ctx->class_name,
-                                     field_name, "Ljava/lang/Object;");
+      cases = grown;
+      memset(&cases[count], 0, sizeof(jsc_engine_case));
+
+      if (!jsc_engine_skip_clause(ctx, JSC_TOKEN_COLON, &cases[count].clause,
+                                  "expected ':' after case expression"))
+      {
+        break;
+      }
+
+      if (!cases[count].clause.start)
+      {
+        jsc_engine_error(ctx, "expected expression after 'case'");
+        break;
+      }
+
+      cases[count].label = jsc_bytecode_new_label(ctx->bytecode);
+      jsc_engine_patch_jump(ctx, cases[count++].label);
+    }
+    else if (jsc_engine_match(ctx, JSC_TOKEN_DEFAULT))
+    {
+      if (default_label >= 0 || !jsc_engine_match(ctx, JSC_TOKEN_COLON))
+      {
+        jsc_engine_error(ctx, default_label >= 0
+                                  ? "more than one default in switch"
+                                  : "expected ':' after 'default'");
+        break;
+      }
+
+      default_label = jsc_bytecode_new_label(ctx->bytecode);
+      jsc_engine_patch_jump(ctx, default_label);
+    }
+    else if (count == 0 && default_label < 0)
+    {
+      jsc_engine_error(ctx, "expected 'case' or 'default'");
+      break;
     }
     else
     {
-      jsc_bytecode_emit_local_var(ctx->bytecode, ctx->current_method,
-                                  JSC_JVM_ASTORE, symbol->index);
+      jsc_engine_parse_declaration(ctx);
     }
   }
-  else
+
+  /* after an error, step over the rest of the cases to stay in sync */
+  jsc_engine_clause rest;
+  jsc_engine_skip_clause(ctx, JSC_TOKEN_RIGHT_BRACE, &rest,
+                         "expected '}' after switch cases");
+
+  jsc_engine_emit_branch(ctx, JSC_JVM_GOTO, exit, 0);
+  jsc_engine_patch_jump(ctx, dispatch);
+
+  if (!ctx->had_error)
+  {
+    jsc_engine_emit_switch_dispatch(ctx, local, cases, count,
+                                    default_label >= 0 ? default_label : exit);
+  }
+
+  jsc_engine_exit_scope(ctx);
+  jsc_engine_patch_jump(ctx, exit);
+
+  for (uint32_t i = 0; i < count; i++)
+  {
+    jsc_engine_release_value(&cases[i].value);
+  }
+
+  free(cases);
+
+  if (pushed)
+  {
+    ctx->jump_target_count--;
+  }
+}
+
+/**
+ * @brief compile a labeled statement, which break can leave and, when it
+ *        is a loop, continue can go on with
+ */
+void jsc_engine_parse_labeled_statement(jsc_engine_context* ctx)
+{
+  jsc_token label = ctx->current_token;
+
+  jsc_engine_advance(ctx);
+  jsc_engine_advance(ctx); /* ':' */
+
+  for (uint32_t i = 0; i < ctx->jump_target_count; i++)
   {
-    if (type == JSC_SYMBOL_CONST)
+    const jsc_jump_target* target = &ctx->jump_targets[i];
+
+    if (target->label && target->label_length == label.length &&
+        memcmp(target->label, label.start, label.length) == 0)
     {
-      jsc_engine_error(ctx, "const variable must be initialized");
+      jsc_engine_error(ctx, "label already declared");
       return;
     }
+  }
 
-    jsc_bytecode_emit(ctx->bytecode, ctx->current_method, JSC_JVM_ACONST_NULL);
+  int32_t exit = jsc_bytecode_new_label(ctx->bytecode);
 
-    if (jsc_engine_is_global_scope(ctx))
-    {
-      char field_name[300];
-      sprintf(field_name, "global_%s", name_buffer);
+  if (!jsc_engine_push_jump_target(ctx, &label, exit, -1))
+  {
+    return;
+  }
 
-      jsc_field* field = jsc_bytecode_add_field(
-          ctx->bytecode, field_name, "Ljava/lang/Object;",
-          JSC_ACC_PUBLIC | JSC_ACC_STATIC);
+  /* left for a loop to take, possibly behind further labels */
+  ctx->jump_targets[ctx->jump_target_count - 1].open =
+      jsc_engine_check(ctx, JSC_TOKEN_WHILE) ||
+      jsc_engine_check(ctx, JSC_TOKEN_DO) ||
+      jsc_engine_check(ctx, JSC_TOKEN_FOR) ||
+      (jsc_engine_check(ctx, JSC_TOKEN_IDENTIFIER) &&
+       jsc_peek_token_type(ctx->tokenizer) == JSC_TOKEN_COLON);
 
-      jsc_bytecode_emit_field_access(ctx->bytecode, ctx->current_method,
-                                     JSC_JVM_PUTSTATIC, ctx->class_name,
-                                     field_name, "Ljava/lang/Object;");
+  jsc_engine_parse_statement(ctx);
+  jsc_engine_patch_jump(ctx, exit);
+  ctx->jump_target_count--;
+}
+
+/**
+ * @brief compile break or continue, type telling which
+ *
+ * @details Without a label, break leaves the innermost loop or switch and
+ *          continue goes on with the innermost loop. A label names the
+ *          statement instead, which for continue must be a loop.
+ */
+void jsc_engine_parse_jump_statement(jsc_engine_context* ctx,
+                                     jsc_token_type type)
+{
+  jsc_token label = ctx->current_token;
+  bool labeled = jsc_engine_match(ctx, JSC_TOKEN_IDENTIFIER);
+  const jsc_jump_target* found = NULL;
+  int32_t target = -1;
+
+  for (uint32_t i = ctx->jump_target_count; i > 0; i--)
+  {
+    const jsc_jump_target* candidate = &ctx->jump_targets[i - 1];
+    bool named = candidate->label && candidate->label_length == label.length &&
+                 memcmp(candidate->label, label.start, label.length) == 0;
+
+    if (labeled ? !named : candidate->label != NULL)
+    {
+      continue;
     }
-    else
+
+    found = candidate;
+    target = type == JSC_TOKEN_BREAK ? candidate->break_label
+                                     : candidate->continue_label;
+
+    if (target >= 0 || labeled)
     {
-      jsc_bytecode_emit_local_var(ctx->bytecode, ctx->current_method,
-                                  JSC_JVM_ASTORE, symbol->index);
+      break;
     }
   }
 
+  if (target < 0)
+  {
+    jsc_engine_error(ctx, labeled && !found ? "undefined label"
+                          : labeled         ? "continue target is not a loop"
+                          : type == JSC_TOKEN_BREAK
+                              ? "break outside of a loop or switch"
+                              : "continue outside of a loop");
+    return;
+  }
+
+  jsc_bytecode_emit_branch(ctx->bytecode, ctx->current_method, JSC_JVM_GOTO,
+                           target);
+
   if (!jsc_engine_match(ctx, JSC_TOKEN_SEMICOLON))
   {
-    jsc_engine_error(ctx, "expected ';' after variable declaration");
+    jsc_engine_error(ctx, type == JSC_TOKEN_BREAK
+                              ? "expected ';' after 'break'"
+                              : "expected ';' after 'continue'");
   }
 }
 
-void jsc_engine_parse_function_declaration(jsc_engine_context* ctx)
+void jsc_engine_parse_return_statement(jsc_engine_context* ctx)
 {
-  if (!jsc_engine_check(ctx, JSC_TOKEN_IDENTIFIER))
+  if (jsc_engine_is_global_scope(ctx))
   {
-    jsc_engine_error(ctx, "expected function name");
+    jsc_engine_error(ctx, "cannot return from global scope");
     return;
   }
 
-  char name_buffer[1 << 8];
-  strncpy(name_buffer, ctx->current_token.start, ctx->current_token.length);
-  name_buffer[ctx->current_token.length] = '\0';
-
-  jsc_engine_advance(ctx);
-
-  jsc_symbol* symbol =
-      jsc_engine_add_symbol(ctx, name_buffer, JSC_SYMBOL_FUNCTION);
-  if (!symbol)
+  if (jsc_engine_check(ctx, JSC_TOKEN_SEMICOLON))
   {
+    jsc_engine_advance(ctx);
+    jsc_engine_emit_byte(ctx, JSC_JVM_ACONST_NULL);
+    jsc_engine_emit_byte(ctx, JSC_JVM_ARETURN);
     return;
   }
 
-  if (!jsc_engine_match(ctx, JSC_TOKEN_LEFT_PAREN))
+  jsc_engine_parse_expr(ctx);
+
+  if (!jsc_engine_match(ctx, JSC_TOKEN_SEMICOLON))
   {
-    jsc_engine_error(ctx, "expected '(' after function name");
+    jsc_engine_error(ctx, "expected ';' after return value");
     return;
   }
 
-  jsc_engine_enter_scope(ctx);
-  ctx->current_scope->is_function = true;
-  ctx->current_scope->function_name = strdup(name_buffer);
+  jsc_engine_emit_byte(ctx, JSC_JVM_ARETURN);
+}
 
-  int param_count = 0;
-  if (!jsc_engine_check(ctx, JSC_TOKEN_RIGHT_PAREN))
+void jsc_engine_parse_block(jsc_engine_context* ctx)
+{
+  /* as in jsc_engine_parse_program, a statement that failed may not have
+     consumed anything */
+  while (!ctx->had_error && !jsc_engine_check(ctx, JSC_TOKEN_RIGHT_BRACE) &&
+         !jsc_engine_check(ctx, JSC_TOKEN_EOF))
   {
-    do
-    {
-      if (!jsc_engine_check(ctx, JSC_TOKEN_IDENTIFIER))
-      {
-        jsc_engine_error(ctx, "expected parameter name");
-        return;
-      }
-
-      char param_name[1 << 8];
-      strncpy(param_name, ctx->current_token.start, ctx->current_token.length);
-      param_name[ctx->current_token.length] = '\0';
-
-      jsc_engine_advance(ctx);
-
-      jsc_symbol* param =
-          jsc_engine_add_symbol(ctx, param_name, JSC_SYMBOL_PARAMETER);
-      if (!param)
-      {
-        return;
-      }
-
-      param_count++;
-    } while (jsc_engine_match(ctx, JSC_TOKEN_COMMA));
+    jsc_engine_parse_declaration(ctx);
   }
 
-  if (!jsc_engine_match(ctx, JSC_TOKEN_RIGHT_PAREN))
+  if (!jsc_engine_match(ctx, JSC_TOKEN_RIGHT_BRACE))
   {
-    jsc_engine_error(ctx, "expected ')' after parameters");
+    jsc_engine_error(ctx, "expected '}' after block");
     return;
   }
+}
 
-  char* descriptor = jsc_engine_generate_descriptor(ctx, param_count);
-  jsc_method* previous_method = ctx->current_method;
-
-  jsc_engine_begin_function(ctx, name_buffer, descriptor);
-  free(descriptor);
+void jsc_engine_parse_expr(jsc_engine_context* ctx)
+{
+  jsc_engine_parse_assign(ctx);
+}
 
-  if (!jsc_engine_match(ctx, JSC_TOKEN_LEFT_BRACE))
+void jsc_engine_parse_assign(jsc_engine_context* ctx)
+{
+  if (!jsc_engine_check(ctx, JSC_TOKEN_IDENTIFIER) ||
+      jsc_peek_token_type(ctx->tokenizer) != JSC_TOKEN_ASSIGN)
   {
-    jsc_engine_error(ctx, "expected '{' before function body");
+    jsc_engine_parse_lor(ctx);
     return;
   }
 
-  jsc_engine_parse_block(ctx);
+  jsc_token target = ctx->current_token;
+  jsc_engine_advance(ctx);
+  jsc_engine_advance(ctx); /* '=' */
 
-  jsc_engine_emit_byte(ctx, JSC_JVM_ACONST_NULL);
-  jsc_engine_emit_byte(ctx, JSC_JVM_ARETURN);
+  jsc_engine_parse_assign(ctx);
 
-  jsc_engine_end_function(ctx);
+  /* the assignment's own value is the one stored */
+  jsc_engine_emit_byte(ctx, JSC_JVM_DUP);
 
-  jsc_engine_exit_scope(ctx);
+  char name_buffer[1 << 8];
+  strncpy(name_buffer, target.start, target.length);
+  name_buffer[target.length] = '\0';
 
-  ctx->current_method = previous_method;
+  jsc_engine_store_variable(ctx, name_buffer);
+}
 
-  if (jsc_engine_is_global_scope(ctx))
-  {
-    char method_ref[300];
-    sprintf(method_ref, "%s.%s", ctx->class_name, name_buffer);
+/**
+ * @brief a chain of operands parsed by parse and joined by operator_type,
+ *        || or &&
+ *
+ * @details The value of the chain is that of the first operand whose truth
+ *          decides it, true for || and false for &&, or else of the last
+ *          one. A constant operand decides at compile time.
+ */
+static void jsc_engine_parse_logical(jsc_engine_context* ctx,
+                                     jsc_token_type operator_type,
+                                     void (*parse)(jsc_engine_context*))
+{
+  bool deciding = operator_type == JSC_TOKEN_LOGICAL_OR;
 
-    jsc_bytecode_emit_load_constant_string(ctx->bytecode, ctx->current_method,
-                                           method_ref);
+  jsc_engine_operand left;
+  jsc_engine_begin_operand(ctx, &left);
+  parse(ctx);
+  jsc_engine_end_operand(ctx, &left);
 
-    char field_name[300];
-    sprintf(field_name, "global_%s", name_buffer);
+  while (jsc_engine_match(ctx, operator_type))
+  {
+    if (left.constant && jsc_engine_to_boolean(&left.value) == deciding)
+    {
+      jsc_engine_parse_discarded(ctx, parse);
+    }
+    else if (left.constant)
+    {
+      jsc_engine_discard_operand(ctx, &left);
+      parse(ctx);
+      jsc_engine_end_operand(ctx, &left);
+    }
+    else
+    {
+      int32_t end = jsc_bytecode_new_label(ctx->bytecode);
+
+      jsc_engine_emit_byte(ctx, JSC_JVM_DUP);
+      jsc_engine_emit_truth_jump(ctx, deciding, end);
+      jsc_engine_emit_byte(ctx, JSC_JVM_POP);
+      parse(ctx);
+      jsc_engine_patch_jump(ctx, end);
+      jsc_engine_end_operand(ctx, &left);
+    }
+  }
 
-    jsc_field* field =
-        jsc_bytecode_add_field(ctx->bytecode, field_name, "Ljava/lang/Object;",
-                               JSC_ACC_PUBLIC | JSC_ACC_STATIC);
+  jsc_engine_release_value(&left.value);
+}
 
-    jsc_bytecode_emit_field_access(ctx->bytecode, ctx->current_method,
-                                   JSC_JVM_PUTSTATIC, ctx->class_name,
-                                   field_name, "Ljava/lang/Object;");
-  }
+void jsc_engine_parse_lor(jsc_engine_context* ctx)
+{
+  jsc_engine_parse_logical(ctx, JSC_TOKEN_LOGICAL_OR, jsc_engine_parse_land);
 }
 
-void jsc_engine_parse_expression_statement(jsc_engine_context* ctx)
+void jsc_engine_parse_land(jsc_engine_context* ctx)
 {
-  jsc_engine_parse_expr(ctx);
+  jsc_engine_parse_logical(ctx, JSC_TOKEN_LOGICAL_AND, jsc_engine_parse_eq);
+}
 
-  if (!jsc_engine_match(ctx, JSC_TOKEN_SEMICOLON))
+void jsc_engine_parse_eq(jsc_engine_context* ctx)
+{
+  jsc_engine_operand left;
+  jsc_engine_begin_operand(ctx, &left);
+  jsc_engine_parse_cmp(ctx);
+  jsc_engine_end_operand(ctx, &left);
+
+  while (jsc_engine_check(ctx, JSC_TOKEN_EQUAL) ||
+         jsc_engine_check(ctx, JSC_TOKEN_NOT_EQUAL) ||
+         jsc_engine_check(ctx, JSC_TOKEN_STRICT_EQUAL) ||
+         jsc_engine_check(ctx, JSC_TOKEN_STRICT_NOT_EQUAL))
   {
-    jsc_engine_error(ctx, "expected ';' after expression");
-    return;
+    jsc_token_type operator_type = ctx->current_token.type;
+    jsc_engine_advance(ctx);
+
+    jsc_engine_operand right;
+    jsc_engine_begin_operand(ctx, &right);
+    jsc_engine_parse_cmp(ctx);
+    jsc_engine_end_operand(ctx, &right);
+
+    jsc_engine_emit_comparison_value(ctx, operator_type, &left, &right,
+                                     false);
+    jsc_engine_release_value(&right.value);
   }
 
-  jsc_engine_emit_byte(ctx, JSC_JVM_POP);
+  jsc_engine_release_value(&left.value);
 }
 
-void jsc_engine_parse_if_statement(jsc_engine_context* ctx)
+void jsc_engine_parse_cmp(jsc_engine_context* ctx)
 {
-  if (!jsc_engine_match(ctx, JSC_TOKEN_LEFT_PAREN))
+  jsc_engine_operand left;
+  jsc_engine_begin_operand(ctx, &left);
+  jsc_engine_parse_add(ctx);
+  jsc_engine_end_operand(ctx, &left);
+
+  while (jsc_engine_check(ctx, JSC_TOKEN_LESS_THAN) ||
+         jsc_engine_check(ctx, JSC_TOKEN_GREATER_THAN) ||
+         jsc_engine_check(ctx, JSC_TOKEN_LESS_THAN_EQUAL) ||
+         jsc_engine_check(ctx, JSC_TOKEN_GREATER_THAN_EQUAL))
   {
-    jsc_engine_error(ctx, "expected '(' after 'if'");
-    return;
+    jsc_token_type operator_type = ctx->current_token.type;
+    jsc_engine_advance(ctx);
+
+    bool loaded = jsc_engine_begin_comparison(ctx, operator_type, &left);
+
+    jsc_engine_operand right;
+    jsc_engine_begin_operand(ctx, &right);
+    jsc_engine_parse_add(ctx);
+    jsc_engine_end_operand(ctx, &right);
+
+    jsc_engine_emit_comparison_value(ctx, operator_type, &left, &right,
+                                     loaded);
+    jsc_engine_release_value(&right.value);
   }
 
-  jsc_engine_parse_expr(ctx);
+  jsc_engine_release_value(&left.value);
+}
 
-  if (!jsc_engine_match(ctx, JSC_TOKEN_RIGHT_PAREN))
+typedef struct
+{
+  char* recipe; /* makeConcatWithConstants recipe, \1 marks an argument */
+  size_t length;
+  size_t capacity;
+  uint16_t argument_count;
+  uint16_t base; /* stack size below the first argument */
+  bool active;
+} jsc_engine_concat;
+
+/* longest literal folded into a recipe; the recipe is a CONSTANT_String */
+#define JSC_ENGINE_MAX_CONCAT_RECIPE (1 << 15)
+
+/**
+ * @brief whether the current token is a string literal forming a whole
+ *        operand of +, so its text can go into a recipe
+ */
+static bool jsc_engine_is_literal_operand(jsc_engine_context* ctx)
+{
+  if (!jsc_engine_check(ctx, JSC_TOKEN_STRING))
   {
-    jsc_engine_error(ctx, "expected ')' after condition");
-    return;
+    return false;
   }
 
-  /* unbox the object and convert to boolean */
-  jsc_bytecode_emit_invoke_virtual(ctx->bytecode, ctx->current_method,
-                                   "java/lang/Object", "equals",
-                                   "(Ljava/lang/Object;)Z");
-  ctx->stack_size -= 1;
+  const char* text = ctx->current_token.string_value.data;
 
-  uint16_t then_jump = jsc_engine_emit_jump(ctx, JSC_JVM_IFEQ);
+  if (!text || strchr(text, '\1') || strchr(text, '\2') ||
+      strlen(text) >= JSC_ENGINE_MAX_CONCAT_RECIPE / 2)
+  {
+    return false; /* recipe tags would need a constant argument */
+  }
 
-  /*mark*/ jsc_bytecode_emit(ctx->bytecode, ctx->current_method, JSC_JVM_NOP);
+  switch (jsc_peek_token_type(ctx->tokenizer))
+  {
+  case JSC_TOKEN_MULTIPLY:
+  case JSC_TOKEN_DIVIDE:
+  case JSC_TOKEN_MODULO:
+  case JSC_TOKEN_EXPONENTIATION:
+  case JSC_TOKEN_PERIOD:
+  case JSC_TOKEN_OPTIONAL_CHAINING:
+  case JSC_TOKEN_LEFT_BRACKET:
+  case JSC_TOKEN_LEFT_PAREN:
+  case JSC_TOKEN_INCREMENT:
+  case JSC_TOKEN_DECREMENT:
+  case JSC_TOKEN_TEMPLATE:
+    return false;
+  default:
+    return true;
+  }
+}
 
-  jsc_engine_parse_statement(ctx);
+static bool jsc_engine_concat_append(jsc_engine_context* ctx,
+                                     jsc_engine_concat* concat,
+                                     const char* text, size_t length)
+{
+  if (concat->length + length + 1 > concat->capacity)
+  {
+    size_t capacity = concat->capacity ? concat->capacity * 2 : 1 << 6;
 
-  uint16_t else_jump = jsc_engine_emit_jump(ctx, JSC_JVM_GOTO);
+    while (capacity < concat->length + length + 1)
+    {
+      capacity *= 2;
+    }
 
-  jsc_engine_patch_jump(ctx, then_jump);
+    char* recipe = realloc(concat->recipe, capacity);
 
-  /*mark*/ jsc_bytecode_emit(ctx->bytecode, ctx->current_method, JSC_JVM_NOP);
+    if (!recipe)
+    {
+      jsc_engine_error(ctx, "jsc_engine_concat_append realloc");
+      return false;
+    }
 
-  if (jsc_engine_match(ctx, JSC_TOKEN_ELSE))
-  {
-    jsc_engine_parse_statement(ctx);
+    concat->recipe = recipe;
+    concat->capacity = capacity;
   }
 
-  jsc_engine_patch_jump(ctx, else_jump);
+  memcpy(concat->recipe + concat->length, text, length);
+  concat->length += length;
+  concat->recipe[concat->length] = '\0';
+
+  return true;
 }
 
-void jsc_engine_parse_while_statement(jsc_engine_context* ctx)
+/**
+ * @brief emit the concatenation collected so far, leaving one String
+ *
+ * @details Literal-only chains become a single ldc.
+ */
+static void jsc_engine_concat_flush(jsc_engine_context* ctx,
+                                    jsc_engine_concat* concat)
 {
-  uint32_t loop_start =
-      jsc_bytecode_get_method_code_length(ctx->current_method);
-
-  if (!jsc_engine_match(ctx, JSC_TOKEN_LEFT_PAREN))
+  if (!concat->recipe || ctx->had_error)
   {
-    jsc_engine_error(ctx, "expected '(' after 'while'");
     return;
   }
 
-  jsc_engine_parse_expr(ctx);
-
-  if (!jsc_engine_match(ctx, JSC_TOKEN_RIGHT_PAREN))
+  if (concat->argument_count == 0)
   {
-    jsc_engine_error(ctx, "expected ')' after condition");
-    return;
+    jsc_engine_emit_constant(ctx, jsc_value_create_string(concat->recipe));
   }
+  else
+  {
+    uint16_t handle = jsc_bytecode_add_method_handle(
+        ctx->bytecode, JSC_REF_INVOKE_STATIC,
+        "java/lang/invoke/StringConcatFactory", "makeConcatWithConstants",
+        "(Ljava/lang/invoke/MethodHandles$Lookup;Ljava/lang/String;"
+        "Ljava/lang/invoke/MethodType;Ljava/lang/String;[Ljava/lang/Object;)"
+        "Ljava/lang/invoke/CallSite;");
+    uint16_t recipe =
+        jsc_bytecode_add_string_constant(ctx->bytecode, concat->recipe);
+    int32_t bootstrap =
+        jsc_bytecode_add_bootstrap_method(ctx->bytecode, handle, &recipe, 1);
+    char* descriptor = malloc(concat->argument_count * 18 + 21);
+
+    if (bootstrap < 0 || !descriptor)
+    {
+      free(descriptor);
+      jsc_engine_error(ctx, "failed to add string concatenation");
+      return;
+    }
 
-  uint16_t exit_jump = jsc_engine_emit_jump(ctx, JSC_JVM_IFEQ);
+    char* p = descriptor;
+    *p++ = '(';
 
-  jsc_engine_parse_statement(ctx);
+    for (uint16_t i = 0; i < concat->argument_count; i++)
+    {
+      memcpy(p, "Ljava/lang/Object;", 18);
+      p += 18;
+    }
+
+    strcpy(p, ")Ljava/lang/String;");
+
+    jsc_bytecode_emit_invokedynamic(ctx->bytecode, ctx->current_method,
+                                    (uint16_t)bootstrap,
+                                    "makeConcatWithConstants", descriptor);
+    free(descriptor);
+  }
 
-  jsc_bytecode_emit_jump(
-      ctx->bytecode, ctx->current_method, JSC_JVM_GOTO,
-      -(jsc_bytecode_get_method_code_length(ctx->current_method) - loop_start +
-        3));
+  if (concat->base + concat->argument_count > ctx->max_stack)
+  {
+    ctx->max_stack = concat->base + concat->argument_count;
+  }
 
-  jsc_engine_patch_jump(ctx, exit_jump);
+  ctx->stack_size = concat->base + 1;
+  concat->length = 0;
+  concat->argument_count = 0;
 }
 
-void jsc_engine_parse_for_statement(jsc_engine_context* ctx)
+/* the flushed String becomes the first argument of a fresh recipe */
+static void jsc_engine_concat_restart(jsc_engine_context* ctx,
+                                      jsc_engine_concat* concat)
 {
-  jsc_engine_enter_scope(ctx);
+  jsc_engine_concat_flush(ctx, concat);
+  jsc_engine_concat_append(ctx, concat, "\1", 1);
+  concat->argument_count = 1;
+}
 
-  if (!jsc_engine_match(ctx, JSC_TOKEN_LEFT_PAREN))
-  {
-    jsc_engine_error(ctx, "expected '(' after 'for'");
-    return;
-  }
+/**
+ * @brief move a constant operand into the recipe as text
+ *
+ * @details Returns false, leaving its code in place, if the operand is not
+ *          a constant or its text cannot be part of a recipe.
+ */
+static bool jsc_engine_concat_constant(jsc_engine_context* ctx,
+                                       jsc_engine_concat* concat,
+                                       const jsc_engine_operand* operand)
+{
+  char* text = operand->constant ? jsc_engine_to_string(&operand->value)
+                                 : NULL;
+  size_t length = text ? strlen(text) : 0;
+  bool inlined = text && !strchr(text, '\1') && !strchr(text, '\2') &&
+                 concat->length + length < JSC_ENGINE_MAX_CONCAT_RECIPE;
 
-  if (jsc_engine_match(ctx, JSC_TOKEN_SEMICOLON))
+  if (inlined)
   {
+    jsc_engine_discard_operand(ctx, operand);
+    jsc_engine_concat_append(ctx, concat, text, length);
   }
-  else if (jsc_engine_match(ctx, JSC_TOKEN_VAR))
-  {
-    jsc_engine_parse_var_declaration(ctx, JSC_SYMBOL_VAR);
-  }
-  else if (jsc_engine_match(ctx, JSC_TOKEN_LET))
+
+  free(text);
+  return inlined;
+}
+
+static void jsc_engine_concat_operand(jsc_engine_context* ctx,
+                                      jsc_engine_concat* concat)
+{
+  if (jsc_engine_is_literal_operand(ctx))
   {
-    jsc_engine_parse_var_declaration(ctx, JSC_SYMBOL_LET);
+    const char* text = ctx->current_token.string_value.data;
+    size_t length = strlen(text);
+
+    if (concat->length + length >= JSC_ENGINE_MAX_CONCAT_RECIPE)
+    {
+      jsc_engine_concat_restart(ctx, concat);
+    }
+
+    jsc_engine_concat_append(ctx, concat, text, length);
+    jsc_engine_advance(ctx);
+    return;
   }
-  else
+
+  if (concat->argument_count == JSC_ENGINE_MAX_CONCAT_ARGUMENTS)
   {
-    jsc_engine_parse_expression_statement(ctx);
+    jsc_engine_concat_restart(ctx, concat);
   }
 
-  uint32_t loop_start =
-      jsc_bytecode_get_method_code_length(ctx->current_method);
+  jsc_engine_operand operand;
+  jsc_engine_begin_operand(ctx, &operand);
+  jsc_engine_parse_mul(ctx);
+  jsc_engine_end_operand(ctx, &operand);
 
-  uint16_t exit_jump = 0;
-  if (!jsc_engine_check(ctx, JSC_TOKEN_SEMICOLON))
+  if (!jsc_engine_concat_constant(ctx, concat, &operand))
   {
-    jsc_engine_parse_expr(ctx);
+    jsc_engine_concat_append(ctx, concat, "\1", 1);
+    concat->argument_count++;
+  }
 
-    if (!jsc_engine_match(ctx, JSC_TOKEN_SEMICOLON))
-    {
-      jsc_engine_error(ctx, "expected ';' after loop condition");
-      return;
-    }
+  jsc_engine_release_value(&operand.value);
+}
+
+/* apply the double opcode to the two values on the stack, see
+   JSC_RUNTIME_ARITHMETIC */
+static void jsc_engine_emit_arithmetic(jsc_engine_context* ctx, uint8_t opcode)
+{
+  jsc_bytecode_emit_load_constant_int(ctx->bytecode, ctx->current_method,
+                                      opcode);
+  jsc_engine_adjust_stack(ctx, 1);
+  jsc_engine_emit_runtime_call(ctx, JSC_RUNTIME_ARITHMETIC,
+                               JSC_RUNTIME_ARITHMETIC_DESCRIPTOR, -2);
+}
+
+void jsc_engine_parse_add(jsc_engine_context* ctx)
+{
+  bool concat_enabled = ctx->flags & JSC_ENGINE_FLAG_STRING_CONCAT;
 
-    exit_jump = jsc_engine_emit_jump(ctx, JSC_JVM_IFEQ);
+  jsc_engine_concat concat;
+  memset(&concat, 0, sizeof(concat));
+  concat.base = ctx->stack_size;
+
+  jsc_engine_operand left;
+  jsc_engine_begin_operand(ctx, &left);
+
+  /* JS + is left-associative: a chain turns into concatenation at its
+     first string operand, and everything after that is appended */
+  if (concat_enabled && jsc_engine_is_literal_operand(ctx) &&
+      jsc_peek_token_type(ctx->tokenizer) == JSC_TOKEN_PLUS)
+  {
+    concat.active = true;
+    jsc_engine_concat_operand(ctx, &concat);
   }
   else
   {
-    jsc_engine_advance(ctx);
+    jsc_engine_parse_mul(ctx);
+    jsc_engine_end_operand(ctx, &left);
   }
 
-  if (!jsc_engine_check(ctx, JSC_TOKEN_RIGHT_PAREN))
+  while (jsc_engine_check(ctx, JSC_TOKEN_PLUS) ||
+         jsc_engine_check(ctx, JSC_TOKEN_MINUS))
   {
-    uint16_t body_jump = jsc_engine_emit_jump(ctx, JSC_JVM_GOTO);
+    jsc_token_type operator_type = ctx->current_token.type;
+    jsc_engine_advance(ctx);
 
-    uint32_t increment_start =
-        jsc_bytecode_get_method_code_length(ctx->current_method);
+    if (operator_type == JSC_TOKEN_PLUS && concat_enabled &&
+        (concat.active || jsc_engine_is_literal_operand(ctx) ||
+         (left.constant && left.value.type == JSC_VALUE_STRING)))
+    {
+      if (!concat.active)
+      {
+        concat.active = true;
 
-    jsc_engine_parse_expr(ctx);
-    jsc_engine_emit_byte(ctx, JSC_JVM_POP);
+        if (!jsc_engine_concat_constant(ctx, &concat, &left))
+        {
+          jsc_engine_concat_append(ctx, &concat, "\1", 1);
+          concat.argument_count = 1;
+        }
+      }
 
-    if (!jsc_engine_match(ctx, JSC_TOKEN_RIGHT_PAREN))
+      jsc_engine_concat_operand(ctx, &concat);
+      continue;
+    }
+
+    if (concat.active)
     {
-      jsc_engine_error(ctx, "expected ')' after for clauses");
-      return;
+      jsc_engine_concat_flush(ctx, &concat);
+      jsc_engine_end_operand(ctx, &left);
+      concat.active = false;
     }
 
-    jsc_bytecode_emit_jump(
-        ctx->bytecode, ctx->current_method, JSC_JVM_GOTO,
-        -(jsc_bytecode_get_method_code_length(ctx->current_method) -
-          loop_start + 3));
+    jsc_engine_operand right;
+    jsc_engine_begin_operand(ctx, &right);
+    jsc_engine_parse_mul(ctx);
+    jsc_engine_end_operand(ctx, &right);
 
-    jsc_engine_patch_jump(ctx, body_jump);
+    if (jsc_engine_fold_operands(ctx, operator_type, &left, &right))
+    {
+      continue;
+    }
 
-    jsc_engine_parse_statement(ctx);
+    if (operator_type == JSC_TOKEN_PLUS)
+    {
+      jsc_engine_emit_runtime_call(ctx, JSC_RUNTIME_ADD,
+                                   JSC_RUNTIME_ADD_DESCRIPTOR, -1);
+    }
+    else
+    {
+      jsc_engine_emit_arithmetic(ctx, JSC_JVM_DSUB);
+    }
+  }
 
-    jsc_bytecode_emit_jump(
-        ctx->bytecode, ctx->current_method, JSC_JVM_GOTO,
-        -(jsc_bytecode_get_method_code_length(ctx->current_method) -
-          increment_start + 3));
+  if (concat.active)
+  {
+    jsc_engine_concat_flush(ctx, &concat);
   }
-  else
+
+  jsc_engine_release_value(&left.value);
+  free(concat.recipe);
+}
+
+void jsc_engine_parse_mul(jsc_engine_context* ctx)
+{
+  jsc_engine_operand left;
+  jsc_engine_begin_operand(ctx, &left);
+  jsc_engine_parse_unary(ctx);
+  jsc_engine_end_operand(ctx, &left);
+
+  while (jsc_engine_check(ctx, JSC_TOKEN_MULTIPLY) ||
+         jsc_engine_check(ctx, JSC_TOKEN_DIVIDE) ||
+         jsc_engine_check(ctx, JSC_TOKEN_MODULO))
   {
+    jsc_token_type operator_type = ctx->current_token.type;
     jsc_engine_advance(ctx);
 
-    jsc_engine_parse_statement(ctx);
+    jsc_engine_operand right;
+    jsc_engine_begin_operand(ctx, &right);
+    jsc_engine_parse_unary(ctx);
+    jsc_engine_end_operand(ctx, &right);
 
-    jsc_bytecode_emit_jump(
-        ctx->bytecode, ctx->current_method, JSC_JVM_GOTO,
-        -(jsc_bytecode_get_method_code_length(ctx->current_method) -
-          loop_start + 3));
-  }
+    if (jsc_engine_fold_operands(ctx, operator_type, &left, &right))
+    {
+      continue;
+    }
 
-  if (exit_jump != 0)
-  {
-    jsc_engine_patch_jump(ctx, exit_jump);
+    jsc_engine_emit_arithmetic(ctx, operator_type == JSC_TOKEN_MULTIPLY
+                                        ? JSC_JVM_DMUL
+                                    : operator_type == JSC_TOKEN_DIVIDE
+                                        ? JSC_JVM_DDIV
+                                        : JSC_JVM_DREM);
   }
 
-  jsc_engine_exit_scope(ctx);
+  jsc_engine_release_value(&left.value);
 }
 
-void jsc_engine_parse_return_statement(jsc_engine_context* ctx)
+void jsc_engine_parse_unary(jsc_engine_context* ctx)
 {
-  if (jsc_engine_is_global_scope(ctx))
+  if (!jsc_engine_check(ctx, JSC_TOKEN_LOGICAL_NOT) &&
+      !jsc_engine_check(ctx, JSC_TOKEN_MINUS) &&
+      !jsc_engine_check(ctx, JSC_TOKEN_TYPEOF))
   {
-    jsc_engine_error(ctx, "cannot return from global scope");
+    jsc_engine_parse_call(ctx);
     return;
   }
 
-  if (jsc_engine_check(ctx, JSC_TOKEN_SEMICOLON))
-  {
-    jsc_engine_advance(ctx);
-    jsc_engine_emit_byte(ctx, JSC_JVM_ACONST_NULL);
-    jsc_engine_emit_byte(ctx, JSC_JVM_ARETURN);
-    return;
-  }
+  jsc_token_type operator_type = ctx->current_token.type;
+  jsc_engine_advance(ctx);
 
-  jsc_engine_parse_expr(ctx);
+  jsc_engine_operand operand;
+  jsc_engine_begin_operand(ctx, &operand);
+  jsc_engine_parse_unary(ctx);
 
-  if (!jsc_engine_match(ctx, JSC_TOKEN_SEMICOLON))
+  jsc_value result;
+
+  if (jsc_engine_end_operand(ctx, &operand) &&
+      jsc_engine_fold_unary(operator_type, &operand.value, &result))
   {
-    jsc_engine_error(ctx, "expected ';' after return value");
-    return;
+    jsc_engine_replace_operand(ctx, &operand, result);
   }
+  else if (operator_type == JSC_TOKEN_LOGICAL_NOT)
+  {
+    int32_t false_label = jsc_bytecode_new_label(ctx->bytecode);
 
-  jsc_engine_emit_byte(ctx, JSC_JVM_ARETURN);
-}
-
-void jsc_engine_parse_block(jsc_engine_context* ctx)
-{
-  while (!jsc_engine_check(ctx, JSC_TOKEN_RIGHT_BRACE) &&
-         !jsc_engine_check(ctx, JSC_TOKEN_EOF))
+    jsc_engine_emit_truth_jump(ctx, true, false_label);
+    jsc_engine_emit_boolean(ctx, false_label, operand.stack);
+  }
+  else if (operator_type == JSC_TOKEN_MINUS)
   {
-    jsc_engine_parse_declaration(ctx);
+    jsc_engine_emit_runtime_call(ctx, JSC_RUNTIME_TO_NUMBER,
+                                 JSC_RUNTIME_TO_NUMBER_DESCRIPTOR, 1);
+    jsc_engine_emit_byte(ctx, JSC_JVM_DNEG);
+    jsc_bytecode_emit_invoke_static(ctx->bytecode, ctx->current_method,
+                                    "java/lang/Double", "valueOf",
+                                    "(D)Ljava/lang/Double;");
+    jsc_engine_adjust_stack(ctx, -1);
   }
-
-  if (!jsc_engine_match(ctx, JSC_TOKEN_RIGHT_BRACE))
+  else if (!ctx->had_error)
   {
-    jsc_engine_error(ctx, "expected '}' after block");
-    return;
+    jsc_engine_error(ctx, "typeof is only supported on constant operands");
   }
-}
 
-void jsc_engine_parse_expr(jsc_engine_context* ctx)
-{
-  jsc_engine_parse_assign(ctx);
+  jsc_engine_release_value(&operand.value);
 }
 
-void jsc_engine_parse_assign(jsc_engine_context* ctx)
+/**
+ * @brief call the method of a function declaration directly
+ *
+ * @details Only used for functions that are never rebound, so the callee is
+ *          known statically: no argument array, no dispatch by name. Missing
+ *          arguments are passed as null and surplus ones are evaluated and
+ *          dropped, so the call always matches the method's descriptor.
+ */
+static void jsc_engine_parse_direct_call(jsc_engine_context* ctx,
+                                         const jsc_symbol* function)
 {
-  jsc_engine_parse_lor(ctx);
+  uint16_t base = ctx->stack_size;
+  uint16_t arg_count = 0;
 
-  if (jsc_engine_match(ctx, JSC_TOKEN_ASSIGN))
+  if (!jsc_engine_check(ctx, JSC_TOKEN_RIGHT_PAREN))
   {
-    jsc_token token = ctx->current_token;
-    jsc_token_type operator_type = token.type;
-
-    jsc_engine_parse_assign(ctx);
-
-    if (operator_type == JSC_TOKEN_ASSIGN)
+    do
     {
-      char name_buffer[1 << 8];
-      strncpy(name_buffer, token.start, token.length);
-      name_buffer[token.length] = '\0';
+      jsc_engine_parse_expr(ctx);
 
-      jsc_engine_store_variable(ctx, name_buffer);
-    }
-  }
-}
+      if (arg_count >= function->param_count)
+      {
+        jsc_bytecode_emit(ctx->bytecode, ctx->current_method, JSC_JVM_POP);
+      }
 
-void jsc_engine_parse_lor(jsc_engine_context* ctx)
-{
-  jsc_engine_parse_land(ctx);
+      arg_count++;
+    } while (jsc_engine_match(ctx, JSC_TOKEN_COMMA));
+  }
 
-  while (jsc_engine_match(ctx, JSC_TOKEN_LOGICAL_OR))
+  if (!jsc_engine_match(ctx, JSC_TOKEN_RIGHT_PAREN))
   {
-    uint16_t end_jump = jsc_engine_emit_jump(ctx, JSC_JVM_IFNE);
-
-    jsc_engine_parse_land(ctx);
-
-    jsc_engine_patch_jump(ctx, end_jump);
+    jsc_engine_error(ctx, "expected ')' after arguments");
+    return;
   }
-}
-
-void jsc_engine_parse_land(jsc_engine_context* ctx)
-{
-  jsc_engine_parse_eq(ctx);
 
-  while (jsc_engine_match(ctx, JSC_TOKEN_LOGICAL_AND))
+  for (uint16_t i = arg_count; i < function->param_count; i++)
   {
-    uint16_t end_jump = jsc_engine_emit_jump(ctx, JSC_JVM_IFEQ);
+    jsc_bytecode_emit(ctx->bytecode, ctx->current_method, JSC_JVM_ACONST_NULL);
+  }
+
+  char* descriptor = jsc_engine_generate_descriptor(ctx, function->param_count);
+  jsc_bytecode_emit_invoke_static(ctx->bytecode, ctx->current_method,
+                                  ctx->class_name, function->name, descriptor);
+  free(descriptor);
 
-    jsc_engine_parse_eq(ctx);
+  uint16_t peak = base + function->param_count +
+                  (arg_count > function->param_count ? 1 : 0);
 
-    jsc_engine_patch_jump(ctx, end_jump);
+  if (peak > ctx->max_stack)
+  {
+    ctx->max_stack = peak;
   }
+
+  ctx->stack_size = base + 1;
 }
 
-void jsc_engine_parse_eq(jsc_engine_context* ctx)
+/**
+ * @brief call the callee on the stack through an invokedynamic site
+ *
+ * @details The site's descriptor is the callee followed by the arguments,
+ *          all Object; JSC_RUNTIME_CLASS links it on first use and caches
+ *          the targets it sees.
+ */
+static void jsc_engine_parse_dynamic_call(jsc_engine_context* ctx)
 {
-  jsc_engine_parse_cmp(ctx);
+  uint16_t base = ctx->stack_size;
+  uint16_t arg_count = 0;
 
-  while (jsc_engine_match(ctx, JSC_TOKEN_EQUAL) ||
-         jsc_engine_match(ctx, JSC_TOKEN_NOT_EQUAL) ||
-         jsc_engine_match(ctx, JSC_TOKEN_STRICT_EQUAL) ||
-         jsc_engine_match(ctx, JSC_TOKEN_STRICT_NOT_EQUAL))
+  if (!jsc_engine_check(ctx, JSC_TOKEN_RIGHT_PAREN))
   {
-
-    jsc_token_type operator_type = ctx->current_token.type;
-
-    jsc_engine_parse_cmp(ctx);
-
-    switch (operator_type)
+    do
     {
-    case JSC_TOKEN_EQUAL:
-    case JSC_TOKEN_STRICT_EQUAL:
-      jsc_bytecode_emit(ctx->bytecode, ctx->current_method, JSC_JVM_IF_ACMPEQ);
-      break;
-    case JSC_TOKEN_NOT_EQUAL:
-    case JSC_TOKEN_STRICT_NOT_EQUAL:
-      jsc_bytecode_emit(ctx->bytecode, ctx->current_method, JSC_JVM_IF_ACMPNE);
-      break;
-    default:
-      break;
-    }
+      jsc_engine_parse_expr(ctx);
+      arg_count++;
+    } while (jsc_engine_match(ctx, JSC_TOKEN_COMMA));
   }
-}
-
-void jsc_engine_parse_cmp(jsc_engine_context* ctx)
-{
-  jsc_engine_parse_add(ctx);
 
-  while (jsc_engine_match(ctx, JSC_TOKEN_LESS_THAN) ||
-         jsc_engine_match(ctx, JSC_TOKEN_GREATER_THAN) ||
-         jsc_engine_match(ctx, JSC_TOKEN_LESS_THAN_EQUAL) ||
-         jsc_engine_match(ctx, JSC_TOKEN_GREATER_THAN_EQUAL))
+  if (!jsc_engine_match(ctx, JSC_TOKEN_RIGHT_PAREN))
   {
+    jsc_engine_error(ctx, "expected ')' after arguments");
+    return;
+  }
 
-    jsc_token_type operator_type = ctx->current_token.type;
-
-    jsc_engine_parse_add(ctx);
-
-    switch (operator_type)
-    {
-    case JSC_TOKEN_LESS_THAN:
-      jsc_bytecode_emit(ctx->bytecode, ctx->current_method, JSC_JVM_IF_ICMPLT);
-      break;
-    case JSC_TOKEN_GREATER_THAN:
-      jsc_bytecode_emit(ctx->bytecode, ctx->current_method, JSC_JVM_IF_ICMPGT);
-      break;
-    case JSC_TOKEN_LESS_THAN_EQUAL:
-      jsc_bytecode_emit(ctx->bytecode, ctx->current_method, JSC_JVM_IF_ICMPLE);
-      break;
-    case JSC_TOKEN_GREATER_THAN_EQUAL:
-      jsc_bytecode_emit(ctx->bytecode, ctx->current_method, JSC_JVM_IF_ICMPGE);
-      break;
-    default:
-      break;
-    }
+  if (arg_count >= 255)
+  {
+    jsc_engine_error(ctx, "too many arguments");
+    return;
   }
-}
 
-void jsc_engine_parse_add(jsc_engine_context* ctx)
-{
-  jsc_engine_parse_mul(ctx);
+  uint16_t handle = jsc_bytecode_add_method_handle(
+      ctx->bytecode, JSC_REF_INVOKE_STATIC, JSC_RUNTIME_CLASS,
+      JSC_RUNTIME_BOOTSTRAP, JSC_RUNTIME_BOOTSTRAP_DESCRIPTOR);
+  int32_t bootstrap =
+      jsc_bytecode_add_bootstrap_method(ctx->bytecode, handle, NULL, 0);
 
-  while (jsc_engine_match(ctx, JSC_TOKEN_PLUS) ||
-         jsc_engine_match(ctx, JSC_TOKEN_MINUS))
+  if (bootstrap < 0)
   {
-    jsc_token_type operator_type = ctx->current_token.type;
+    jsc_engine_error(ctx, "failed to add bootstrap method");
+    return;
+  }
 
-    jsc_engine_parse_mul(ctx);
+  char* descriptor = jsc_engine_generate_descriptor(ctx, arg_count + 1);
+  jsc_bytecode_emit_invokedynamic(ctx->bytecode, ctx->current_method,
+                                  (uint16_t)bootstrap, "call", descriptor);
+  free(descriptor);
 
-    switch (operator_type)
-    {
-    case JSC_TOKEN_PLUS:
-      jsc_bytecode_emit(ctx->bytecode, ctx->current_method, JSC_JVM_IADD);
-      break;
-    case JSC_TOKEN_MINUS:
-      jsc_bytecode_emit(ctx->bytecode, ctx->current_method, JSC_JVM_ISUB);
-      break;
-    default:
-      break;
-    }
+  if (base + arg_count > ctx->max_stack)
+  {
+    ctx->max_stack = base + arg_count;
   }
+
+  ctx->stack_size = base;
 }
 
-void jsc_engine_parse_mul(jsc_engine_context* ctx)
+void jsc_engine_parse_call(jsc_engine_context* ctx)
 {
-  jsc_engine_parse_unary(ctx);
+  jsc_symbol* function = NULL;
 
-  while (jsc_engine_match(ctx, JSC_TOKEN_MULTIPLY) ||
-         jsc_engine_match(ctx, JSC_TOKEN_DIVIDE) ||
-         jsc_engine_match(ctx, JSC_TOKEN_MODULO))
+  if (jsc_engine_check(ctx, JSC_TOKEN_IDENTIFIER) &&
+      ctx->current_token.length < (1 << 8))
   {
+    char name_buffer[1 << 8];
+    strncpy(name_buffer, ctx->current_token.start, ctx->current_token.length);
+    name_buffer[ctx->current_token.length] = '\0';
 
-    jsc_token_type operator_type = ctx->current_token.type;
-
-    jsc_engine_parse_unary(ctx);
+    function = jsc_engine_lookup_symbol(ctx, name_buffer);
 
-    switch (operator_type)
+    if (function &&
+        (function->type != JSC_SYMBOL_FUNCTION || function->reassigned))
     {
-    case JSC_TOKEN_MULTIPLY:
-      jsc_bytecode_emit(ctx->bytecode, ctx->current_method, JSC_JVM_IMUL);
-      break;
-    case JSC_TOKEN_DIVIDE:
-      jsc_bytecode_emit(ctx->bytecode, ctx->current_method, JSC_JVM_IDIV);
-      break;
-    case JSC_TOKEN_MODULO:
-      jsc_bytecode_emit(ctx->bytecode, ctx->current_method, JSC_JVM_IREM);
-      break;
-    default:
-      break;
+      function = NULL;
     }
   }
-}
 
-void jsc_engine_parse_unary(jsc_engine_context* ctx)
-{
-  if (jsc_engine_match(ctx, JSC_TOKEN_LOGICAL_NOT))
-  {
-    jsc_engine_parse_unary(ctx);
-    jsc_engine_emit_byte(ctx, JSC_JVM_ICONST_0);
-    jsc_engine_emit_byte(ctx, JSC_JVM_IF_ICMPEQ);
-    jsc_engine_emit_byte(ctx, JSC_JVM_ICONST_1);
-    jsc_engine_emit_byte(ctx, JSC_JVM_GOTO);
-    jsc_engine_emit_byte(ctx, JSC_JVM_ICONST_0);
-  }
-  else if (jsc_engine_match(ctx, JSC_TOKEN_MINUS))
+  if (!function)
   {
-    jsc_engine_parse_unary(ctx);
-    jsc_engine_emit_byte(ctx, JSC_JVM_INEG);
+    jsc_engine_parse_primary(ctx);
   }
   else
   {
-    jsc_engine_parse_call(ctx);
-  }
-}
+    jsc_engine_advance(ctx);
 
-void jsc_engine_parse_call(jsc_engine_context* ctx)
-{
-  jsc_engine_parse_primary(ctx);
+    if (jsc_engine_match(ctx, JSC_TOKEN_LEFT_PAREN))
+    {
+      jsc_engine_parse_direct_call(ctx, function);
+      return;
+    }
+
+    jsc_engine_load_variable(ctx, function->name);
+  }
 
   if (jsc_engine_match(ctx, JSC_TOKEN_LEFT_PAREN))
   {
-    int arg_count = 0;
+    if (ctx->flags & JSC_ENGINE_FLAG_INVOKEDYNAMIC)
+    {
+      jsc_engine_parse_dynamic_call(ctx);
+      return;
+    }
 
-    jclass object_array_class =
-        (*ctx->env)->FindClass(ctx->env, "[Ljava/lang/Object;");
-    jmethodID array_init = (*ctx->env)->GetMethodID(
-        ctx->env, object_array_class, "<init>", "(I)V");
+    /* the arguments are packed into an Object[] by the emitted code; its
+       length is only known once they are parsed, so it is patched in */
+    jsc_bytecode_emit_u16(ctx->bytecode, ctx->current_method, JSC_JVM_SIPUSH,
+                          0);
+    uint32_t length_offset =
+        jsc_bytecode_get_method_code_length(ctx->current_method) - 2;
 
-    jobjectArray arg_array = (*ctx->env)->NewObjectArray(
-        ctx->env, arg_count, object_array_class, NULL);
+    jsc_bytecode_emit_anewarray(ctx->bytecode, ctx->current_method,
+                                "java/lang/Object");
+    ctx->stack_size += 1;
+
+    uint16_t arg_count = 0;
 
     if (!jsc_engine_check(ctx, JSC_TOKEN_RIGHT_PAREN))
     {
       do
       {
+        jsc_engine_emit_byte(ctx, JSC_JVM_DUP);
+        jsc_bytecode_emit_load_constant_int(ctx->bytecode, ctx->current_method,
+                                            arg_count);
+        ctx->stack_size += 1;
+
         jsc_engine_parse_expr(ctx);
-        arg_count++;
 
-        jobject arg = (*ctx->env)->GetObjectArrayElement(ctx->env, arg_array,
-                                                         arg_count - 1);
-        (*ctx->env)->SetObjectArrayElement(ctx->env, arg_array, arg_count - 1,
-                                           arg);
+        jsc_bytecode_emit(ctx->bytecode, ctx->current_method, JSC_JVM_AASTORE);
+        ctx->stack_size -= 3;
 
+        arg_count++;
       } while (jsc_engine_match(ctx, JSC_TOKEN_COMMA));
     }
 
@@ -1598,46 +6877,66 @@ void jsc_engine_parse_call(jsc_engine_context* ctx)
       return;
     }
 
+    uint8_t* code = jsc_bytecode_get_method_code(ctx->current_method);
+    uint16_t arg_count_be = htobe16(arg_count);
+    memcpy(&code[length_offset], &arg_count_be, 2);
+
     jsc_bytecode_emit_invoke_static(
         ctx->bytecode, ctx->current_method, ctx->class_name, "invoke",
         "(Ljava/lang/Object;[Ljava/lang/Object;)Ljava/lang/Object;");
+    ctx->stack_size -= 1;
   }
 }
 
 void jsc_engine_parse_primary(jsc_engine_context* ctx)
 {
+  jsc_token token = ctx->current_token; /* match() advances past it */
+
   if (jsc_engine_match(ctx, JSC_TOKEN_TRUE))
   {
-    jsc_bytecode_emit_load_constant_int_boxed(ctx->bytecode,
-                                              ctx->current_method, 1);
+    jsc_engine_emit_constant(ctx, jsc_value_create_boolean(true));
   }
   else if (jsc_engine_match(ctx, JSC_TOKEN_FALSE))
   {
-    jsc_bytecode_emit_load_constant_int_boxed(ctx->bytecode,
-                                              ctx->current_method, 0);
+    jsc_engine_emit_constant(ctx, jsc_value_create_boolean(false));
   }
   else if (jsc_engine_match(ctx, JSC_TOKEN_NULL))
   {
-    jsc_engine_emit_byte(ctx, JSC_JVM_ACONST_NULL);
+    jsc_engine_emit_constant(ctx, jsc_value_create_null());
   }
   else if (jsc_engine_match(ctx, JSC_TOKEN_NUMBER))
   {
-    jsc_bytecode_emit_load_constant_double_boxed(
-        ctx->bytecode, ctx->current_method, ctx->current_token.number_value);
+    jsc_engine_emit_constant(ctx,
+                             jsc_value_create_number(token.number_value));
   }
   else if (jsc_engine_match(ctx, JSC_TOKEN_STRING))
   {
-    jsc_bytecode_emit_load_constant_string(
-        ctx->bytecode, ctx->current_method,
-        ctx->current_token.string_value.data);
+    jsc_engine_emit_constant(
+        ctx, jsc_value_create_string(token.string_value.data));
   }
   else if (jsc_engine_match(ctx, JSC_TOKEN_IDENTIFIER))
   {
     char name_buffer[1 << 8];
-    strncpy(name_buffer, ctx->current_token.start, ctx->current_token.length);
-    name_buffer[ctx->current_token.length] = '\0';
+    strncpy(name_buffer, token.start, token.length);
+    name_buffer[token.length] = '\0';
+
+    jsc_symbol* symbol = jsc_engine_lookup_symbol(ctx, name_buffer);
+
+    if (symbol && symbol->folded)
+    {
+      jsc_value value = symbol->value;
+
+      if (value.type == JSC_VALUE_STRING)
+      {
+        value = jsc_value_create_string(value.string_value);
+      }
 
-    jsc_engine_load_variable(ctx, name_buffer);
+      jsc_engine_emit_constant(ctx, value);
+    }
+    else
+    {
+      jsc_engine_load_variable(ctx, name_buffer);
+    }
   }
   else if (jsc_engine_match(ctx, JSC_TOKEN_LEFT_PAREN))
   {
@@ -1714,6 +7013,30 @@ void jsc_engine_begin_function(jsc_engine_context* ctx, const char* name,
 
 void jsc_engine_end_function(jsc_engine_context* ctx)
 {
+  if (!ctx->current_method)
+  {
+    return;
+  }
+
+  jsc_engine_forget_constant(ctx);
+
+  bool resolved =
+      jsc_bytecode_resolve_branches(ctx->bytecode, ctx->current_method);
+
+  if (resolved && (ctx->flags & JSC_ENGINE_FLAG_OPTIMIZE))
+  {
+    jsc_bytecode_optimize_method(ctx->bytecode, ctx->current_method);
+  }
+
+  if (!resolved)
+  {
+    jsc_engine_error(ctx, "failed to resolve branches");
+  }
+  else if (jsc_bytecode_get_method_code_length(ctx->current_method) >
+           JSC_MAX_CODE_SIZE)
+  {
+    jsc_engine_error(ctx, "method code exceeds the 64 KiB limit");
+  }
 }
 
 void jsc_engine_load_variable(jsc_engine_context* ctx, const char* name)
@@ -1742,6 +7065,31 @@ void jsc_engine_load_variable(jsc_engine_context* ctx, const char* name)
                                    field_name, "Ljava/lang/Object;");
     ctx->stack_size += 1;
   }
+  else if (symbol->induction)
+  {
+    /* a counter is kept as an int and read as the number it stands for;
+       a comparison may take the int instead, see jsc_engine_end_operand */
+    ctx->counter_method = ctx->current_method;
+    ctx->counter_start = jsc_engine_code_length(ctx);
+    ctx->counter_index = symbol->index;
+
+    jsc_bytecode_emit_new(ctx->bytecode, ctx->current_method,
+                          "java/lang/Double");
+    jsc_bytecode_emit(ctx->bytecode, ctx->current_method, JSC_JVM_DUP);
+    jsc_bytecode_emit_local_var(ctx->bytecode, ctx->current_method,
+                                JSC_JVM_ILOAD, symbol->index);
+    jsc_bytecode_emit(ctx->bytecode, ctx->current_method, JSC_JVM_I2D);
+    jsc_bytecode_emit_invoke_special(ctx->bytecode, ctx->current_method,
+                                     "java/lang/Double", "<init>", "(D)V");
+    ctx->counter_end = jsc_engine_code_length(ctx);
+
+    if (ctx->stack_size + 4 > ctx->max_stack)
+    {
+      ctx->max_stack = ctx->stack_size + 4;
+    }
+
+    ctx->stack_size += 1;
+  }
   else
   {
     jsc_bytecode_emit_local_var(ctx->bytecode, ctx->current_method,
@@ -1771,7 +7119,10 @@ void jsc_engine_store_variable(jsc_engine_context* ctx, const char* name)
     return;
   }
 
-  symbol->initialized = true;
+  if (!symbol->initialized)
+  {
+    symbol->initialized = true; /* globals may be shared with workers */
+  }
 
   if (jsc_engine_is_global_scope(ctx) || symbol->scope_depth == 0)
   {
@@ -1834,6 +7185,7 @@ jsc_value jsc_value_create_string(const char* value)
   return js_value;
 }
 
+#ifndef JSC_NO_JVM
 jsc_value jsc_value_from_jobject(JNIEnv* env, jobject obj)
 {
   if (obj == NULL)
@@ -1985,10 +7337,12 @@ void jsc_value_free(JNIEnv* env, jsc_value value)
     (*env)->DeleteGlobalRef(env, value.object_value);
   }
 }
+#endif
 
 char* jsc_engine_generate_descriptor(jsc_engine_context* ctx, int param_count)
 {
-  char* descriptor = malloc(param_count * 20 + 20);
+  /* "(" + "Ljava/lang/Object;" per parameter + ")Ljava/lang/Object;" */
+  char* descriptor = malloc(param_count * 18 + 21);
 
   if (!descriptor)
   {
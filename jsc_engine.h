@@ -3,15 +3,75 @@
 
 #include "jsc_tokenizer.h"
 #include "jsc_bytecode.h"
+#include "jsc_cache.h"
 
+#include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+
+/* -DJSC_NO_JVM builds the compiler alone: no jni.h, no libjvm */
+#ifndef JSC_NO_JVM
 #include <jni.h>
+#endif
 
 typedef struct jsc_symbol jsc_symbol;
 typedef struct jsc_scope jsc_scope;
 typedef struct jsc_engine_context jsc_engine_context;
 typedef struct jsc_value jsc_value;
+typedef struct jsc_deferred_function jsc_deferred_function;
+typedef struct jsc_jump_target jsc_jump_target;
+typedef struct jsc_engine_stats jsc_engine_stats;
+
+/* compile top-level function bodies on a worker pool, see
+   jsc_engine_compile_deferred_functions */
+#define JSC_ENGINE_FLAG_PARALLEL_FUNCTIONS (1 << 0)
+/* emit stubs for top-level functions and compile each body on its first
+   call, see jsc_engine_compile_lazy_function */
+#define JSC_ENGINE_FLAG_LAZY_FUNCTIONS (1 << 1)
+/* link calls to non-constant callees with invokedynamic through the
+   inline-caching call sites of JSC_RUNTIME_CLASS */
+#define JSC_ENGINE_FLAG_INVOKEDYNAMIC (1 << 2)
+/* lower + chains with a string literal operand to one
+   StringConcatFactory.makeConcatWithConstants call site */
+#define JSC_ENGINE_FLAG_STRING_CONCAT (1 << 3)
+/* once a method is emitted, run jsc_bytecode_optimize_method over it to
+   thread jumps, forward locals and drop dead code, stores and values */
+#define JSC_ENGINE_FLAG_OPTIMIZE (1 << 4)
+/* leave out top-level bindings the program never reads and whose
+   initializers have no effect, see jsc_engine_collect_unused_names; the
+   host can then no longer call or read them */
+#define JSC_ENGINE_FLAG_DROP_UNUSED (1 << 5)
+/* also time each token the parser reads and measure how far the process
+   heap grows during a compile, see jsc_engine_stats; these take a clock
+   reading per token and a walk of the heap per compile, so they are off by
+   default */
+#define JSC_ENGINE_FLAG_STATS (1 << 6)
+
+/* bump whenever the classes emitted for some program change, so that the
+   cache never hands out a class an older compiler built */
+#define JSC_ENGINE_CODEGEN_VERSION 6
+
+/* top-level code main takes before the rest continues in a chained
+   main$N helper; HotSpot does not JIT methods over 8000 bytes */
+#define JSC_ENGINE_MAX_TOP_LEVEL_CODE 8000
+
+/* argument slots a single concatenation call site may take */
+#define JSC_ENGINE_MAX_CONCAT_ARGUMENTS 200
+
+/* what jsc_engine_stats times. Time spent in a phase nested in another,
+   such as starting the JVM to define a class, counts only for the inner */
+typedef enum
+{
+  JSC_ENGINE_PHASE_NONE,
+  JSC_ENGINE_PHASE_TOKENIZE, /* the parser's own reads under FLAG_STATS */
+  JSC_ENGINE_PHASE_PARSE,    /* parsing and emitting code */
+  JSC_ENGINE_PHASE_SERIALIZE,
+  JSC_ENGINE_PHASE_CLASS_WRITE, /* the class file on the class path */
+  JSC_ENGINE_PHASE_JVM_INIT,
+  JSC_ENGINE_PHASE_CLASS_LOAD, /* finding, loading or defining the class */
+  JSC_ENGINE_PHASE_RUN,
+  JSC_ENGINE_PHASE_COUNT
+} jsc_engine_phase;
 
 typedef enum
 {
@@ -35,6 +95,22 @@ typedef enum
   JSC_VALUE_ARRAY
 } jsc_value_type;
 
+struct jsc_value
+{
+  jsc_value_type type;
+  union
+  {
+    bool boolean_value;
+    double number_value;
+    char* string_value;
+#ifndef JSC_NO_JVM
+    jobject object_value;
+#else
+    void* object_value;
+#endif
+  };
+};
+
 struct jsc_symbol
 {
   char* name;
@@ -42,6 +118,11 @@ struct jsc_symbol
   bool initialized;
   uint16_t index;
   uint16_t scope_depth;
+  uint16_t param_count; /* functions: arity of the generated method */
+  bool reassigned;      /* functions: rebound somewhere, no direct calls */
+  bool folded;          /* consts: initializer folded to value */
+  bool induction;       /* loop counters: an int, boxed when read */
+  jsc_value value;
   jsc_symbol* next;
 };
 
@@ -57,16 +138,44 @@ struct jsc_scope
   jsc_scope* first_child;
 };
 
-struct jsc_value
+struct jsc_deferred_function
 {
-  jsc_value_type type;
-  union
-  {
-    bool boolean_value;
-    double number_value;
-    char* string_value;
-    jobject object_value;
-  };
+  char* name;
+  const char* source; /* "(params) { body }" within the program text */
+  size_t length;
+  uint16_t param_count;
+  jsc_scope globals; /* global symbols declared before the function */
+
+  jsc_bytecode_context* bytecode; /* shard holding the compiled methods */
+  uint16_t first_method;
+  char* error_message;
+  uint64_t tokens; /* read by the worker that compiled it */
+};
+
+/* where break and continue go inside a loop, switch or labeled statement */
+struct jsc_jump_target
+{
+  const char* label; /* within the program text; NULL when unlabeled */
+  size_t label_length;
+  int32_t break_label;
+  int32_t continue_label; /* -1 unless a loop */
+  bool open; /* a label whose statement has not started yet */
+};
+
+/* what a context has done so far, summed over every call */
+struct jsc_engine_stats
+{
+  uint64_t phase_ns[JSC_ENGINE_PHASE_COUNT]; /* on a monotonic clock */
+  uint64_t tokens;     /* read by the parser, workers included */
+  uint64_t methods;    /* in the classes serialized */
+  uint64_t constants;  /* constant pool entries, likewise */
+  uint64_t code_bytes; /* in Code attributes, likewise */
+  uint64_t class_bytes;
+  /* net growth of the whole process heap while parsing, as mallinfo2
+     reports it under FLAG_STATS; other threads, workers included, count
+     too, and memory freed meanwhile offsets it, so this is not what the
+     parse allocated */
+  uint64_t heap_growth_bytes;
 };
 
 struct jsc_engine_context
@@ -84,6 +193,41 @@ struct jsc_engine_context
   bool had_error;
   char* error_message;
 
+  uint32_t flags;
+  uint16_t worker_count; /* 0 selects one worker per online CPU */
+  jsc_deferred_function* deferred_functions;
+  uint32_t deferred_count;
+  uint32_t deferred_capacity;
+  char* source; /* program text, kept while lazy bodies may be compiled */
+  char** assigned_names; /* every assignment target, sorted */
+  uint32_t assigned_count;
+  char** unused_names; /* bindings left out under DROP_UNUSED, sorted */
+  uint32_t unused_count;
+  jsc_jump_target* jump_targets; /* innermost last */
+  uint32_t jump_target_count;
+  uint32_t jump_target_capacity;
+  jsc_class_writer writer;  /* reused by every class this context writes */
+  uint8_t* class_buffer;    /* last class serialized through writer */
+  uint32_t class_buffer_capacity;
+
+  /* last constant emitted, whose load spans [constant_start, constant_end)
+     of constant_method; see jsc_engine_end_operand */
+  jsc_value constant;
+  jsc_method* constant_method;
+  uint32_t constant_start;
+  uint32_t constant_end;
+
+  /* last read of a loop counter, tracked like the constant above */
+  jsc_method* counter_method;
+  uint32_t counter_start;
+  uint32_t counter_end;
+  uint16_t counter_index;
+
+  jsc_engine_stats stats;
+  jsc_engine_phase phase; /* the one being timed, since phase_start */
+  uint64_t phase_start;
+
+#ifndef JSC_NO_JVM
   JavaVM* jvm;
   JNIEnv* env;
   jclass runtime_class;
@@ -91,6 +235,7 @@ struct jsc_engine_context
   jmethodID call_method;
   jobject runtime_instance;
   jobjectArray args;
+#endif
 
   char* class_path;
   char* temp_dir;
@@ -100,14 +245,31 @@ jsc_engine_context* jsc_engine_init(const char* class_name);
 void jsc_engine_free(jsc_engine_context* ctx);
 
 bool jsc_engine_compile(jsc_engine_context* ctx, const char* source);
+bool jsc_engine_compile_to_buffer(jsc_engine_context* ctx, const char* source,
+                                  uint8_t** out_buffer, uint32_t* out_size);
+bool jsc_engine_compile_cached(jsc_engine_context* ctx, jsc_cache* cache,
+                               const char* source);
+void jsc_engine_set_default_cache(jsc_cache* cache);
+jsc_cache* jsc_engine_get_default_cache(void);
+
+const jsc_engine_stats* jsc_engine_get_stats(const jsc_engine_context* ctx);
+void jsc_engine_add_stats(jsc_engine_stats* total,
+                          const jsc_engine_stats* stats);
+const char* jsc_engine_phase_name(jsc_engine_phase phase);
+void jsc_engine_print_stats(const jsc_engine_stats* stats, FILE* out);
+
+#ifndef JSC_NO_JVM
 bool jsc_engine_init_jvm(jsc_engine_context* ctx);
 bool jsc_engine_load_class(jsc_engine_context* ctx, const char* class_file);
+bool jsc_engine_define_class(jsc_engine_context* ctx, const uint8_t* data,
+                             uint32_t size);
 jsc_value jsc_engine_run(jsc_engine_context* ctx);
 jsc_value jsc_engine_call_method(jsc_engine_context* ctx,
                                  const char* method_name, jsc_value* args,
                                  int arg_count);
 
 jsc_value jsc_engine_eval(const char* source);
+#endif
 
 jsc_symbol* jsc_engine_add_symbol(jsc_engine_context* ctx, const char* name,
                                   jsc_symbol_type type);
@@ -121,19 +283,29 @@ void jsc_engine_error(jsc_engine_context* ctx, const char* message);
 void jsc_engine_emit_byte(jsc_engine_context* ctx, uint8_t byte);
 void jsc_engine_emit_bytes(jsc_engine_context* ctx, uint8_t byte1,
                            uint8_t byte2);
-uint16_t jsc_engine_emit_jump(jsc_engine_context* ctx, uint8_t instruction);
-void jsc_engine_patch_jump(jsc_engine_context* ctx, uint16_t offset);
+int32_t jsc_engine_emit_jump(jsc_engine_context* ctx, uint8_t instruction);
+void jsc_engine_patch_jump(jsc_engine_context* ctx, int32_t label);
 
+uint16_t jsc_engine_class_version(const jsc_engine_context* ctx);
 void jsc_engine_parse_program(jsc_engine_context* ctx);
 void jsc_engine_parse_statement(jsc_engine_context* ctx);
 void jsc_engine_parse_declaration(jsc_engine_context* ctx);
 void jsc_engine_parse_var_declaration(jsc_engine_context* ctx,
                                       jsc_symbol_type type);
 void jsc_engine_parse_function_declaration(jsc_engine_context* ctx);
+void jsc_engine_parse_function(jsc_engine_context* ctx, const char* name);
+void jsc_engine_compile_deferred_functions(jsc_engine_context* ctx);
+bool jsc_engine_compile_lazy_function(jsc_engine_context* ctx, uint32_t index,
+                                      uint8_t** out_buffer, uint32_t* out_size);
 void jsc_engine_parse_expression_statement(jsc_engine_context* ctx);
 void jsc_engine_parse_if_statement(jsc_engine_context* ctx);
 void jsc_engine_parse_while_statement(jsc_engine_context* ctx);
+void jsc_engine_parse_do_statement(jsc_engine_context* ctx);
 void jsc_engine_parse_for_statement(jsc_engine_context* ctx);
+void jsc_engine_parse_switch_statement(jsc_engine_context* ctx);
+void jsc_engine_parse_labeled_statement(jsc_engine_context* ctx);
+void jsc_engine_parse_jump_statement(jsc_engine_context* ctx,
+                                     jsc_token_type type);
 void jsc_engine_parse_return_statement(jsc_engine_context* ctx);
 void jsc_engine_parse_block(jsc_engine_context* ctx);
 
@@ -165,10 +337,12 @@ jsc_value jsc_value_create_null(void);
 jsc_value jsc_value_create_boolean(bool value);
 jsc_value jsc_value_create_number(double value);
 jsc_value jsc_value_create_string(const char* value);
+char* jsc_value_to_string(jsc_value value);
+#ifndef JSC_NO_JVM
 jsc_value jsc_value_from_jobject(JNIEnv* env, jobject obj);
 jobject jsc_value_to_jobject(JNIEnv* env, jsc_value value);
-char* jsc_value_to_string(jsc_value value);
 void jsc_value_free(JNIEnv* env, jsc_value value);
+#endif
 
 char* jsc_engine_generate_descriptor(jsc_engine_context* ctx, int param_count);
 char* jsc_engine_get_temp_filename(const char* prefix, const char* suffix);
@@ -0,0 +1,282 @@
+#include "jsc_jar.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <endian.h>
+
+#define JSC_JAR_LOCAL_HEADER 0x04034b50
+#define JSC_JAR_CENTRAL_HEADER 0x02014b50
+#define JSC_JAR_END_OF_CENTRAL 0x06054b50
+#define JSC_JAR_VERSION 10 /* 1.0: stored entries only */
+#define JSC_JAR_DOS_DATE 0x0021 /* 1980-01-01, keeps archives reproducible */
+
+static uint32_t jsc_jar_crc_table[1 << 8];
+static bool jsc_jar_crc_ready = false;
+
+static void jsc_jar_init_crc_table(void)
+{
+  for (uint32_t i = 0; i < (1 << 8); i++)
+  {
+    uint32_t c = i;
+
+    for (int k = 0; k < 8; k++)
+    {
+      c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+    }
+
+    jsc_jar_crc_table[i] = c;
+  }
+
+  jsc_jar_crc_ready = true;
+}
+
+uint32_t jsc_jar_crc32(uint32_t crc, const uint8_t* data, size_t size)
+{
+  if (!jsc_jar_crc_ready)
+  {
+    jsc_jar_init_crc_table();
+  }
+
+  crc = ~crc;
+
+  for (size_t i = 0; i < size; i++)
+  {
+    crc = jsc_jar_crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+
+  return ~crc;
+}
+
+static void jsc_jar_put_u16(uint8_t** p, uint16_t value)
+{
+  uint16_t le = htole16(value);
+  memcpy(*p, &le, sizeof(uint16_t));
+  *p += sizeof(uint16_t);
+}
+
+static void jsc_jar_put_u32(uint8_t** p, uint32_t value)
+{
+  uint32_t le = htole32(value);
+  memcpy(*p, &le, sizeof(uint32_t));
+  *p += sizeof(uint32_t);
+}
+
+static bool jsc_jar_write(jsc_jar* jar, const void* data, size_t size)
+{
+  if (jar->had_error)
+  {
+    return false;
+  }
+
+  /* offsets are 32-bit fields, and ZIP64 is not implemented */
+  if ((uint64_t)jar->offset + size > UINT32_MAX)
+  {
+    jar->had_error = true;
+    return false;
+  }
+
+  if (size > 0 && fwrite(data, 1, size, jar->file) != size)
+  {
+    jar->had_error = true;
+    return false;
+  }
+
+  jar->offset += (uint32_t)size;
+
+  return true;
+}
+
+/**
+ * @brief open a JAR for writing and add its manifest
+ *
+ * @details Entries are stored uncompressed so the JVM can map class bytes
+ *          without inflating them; main_class may be NULL.
+ */
+jsc_jar* jsc_jar_open(const char* path, const char* main_class)
+{
+  jsc_jar* jar = (jsc_jar*)malloc(sizeof(jsc_jar));
+
+  if (!jar)
+  {
+    return NULL;
+  }
+
+  memset(jar, 0, sizeof(jsc_jar));
+
+  jar->file = fopen(path, "wb");
+
+  if (!jar->file)
+  {
+    free(jar);
+    return NULL;
+  }
+
+  char manifest[1 << 10];
+  int length = snprintf(manifest, sizeof(manifest),
+                        "Manifest-Version: 1.0\r\nCreated-By: jsc\r\n");
+
+  if (main_class)
+  {
+    length += snprintf(manifest + length, sizeof(manifest) - length,
+                       "Main-Class: %s\r\n", main_class);
+  }
+
+  length += snprintf(manifest + length, sizeof(manifest) - length, "\r\n");
+
+  if (length >= (int)sizeof(manifest) ||
+      !jsc_jar_add(jar, "META-INF/MANIFEST.MF", (const uint8_t*)manifest,
+                   (uint32_t)length))
+  {
+    fclose(jar->file);
+    free(jar->entries);
+    free(jar);
+    return NULL;
+  }
+
+  return jar;
+}
+
+bool jsc_jar_add(jsc_jar* jar, const char* name, const uint8_t* data,
+                 uint32_t size)
+{
+  size_t name_length = strlen(name);
+
+  if (jar->had_error || name_length > UINT16_MAX ||
+      jar->entry_count == UINT16_MAX)
+  {
+    jar->had_error = true;
+    return false;
+  }
+
+  if (jar->entry_count == jar->entry_capacity)
+  {
+    uint32_t capacity = jar->entry_capacity ? jar->entry_capacity * 2 : 16;
+
+    if (capacity > UINT16_MAX)
+    {
+      capacity = UINT16_MAX;
+    }
+
+    jsc_jar_entry* entries = (jsc_jar_entry*)realloc(
+        jar->entries, capacity * sizeof(jsc_jar_entry));
+
+    if (!entries)
+    {
+      jar->had_error = true;
+      return false;
+    }
+
+    jar->entries = entries;
+    jar->entry_capacity = (uint16_t)capacity;
+  }
+
+  jsc_jar_entry* entry = &jar->entries[jar->entry_count];
+
+  entry->name = strdup(name);
+
+  if (!entry->name)
+  {
+    jar->had_error = true;
+    return false;
+  }
+
+  entry->crc32 = jsc_jar_crc32(0, data, size);
+  entry->size = size;
+  entry->offset = jar->offset;
+  jar->entry_count++;
+
+  uint8_t header[30];
+  uint8_t* p = header;
+
+  jsc_jar_put_u32(&p, JSC_JAR_LOCAL_HEADER);
+  jsc_jar_put_u16(&p, JSC_JAR_VERSION);
+  jsc_jar_put_u16(&p, 0); /* flags */
+  jsc_jar_put_u16(&p, 0); /* stored */
+  jsc_jar_put_u16(&p, 0); /* time */
+  jsc_jar_put_u16(&p, JSC_JAR_DOS_DATE);
+  jsc_jar_put_u32(&p, entry->crc32);
+  jsc_jar_put_u32(&p, size);
+  jsc_jar_put_u32(&p, size);
+  jsc_jar_put_u16(&p, (uint16_t)name_length);
+  jsc_jar_put_u16(&p, 0); /* extra field length */
+
+  return jsc_jar_write(jar, header, sizeof(header)) &&
+         jsc_jar_write(jar, name, name_length) &&
+         jsc_jar_write(jar, data, size);
+}
+
+/**
+ * @brief write the central directory and close the archive
+ *
+ * @details The jar is freed whether or not writing succeeded.
+ */
+bool jsc_jar_close(jsc_jar* jar)
+{
+  if (!jar)
+  {
+    return false;
+  }
+
+  uint32_t directory_offset = jar->offset;
+
+  for (uint16_t i = 0; i < jar->entry_count; i++)
+  {
+    jsc_jar_entry* entry = &jar->entries[i];
+    size_t name_length = strlen(entry->name);
+
+    uint8_t header[46];
+    uint8_t* p = header;
+
+    jsc_jar_put_u32(&p, JSC_JAR_CENTRAL_HEADER);
+    jsc_jar_put_u16(&p, JSC_JAR_VERSION); /* made by */
+    jsc_jar_put_u16(&p, JSC_JAR_VERSION); /* needed */
+    jsc_jar_put_u16(&p, 0);
+    jsc_jar_put_u16(&p, 0);
+    jsc_jar_put_u16(&p, 0);
+    jsc_jar_put_u16(&p, JSC_JAR_DOS_DATE);
+    jsc_jar_put_u32(&p, entry->crc32);
+    jsc_jar_put_u32(&p, entry->size);
+    jsc_jar_put_u32(&p, entry->size);
+    jsc_jar_put_u16(&p, (uint16_t)name_length);
+    jsc_jar_put_u16(&p, 0); /* extra field length */
+    jsc_jar_put_u16(&p, 0); /* comment length */
+    jsc_jar_put_u16(&p, 0); /* disk */
+    jsc_jar_put_u16(&p, 0); /* internal attributes */
+    jsc_jar_put_u32(&p, 0); /* external attributes */
+    jsc_jar_put_u32(&p, entry->offset);
+
+    jsc_jar_write(jar, header, sizeof(header));
+    jsc_jar_write(jar, entry->name, name_length);
+  }
+
+  uint8_t end[22];
+  uint8_t* p = end;
+
+  jsc_jar_put_u32(&p, JSC_JAR_END_OF_CENTRAL);
+  jsc_jar_put_u16(&p, 0);
+  jsc_jar_put_u16(&p, 0);
+  jsc_jar_put_u16(&p, jar->entry_count);
+  jsc_jar_put_u16(&p, jar->entry_count);
+  jsc_jar_put_u32(&p, jar->offset - directory_offset);
+  jsc_jar_put_u32(&p, directory_offset);
+  jsc_jar_put_u16(&p, 0); /* comment length */
+
+  jsc_jar_write(jar, end, sizeof(end));
+
+  bool ok = !jar->had_error;
+
+  if (fclose(jar->file) != 0)
+  {
+    ok = false;
+  }
+
+  for (uint16_t i = 0; i < jar->entry_count; i++)
+  {
+    free(jar->entries[i].name);
+  }
+
+  free(jar->entries);
+  free(jar);
+
+  return ok;
+}
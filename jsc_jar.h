@@ -0,0 +1,38 @@
+#ifndef JSC_JAR_H
+#define JSC_JAR_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct jsc_jar jsc_jar;
+typedef struct jsc_jar_entry jsc_jar_entry;
+
+struct jsc_jar_entry
+{
+  char* name;
+  uint32_t crc32;
+  uint32_t size;
+  uint32_t offset;
+};
+
+struct jsc_jar
+{
+  FILE* file;
+  uint32_t offset;
+
+  jsc_jar_entry* entries;
+  uint16_t entry_count;
+  uint16_t entry_capacity;
+
+  bool had_error;
+};
+
+uint32_t jsc_jar_crc32(uint32_t crc, const uint8_t* data, size_t size);
+
+jsc_jar* jsc_jar_open(const char* path, const char* main_class);
+bool jsc_jar_add(jsc_jar* jar, const char* name, const uint8_t* data,
+                 uint32_t size);
+bool jsc_jar_close(jsc_jar* jar);
+
+#endif
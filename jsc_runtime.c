@@ -0,0 +1,896 @@
+#include "jsc_runtime.h"
+#include "jsc_bytecode.h"
+
+#include <math.h>
+#include <string.h>
+#include <endian.h>
+
+#define JSC_RUNTIME_LOOKUP "Ljava/lang/invoke/MethodHandles$Lookup;"
+#define JSC_RUNTIME_HANDLE "Ljava/lang/invoke/MethodHandle;"
+#define JSC_RUNTIME_SITE "java/lang/invoke/MutableCallSite"
+#define JSC_RUNTIME_FALLBACK_DESCRIPTOR                                        \
+  "(Ljsc/JSCRuntime;[Ljava/lang/Object;)Ljava/lang/Object;"
+
+static void jsc_runtime_load_class(jsc_bytecode_context* ctx,
+                                   jsc_method* method, const char* class_name)
+{
+  jsc_bytecode_emit_const_load(
+      ctx, method, jsc_bytecode_add_class_constant(ctx, class_name));
+}
+
+/* MethodHandles.lookup().findStatic(<class on stack>, name, type) where the
+   type is parsed from a descriptor against the loader left on the stack */
+static void jsc_runtime_find_static(jsc_bytecode_context* ctx,
+                                    jsc_method* method)
+{
+  jsc_bytecode_emit_invoke_static(
+      ctx, method, "java/lang/invoke/MethodType", "fromMethodDescriptorString",
+      "(Ljava/lang/String;Ljava/lang/ClassLoader;)"
+      "Ljava/lang/invoke/MethodType;");
+  jsc_bytecode_emit_invoke_virtual(
+      ctx, method, "java/lang/invoke/MethodHandles$Lookup", "findStatic",
+      "(Ljava/lang/Class;Ljava/lang/String;Ljava/lang/invoke/MethodType;)"
+      "Ljava/lang/invoke/MethodHandle;");
+}
+
+static bool jsc_runtime_emit_clinit(jsc_bytecode_context* ctx)
+{
+  jsc_method* method = jsc_bytecode_create_method(ctx, "<clinit>", "()V",
+                                                  JSC_ACC_STATIC, 5, 0);
+
+  if (!method)
+  {
+    return false;
+  }
+
+  jsc_bytecode_emit_invoke_static(ctx, method, "java/lang/invoke/MethodHandles",
+                                  "lookup", "()" JSC_RUNTIME_LOOKUP);
+  jsc_runtime_load_class(ctx, method, JSC_RUNTIME_CLASS);
+  jsc_bytecode_emit_load_constant_string(ctx, method, "fallback");
+  jsc_bytecode_emit_load_constant_string(ctx, method,
+                                         JSC_RUNTIME_FALLBACK_DESCRIPTOR);
+  jsc_runtime_load_class(ctx, method, JSC_RUNTIME_CLASS);
+  jsc_bytecode_emit_invoke_virtual(ctx, method, "java/lang/Class",
+                                   "getClassLoader",
+                                   "()Ljava/lang/ClassLoader;");
+  jsc_runtime_find_static(ctx, method);
+  jsc_bytecode_emit_field_access(ctx, method, JSC_JVM_PUTSTATIC,
+                                 JSC_RUNTIME_CLASS, "FALLBACK",
+                                 JSC_RUNTIME_HANDLE);
+
+  jsc_bytecode_emit_invoke_static(ctx, method, "java/lang/invoke/MethodHandles",
+                                  "lookup", "()" JSC_RUNTIME_LOOKUP);
+  jsc_runtime_load_class(ctx, method, "java/util/Objects");
+  jsc_bytecode_emit_load_constant_string(ctx, method, "equals");
+  jsc_bytecode_emit_load_constant_string(
+      ctx, method, "(Ljava/lang/Object;Ljava/lang/Object;)Z");
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ACONST_NULL);
+  jsc_runtime_find_static(ctx, method);
+  jsc_bytecode_emit_field_access(ctx, method, JSC_JVM_PUTSTATIC,
+                                 JSC_RUNTIME_CLASS, "EQUALS",
+                                 JSC_RUNTIME_HANDLE);
+
+  jsc_bytecode_emit(ctx, method, JSC_JVM_RETURN);
+
+  return true;
+}
+
+static bool jsc_runtime_emit_init(jsc_bytecode_context* ctx)
+{
+  jsc_method* method = jsc_bytecode_create_method(
+      ctx, "<init>", "(Ljava/lang/invoke/MethodType;)V", JSC_ACC_PRIVATE, 2,
+      2);
+
+  if (!method)
+  {
+    return false;
+  }
+
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_0);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_1);
+  jsc_bytecode_emit_invoke_special(ctx, method, JSC_RUNTIME_SITE, "<init>",
+                                   "(Ljava/lang/invoke/MethodType;)V");
+  jsc_bytecode_emit(ctx, method, JSC_JVM_RETURN);
+
+  return true;
+}
+
+/**
+ * @brief emit the bootstrap method named by every call site
+ *
+ * @details Each site starts out pointing at fallback, bound to the site and
+ *          collecting the callee and arguments into one Object[].
+ */
+static bool jsc_runtime_emit_bootstrap(jsc_bytecode_context* ctx)
+{
+  jsc_method* method = jsc_bytecode_create_method(
+      ctx, JSC_RUNTIME_BOOTSTRAP, JSC_RUNTIME_BOOTSTRAP_DESCRIPTOR,
+      JSC_ACC_PUBLIC | JSC_ACC_STATIC, 4, 4);
+
+  if (!method)
+  {
+    return false;
+  }
+
+  jsc_bytecode_emit_new(ctx, method, JSC_RUNTIME_CLASS);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_DUP);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_2);
+  jsc_bytecode_emit_invoke_special(ctx, method, JSC_RUNTIME_CLASS, "<init>",
+                                   "(Ljava/lang/invoke/MethodType;)V");
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ASTORE_3);
+
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_3);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_0);
+  jsc_bytecode_emit_field_access(ctx, method, JSC_JVM_PUTFIELD,
+                                 JSC_RUNTIME_CLASS, "lookup",
+                                 JSC_RUNTIME_LOOKUP);
+
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_3);
+  jsc_bytecode_emit_field_access(ctx, method, JSC_JVM_GETSTATIC,
+                                 JSC_RUNTIME_CLASS, "FALLBACK",
+                                 JSC_RUNTIME_HANDLE);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_3);
+  jsc_bytecode_emit_invoke_virtual(ctx, method, "java/lang/invoke/MethodHandle",
+                                   "bindTo",
+                                   "(Ljava/lang/Object;)" JSC_RUNTIME_HANDLE);
+  jsc_runtime_load_class(ctx, method, "[Ljava/lang/Object;");
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_2);
+  jsc_bytecode_emit_invoke_virtual(ctx, method, "java/lang/invoke/MethodType",
+                                   "parameterCount", "()I");
+  jsc_bytecode_emit_invoke_virtual(ctx, method, "java/lang/invoke/MethodHandle",
+                                   "asCollector",
+                                   "(Ljava/lang/Class;I)" JSC_RUNTIME_HANDLE);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_2);
+  jsc_bytecode_emit_invoke_virtual(
+      ctx, method, "java/lang/invoke/MethodHandle", "asType",
+      "(Ljava/lang/invoke/MethodType;)" JSC_RUNTIME_HANDLE);
+  jsc_bytecode_emit_invoke_virtual(ctx, method, JSC_RUNTIME_SITE, "setTarget",
+                                   "(" JSC_RUNTIME_HANDLE ")V");
+
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_3);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ARETURN);
+
+  return true;
+}
+
+/**
+ * @brief emit the slow path taken on a cache miss
+ *
+ * @details args[0] is the callee, a "Class.name" string as stored in the
+ *          global for a function declaration. The resolved method is put in
+ *          front of the site's current target behind an equality test on the
+ *          callee, so a site seeing one function settles into a single guard
+ *          and one seeing a few into a short chain; after
+ *          JSC_RUNTIME_MAX_POLYMORPHISM guards misses resolve every time.
+ */
+static bool jsc_runtime_emit_fallback(jsc_bytecode_context* ctx)
+{
+  jsc_method* method = jsc_bytecode_create_method(
+      ctx, "fallback", JSC_RUNTIME_FALLBACK_DESCRIPTOR,
+      JSC_ACC_PRIVATE | JSC_ACC_STATIC, 8, 6);
+
+  if (!method)
+  {
+    return false;
+  }
+
+  /* locals: 0 site, 1 args, 2 callee, 3 index of '.', 4 class, 5 target */
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_1);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ICONST_0);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_AALOAD);
+  jsc_bytecode_emit_u16(ctx, method, JSC_JVM_CHECKCAST,
+                        jsc_bytecode_add_class_constant(ctx,
+                                                        "java/lang/String"));
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ASTORE_2);
+
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_2);
+  jsc_bytecode_emit_load_constant_int(ctx, method, '.');
+  jsc_bytecode_emit_invoke_virtual(ctx, method, "java/lang/String",
+                                   "lastIndexOf", "(I)I");
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ISTORE_3);
+
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_2);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ICONST_0);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ILOAD_3);
+  jsc_bytecode_emit_invoke_virtual(ctx, method, "java/lang/String", "substring",
+                                   "(II)Ljava/lang/String;");
+  jsc_bytecode_emit_load_constant_int(ctx, method, '/');
+  jsc_bytecode_emit_load_constant_int(ctx, method, '.');
+  jsc_bytecode_emit_invoke_virtual(ctx, method, "java/lang/String", "replace",
+                                   "(CC)Ljava/lang/String;");
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ICONST_1);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_0);
+  jsc_bytecode_emit_field_access(ctx, method, JSC_JVM_GETFIELD,
+                                 JSC_RUNTIME_CLASS, "lookup",
+                                 JSC_RUNTIME_LOOKUP);
+  jsc_bytecode_emit_invoke_virtual(ctx, method,
+                                   "java/lang/invoke/MethodHandles$Lookup",
+                                   "lookupClass", "()Ljava/lang/Class;");
+  jsc_bytecode_emit_invoke_virtual(ctx, method, "java/lang/Class",
+                                   "getClassLoader",
+                                   "()Ljava/lang/ClassLoader;");
+  jsc_bytecode_emit_invoke_static(
+      ctx, method, "java/lang/Class", "forName",
+      "(Ljava/lang/String;ZLjava/lang/ClassLoader;)Ljava/lang/Class;");
+  jsc_bytecode_emit_local_var(ctx, method, JSC_JVM_ASTORE, 4);
+
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_0);
+  jsc_bytecode_emit_field_access(ctx, method, JSC_JVM_GETFIELD,
+                                 JSC_RUNTIME_CLASS, "lookup",
+                                 JSC_RUNTIME_LOOKUP);
+  jsc_bytecode_emit_local_var(ctx, method, JSC_JVM_ALOAD, 4);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_2);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ILOAD_3);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ICONST_1);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_IADD);
+  jsc_bytecode_emit_invoke_virtual(ctx, method, "java/lang/String", "substring",
+                                   "(I)Ljava/lang/String;");
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_1);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ARRAYLENGTH);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ICONST_1);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ISUB);
+  jsc_bytecode_emit_invoke_static(ctx, method, "java/lang/invoke/MethodType",
+                                  "genericMethodType",
+                                  "(I)Ljava/lang/invoke/MethodType;");
+  jsc_bytecode_emit_invoke_virtual(
+      ctx, method, "java/lang/invoke/MethodHandles$Lookup", "findStatic",
+      "(Ljava/lang/Class;Ljava/lang/String;Ljava/lang/invoke/MethodType;)"
+      "Ljava/lang/invoke/MethodHandle;");
+  jsc_bytecode_emit_local_var(ctx, method, JSC_JVM_ASTORE, 5);
+
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_0);
+  jsc_bytecode_emit_field_access(ctx, method, JSC_JVM_GETFIELD,
+                                 JSC_RUNTIME_CLASS, "depth", "I");
+  jsc_bytecode_emit_load_constant_int(ctx, method,
+                                      JSC_RUNTIME_MAX_POLYMORPHISM);
+
+  uint32_t branch = jsc_bytecode_get_method_code_length(method);
+  jsc_bytecode_emit_jump(ctx, method, JSC_JVM_IF_ICMPGE, 0);
+
+  /* setTarget(guardWithTest(insertArguments(EQUALS, 1, callee),
+                             dropArguments(target, 0, Object.class),
+                             getTarget())) */
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_0);
+  jsc_bytecode_emit_field_access(ctx, method, JSC_JVM_GETSTATIC,
+                                 JSC_RUNTIME_CLASS, "EQUALS",
+                                 JSC_RUNTIME_HANDLE);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ICONST_1);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ICONST_1);
+  jsc_bytecode_emit_anewarray(ctx, method, "java/lang/Object");
+  jsc_bytecode_emit(ctx, method, JSC_JVM_DUP);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ICONST_0);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_2);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_AASTORE);
+  jsc_bytecode_emit_invoke_static(
+      ctx, method, "java/lang/invoke/MethodHandles", "insertArguments",
+      "(" JSC_RUNTIME_HANDLE "I[Ljava/lang/Object;)" JSC_RUNTIME_HANDLE);
+
+  jsc_bytecode_emit_local_var(ctx, method, JSC_JVM_ALOAD, 5);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ICONST_0);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ICONST_1);
+  jsc_bytecode_emit_anewarray(ctx, method, "java/lang/Class");
+  jsc_bytecode_emit(ctx, method, JSC_JVM_DUP);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ICONST_0);
+  jsc_runtime_load_class(ctx, method, "java/lang/Object");
+  jsc_bytecode_emit(ctx, method, JSC_JVM_AASTORE);
+  jsc_bytecode_emit_invoke_static(
+      ctx, method, "java/lang/invoke/MethodHandles", "dropArguments",
+      "(" JSC_RUNTIME_HANDLE "I[Ljava/lang/Class;)" JSC_RUNTIME_HANDLE);
+
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_0);
+  jsc_bytecode_emit_invoke_virtual(ctx, method, JSC_RUNTIME_SITE, "getTarget",
+                                   "()" JSC_RUNTIME_HANDLE);
+  jsc_bytecode_emit_invoke_static(
+      ctx, method, "java/lang/invoke/MethodHandles", "guardWithTest",
+      "(" JSC_RUNTIME_HANDLE JSC_RUNTIME_HANDLE JSC_RUNTIME_HANDLE
+      ")" JSC_RUNTIME_HANDLE);
+  jsc_bytecode_emit_invoke_virtual(ctx, method, JSC_RUNTIME_SITE, "setTarget",
+                                   "(" JSC_RUNTIME_HANDLE ")V");
+
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_0);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_DUP);
+  jsc_bytecode_emit_field_access(ctx, method, JSC_JVM_GETFIELD,
+                                 JSC_RUNTIME_CLASS, "depth", "I");
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ICONST_1);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_IADD);
+  jsc_bytecode_emit_field_access(ctx, method, JSC_JVM_PUTFIELD,
+                                 JSC_RUNTIME_CLASS, "depth", "I");
+
+  uint8_t* code = jsc_bytecode_get_method_code(method);
+  uint16_t offset_be =
+      htobe16(jsc_bytecode_get_method_code_length(method) - branch);
+  memcpy(&code[branch + 1], &offset_be, 2);
+
+  jsc_bytecode_emit_local_var(ctx, method, JSC_JVM_ALOAD, 5);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_1);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ICONST_1);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_1);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ARRAYLENGTH);
+  jsc_bytecode_emit_invoke_static(
+      ctx, method, "java/util/Arrays", "copyOfRange",
+      "([Ljava/lang/Object;II)[Ljava/lang/Object;");
+  jsc_bytecode_emit_invoke_virtual(
+      ctx, method, "java/lang/invoke/MethodHandle", "invokeWithArguments",
+      "([Ljava/lang/Object;)Ljava/lang/Object;");
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ARETURN);
+
+  return true;
+}
+
+/* branch to label unless local holds an instance of class_name */
+static void jsc_runtime_branch_unless(jsc_bytecode_context* ctx,
+                                      jsc_method* method, uint16_t local,
+                                      const char* class_name, int32_t label)
+{
+  jsc_bytecode_emit_local_var(ctx, method, JSC_JVM_ALOAD, local);
+  jsc_bytecode_emit_u16(ctx, method, JSC_JVM_INSTANCEOF,
+                        jsc_bytecode_add_class_constant(ctx, class_name));
+  jsc_bytecode_emit_branch(ctx, method, JSC_JVM_IFEQ, label);
+}
+
+/* load local, known to hold an instance of class_name, as one */
+static void jsc_runtime_load_as(jsc_bytecode_context* ctx, jsc_method* method,
+                                uint16_t local, const char* class_name)
+{
+  jsc_bytecode_emit_local_var(ctx, method, JSC_JVM_ALOAD, local);
+  jsc_bytecode_emit_u16(ctx, method, JSC_JVM_CHECKCAST,
+                        jsc_bytecode_add_class_constant(ctx, class_name));
+}
+
+/* the double value of local, known to hold a java/lang/Number */
+static void jsc_runtime_load_double(jsc_bytecode_context* ctx,
+                                    jsc_method* method, uint16_t local)
+{
+  jsc_runtime_load_as(ctx, method, local, "java/lang/Number");
+  jsc_bytecode_emit_invoke_virtual(ctx, method, "java/lang/Number",
+                                   "doubleValue", "()D");
+}
+
+/* return the boolean constant value */
+static void jsc_runtime_return_boolean(jsc_bytecode_context* ctx,
+                                       jsc_method* method, bool value)
+{
+  jsc_bytecode_emit(ctx, method, value ? JSC_JVM_ICONST_1 : JSC_JVM_ICONST_0);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_IRETURN);
+}
+
+/**
+ * @brief emit toBoolean(Object)Z, JS ToBoolean of a value
+ *
+ * @details Numbers are true unless zero or NaN, strings unless empty and
+ *          other objects always; null, standing for undefined as well, is
+ *          false.
+ */
+static bool jsc_runtime_emit_to_boolean(jsc_bytecode_context* ctx)
+{
+  jsc_method* method = jsc_bytecode_create_method(
+      ctx, JSC_RUNTIME_TO_BOOLEAN, JSC_RUNTIME_TO_BOOLEAN_DESCRIPTOR,
+      JSC_ACC_PUBLIC | JSC_ACC_STATIC, 4, 1);
+
+  if (!method)
+  {
+    return false;
+  }
+
+  int32_t not_boolean = jsc_bytecode_new_label(ctx);
+  int32_t not_number = jsc_bytecode_new_label(ctx);
+  int32_t not_string = jsc_bytecode_new_label(ctx);
+  int32_t falsy = jsc_bytecode_new_label(ctx);
+
+  jsc_runtime_branch_unless(ctx, method, 0, "java/lang/Boolean", not_boolean);
+  jsc_runtime_load_as(ctx, method, 0, "java/lang/Boolean");
+  jsc_bytecode_emit_invoke_virtual(ctx, method, "java/lang/Boolean",
+                                   "booleanValue", "()Z");
+  jsc_bytecode_emit(ctx, method, JSC_JVM_IRETURN);
+
+  /* |x| > 0 fails for zero and, through dcmpl, for NaN */
+  jsc_bytecode_place_label(ctx, method, not_boolean);
+  jsc_runtime_branch_unless(ctx, method, 0, "java/lang/Number", not_number);
+  jsc_runtime_load_double(ctx, method, 0);
+  jsc_bytecode_emit_invoke_static(ctx, method, "java/lang/Math", "abs",
+                                  "(D)D");
+  jsc_bytecode_emit(ctx, method, JSC_JVM_DCONST_0);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_DCMPL);
+  jsc_bytecode_emit_branch(ctx, method, JSC_JVM_IFLE, falsy);
+  jsc_runtime_return_boolean(ctx, method, true);
+
+  jsc_bytecode_place_label(ctx, method, not_number);
+  jsc_runtime_branch_unless(ctx, method, 0, "java/lang/String", not_string);
+  jsc_runtime_load_as(ctx, method, 0, "java/lang/String");
+  jsc_bytecode_emit_invoke_virtual(ctx, method, "java/lang/String", "isEmpty",
+                                   "()Z");
+  jsc_bytecode_emit_branch(ctx, method, JSC_JVM_IFNE, falsy);
+  jsc_runtime_return_boolean(ctx, method, true);
+
+  jsc_bytecode_place_label(ctx, method, not_string);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_0);
+  jsc_bytecode_emit_branch(ctx, method, JSC_JVM_IFNULL, falsy);
+  jsc_runtime_return_boolean(ctx, method, true);
+
+  jsc_bytecode_place_label(ctx, method, falsy);
+  jsc_runtime_return_boolean(ctx, method, false);
+
+  return true;
+}
+
+/**
+ * @brief emit toNumber(Object)D, JS ToNumber of a value
+ *
+ * @details Strings are trimmed and read by Double.parseDouble, NaN when it
+ *          rejects them, so its few extensions such as a trailing 'd' are
+ *          accepted too. null counts as 0, as the constant folder has it.
+ */
+static bool jsc_runtime_emit_to_number(jsc_bytecode_context* ctx)
+{
+  jsc_method* method = jsc_bytecode_create_method(
+      ctx, JSC_RUNTIME_TO_NUMBER, JSC_RUNTIME_TO_NUMBER_DESCRIPTOR,
+      JSC_ACC_PUBLIC | JSC_ACC_STATIC, 4, 2);
+
+  if (!method)
+  {
+    return false;
+  }
+
+  int32_t not_number = jsc_bytecode_new_label(ctx);
+  int32_t not_boolean = jsc_bytecode_new_label(ctx);
+  int32_t not_string = jsc_bytecode_new_label(ctx);
+  int32_t zero = jsc_bytecode_new_label(ctx);
+  int32_t nan = jsc_bytecode_new_label(ctx);
+
+  jsc_runtime_branch_unless(ctx, method, 0, "java/lang/Number", not_number);
+  jsc_runtime_load_double(ctx, method, 0);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_DRETURN);
+
+  jsc_bytecode_place_label(ctx, method, not_number);
+  jsc_runtime_branch_unless(ctx, method, 0, "java/lang/Boolean", not_boolean);
+  jsc_runtime_load_as(ctx, method, 0, "java/lang/Boolean");
+  jsc_bytecode_emit_invoke_virtual(ctx, method, "java/lang/Boolean",
+                                   "booleanValue", "()Z");
+  jsc_bytecode_emit(ctx, method, JSC_JVM_I2D);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_DRETURN);
+
+  jsc_bytecode_place_label(ctx, method, not_boolean);
+  jsc_runtime_branch_unless(ctx, method, 0, "java/lang/String", not_string);
+  jsc_runtime_load_as(ctx, method, 0, "java/lang/String");
+  jsc_bytecode_emit_invoke_virtual(ctx, method, "java/lang/String", "trim",
+                                   "()Ljava/lang/String;");
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ASTORE_1);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_1);
+  jsc_bytecode_emit_invoke_virtual(ctx, method, "java/lang/String", "isEmpty",
+                                   "()Z");
+  jsc_bytecode_emit_branch(ctx, method, JSC_JVM_IFNE, zero);
+
+  uint32_t try_start = jsc_bytecode_get_method_code_length(method);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_1);
+  jsc_bytecode_emit_invoke_static(ctx, method, "java/lang/Double",
+                                  "parseDouble", "(Ljava/lang/String;)D");
+  uint32_t try_end = jsc_bytecode_get_method_code_length(method);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_DRETURN);
+
+  uint32_t handler = jsc_bytecode_get_method_code_length(method);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_POP);
+  jsc_bytecode_emit_branch(ctx, method, JSC_JVM_GOTO, nan);
+
+  jsc_bytecode_place_label(ctx, method, not_string);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_0);
+  jsc_bytecode_emit_branch(ctx, method, JSC_JVM_IFNONNULL, nan);
+
+  jsc_bytecode_place_label(ctx, method, zero);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_DCONST_0);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_DRETURN);
+
+  jsc_bytecode_place_label(ctx, method, nan);
+  jsc_bytecode_emit_load_constant_double(ctx, method, NAN);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_DRETURN);
+
+  /* the code is short enough for every branch to stay in place, so the
+     offsets of the handler are final */
+  for (uint16_t i = 0; i < method->attribute_count; i++)
+  {
+    const jsc_constant_pool_entry* entry =
+        &ctx->constant_pool[method->attributes[i].name_index];
+
+    if (entry->utf8_info.length == 4 &&
+        memcmp(entry->utf8_info.bytes, "Code", 4) == 0)
+    {
+      jsc_bytecode_add_exception_table_entry(
+          ctx, &method->attributes[i], (uint16_t)try_start, (uint16_t)try_end,
+          (uint16_t)handler,
+          jsc_bytecode_add_class_constant(ctx,
+                                          "java/lang/NumberFormatException"));
+      break;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * @brief emit compare(Object, Object, int)I, JS relational comparison
+ *
+ * @details Two strings compare by UTF-16 code units, anything else as
+ *          numbers. The result is negative, zero or positive like that of
+ *          dcmpl, with the third argument returned when either number is
+ *          NaN: 1 makes it act as dcmpg, -1 as dcmpl.
+ */
+static bool jsc_runtime_emit_compare(jsc_bytecode_context* ctx)
+{
+  jsc_method* method = jsc_bytecode_create_method(
+      ctx, JSC_RUNTIME_COMPARE, JSC_RUNTIME_COMPARE_DESCRIPTOR,
+      JSC_ACC_PUBLIC | JSC_ACC_STATIC, 4, 7);
+
+  if (!method)
+  {
+    return false;
+  }
+
+  int32_t numbers = jsc_bytecode_new_label(ctx);
+  int32_t unordered = jsc_bytecode_new_label(ctx);
+
+  jsc_runtime_branch_unless(ctx, method, 0, "java/lang/String", numbers);
+  jsc_runtime_branch_unless(ctx, method, 1, "java/lang/String", numbers);
+  jsc_runtime_load_as(ctx, method, 0, "java/lang/String");
+  jsc_runtime_load_as(ctx, method, 1, "java/lang/String");
+  jsc_bytecode_emit_invoke_virtual(ctx, method, "java/lang/String",
+                                   "compareTo", "(Ljava/lang/String;)I");
+  jsc_bytecode_emit(ctx, method, JSC_JVM_IRETURN);
+
+  /* locals: 3 the left number, 5 the right one */
+  jsc_bytecode_place_label(ctx, method, numbers);
+
+  for (uint16_t i = 0; i < 2; i++)
+  {
+    jsc_bytecode_emit_local_var(ctx, method, JSC_JVM_ALOAD, i);
+    jsc_bytecode_emit_invoke_static(ctx, method, JSC_RUNTIME_CLASS,
+                                    JSC_RUNTIME_TO_NUMBER,
+                                    JSC_RUNTIME_TO_NUMBER_DESCRIPTOR);
+    jsc_bytecode_emit_local_var(ctx, method, JSC_JVM_DSTORE, 3 + i * 2);
+
+    /* only NaN differs from itself */
+    jsc_bytecode_emit_local_var(ctx, method, JSC_JVM_DLOAD, 3 + i * 2);
+    jsc_bytecode_emit_local_var(ctx, method, JSC_JVM_DLOAD, 3 + i * 2);
+    jsc_bytecode_emit(ctx, method, JSC_JVM_DCMPL);
+    jsc_bytecode_emit_branch(ctx, method, JSC_JVM_IFNE, unordered);
+  }
+
+  jsc_bytecode_emit_local_var(ctx, method, JSC_JVM_DLOAD, 3);
+  jsc_bytecode_emit_local_var(ctx, method, JSC_JVM_DLOAD, 5);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_DCMPL);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_IRETURN);
+
+  jsc_bytecode_place_label(ctx, method, unordered);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ILOAD_2);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_IRETURN);
+
+  return true;
+}
+
+/**
+ * @brief emit strictEquals(Object, Object)Z, JS ===
+ *
+ * @details Two Doubles compare by value, so that NaN differs from itself
+ *          and 0 equals -0; anything else by Objects.equals, so a Boolean
+ *          never equals a number.
+ */
+static bool jsc_runtime_emit_strict_equals(jsc_bytecode_context* ctx)
+{
+  jsc_method* method = jsc_bytecode_create_method(
+      ctx, JSC_RUNTIME_STRICT_EQUALS, JSC_RUNTIME_EQUALS_DESCRIPTOR,
+      JSC_ACC_PUBLIC | JSC_ACC_STATIC, 4, 2);
+
+  if (!method)
+  {
+    return false;
+  }
+
+  int32_t objects = jsc_bytecode_new_label(ctx);
+  int32_t differ = jsc_bytecode_new_label(ctx);
+
+  jsc_runtime_branch_unless(ctx, method, 0, "java/lang/Double", objects);
+  jsc_runtime_branch_unless(ctx, method, 1, "java/lang/Double", objects);
+  jsc_runtime_load_double(ctx, method, 0);
+  jsc_runtime_load_double(ctx, method, 1);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_DCMPL);
+  jsc_bytecode_emit_branch(ctx, method, JSC_JVM_IFNE, differ);
+  jsc_runtime_return_boolean(ctx, method, true);
+
+  jsc_bytecode_place_label(ctx, method, differ);
+  jsc_runtime_return_boolean(ctx, method, false);
+
+  jsc_bytecode_place_label(ctx, method, objects);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_0);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_1);
+  jsc_bytecode_emit_invoke_static(ctx, method, "java/util/Objects", "equals",
+                                  "(Ljava/lang/Object;Ljava/lang/Object;)Z");
+  jsc_bytecode_emit(ctx, method, JSC_JVM_IRETURN);
+
+  return true;
+}
+
+/* branch to label unless local holds a number, string or boolean */
+static void jsc_runtime_branch_unless_primitive(jsc_bytecode_context* ctx,
+                                                jsc_method* method,
+                                                uint16_t local, int32_t label)
+{
+  int32_t primitive = jsc_bytecode_new_label(ctx);
+  const char* classes[] = {"java/lang/Number", "java/lang/String"};
+
+  for (size_t i = 0; i < sizeof(classes) / sizeof(classes[0]); i++)
+  {
+    jsc_bytecode_emit_local_var(ctx, method, JSC_JVM_ALOAD, local);
+    jsc_bytecode_emit_u16(ctx, method, JSC_JVM_INSTANCEOF,
+                          jsc_bytecode_add_class_constant(ctx, classes[i]));
+    jsc_bytecode_emit_branch(ctx, method, JSC_JVM_IFNE, primitive);
+  }
+
+  jsc_runtime_branch_unless(ctx, method, local, "java/lang/Boolean", label);
+  jsc_bytecode_place_label(ctx, method, primitive);
+}
+
+/**
+ * @brief emit looseEquals(Object, Object)Z, JS ==
+ *
+ * @details null, which also stands for undefined, only equals itself. Two
+ *          strings compare as strings, other mixes of numbers, strings and
+ *          booleans as numbers, and any other pair by Objects.equals.
+ */
+static bool jsc_runtime_emit_loose_equals(jsc_bytecode_context* ctx)
+{
+  jsc_method* method = jsc_bytecode_create_method(
+      ctx, JSC_RUNTIME_LOOSE_EQUALS, JSC_RUNTIME_EQUALS_DESCRIPTOR,
+      JSC_ACC_PUBLIC | JSC_ACC_STATIC, 4, 2);
+
+  if (!method)
+  {
+    return false;
+  }
+
+  int32_t nullish = jsc_bytecode_new_label(ctx);
+  int32_t not_strings = jsc_bytecode_new_label(ctx);
+  int32_t objects = jsc_bytecode_new_label(ctx);
+  int32_t differ = jsc_bytecode_new_label(ctx);
+
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_0);
+  jsc_bytecode_emit_branch(ctx, method, JSC_JVM_IFNULL, nullish);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_1);
+  jsc_bytecode_emit_branch(ctx, method, JSC_JVM_IFNULL, nullish);
+
+  jsc_runtime_branch_unless(ctx, method, 0, "java/lang/String", not_strings);
+  jsc_runtime_branch_unless(ctx, method, 1, "java/lang/String", not_strings);
+  jsc_bytecode_emit_branch(ctx, method, JSC_JVM_GOTO, objects);
+
+  jsc_bytecode_place_label(ctx, method, not_strings);
+  jsc_runtime_branch_unless_primitive(ctx, method, 0, objects);
+  jsc_runtime_branch_unless_primitive(ctx, method, 1, objects);
+
+  for (uint16_t i = 0; i < 2; i++)
+  {
+    jsc_bytecode_emit_local_var(ctx, method, JSC_JVM_ALOAD, i);
+    jsc_bytecode_emit_invoke_static(ctx, method, JSC_RUNTIME_CLASS,
+                                    JSC_RUNTIME_TO_NUMBER,
+                                    JSC_RUNTIME_TO_NUMBER_DESCRIPTOR);
+  }
+
+  jsc_bytecode_emit(ctx, method, JSC_JVM_DCMPL);
+  jsc_bytecode_emit_branch(ctx, method, JSC_JVM_IFNE, differ);
+  jsc_runtime_return_boolean(ctx, method, true);
+
+  jsc_bytecode_place_label(ctx, method, objects);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_0);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_1);
+  jsc_bytecode_emit_invoke_static(ctx, method, "java/util/Objects", "equals",
+                                  "(Ljava/lang/Object;Ljava/lang/Object;)Z");
+  jsc_bytecode_emit(ctx, method, JSC_JVM_IRETURN);
+
+  jsc_bytecode_place_label(ctx, method, nullish);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_0);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_1);
+  jsc_bytecode_emit_branch(ctx, method, JSC_JVM_IF_ACMPNE, differ);
+  jsc_runtime_return_boolean(ctx, method, true);
+
+  jsc_bytecode_place_label(ctx, method, differ);
+  jsc_runtime_return_boolean(ctx, method, false);
+
+  return true;
+}
+
+/**
+ * @brief emit switchKey(Object, int)I, the case key of a switch value
+ *
+ * @details A Double that is an int32 gives that int, 0 also for -0; any
+ *          other value gives the second argument, a key no case has.
+ */
+static bool jsc_runtime_emit_switch_key(jsc_bytecode_context* ctx)
+{
+  jsc_method* method = jsc_bytecode_create_method(
+      ctx, JSC_RUNTIME_SWITCH_KEY, JSC_RUNTIME_SWITCH_KEY_DESCRIPTOR,
+      JSC_ACC_PUBLIC | JSC_ACC_STATIC, 4, 4);
+
+  if (!method)
+  {
+    return false;
+  }
+
+  int32_t missing = jsc_bytecode_new_label(ctx);
+
+  jsc_runtime_branch_unless(ctx, method, 0, "java/lang/Double", missing);
+  jsc_runtime_load_double(ctx, method, 0);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_DSTORE_2);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_DLOAD_2);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_D2I);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_I2D);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_DLOAD_2);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_DCMPL);
+  jsc_bytecode_emit_branch(ctx, method, JSC_JVM_IFNE, missing);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_DLOAD_2);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_D2I);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_IRETURN);
+
+  jsc_bytecode_place_label(ctx, method, missing);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ILOAD_1);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_IRETURN);
+
+  return true;
+}
+
+/**
+ * @brief emit arithmetic(Object, Object, int)Object, JS - * / % and numeric +
+ *
+ * @details Both values go through toNumber; the int is the double opcode
+ *          of the operation, anything unknown adding. The result is boxed
+ *          as a Double like every number the compiled code handles.
+ */
+static bool jsc_runtime_emit_arithmetic(jsc_bytecode_context* ctx)
+{
+  jsc_method* method = jsc_bytecode_create_method(
+      ctx, JSC_RUNTIME_ARITHMETIC, JSC_RUNTIME_ARITHMETIC_DESCRIPTOR,
+      JSC_ACC_PUBLIC | JSC_ACC_STATIC, 4, 7);
+
+  if (!method)
+  {
+    return false;
+  }
+
+  static const uint8_t opcodes[] = {JSC_JVM_DADD, JSC_JVM_DSUB, JSC_JVM_DMUL,
+                                    JSC_JVM_DDIV, JSC_JVM_DREM};
+  int32_t keys[5];
+  int32_t labels[5];
+  int32_t box = jsc_bytecode_new_label(ctx);
+
+  /* locals: 3 the left number, 5 the right one */
+  for (uint16_t i = 0; i < 2; i++)
+  {
+    jsc_bytecode_emit_local_var(ctx, method, JSC_JVM_ALOAD, i);
+    jsc_bytecode_emit_invoke_static(ctx, method, JSC_RUNTIME_CLASS,
+                                    JSC_RUNTIME_TO_NUMBER,
+                                    JSC_RUNTIME_TO_NUMBER_DESCRIPTOR);
+    jsc_bytecode_emit_local_var(ctx, method, JSC_JVM_DSTORE, 3 + i * 2);
+  }
+
+  for (uint32_t i = 0; i < 5; i++)
+  {
+    keys[i] = opcodes[i];
+    labels[i] = jsc_bytecode_new_label(ctx);
+  }
+
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ILOAD_2);
+  jsc_bytecode_emit_switch(ctx, method, keys + 1, labels + 1, 4, labels[0]);
+
+  for (uint32_t i = 0; i < 5; i++)
+  {
+    jsc_bytecode_place_label(ctx, method, labels[i]);
+    jsc_bytecode_emit_local_var(ctx, method, JSC_JVM_DLOAD, 3);
+    jsc_bytecode_emit_local_var(ctx, method, JSC_JVM_DLOAD, 5);
+    jsc_bytecode_emit(ctx, method, opcodes[i]);
+    jsc_bytecode_emit_branch(ctx, method, JSC_JVM_GOTO, box);
+  }
+
+  jsc_bytecode_place_label(ctx, method, box);
+  jsc_bytecode_emit_invoke_static(ctx, method, "java/lang/Double", "valueOf",
+                                  "(D)Ljava/lang/Double;");
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ARETURN);
+
+  return true;
+}
+
+/**
+ * @brief emit add(Object, Object)Object, JS +
+ *
+ * @details Concatenates by String.valueOf when either value is a string,
+ *          as the concatenation call sites do, and adds numbers otherwise.
+ */
+static bool jsc_runtime_emit_add(jsc_bytecode_context* ctx)
+{
+  jsc_method* method = jsc_bytecode_create_method(
+      ctx, JSC_RUNTIME_ADD, JSC_RUNTIME_ADD_DESCRIPTOR,
+      JSC_ACC_PUBLIC | JSC_ACC_STATIC, 4, 2);
+
+  if (!method)
+  {
+    return false;
+  }
+
+  int32_t concat = jsc_bytecode_new_label(ctx);
+  int32_t numbers = jsc_bytecode_new_label(ctx);
+
+  for (uint16_t i = 0; i < 2; i++)
+  {
+    jsc_bytecode_emit_local_var(ctx, method, JSC_JVM_ALOAD, i);
+    jsc_bytecode_emit_u16(
+        ctx, method, JSC_JVM_INSTANCEOF,
+        jsc_bytecode_add_class_constant(ctx, "java/lang/String"));
+    jsc_bytecode_emit_branch(ctx, method, JSC_JVM_IFNE, concat);
+  }
+
+  jsc_bytecode_emit_branch(ctx, method, JSC_JVM_GOTO, numbers);
+
+  jsc_bytecode_place_label(ctx, method, concat);
+
+  for (uint16_t i = 0; i < 2; i++)
+  {
+    jsc_bytecode_emit_local_var(ctx, method, JSC_JVM_ALOAD, i);
+    jsc_bytecode_emit_invoke_static(ctx, method, "java/lang/String", "valueOf",
+                                    "(Ljava/lang/Object;)Ljava/lang/String;");
+  }
+
+  jsc_bytecode_emit_invoke_virtual(ctx, method, "java/lang/String", "concat",
+                                   "(Ljava/lang/String;)Ljava/lang/String;");
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ARETURN);
+
+  jsc_bytecode_place_label(ctx, method, numbers);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_0);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ALOAD_1);
+  jsc_bytecode_emit_load_constant_int(ctx, method, JSC_JVM_DADD);
+  jsc_bytecode_emit_invoke_static(ctx, method, JSC_RUNTIME_CLASS,
+                                  JSC_RUNTIME_ARITHMETIC,
+                                  JSC_RUNTIME_ARITHMETIC_DESCRIPTOR);
+  jsc_bytecode_emit(ctx, method, JSC_JVM_ARETURN);
+
+  return true;
+}
+
+/**
+ * @brief generate the class file for JSC_RUNTIME_CLASS
+ *
+ * @details The class extends MutableCallSite; one instance backs each
+ *          invokedynamic site emitted under JSC_ENGINE_FLAG_INVOKEDYNAMIC.
+ *          Its static conversions and arithmetic serve every program, which
+ *          calls them where a condition's, switch value's or operand's type
+ *          is only known at run time.
+ *          Returns the size of the buffer, or 0 on failure.
+ */
+uint32_t jsc_runtime_build(uint8_t** out_buffer)
+{
+  jsc_bytecode_context* ctx = jsc_bytecode_create_class(
+      JSC_RUNTIME_CLASS, JSC_RUNTIME_SITE, JSC_ACC_PUBLIC | JSC_ACC_SUPER);
+
+  if (!ctx)
+  {
+    return 0;
+  }
+
+  jsc_bytecode_set_version(ctx, 52, 0);
+
+  jsc_bytecode_add_field(ctx, "lookup", JSC_RUNTIME_LOOKUP, JSC_ACC_PRIVATE);
+  jsc_bytecode_add_field(ctx, "depth", "I", JSC_ACC_PRIVATE);
+  jsc_bytecode_add_field(ctx, "FALLBACK", JSC_RUNTIME_HANDLE,
+                         JSC_ACC_PRIVATE | JSC_ACC_STATIC | JSC_ACC_FINAL);
+  jsc_bytecode_add_field(ctx, "EQUALS", JSC_RUNTIME_HANDLE,
+                         JSC_ACC_PRIVATE | JSC_ACC_STATIC | JSC_ACC_FINAL);
+
+  uint32_t size = 0;
+
+  if (jsc_runtime_emit_clinit(ctx) && jsc_runtime_emit_init(ctx) &&
+      jsc_runtime_emit_bootstrap(ctx) && jsc_runtime_emit_fallback(ctx) &&
+      jsc_runtime_emit_to_boolean(ctx) && jsc_runtime_emit_to_number(ctx) &&
+      jsc_runtime_emit_compare(ctx) && jsc_runtime_emit_strict_equals(ctx) &&
+      jsc_runtime_emit_loose_equals(ctx) && jsc_runtime_emit_switch_key(ctx) &&
+      jsc_runtime_emit_arithmetic(ctx) && jsc_runtime_emit_add(ctx))
+  {
+    size = jsc_bytecode_write(ctx, out_buffer);
+  }
+
+  jsc_bytecode_free(ctx);
+
+  return size;
+}
@@ -0,0 +1,43 @@
+#ifndef JSC_RUNTIME_H
+#define JSC_RUNTIME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* support class for invokedynamic call sites, generated by jsc_runtime_build
+   and defined next to the compiled programs */
+#define JSC_RUNTIME_CLASS "jsc/JSCRuntime"
+
+#define JSC_RUNTIME_BOOTSTRAP "bootstrap"
+#define JSC_RUNTIME_BOOTSTRAP_DESCRIPTOR                                       \
+  "(Ljava/lang/invoke/MethodHandles$Lookup;Ljava/lang/String;"                 \
+  "Ljava/lang/invoke/MethodType;)Ljava/lang/invoke/CallSite;"
+
+/* static conversions the compiled code calls on values whose type is only
+   known at run time, see jsc_runtime_build */
+#define JSC_RUNTIME_TO_BOOLEAN "toBoolean"
+#define JSC_RUNTIME_TO_BOOLEAN_DESCRIPTOR "(Ljava/lang/Object;)Z"
+#define JSC_RUNTIME_TO_NUMBER "toNumber"
+#define JSC_RUNTIME_TO_NUMBER_DESCRIPTOR "(Ljava/lang/Object;)D"
+#define JSC_RUNTIME_COMPARE "compare"
+#define JSC_RUNTIME_COMPARE_DESCRIPTOR                                         \
+  "(Ljava/lang/Object;Ljava/lang/Object;I)I"
+#define JSC_RUNTIME_STRICT_EQUALS "strictEquals"
+#define JSC_RUNTIME_LOOSE_EQUALS "looseEquals"
+#define JSC_RUNTIME_EQUALS_DESCRIPTOR "(Ljava/lang/Object;Ljava/lang/Object;)Z"
+#define JSC_RUNTIME_SWITCH_KEY "switchKey"
+#define JSC_RUNTIME_SWITCH_KEY_DESCRIPTOR "(Ljava/lang/Object;I)I"
+#define JSC_RUNTIME_ADD "add"
+#define JSC_RUNTIME_ADD_DESCRIPTOR                                             \
+  "(Ljava/lang/Object;Ljava/lang/Object;)Ljava/lang/Object;"
+/* takes the double opcode to apply, JSC_JVM_DADD to JSC_JVM_DREM */
+#define JSC_RUNTIME_ARITHMETIC "arithmetic"
+#define JSC_RUNTIME_ARITHMETIC_DESCRIPTOR                                      \
+  "(Ljava/lang/Object;Ljava/lang/Object;I)Ljava/lang/Object;"
+
+/* guards chained onto one call site before it stops relinking */
+#define JSC_RUNTIME_MAX_POLYMORPHISM 8
+
+uint32_t jsc_runtime_build(uint8_t** out_buffer);
+
+#endif
@@ -2626,6 +2626,10 @@ jsc_token jsc_next_token(jsc_tokenizer_context* ctx)
       {
         token.type = JSC_TOKEN_AWAIT;
       }
+      else if (len == 6 && strncmp(ctx->source + start, "typeof", 6) == 0)
+      {
+        token.type = JSC_TOKEN_TYPEOF;
+      }
       else
       {
         token.type = JSC_TOKEN_IDENTIFIER;
@@ -3032,6 +3036,70 @@ void jsc_tokenizer_free(jsc_tokenizer_context* ctx)
   }
 }
 
+/**
+ * @brief remember where ctx is, for jsc_tokenizer_restore to come back to
+ *        after scanning ahead
+ *
+ * @details Errors raised in between are dropped by the restore.
+ */
+void jsc_tokenizer_save(jsc_tokenizer_context* ctx, jsc_tokenizer_mark* mark)
+{
+  mark->position = ctx->position;
+  mark->line = ctx->line;
+  mark->column = ctx->column;
+  mark->in_template = ctx->in_template;
+  mark->template_depth = ctx->template_depth;
+  mark->template_brace_depth = ctx->template_brace_depth;
+  mark->eof_reached = ctx->eof_reached;
+  mark->current = ctx->current;
+  mark->error_message = ctx->error_message;
+
+  ctx->error_message = NULL;
+}
+
+void jsc_tokenizer_restore(jsc_tokenizer_context* ctx,
+                           const jsc_tokenizer_mark* mark)
+{
+  free(ctx->error_message);
+
+  ctx->position = mark->position;
+  ctx->line = mark->line;
+  ctx->column = mark->column;
+  ctx->in_template = mark->in_template;
+  ctx->template_depth = mark->template_depth;
+  ctx->template_brace_depth = mark->template_brace_depth;
+  ctx->eof_reached = mark->eof_reached;
+  ctx->current = mark->current;
+  ctx->error_message = mark->error_message;
+}
+
+/**
+ * @brief type of the token jsc_next_token would return, without consuming it
+ *
+ * @details The scan is undone afterwards, including any error it raised.
+ */
+jsc_token_type jsc_peek_token_type(jsc_tokenizer_context* ctx)
+{
+  jsc_tokenizer_mark mark;
+  jsc_tokenizer_save(ctx, &mark);
+
+  jsc_token token = jsc_next_token(ctx);
+
+  if (token.type == JSC_TOKEN_STRING || token.type == JSC_TOKEN_TEMPLATE)
+  {
+    free(token.string_value.data);
+  }
+  else if (token.type == JSC_TOKEN_REGEXP)
+  {
+    free(token.regexp_value.data);
+    free(token.regexp_value.flags);
+  }
+
+  jsc_tokenizer_restore(ctx, &mark);
+
+  return token.type;
+}
+
 bool jsc_tokenizer_has_error(jsc_tokenizer_context* ctx)
 {
   return ctx->error_message != NULL;
@@ -228,10 +228,28 @@ struct jsc_tokenizer_context
   bool eof_reached;
 };
 
+/* a tokenizer's position, see jsc_tokenizer_save */
+typedef struct
+{
+  size_t position;
+  uint32_t line;
+  uint32_t column;
+  bool in_template;
+  int template_depth;
+  int template_brace_depth;
+  bool eof_reached;
+  jsc_token current;
+  char* error_message;
+} jsc_tokenizer_mark;
+
 jsc_vector_level jsc_get_vector_level(void);
 jsc_tokenizer_context* jsc_tokenizer_init(const char* source, size_t length);
 void jsc_tokenizer_free(jsc_tokenizer_context* ctx);
 jsc_token jsc_next_token(jsc_tokenizer_context* ctx);
+jsc_token_type jsc_peek_token_type(jsc_tokenizer_context* ctx);
+void jsc_tokenizer_save(jsc_tokenizer_context* ctx, jsc_tokenizer_mark* mark);
+void jsc_tokenizer_restore(jsc_tokenizer_context* ctx,
+                           const jsc_tokenizer_mark* mark);
 bool jsc_tokenizer_has_error(jsc_tokenizer_context* ctx);
 const char* jsc_tokenizer_get_error(jsc_tokenizer_context* ctx);
 const char* jsc_token_type_to_string(jsc_token_type type);
@@ -1,11 +1,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "jsc_bytecode.h"
 #include "jsc_tokenizer.h"
+#include "jsc_cache.h"
+#include "jsc_jar.h"
+#include "jsc_runtime.h"
 #include "jsc_engine.h"
 
+#ifndef JSC_NO_JVM
 void test_engine_basic()
 {
   printf("testing execution...\n");
@@ -23,6 +33,164 @@ void test_engine_basic()
   printf("output: %s\n", jsc_value_to_string(out));
   printf("done\n");
 }
+#endif
+
+/* remove a directory of plain files, such as a cache directory */
+static void remove_flat_directory(const char* path)
+{
+  DIR* dir = opendir(path);
+  struct dirent* entry;
+
+  while (dir && (entry = readdir(dir)) != NULL)
+  {
+    char file[1 << 12];
+
+    if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+    {
+      snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+      unlink(file);
+    }
+  }
+
+  if (dir)
+  {
+    closedir(dir);
+  }
+
+  rmdir(path);
+}
+
+void test_cache()
+{
+  printf("testing compile cache...\n");
+
+  const char* source = "let n = 7 * 3;";
+  uint8_t blob[1 << 6];
+  memset(blob, 0xAB, sizeof(blob));
+
+  jsc_cache_key key_a, key_b, key_c, key_d;
+  jsc_cache_compute_key(&key_a, source, strlen(source), "A", 0);
+  jsc_cache_compute_key(&key_b, source, strlen(source), "B", 0);
+  jsc_cache_compute_key(&key_c, "let n = 1;", 10, "A", 0);
+  jsc_cache_compute_key(&key_d, source, strlen(source), "A",
+                        JSC_ENGINE_FLAG_OPTIMIZE);
+
+  if (memcmp(&key_a, &key_b, sizeof(key_a)) == 0 ||
+      memcmp(&key_a, &key_c, sizeof(key_a)) == 0 ||
+      memcmp(&key_a, &key_d, sizeof(key_a)) == 0)
+  {
+    printf("jsc_cache_compute_key collision\n");
+    return;
+  }
+
+  jsc_cache* cache = jsc_cache_init(sizeof(blob) * 2, NULL);
+
+  if (!cache)
+  {
+    printf("jsc_cache_init\n");
+    return;
+  }
+
+  jsc_cache_store(cache, &key_a, blob, sizeof(blob));
+  jsc_cache_store(cache, &key_b, blob, sizeof(blob));
+
+  uint32_t size = 0;
+
+  if (!jsc_cache_lookup(cache, &key_a, &size) || size != sizeof(blob))
+  {
+    printf("jsc_cache_lookup miss\n");
+    jsc_cache_free(cache);
+    return;
+  }
+
+  /* key_b is now least recently used and must make room for key_c */
+  jsc_cache_store(cache, &key_c, blob, sizeof(blob));
+
+  if (jsc_cache_lookup(cache, &key_b, &size) ||
+      !jsc_cache_lookup(cache, &key_a, &size) ||
+      !jsc_cache_lookup(cache, &key_c, &size))
+  {
+    printf("jsc_cache LRU eviction\n");
+    jsc_cache_free(cache);
+    return;
+  }
+
+  if (cache->stats.evictions != 1 || cache->stats.hits != 3 ||
+      cache->stats.misses != 1 || cache->stats.stores != 3)
+  {
+    printf("jsc_cache counters wrong: %llu evictions, %llu hits, "
+           "%llu misses, %llu stores\n",
+           (unsigned long long)cache->stats.evictions,
+           (unsigned long long)cache->stats.hits,
+           (unsigned long long)cache->stats.misses,
+           (unsigned long long)cache->stats.stores);
+    jsc_cache_free(cache);
+    return;
+  }
+
+  jsc_cache_free(cache);
+
+  /* a second process-like instance must see blobs published by the first */
+  char directory[] = "/tmp/jsc_cache_XXXXXX";
+
+  if (!mkdtemp(directory))
+  {
+    printf("mkdtemp\n");
+    return;
+  }
+
+  jsc_cache* writer = jsc_cache_init(0, directory);
+  jsc_cache* reader = jsc_cache_init(0, directory);
+  jsc_cache_blob mapped;
+
+  jsc_cache_store(writer, &key_a, blob, sizeof(blob));
+
+  bool acquired = jsc_cache_acquire(reader, &key_a, &mapped);
+  bool shared = acquired && mapped.size == sizeof(blob) && mapped.mapping &&
+                memcmp(mapped.data, blob, sizeof(blob)) == 0 &&
+                reader->stats.disk_hits == 1;
+
+  if (acquired)
+  {
+    jsc_cache_release(&mapped);
+  }
+
+  /* key_b was never published to the directory */
+  bool unpublished = !jsc_cache_acquire(reader, &key_b, &mapped);
+
+  if (!unpublished)
+  {
+    jsc_cache_release(&mapped);
+  }
+
+  /* a blob too large for the memory tier of small comes back as a miss */
+  jsc_cache* small = jsc_cache_init(sizeof(blob) / 2, directory);
+  bool too_large = small && !jsc_cache_lookup(small, &key_a, &size) &&
+                   small->stats.disk_hits == 0 && small->stats.misses == 1;
+
+  if (!shared)
+  {
+    printf("jsc_cache_acquire shared directory\n");
+  }
+  else if (!unpublished || reader->stats.misses != 1 ||
+           reader->stats.hits != 0)
+  {
+    printf("jsc_cache_acquire of an unpublished key\n");
+  }
+  else if (!too_large)
+  {
+    printf("jsc_cache_lookup of a blob larger than the memory tier\n");
+  }
+  else
+  {
+    printf("cache tests completed...\n");
+  }
+
+  jsc_cache_free(writer);
+  jsc_cache_free(reader);
+  jsc_cache_free(small);
+  remove_flat_directory(directory);
+}
 
 void test_bytecode_basic()
 {
@@ -628,13 +796,2552 @@ void test_tokenize()
   tokenize_and_print(js_func_control_flow, "function with control flow");
 }
 
-int main()
+static uint32_t compile_with_workers(const char* source, uint32_t flags,
+                                     uint16_t workers, uint8_t** out_buffer)
+{
+  jsc_engine_context* ctx = jsc_engine_init("JSCParallel");
+  uint32_t size = 0;
+
+  ctx->flags = flags;
+  ctx->worker_count = workers;
+
+  if (!jsc_engine_compile_to_buffer(ctx, source, out_buffer, &size))
+  {
+    size = 0;
+  }
+
+  jsc_engine_free(ctx);
+
+  return size;
+}
+
+void test_parallel_functions()
+{
+  printf("testing parallel function compilation...\n");
+
+  char source[1 << 14] = "let base = 'x';";
+
+  for (int i = 0; i < 64; i++)
+  {
+    char function[1 << 8];
+    sprintf(function,
+            "function f%d(a, b) { let s = 'f%d'; if (a > b) { return base; }"
+            " return s; }",
+            i, i);
+    strcat(source, function);
+  }
+
+  strcat(source, "let r = f3(1, 2);");
+
+  uint8_t* serial = NULL;
+  uint8_t* one = NULL;
+  uint8_t* many = NULL;
+
+  uint32_t serial_size = compile_with_workers(source, 0, 0, &serial);
+  uint32_t one_size = compile_with_workers(
+      source, JSC_ENGINE_FLAG_PARALLEL_FUNCTIONS, 1, &one);
+  uint32_t many_size = compile_with_workers(
+      source, JSC_ENGINE_FLAG_PARALLEL_FUNCTIONS, 8, &many);
+
+  if (serial_size == 0 || one_size == 0 || many_size == 0)
+  {
+    printf("parallel compilation failed\n");
+  }
+  else if (one_size != many_size || memcmp(one, many, one_size) != 0)
+  {
+    printf("parallel compilation is not deterministic\n");
+  }
+  else
+  {
+    printf("parallel function tests completed...\n");
+  }
+
+  free(serial);
+  free(one);
+  free(many);
+}
+
+/* the error compiling source with flags reports, or NULL if it compiles */
+static char* compile_error(const char* source, uint32_t flags)
+{
+  jsc_engine_context* ctx = jsc_engine_init("JSCErrors");
+  uint8_t* data = NULL;
+  uint32_t size = 0;
+  char* error = NULL;
+
+  ctx->flags = flags;
+
+  if (!jsc_engine_compile_to_buffer(ctx, source, &data, &size))
+  {
+    error = strdup(ctx->error_message ? ctx->error_message : "?");
+  }
+
+  free(data);
+  jsc_engine_free(ctx);
+  return error;
+}
+
+/* whether compiling source with flags fails as it does without */
+static bool same_compile_error(const char* source, uint32_t flags)
+{
+  char* expected = compile_error(source, 0);
+  char* error = compile_error(source, flags);
+  bool same = expected && error && strcmp(error, expected) == 0;
+
+  if (!same)
+  {
+    printf("%s: expected \"%s\" with flags %u, got \"%s\"\n", source,
+           expected ? expected : "an error", flags, error ? error : "none");
+  }
+
+  free(expected);
+  free(error);
+  return same;
+}
+
+void test_deferred_errors()
+{
+  printf("testing errors in skipped functions...\n");
+
+  /* skipping or dropping a function must reject, and report, what parsing
+     it would */
+  const char* sources[] = {";function f(a,",
+                           "var x=1;function f(a,",
+                           "function f(a b) { return a; }",
+                           "function f(a) { return a;",
+                           "const c = 1; c = 2; function f() { return 1; }",
+                           "let y = ; function f() {} function g() {}"};
+  const uint32_t flags[] = {JSC_ENGINE_FLAG_PARALLEL_FUNCTIONS,
+                            JSC_ENGINE_FLAG_LAZY_FUNCTIONS,
+                            JSC_ENGINE_FLAG_DROP_UNUSED};
+  /* lazy bodies are only compiled when first called */
+  const char* bodies[] = {"function f() { let = 1; }",
+                          "function f() { return 1 +; } f;",
+                          "function f() { function g( {} }"};
+  const uint32_t body_flags[] = {JSC_ENGINE_FLAG_PARALLEL_FUNCTIONS,
+                                 JSC_ENGINE_FLAG_DROP_UNUSED};
+  bool ok = true;
+
+  for (size_t i = 0; ok && i < sizeof(sources) / sizeof(*sources); i++)
+  {
+    for (size_t j = 0; ok && j < sizeof(flags) / sizeof(*flags); j++)
+    {
+      ok = same_compile_error(sources[i], flags[j]);
+    }
+  }
+
+  for (size_t i = 0; ok && i < sizeof(bodies) / sizeof(*bodies); i++)
+  {
+    for (size_t j = 0; ok && j < sizeof(body_flags) / sizeof(*body_flags);
+         j++)
+    {
+      ok = same_compile_error(bodies[i], body_flags[j]);
+    }
+  }
+
+  if (ok)
+  {
+    printf("deferred error tests completed...\n");
+  }
+}
+
+static bool class_has_utf8(const uint8_t* data, uint32_t size,
+                           const char* value)
+{
+  size_t length = strlen(value);
+
+  for (uint32_t i = 0; i + 3 + length <= size; i++)
+  {
+    if (data[i] == 1 && data[i + 1] == (length >> 8) &&
+        data[i + 2] == (length & 0xFF) &&
+        memcmp(&data[i + 3], value, length) == 0)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void test_direct_calls()
+{
+  printf("testing direct calls...\n");
+
+  const char* direct = "function add(a, b) { return add(b, a); }"
+                       "let r = add(1, 2); let s = add(r); let t = add(1, 2, 3);";
+  const char* rebound = "function add(a, b) { return a; }"
+                        "let r = add(1, 2); add = r;";
+
+  uint8_t* direct_class = NULL;
+  uint8_t* rebound_class = NULL;
+  uint32_t direct_size = compile_with_workers(direct, 0, 0, &direct_class);
+  uint32_t rebound_size = compile_with_workers(rebound, 0, 0, &rebound_class);
+
+  if (direct_size == 0 || rebound_size == 0)
+  {
+    printf("direct call programs failed to compile\n");
+  }
+  else if (class_has_utf8(direct_class, direct_size, "invoke"))
+  {
+    printf("statically resolvable call went through invoke\n");
+  }
+  else if (!class_has_utf8(rebound_class, rebound_size, "invoke"))
+  {
+    printf("rebound function was called directly\n");
+  }
+  else
+  {
+    printf("direct call tests completed...\n");
+  }
+
+  free(direct_class);
+  free(rebound_class);
+}
+
+void test_invokedynamic()
+{
+  printf("testing invokedynamic call sites...\n");
+
+  /* f is rebound, so calls to it are dynamic, also inside a parallel body */
+  const char* source = "function f(a) { return a; }"
+                       "function g(a) { return f(a); }"
+                       "let r = f(1); f = g; r = g(r);";
+  uint32_t flags =
+      JSC_ENGINE_FLAG_INVOKEDYNAMIC | JSC_ENGINE_FLAG_PARALLEL_FUNCTIONS;
+
+  uint8_t* one = NULL;
+  uint8_t* many = NULL;
+  uint8_t* runtime = NULL;
+  uint32_t one_size = compile_with_workers(source, flags, 1, &one);
+  uint32_t many_size = compile_with_workers(source, flags, 8, &many);
+  uint32_t runtime_size = jsc_runtime_build(&runtime);
+
+  if (one_size == 0 || many_size == 0 || runtime_size == 0)
+  {
+    printf("invokedynamic compilation failed\n");
+  }
+  else if (one_size != many_size || memcmp(one, many, one_size) != 0)
+  {
+    printf("invokedynamic compilation is not deterministic\n");
+  }
+  else if (one[7] < 51 || !class_has_utf8(one, one_size, "BootstrapMethods") ||
+           !class_has_utf8(one, one_size, JSC_RUNTIME_CLASS) ||
+           class_has_utf8(one, one_size, "invoke"))
+  {
+    printf("dynamic call did not use invokedynamic\n");
+  }
+  else
+  {
+    printf("invokedynamic tests completed...\n");
+  }
+
+  free(one);
+  free(many);
+  free(runtime);
+}
+
+void test_bytecode_invokedynamic()
+{
+  printf("testing invokedynamic bytecode...\n");
+
+  jsc_bytecode_context* state = jsc_bytecode_create_class(
+      "Indy", "java/lang/Object", JSC_ACC_PUBLIC | JSC_ACC_SUPER);
+  jsc_method* method = jsc_bytecode_create_method(
+      state, "concat", "(Ljava/lang/Object;)Ljava/lang/String;",
+      JSC_ACC_PUBLIC | JSC_ACC_STATIC, 1, 1);
+
+  uint16_t handle = jsc_bytecode_add_method_handle(
+      state, JSC_REF_INVOKE_STATIC, "java/lang/invoke/StringConcatFactory",
+      "makeConcatWithConstants",
+      "(Ljava/lang/invoke/MethodHandles$Lookup;Ljava/lang/String;"
+      "Ljava/lang/invoke/MethodType;Ljava/lang/String;[Ljava/lang/Object;)"
+      "Ljava/lang/invoke/CallSite;");
+  uint16_t arguments[] = {jsc_bytecode_add_string_constant(state, "v=\1"),
+                          jsc_bytecode_add_method_type(state, "()V")};
+  int32_t bootstrap =
+      jsc_bytecode_add_bootstrap_method(state, handle, arguments, 2);
+
+  jsc_bytecode_emit(state, method, JSC_JVM_ALOAD_0);
+  jsc_bytecode_emit_invokedynamic(state, method, (uint16_t)bootstrap,
+                                  "makeConcatWithConstants",
+                                  "(Ljava/lang/Object;)Ljava/lang/String;");
+  jsc_bytecode_emit(state, method, JSC_JVM_ARETURN);
+
+  uint8_t* buffer = NULL;
+  jsc_bytecode_set_version(state, 49, 0);
+  uint32_t old_size = jsc_bytecode_write(state, &buffer);
+  jsc_bytecode_set_version(state, 51, 0);
+  uint32_t size = jsc_bytecode_write(state, &buffer);
+
+  if (handle == 0 || bootstrap != 0 ||
+      jsc_bytecode_add_bootstrap_method(state, handle, arguments, 2) != 0 ||
+      jsc_bytecode_add_method_type(state, "()V") != arguments[1])
+  {
+    printf("invokedynamic constants are not shared\n");
+  }
+  else if (old_size != 0)
+  {
+    printf("invokedynamic written to a version 49 class\n");
+  }
+  else if (size == 0 || !class_has_utf8(buffer, size, "BootstrapMethods") ||
+           jsc_bytecode_get_method_code_length(method) != 7)
+  {
+    printf("invokedynamic class is malformed\n");
+  }
+  else
+  {
+    printf("invokedynamic bytecode tests completed...\n");
+  }
+
+  free(buffer);
+  jsc_bytecode_free(state);
+}
+
+void test_string_concat()
+{
+  printf("testing string concatenation...\n");
+
+  const char* mixed = "let x = 1; let s = x + 'a' + x + 'b';";
+  const char* literal = "let s = 'a' + 'b' + 'c';";
+
+  uint8_t* mixed_class = NULL;
+  uint8_t* literal_class = NULL;
+  uint32_t mixed_size = compile_with_workers(
+      mixed, JSC_ENGINE_FLAG_STRING_CONCAT, 0, &mixed_class);
+  uint32_t literal_size = compile_with_workers(
+      literal, JSC_ENGINE_FLAG_STRING_CONCAT, 0, &literal_class);
+
+  if (mixed_size == 0 || literal_size == 0)
+  {
+    printf("string concatenation failed to compile\n");
+  }
+  else if (mixed_class[7] < 53 ||
+           !class_has_utf8(mixed_class, mixed_size, "\1a\1b") ||
+           !class_has_utf8(mixed_class, mixed_size, "makeConcatWithConstants"))
+  {
+    printf("chain was not lowered to one concatenation\n");
+  }
+  else if (!class_has_utf8(literal_class, literal_size, "abc") ||
+           class_has_utf8(literal_class, literal_size, "BootstrapMethods"))
+  {
+    printf("literal chain was not folded\n");
+  }
+  else
+  {
+    printf("string concatenation tests completed...\n");
+  }
+
+  free(mixed_class);
+  free(literal_class);
+}
+
+static bool class_has_bytes(const uint8_t* data, uint32_t size,
+                            const uint8_t* bytes, uint32_t length)
+{
+  for (uint32_t i = 0; i + length <= size; i++)
+  {
+    if (memcmp(&data[i], bytes, length) == 0)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/* the listing jsc_bytecode_disassemble prints for a class, NULL when that
+   fails; with strip_pcs the offset in front of each instruction is left
+   out, so tests match opcode sequences rather than where code landed */
+static char* disassemble_listing(const uint8_t* data, uint32_t size,
+                                 uint32_t flags, bool strip_pcs)
+{
+  char* listing = NULL;
+  size_t listing_size = 0;
+  FILE* out = open_memstream(&listing, &listing_size);
+  bool printed =
+      size > 0 && out && jsc_bytecode_disassemble(data, size, out, flags);
+
+  if (out)
+  {
+    fclose(out);
+  }
+
+  if (!printed)
+  {
+    free(listing);
+    return NULL;
+  }
+
+  char* to = listing;
+  const char* from = listing;
+
+  while (strip_pcs && *from)
+  {
+    const char* text = from + strspn(from, " ");
+    const char* digits = text;
+
+    while (isdigit((unsigned char)*text))
+    {
+      text++;
+    }
+
+    /* switch cases are digits too, but followed by their target */
+    if (text > digits && text[0] == ':' && text[1] == ' ' &&
+        islower((unsigned char)text[2]))
+    {
+      from = text + 2;
+    }
+
+    while (*from && *from != '\n')
+    {
+      *to++ = *from++;
+    }
+
+    if (*from)
+    {
+      *to++ = *from++;
+    }
+  }
+
+  if (strip_pcs)
+  {
+    *to = '\0';
+  }
+
+  return listing;
+}
+
+/* the part of listing for method name, up to the next method */
+static char* listing_method(const char* listing, const char* name)
+{
+  char header[300];
+  snprintf(header, sizeof(header), "\nmethod %s (", name);
+
+  const char* start = listing ? strstr(listing, header) : NULL;
+  const char* end = start ? strstr(start + 1, "\nmethod ") : NULL;
+
+  return !start ? NULL
+         : end  ? strndup(start, (size_t)(end - start))
+                : strdup(start);
+}
+
+/* the first of expected that listing lacks, "listing" without a listing,
+   NULL when all are there */
+static const char* listing_lacks(const char* listing,
+                                 const char* const* expected, size_t count)
+{
+  if (!listing)
+  {
+    return "listing";
+  }
+
+  for (size_t i = 0; i < count; i++)
+  {
+    if (!strstr(listing, expected[i]))
+    {
+      return expected[i];
+    }
+  }
+
+  return NULL;
+}
+
+/* the first of sources that compiles although it should be rejected */
+static const char* first_compiled(const char* const* sources, size_t count)
 {
+  const char* accepted = NULL;
+
+  for (size_t i = 0; !accepted && i < count; i++)
+  {
+    uint8_t* data = NULL;
+
+    if (compile_with_workers(sources[i], 0, 0, &data) > 0)
+    {
+      accepted = sources[i];
+    }
+
+    free(data);
+  }
+
+  return accepted;
+}
+
+void test_stack_map()
+{
+  printf("testing stack map frames...\n");
+
+  jsc_bytecode_context* state = jsc_bytecode_create_class(
+      "Frames", "java/lang/Object", JSC_ACC_PUBLIC | JSC_ACC_SUPER);
+  jsc_method* pick = jsc_bytecode_create_method(
+      state, "pick", "(I)I", JSC_ACC_PUBLIC | JSC_ACC_STATIC, 1, 1);
+
+  /* return a != 0 ? 1 : 0, followed by code nothing branches to */
+  jsc_bytecode_emit(state, pick, JSC_JVM_ILOAD_0);
+  jsc_bytecode_emit_jump(state, pick, JSC_JVM_IFEQ, 7);
+  jsc_bytecode_emit(state, pick, JSC_JVM_ICONST_1);
+  jsc_bytecode_emit_jump(state, pick, JSC_JVM_GOTO, 4);
+  jsc_bytecode_emit(state, pick, JSC_JVM_ICONST_0);
+  jsc_bytecode_emit(state, pick, JSC_JVM_IRETURN);
+  jsc_bytecode_emit(state, pick, JSC_JVM_ICONST_2);
+  jsc_bytecode_emit(state, pick, JSC_JVM_IRETURN);
+
+  /* for (long i = 0;; i++), created after pick since methods move */
+  jsc_method* loop = jsc_bytecode_create_method(
+      state, "loop", "()V", JSC_ACC_PUBLIC | JSC_ACC_STATIC, 4, 2);
+
+  jsc_bytecode_emit(state, loop, JSC_JVM_LCONST_0);
+  jsc_bytecode_emit(state, loop, JSC_JVM_LSTORE_0);
+  jsc_bytecode_emit(state, loop, JSC_JVM_LLOAD_0);
+  jsc_bytecode_emit(state, loop, JSC_JVM_LCONST_1);
+  jsc_bytecode_emit(state, loop, JSC_JVM_LADD);
+  jsc_bytecode_emit(state, loop, JSC_JVM_LSTORE_0);
+  jsc_bytecode_emit_jump(state, loop, JSC_JVM_GOTO, -4);
+
+  uint8_t* buffer = NULL;
+  uint32_t size = jsc_bytecode_write(state, &buffer);
+
+  /* stacks of different depths merging at 5 cannot be typed */
+  jsc_bytecode_context* untyped = jsc_bytecode_create_class(
+      "Untyped", "java/lang/Object", JSC_ACC_PUBLIC | JSC_ACC_SUPER);
+  jsc_method* merge = jsc_bytecode_create_method(
+      untyped, "merge", "(I)V", JSC_ACC_PUBLIC | JSC_ACC_STATIC, 2, 1);
+
+  jsc_bytecode_emit(untyped, merge, JSC_JVM_ILOAD_0);
+  jsc_bytecode_emit_jump(untyped, merge, JSC_JVM_IFEQ, 4);
+  jsc_bytecode_emit(untyped, merge, JSC_JVM_ICONST_1);
+  jsc_bytecode_emit(untyped, merge, JSC_JVM_RETURN);
+
+  uint8_t* untyped_buffer = NULL;
+  uint32_t untyped_size = jsc_bytecode_write(untyped, &untyped_buffer);
+
+  char* listing = disassemble_listing(buffer, size, JSC_DISASSEMBLE_CODE,
+                                      true);
+  char* pick_code = listing_method(listing, "pick");
+
+  /* same at 8, same_locals_1_stack_item int at 9, nop athrow at 10 */
+  const uint8_t pick_frames[] = {0x00, 0x00, 0x00, 0x0F, 0x00, 0x03,
+                                 0x08, 0x40, 0x01, 0xFF, 0x00, 0x00};
+  /* append one long at 2 */
+  const uint8_t loop_frames[] = {0x00, 0x00, 0x00, 0x06, 0x00,
+                                 0x01, 0xFC, 0x00, 0x02, 0x04};
+
+  if (size == 0 || buffer[7] != 52)
+  {
+    printf("class with frames failed to write\n");
+  }
+  else if (!pick_code || strstr(pick_code, "iconst_2") ||
+           !strstr(pick_code, "iconst_0\nireturn\nnop\nathrow\n"))
+  {
+    printf("unreachable code was not replaced:\n%s",
+           pick_code ? pick_code : "");
+  }
+  else if (!class_has_bytes(buffer, size, pick_frames, sizeof(pick_frames)) ||
+           !class_has_bytes(buffer, size, loop_frames, sizeof(loop_frames)))
+  {
+    printf("stack map frames are wrong\n");
+  }
+  else if (untyped_size != 0)
+  {
+    printf("class with a method that cannot be typed was written\n");
+  }
+  else
+  {
+    printf("stack map tests completed...\n");
+  }
+
+  free(pick_code);
+  free(listing);
+  free(buffer);
+  free(untyped_buffer);
+  jsc_bytecode_free(state);
+  jsc_bytecode_free(untyped);
+}
+
+void test_dynamic_arithmetic()
+{
+  printf("testing dynamic arithmetic...\n");
+
+  const char* source =
+      "function f(a, b) { return -(a + b) * (a - b) / a % b; }";
+
+  uint8_t* class_file = NULL;
+  uint32_t size = compile_with_workers(source, 0, 0, &class_file);
+  char* listing =
+      disassemble_listing(class_file, size, JSC_DISASSEMBLE_CODE, true);
+
+  const char* expected[] = {"jsc/JSCRuntime.add", "jsc/JSCRuntime.arithmetic"};
+  const char* int_ops[] = {"\niadd", "\nisub", "\nimul",
+                           "\nidiv", "\nirem", "\nineg"};
+  bool int_arithmetic = false;
+
+  for (size_t i = 0; listing && i < sizeof(int_ops) / sizeof(*int_ops); i++)
+  {
+    int_arithmetic = int_arithmetic || strstr(listing, int_ops[i]);
+  }
+
+  if (!listing)
+  {
+    printf("dynamic arithmetic failed to compile\n");
+  }
+  else if (listing_lacks(listing, expected,
+                         sizeof(expected) / sizeof(*expected)) ||
+           !class_has_utf8(class_file, size, "StackMapTable"))
+  {
+    printf("arithmetic on values does not go through the runtime\n");
+  }
+  else if (int_arithmetic)
+  {
+    printf("int arithmetic is applied to boxed values:\n%s", listing);
+  }
+  else
+  {
+    printf("dynamic arithmetic tests completed...\n");
+  }
+
+  free(listing);
+  free(class_file);
+}
+
+void test_max_stack()
+{
+  printf("testing max_stack and max_locals...\n");
+
+  jsc_bytecode_context* state = jsc_bytecode_create_class(
+      "Maxs", "java/lang/Object", JSC_ACC_PUBLIC | JSC_ACC_SUPER);
+  jsc_method* method = jsc_bytecode_create_method(
+      state, "max", "(JJ)J", JSC_ACC_PUBLIC | JSC_ACC_STATIC, 100, 100);
+
+  jsc_bytecode_emit(state, method, JSC_JVM_LLOAD_0);
+  jsc_bytecode_emit(state, method, JSC_JVM_LLOAD_2);
+  jsc_bytecode_emit_invoke_static(state, method, "java/lang/Math", "max",
+                                  "(JJ)J");
+  jsc_bytecode_emit(state, method, JSC_JVM_LRETURN);
+
+  uint8_t* buffer = NULL;
+  uint32_t size = jsc_bytecode_write(state, &buffer);
+
+  /* two longs on the stack, two in the locals */
+  const uint8_t header[] = {0x00, 0x04, 0x00, 0x04, 0x00, 0x00,
+                            0x00, 0x06, 0x1E, 0x20, 0xB8};
+
+  if (size == 0 || !class_has_bytes(buffer, size, header, sizeof(header)))
+  {
+    printf("max_stack and max_locals were not recomputed\n");
+  }
+  else
+  {
+    printf("max_stack tests completed...\n");
+  }
+
+  free(buffer);
+  jsc_bytecode_free(state);
+}
+
+void test_peephole()
+{
+  printf("testing peephole optimization...\n");
+
+  jsc_bytecode_context* state = jsc_bytecode_create_class(
+      "Peephole", "java/lang/Object", JSC_ACC_PUBLIC | JSC_ACC_SUPER);
+  jsc_method* method = jsc_bytecode_create_method(
+      state, "pick", "(I)I", JSC_ACC_PUBLIC | JSC_ACC_STATIC, 100, 100);
+
+  /* 0: ifeq to a goto; 4: nop and a store/load pair returned; 9: a goto to
+     the next instruction; 15: a box unboxed and a box popped; 36: dead
+     code */
+  jsc_bytecode_emit(state, method, JSC_JVM_ILOAD_0);
+  jsc_bytecode_emit_jump(state, method, JSC_JVM_IFEQ, 11);
+  jsc_bytecode_emit(state, method, JSC_JVM_NOP);
+  jsc_bytecode_emit(state, method, JSC_JVM_ILOAD_0);
+  jsc_bytecode_emit(state, method, JSC_JVM_ISTORE_1);
+  jsc_bytecode_emit(state, method, JSC_JVM_ILOAD_1);
+  jsc_bytecode_emit(state, method, JSC_JVM_IRETURN);
+  jsc_bytecode_emit_jump(state, method, JSC_JVM_GOTO, 3);
+  jsc_bytecode_emit_jump(state, method, JSC_JVM_GOTO, 3);
+  jsc_bytecode_emit_load_constant_int_boxed(state, method, 2);
+  jsc_bytecode_emit_invoke_virtual(state, method, "java/lang/Integer",
+                                   "intValue", "()I");
+  jsc_bytecode_emit_load_constant_double_boxed(state, method, 1.0);
+  jsc_bytecode_emit(state, method, JSC_JVM_POP);
+  jsc_bytecode_emit(state, method, JSC_JVM_IRETURN);
+  jsc_bytecode_emit(state, method, JSC_JVM_ICONST_0);
+  jsc_bytecode_emit(state, method, JSC_JVM_IRETURN);
+
+  bool optimized = jsc_bytecode_optimize_method(state, method);
+
+  uint8_t* buffer = NULL;
+  uint32_t size = jsc_bytecode_write(state, &buffer);
+
+  /* the ifeq lands on the unboxed constant; the store, folded into a dup,
+     is never read and goes with it */
+  const uint8_t code[] = {0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00,
+                          0x08, 0x1A, 0x99, 0x00, 0x05, 0x1A, 0xAC,
+                          0x05, 0xAC, 0x00, 0x00};
+
+  if (!optimized || size == 0 ||
+      !class_has_bytes(buffer, size, code, sizeof(code)))
+  {
+    printf("peephole optimization did not produce the expected code\n");
+  }
+  else
+  {
+    printf("peephole tests completed...\n");
+  }
+
+  free(buffer);
+  jsc_bytecode_free(state);
+}
+
+void test_wide_branches()
+{
+  printf("testing branch relaxation...\n");
+
+  jsc_bytecode_context* state = jsc_bytecode_create_class(
+      "Wide", "java/lang/Object", JSC_ACC_PUBLIC | JSC_ACC_SUPER);
+  jsc_method* method = jsc_bytecode_create_method(
+      state, "spin", "(I)I", JSC_ACC_PUBLIC | JSC_ACC_STATIC, 100, 100);
+  int32_t top = jsc_bytecode_new_label(state);
+  int32_t done = jsc_bytecode_new_label(state);
+
+  /* a loop whose body is longer than a 16-bit branch reaches */
+  jsc_bytecode_place_label(state, method, top);
+  jsc_bytecode_emit(state, method, JSC_JVM_ILOAD_0);
+  jsc_bytecode_emit_branch(state, method, JSC_JVM_IFEQ, done);
+
+  for (uint32_t i = 0; i < 17000; i++)
+  {
+    jsc_bytecode_emit(state, method, JSC_JVM_ICONST_0);
+    jsc_bytecode_emit(state, method, JSC_JVM_POP);
+  }
+
+  jsc_bytecode_emit_branch(state, method, JSC_JVM_GOTO, top);
+  jsc_bytecode_place_label(state, method, done);
+  jsc_bytecode_emit(state, method, JSC_JVM_ICONST_1);
+  jsc_bytecode_emit(state, method, JSC_JVM_IRETURN);
+
+  uint8_t* buffer = NULL;
+  uint32_t size = jsc_bytecode_write(state, &buffer);
+
+  /* ifne over a goto_w forward to done, and a goto_w back to top */
+  const uint8_t exit[] = {0x1A, 0x9A, 0x00, 0x08, 0xC8, 0x00,
+                          0x00, 0x84, 0xDA, 0x03, 0x57};
+  const uint8_t loop[] = {0x57, 0xC8, 0xFF, 0xFF, 0x7B, 0x27, 0x04, 0xAC};
+
+  if (size == 0 || !class_has_bytes(buffer, size, exit, sizeof(exit)) ||
+      !class_has_bytes(buffer, size, loop, sizeof(loop)))
+  {
+    printf("far branches were not relaxed to goto_w\n");
+  }
+  else
+  {
+    printf("branch relaxation tests completed...\n");
+  }
+
+  free(buffer);
+  jsc_bytecode_free(state);
+}
+
+void test_method_splitting()
+{
+  printf("testing top-level method splitting...\n");
+
+  /* about ten bytes per statement, twice the limit of main */
+  size_t capacity = 1 << 16;
+  char* source = (char*)malloc(capacity);
+  size_t length = 0;
+
+  for (int i = 0; source && i < 1600; i++)
+  {
+    length += snprintf(source + length, capacity - length, "let v%d = %d; ",
+                       i, i);
+  }
+
+  uint8_t* class_data = NULL;
+  uint32_t size =
+      source ? compile_with_workers(source, 0, 0, &class_data) : 0;
+
+  if (size == 0)
+  {
+    printf("large program failed to compile\n");
+  }
+  else if (!class_has_utf8(class_data, size, "main$0") ||
+           !class_has_utf8(class_data, size, "main$1") ||
+           class_has_utf8(class_data, size, "main$2"))
+  {
+    printf("top-level code was not split into main$0 and main$1\n");
+  }
+  else
+  {
+    printf("method splitting tests completed...\n");
+  }
+
+  free(class_data);
+  free(source);
+}
+
+void test_class_writer()
+{
+  printf("testing class writer...\n");
+
+  jsc_bytecode_context* state = jsc_bytecode_create_class(
+      "Writer", "java/lang/Object", JSC_ACC_PUBLIC | JSC_ACC_SUPER);
+  jsc_method* method = jsc_bytecode_create_method(
+      state, "text", "()Ljava/lang/String;", JSC_ACC_PUBLIC | JSC_ACC_STATIC,
+      1, 0);
+
+  /* long enough to be written from the pool in place */
+  const char* text = "a constant well past the size at which the writer "
+                     "stops copying bytes into its scratch area";
+
+  jsc_bytecode_emit_u16(state, method, JSC_JVM_LDC_W,
+                        jsc_bytecode_add_string_constant(state, text));
+  jsc_bytecode_emit(state, method, JSC_JVM_ARETURN);
+
+  uint8_t* expected = NULL;
+  uint32_t size = jsc_bytecode_write(state, &expected);
+
+  jsc_class_writer writer;
+  jsc_class_writer_init(&writer);
+
+  uint8_t* buffer = NULL;
+  uint32_t capacity = 0;
+  bool same = size > 0;
+
+  /* the second pass reuses the writer and the buffer */
+  for (int pass = 0; same && pass < 2; pass++)
+  {
+    same = jsc_bytecode_write_buffer(state, &writer, &buffer, &capacity) ==
+               size &&
+           capacity == size && memcmp(buffer, expected, size) == 0;
+  }
+
+  FILE* file = tmpfile();
+  uint8_t* written = (uint8_t*)malloc(size + 1);
+
+  if (!same || !class_has_utf8(expected, size, text))
+  {
+    printf("buffered class differs from jsc_bytecode_write\n");
+  }
+  else if (!file || !written || !jsc_class_writer_writev(&writer, fileno(file)))
+  {
+    printf("class writev failed\n");
+  }
+  else if (fseek(file, 0, SEEK_SET) != 0 ||
+           fread(written, 1, size + 1, file) != size ||
+           memcmp(written, expected, size) != 0)
+  {
+    printf("written class differs from jsc_bytecode_write\n");
+  }
+  else
+  {
+    printf("class writer tests completed...\n");
+  }
+
+  if (file)
+  {
+    fclose(file);
+  }
+
+  free(written);
+  free(buffer);
+  free(expected);
+  jsc_class_writer_free(&writer);
+  jsc_bytecode_free(state);
+}
+
+/* xorshift32, so every run fuzzes the same classes */
+static uint32_t fuzz_next(uint32_t* state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+/* a class of random constants, fields and branching methods */
+static jsc_bytecode_context* fuzz_class(uint32_t* seed)
+{
+  static const char* descriptors[] = {"I", "J", "D", "Ljava/lang/Object;"};
+  jsc_bytecode_context* state = jsc_bytecode_create_class(
+      "Fuzz", "java/lang/Object", JSC_ACC_PUBLIC | JSC_ACC_SUPER);
+  char name[16];
+  char text[128];
+
+  for (uint32_t i = fuzz_next(seed) % 4; i > 0; i--)
+  {
+    snprintf(name, sizeof(name), "f%u", i);
+    jsc_bytecode_add_field(state, name, descriptors[fuzz_next(seed) % 4],
+                           JSC_ACC_STATIC);
+  }
+
+  for (uint32_t i = 1 + fuzz_next(seed) % 4; i > 0; i--)
+  {
+    snprintf(name, sizeof(name), "m%u", i);
+    jsc_method* method = jsc_bytecode_create_method(
+        state, name, "()V", JSC_ACC_PUBLIC | JSC_ACC_STATIC, 0, 0);
+
+    for (uint32_t j = 1 + fuzz_next(seed) % 12; j > 0; j--)
+    {
+      switch (fuzz_next(seed) % 4)
+      {
+      case 0:
+        jsc_bytecode_emit_load_constant_int(state, method,
+                                            (int32_t)fuzz_next(seed));
+        jsc_bytecode_emit(state, method, JSC_JVM_POP);
+        break;
+      case 1:
+      {
+        uint32_t length = fuzz_next(seed) % (sizeof(text) - 1);
+
+        for (uint32_t k = 0; k < length; k++)
+        {
+          text[k] = (char)('a' + fuzz_next(seed) % 26);
+        }
+
+        text[length] = '\0';
+        jsc_bytecode_emit_load_constant_string(state, method, text);
+        jsc_bytecode_emit(state, method, JSC_JVM_POP);
+        break;
+      }
+      case 2:
+        jsc_bytecode_emit_load_constant_long(
+            state, method,
+            (int64_t)(((uint64_t)fuzz_next(seed) << 32) | fuzz_next(seed)));
+        jsc_bytecode_emit(state, method, JSC_JVM_POP2);
+        break;
+      default:
+      {
+        int32_t skip = jsc_bytecode_new_label(state);
+
+        jsc_bytecode_emit_load_constant_int(state, method,
+                                            (int32_t)(fuzz_next(seed) % 3));
+        jsc_bytecode_emit_branch(state, method, JSC_JVM_IFEQ, skip);
+        jsc_bytecode_emit_load_constant_double(state, method,
+                                               fuzz_next(seed) / 7.0);
+        jsc_bytecode_emit(state, method, JSC_JVM_POP2);
+        jsc_bytecode_place_label(state, method, skip);
+        break;
+      }
+      }
+    }
+
+    jsc_bytecode_emit(state, method, JSC_JVM_RETURN);
+  }
+
+  return state;
+}
+
+/* the reader sees what the context holds */
+static bool class_reader_matches(const jsc_class_reader* reader,
+                                 jsc_bytecode_context* state)
+{
+  if (reader->constant_pool_count != state->constant_pool_count ||
+      reader->field_count != state->field_count ||
+      reader->method_count != state->method_count)
+  {
+    return false;
+  }
+
+  for (uint16_t i = 1; i < state->constant_pool_count; i++)
+  {
+    const jsc_constant_pool_entry* entry = &state->constant_pool[i];
+    uint16_t length;
+    const char* bytes;
+
+    if (entry->tag == JSC_CP_UTF8 &&
+        (!(bytes = jsc_class_reader_utf8(reader, i, &length)) ||
+         length != entry->utf8_info.length ||
+         memcmp(bytes, entry->utf8_info.bytes, length) != 0))
+    {
+      return false;
+    }
+  }
+
+  for (uint16_t i = 0; i < state->method_count; i++)
+  {
+    jsc_method* method = &state->methods[i];
+    jsc_class_member_view view;
+    jsc_class_attribute_view code;
+    uint32_t code_length = jsc_bytecode_get_method_code_length(method);
+
+    if (!jsc_class_reader_method(reader, i, &view) ||
+        view.name_index != method->name_index ||
+        !jsc_class_reader_find_attribute(reader, view.attributes,
+                                         view.attribute_count, "Code",
+                                         &code) ||
+        code.length < 8 + code_length ||
+        memcmp(code.info + 8, jsc_bytecode_get_method_code(method),
+               code_length) != 0)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void test_class_reader()
+{
+  printf("testing class reader...\n");
+
+  uint32_t seed = 0x2545F491;
+  uint32_t rejected = 0;
+  uint32_t cases = 0;
+  const char* failure = NULL;
+
+  for (uint32_t round = 0; !failure && round < 200; round++)
+  {
+    jsc_bytecode_context* state = fuzz_class(&seed);
+    uint8_t* buffer = NULL;
+    uint32_t size = jsc_bytecode_write(state, &buffer);
+    jsc_class_reader reader;
+
+    if (size == 0)
+    {
+      failure = "fuzzed class failed to write";
+    }
+    else if (!jsc_class_reader_init(&reader, buffer, size) ||
+             !jsc_class_reader_validate(&reader))
+    {
+      failure = reader.error;
+    }
+    else if (!class_reader_matches(&reader, state))
+    {
+      failure = "read class differs from the written one";
+    }
+
+    if (size > 0)
+    {
+      jsc_class_reader_free(&reader);
+    }
+
+    /* damaged copies are rejected or read, never read out of bounds */
+    for (uint32_t k = 0; !failure && k < 8; k++, cases++)
+    {
+      uint8_t* damaged = (uint8_t*)malloc(size);
+      uint32_t damaged_size = size;
+
+      memcpy(damaged, buffer, size);
+
+      if (k == 0)
+      {
+        damaged_size = fuzz_next(&seed) % size;
+      }
+      else
+      {
+        for (uint32_t flips = 1 + fuzz_next(&seed) % 4; flips > 0; flips--)
+        {
+          damaged[fuzz_next(&seed) % size] ^= (uint8_t)(1 + fuzz_next(&seed));
+        }
+      }
+
+      bool valid = jsc_class_reader_init(&reader, damaged, damaged_size) &&
+                   jsc_class_reader_validate(&reader);
+
+      if (k == 0 && valid)
+      {
+        failure = "truncated class was accepted";
+      }
+
+      rejected += valid ? 0 : 1;
+      jsc_class_reader_free(&reader);
+      free(damaged);
+    }
+
+    free(buffer);
+    jsc_bytecode_free(state);
+  }
+
+  if (failure)
+  {
+    printf("class reader round trip failed: %s\n", failure);
+  }
+  else if (rejected < cases / 2)
+  {
+    printf("only %u of %u damaged classes were rejected\n", rejected, cases);
+  }
+  else
+  {
+    printf("class reader tests completed...\n");
+  }
+}
+
+void test_disassembler()
+{
+  printf("testing disassembler...\n");
+
+  jsc_bytecode_context* state = jsc_bytecode_create_class(
+      "Listing", "java/lang/Object", JSC_ACC_PUBLIC | JSC_ACC_SUPER);
+  jsc_method* method = jsc_bytecode_create_method(
+      state, "pick", "(I)Ljava/lang/String;", JSC_ACC_PUBLIC | JSC_ACC_STATIC,
+      0, 0);
+  int32_t other = jsc_bytecode_new_label(state);
+
+  jsc_bytecode_emit(state, method, JSC_JVM_ILOAD_0);
+  jsc_bytecode_emit_u8(state, method, JSC_JVM_BIPUSH, 42);
+  jsc_bytecode_emit_branch(state, method, JSC_JVM_IF_ICMPNE, other);
+  jsc_bytecode_emit_load_constant_string(state, method, "answer");
+  jsc_bytecode_emit(state, method, JSC_JVM_ARETURN);
+  jsc_bytecode_place_label(state, method, other);
+  jsc_bytecode_emit(state, method, JSC_JVM_ACONST_NULL);
+  jsc_bytecode_emit(state, method, JSC_JVM_ARETURN);
+
+  uint8_t* buffer = NULL;
+  uint32_t size = jsc_bytecode_write(state, &buffer);
+  char* listing = disassemble_listing(
+      buffer, size, JSC_DISASSEMBLE_CODE | JSC_DISASSEMBLE_HISTOGRAM, false);
+
+  /* pcs are kept here, they are part of the format under test */
+  const char* expected[] = {
+      "class Listing extends java/lang/Object",
+      "method pick (I)Ljava/lang/String; flags 0x0009",
+      "  code 11 bytes, max_stack 2, max_locals 1",
+      "      1: bipush 42",
+      "      3: if_icmpne 9",
+      "      6: ldc #", " // String \"answer\"",
+      "    areturn                 2  28.57%",
+      "class histogram (7 instructions):"};
+  const char* missing =
+      listing_lacks(listing, expected, sizeof(expected) / sizeof(*expected));
+
+  if (missing)
+  {
+    printf("disassembly lacks \"%s\":\n%s", missing,
+           listing ? listing : "");
+  }
+  else if (!jsc_bytecode_opcode_name(0xba) ||
+           strcmp(jsc_bytecode_opcode_name(0xba), "invokedynamic") != 0 ||
+           jsc_bytecode_opcode_name(0xff) != NULL)
+  {
+    printf("opcode names are wrong\n");
+  }
+  else
+  {
+    printf("disassembler tests completed...\n");
+  }
+
+  free(listing);
+  free(buffer);
+  jsc_bytecode_free(state);
+}
+
+void test_constant_folding()
+{
+  printf("testing constant folding...\n");
+
+  const char* source = "let n = 7 * 3;"
+                       "const base = 'v' + (2 - 0.5) * 2;"
+                       "const tag = typeof base + (null == 0) + !'';"
+                       "let s = base + '.' + tag;"
+                       "let b = '10' > 9 === 1 < 2;";
+
+  uint8_t* buffer = NULL;
+  uint32_t size = compile_with_workers(source, 0, 0, &buffer);
+  char* listing = disassemble_listing(buffer, size, JSC_DISASSEMBLE_CODE, true);
+
+  const char* expected[] = {"// double 21d", "// String \"v3\"",
+                            "// String \"stringfalsetrue\"",
+                            "// String \"v3.stringfalsetrue\"",
+                            "// Field java/lang/Boolean.TRUE"};
+  const char* missing =
+      listing_lacks(listing, expected, sizeof(expected) / sizeof(*expected));
+
+  /* booleans are the shared Boolean constants; nothing else is read */
+  bool reads_global = false;
+
+  for (const char* at = listing ? strstr(listing, "getstatic") : NULL; at;
+       at = strstr(at + 1, "getstatic"))
+  {
+    reads_global = reads_global ||
+                   strncmp(strstr(at, "// Field ") + 9, "java/lang/Boolean.",
+                           18) != 0;
+  }
+
+  if (missing)
+  {
+    printf("folded class lacks \"%s\":\n%s", missing,
+           listing ? listing : "");
+  }
+  else if (strstr(listing, "mul") || strstr(listing, "add") ||
+           strstr(listing, "Integer") || reads_global)
+  {
+    printf("constant expressions were not folded:\n%s", listing);
+  }
+  else
+  {
+    printf("constant folding tests completed...\n");
+  }
+
+  free(listing);
+  free(buffer);
+}
+
+void test_dead_stores()
+{
+  printf("testing dead stores...\n");
+
+  jsc_bytecode_context* state = jsc_bytecode_create_class(
+      "DeadStores", "java/lang/Object", JSC_ACC_PUBLIC | JSC_ACC_SUPER);
+  jsc_bytecode_add_field(state, "cache", "Ljava/lang/Object;",
+                         JSC_ACC_PRIVATE | JSC_ACC_STATIC);
+  jsc_method* method = jsc_bytecode_create_method(
+      state, "pick", "(Ljava/lang/Object;)Ljava/lang/Object;",
+      JSC_ACC_PUBLIC | JSC_ACC_STATIC, 100, 100);
+
+  /* a store/load pair into a local never read again, the cache or the
+     argument joined at 17, and a box popped there */
+  jsc_bytecode_emit(state, method, JSC_JVM_ALOAD_0);
+  jsc_bytecode_emit(state, method, JSC_JVM_ASTORE_1);
+  jsc_bytecode_emit(state, method, JSC_JVM_ALOAD_1);
+  jsc_bytecode_emit(state, method, JSC_JVM_ASTORE_2);
+  jsc_bytecode_emit_field_access(state, method, JSC_JVM_GETSTATIC,
+                                 "DeadStores", "cache", "Ljava/lang/Object;");
+  jsc_bytecode_emit(state, method, JSC_JVM_DUP);
+  jsc_bytecode_emit_jump(state, method, JSC_JVM_IFNONNULL, 9);
+  jsc_bytecode_emit(state, method, JSC_JVM_POP);
+  jsc_bytecode_emit(state, method, JSC_JVM_ALOAD_2);
+  jsc_bytecode_emit(state, method, JSC_JVM_DUP);
+  jsc_bytecode_emit_field_access(state, method, JSC_JVM_PUTSTATIC,
+                                 "DeadStores", "cache", "Ljava/lang/Object;");
+  jsc_bytecode_emit_load_constant_double_boxed(state, method, 1.0);
+  jsc_bytecode_emit(state, method, JSC_JVM_POP);
+  jsc_bytecode_emit(state, method, JSC_JVM_ARETURN);
+
+  bool optimized = jsc_bytecode_optimize_method(state, method);
+
+  uint8_t* buffer = NULL;
+  uint32_t size = jsc_bytecode_write(state, &buffer);
+  jsc_class_reader reader;
+
+  /* the argument kept in 2 only, the value at the join left on the stack */
+  const uint8_t head[] = {0x2A, 0x4D, 0xB2};
+  const uint8_t tail[] = {0x59, 0xC7, 0x00, 0x09, 0x57,
+                          0x2C, 0x59, 0xB3};
+  const uint8_t end[] = {0xB0, 0x00, 0x00, 0x00};
+
+  if (!optimized || size == 0 ||
+      !jsc_class_reader_init(&reader, buffer, size) ||
+      !jsc_class_reader_validate(&reader) ||
+      !class_has_bytes(buffer, size, head, sizeof(head)) ||
+      !class_has_bytes(buffer, size, tail, sizeof(tail)) ||
+      !class_has_bytes(buffer, size, end, sizeof(end)))
+  {
+    printf("dead stores and values were not removed\n");
+  }
+  else
+  {
+    printf("dead store tests completed...\n");
+  }
+
+  free(buffer);
+  jsc_bytecode_free(state);
+}
+
+void test_dead_code()
+{
+  printf("testing dead code elimination...\n");
+
+  const char* source = "let unused = 'never read';"
+                       "const limit = 4 * 2;"
+                       "let chain = 'chained' + limit;"
+                       "function dead(a) { return chain + 'body'; }"
+                       "function helper(a) { return a; }"
+                       "let used = helper('kept');"
+                       "let effect = helper('effect');"
+                       "if (1 > 2) { helper('then'); }"
+                       "else { helper('else'); }";
+
+  uint8_t* plain = NULL;
+  uint8_t* dropped = NULL;
+  uint32_t plain_size = compile_with_workers(source, 0, 0, &plain);
+  uint32_t dropped_size =
+      compile_with_workers(source, JSC_ENGINE_FLAG_DROP_UNUSED, 0, &dropped);
+
+  const char* gone[] = {"never read", "global_limit", "global_chain",
+                        "JSCParallel.dead", "dead", "body", "then"};
+  const char* kept[] = {"global_helper", "global_used", "global_effect",
+                        "kept", "else"};
+  const char* wrong = NULL;
+
+  for (size_t i = 0; !wrong && i < sizeof(gone) / sizeof(*gone); i++)
+  {
+    if (class_has_utf8(dropped, dropped_size, gone[i]))
+    {
+      wrong = gone[i];
+    }
+  }
+
+  for (size_t i = 0; !wrong && i < sizeof(kept) / sizeof(*kept); i++)
+  {
+    if (!class_has_utf8(dropped, dropped_size, kept[i]))
+    {
+      wrong = kept[i];
+    }
+  }
+
+  if (plain_size == 0 || dropped_size == 0)
+  {
+    printf("dead code test program failed to compile\n");
+  }
+  else if (wrong)
+  {
+    printf("class without unused bindings is wrong about \"%s\"\n", wrong);
+  }
+  else if (class_has_utf8(plain, plain_size, "then") ||
+           !class_has_utf8(plain, plain_size, "never read") ||
+           dropped_size >= plain_size)
+  {
+    printf("dead branches or unused bindings were handled wrongly\n");
+  }
+  else
+  {
+    printf("dead code tests completed...\n");
+  }
+
+  free(plain);
+  free(dropped);
+}
+
+void test_loops()
+{
+  printf("testing loops...\n");
+
+  const char* source =
+      "function count() { let k = 0;"
+      "  for (let i = 0; i < 1000; i++) { k = i; } return k; }"
+      "function nested() { let k = 0;"
+      "  outer: for (let i = 0; i < 8; i++) {"
+      "    for (let j = 8; j > 0; j -= 2) {"
+      "      if (k) continue outer; if (j < 4) break; k = j; } }"
+      "  return k; }"
+      "function forever(n) { let k = 0;"
+      "  while (true) { k = n; break; }"
+      "  do { k = 2; } while (false);"
+      "  for (; n; n = null) { k = 3; }"
+      "  return k; }";
+
+  uint8_t* data = NULL;
+  uint32_t size = compile_with_workers(source, 0, 0, &data);
+  char* listing = disassemble_listing(data, size, JSC_DISASSEMBLE_CODE, true);
+
+  /* counters are int locals stepped by iinc and tested at the bottom */
+  const char* expected[] = {"iconst_0\nistore_1\ngoto ",
+                            "iinc 1, 1\niload_1\nsipush 1000\nif_icmplt ",
+                            "iinc 2, -2", "\nifgt ", "\ni2d\n"};
+  const char* missing =
+      listing_lacks(listing, expected, sizeof(expected) / sizeof(*expected));
+
+  const char* invalid[] = {"function f() { break; }",
+                           "function f() { a: { continue a; } }",
+                           "function f() { for (;;) { continue b; } }",
+                           "a: a: while (true) {}"};
+  const char* accepted =
+      first_compiled(invalid, sizeof(invalid) / sizeof(*invalid));
+
+  if (missing)
+  {
+    printf("loop code lacks \"%s\":\n%s", missing, listing ? listing : "");
+  }
+  else if (strstr(listing, "invalid"))
+  {
+    printf("loop code is not a valid class:\n%s", listing);
+  }
+  else if (accepted)
+  {
+    printf("misplaced jump was not expected to compile: %s\n", accepted);
+  }
+  else
+  {
+    printf("loop tests completed...\n");
+  }
+
+  free(listing);
+  free(data);
+}
+
+void test_conditions()
+{
+  printf("testing conditions...\n");
+
+  const char* source =
+      "function pick(a, b) {"
+      "  if (a > 3 && b != null) return 1;"
+      "  if (!(a < 2) || a === \"x\") return 2;"
+      "  while (a >= b) a = null;"
+      "  return a <= b; }"
+      "function count() { let k = 0;"
+      "  for (let i = 0; i < 9; i++) { if (i >= 5 || i == 2) k = i; }"
+      "  return k; }"
+      "function folded() { if (true && false) return 1; return !(1 < 2); }"
+      "function truthy(a) { if (a) return a || 1; return !a; }";
+
+  uint8_t* data = NULL;
+  uint32_t size = compile_with_workers(source, 0, 0, &data);
+  char* listing = disassemble_listing(data, size, JSC_DISASSEMBLE_CODE, true);
+
+  /* comparisons branch on their own result, && and || are jumps, and only
+     values of unknown type are tested for truth by the runtime */
+  const char* expected[] = {"dcmpl\nifle ",
+                            "aload_1\nifnull ",
+                            "dcmpg\nifge ",
+                            "JSCRuntime.strictEquals:",
+                            "iconst_m1\n",
+                            "JSCRuntime.compare:",
+                            "iconst_5\nif_icmpge ",
+                            "iconst_2\nif_icmpne ",
+                            "JSCRuntime.toBoolean:"};
+  const char* missing =
+      listing_lacks(listing, expected, sizeof(expected) / sizeof(*expected));
+
+  /* a condition of constants leaves no branch behind */
+  char* folded = listing_method(listing, "folded");
+
+  if (missing)
+  {
+    printf("condition code lacks \"%s\":\n%s", missing,
+           listing ? listing : "");
+  }
+  else if (strstr(listing, "invalid") || strstr(listing, "Object.equals"))
+  {
+    printf("condition code is not a valid fused branch:\n%s", listing);
+  }
+  else if (!folded || strstr(folded, "\nif") ||
+           !strstr(folded, "Boolean.FALSE"))
+  {
+    printf("constant condition was not folded:\n%s", folded ? folded : "");
+  }
+  else
+  {
+    printf("condition tests completed...\n");
+  }
+
+  free(folded);
+  free(listing);
+  free(data);
+}
+
+void test_switch()
+{
+  printf("testing switch...\n");
+
+  const char* source =
+      "function dense(x) { let r = 0;"
+      "  switch (x) { case 1: r = 10; break; case 2: r = 20;"
+      "    case 3: r = 30; break; case 4: return 4; default: r = -1; }"
+      "  return r; }"
+      "function sparse(x) {"
+      "  switch (x) { case 1: return 1; case 1000: return 2;"
+      "    case -50000: return 3; }"
+      "  return 0; }"
+      "function names(s) {"
+      "  switch (s) { case \"Aa\": return 1; case \"BB\": return 2;"
+      "    case \"go\": return 3; default: return 0; } }"
+      "function mixed(s, y) {"
+      "  switch (s) { case y: return 1; case \"a\": return 2; }"
+      "  return 0; }"
+      "function loop() { let k = 0;"
+      "  for (let i = 0; i < 9; i++) {"
+      "    switch (i) { case 2: continue; case 5: k = i; break; } }"
+      "  return k; }";
+
+  uint8_t* data = NULL;
+  uint32_t size = compile_with_workers(source, 0, 0, &data);
+  char* listing = disassemble_listing(data, size, JSC_DISASSEMBLE_CODE, true);
+
+  /* "Aa" and "BB" share a hash, so one bucket tests both */
+  const char* expected[] = {"tableswitch { // 4\n",
+                            "lookupswitch { // 3\n         -50000: ",
+                            "Object.hashCode:()I\n",
+                            "lookupswitch { // 2\n           2112: ",
+                            "JSCRuntime.switchKey:",
+                            "JSCRuntime.strictEquals:",
+                            "String \"BB\"\n"};
+  const char* missing =
+      listing_lacks(listing, expected, sizeof(expected) / sizeof(*expected));
+
+  const char* invalid[] = {"function f(x) { switch (x) { f(); } }",
+                           "function f(x) { switch (x) { default: default: } }",
+                           "function f(x) { switch (x) { case 1: continue; } }",
+                           "function f(x) { switch (x) { case: } }"};
+  const char* accepted =
+      first_compiled(invalid, sizeof(invalid) / sizeof(*invalid));
+
+  if (missing)
+  {
+    printf("switch code lacks \"%s\":\n%s", missing, listing ? listing : "");
+  }
+  else if (strstr(listing, "invalid"))
+  {
+    printf("switch code is not a valid class:\n%s", listing);
+  }
+  else if (accepted)
+  {
+    printf("bad switch was not expected to compile: %s\n", accepted);
+  }
+  else
+  {
+    printf("switch tests completed...\n");
+  }
+
+  free(listing);
+  free(data);
+}
+
+void test_stats()
+{
+  printf("testing compile stats...\n");
+
+  const char* source = "let a = 1;"
+                       "function f(x) { return x + a; }"
+                       "function g(x) { return f(x); }";
+
+  jsc_engine_context* serial = jsc_engine_init("JSCStats");
+  jsc_engine_context* parallel = jsc_engine_init("JSCStats");
+  uint8_t* data = NULL;
+  uint8_t* shards = NULL;
+  uint32_t size = 0;
+  uint32_t shards_size = 0;
+
+  serial->flags = JSC_ENGINE_FLAG_STATS;
+  parallel->flags = JSC_ENGINE_FLAG_PARALLEL_FUNCTIONS;
+  parallel->worker_count = 2;
+
+  bool compiled =
+      jsc_engine_compile_to_buffer(serial, source, &data, &size) &&
+      jsc_engine_compile_to_buffer(parallel, source, &shards, &shards_size);
+
+  const jsc_engine_stats* stats = jsc_engine_get_stats(serial);
+  const jsc_engine_stats* merged = jsc_engine_get_stats(parallel);
+
+  char* json = NULL;
+  size_t json_size = 0;
+  FILE* out = open_memstream(&json, &json_size);
+
+  if (out)
+  {
+    jsc_engine_print_stats(stats, out);
+    fclose(out);
+  }
+
+  char tokens[64];
+  sprintf(tokens, "\"tokens\": %llu,", (unsigned long long)stats->tokens);
+
+  if (!compiled)
+  {
+    printf("stats program failed to compile\n");
+  }
+  else if (stats->tokens != 31 || merged->tokens <= stats->tokens)
+  {
+    /* workers read the bodies again after the first pass skips them */
+    printf("expected 31 tokens and more with workers, got %llu and %llu\n",
+           (unsigned long long)stats->tokens,
+           (unsigned long long)merged->tokens);
+  }
+  else if (stats->methods != merged->methods || stats->methods < 3 ||
+           stats->constants == 0 || stats->code_bytes == 0 ||
+           stats->code_bytes >= size || stats->class_bytes != size)
+  {
+    printf("class counts are wrong: %llu methods, %llu constants, "
+           "%llu code bytes\n",
+           (unsigned long long)stats->methods,
+           (unsigned long long)stats->constants,
+           (unsigned long long)stats->code_bytes);
+  }
+  else if (stats->phase_ns[JSC_ENGINE_PHASE_TOKENIZE] == 0 ||
+           stats->phase_ns[JSC_ENGINE_PHASE_PARSE] == 0 ||
+           stats->phase_ns[JSC_ENGINE_PHASE_SERIALIZE] == 0 ||
+           stats->phase_ns[JSC_ENGINE_PHASE_RUN] != 0)
+  {
+    printf("phase timings are wrong\n");
+  }
+  else if (!json || !strstr(json, tokens) ||
+           !strstr(json, "{\"tokenize_ns\": ") ||
+           !strstr(json, "\"heap_growth_bytes\": "))
+  {
+    printf("stats JSON lacks %s: %s", tokens, json ? json : "");
+  }
+  else
+  {
+    printf("compile stats tests completed...\n");
+  }
+
+  free(json);
+  free(data);
+  free(shards);
+  jsc_engine_free(serial);
+  jsc_engine_free(parallel);
+}
+
+void test_jar()
+{
+  printf("testing jar limits...\n");
+
+  char path[] = "/tmp/jsc_jar_XXXXXX";
+  int fd = mkstemp(path);
+
+  if (fd < 0)
+  {
+    printf("mkstemp\n");
+    return;
+  }
+
+  close(fd);
+
+  const uint8_t data[] = {0xCA, 0xFE, 0xBA, 0xBE};
+  jsc_jar* jar = jsc_jar_open(path, NULL);
+  bool added = jar && jsc_jar_add(jar, "A.class", data, sizeof(data));
+
+  /* stand in for an archive 4 GiB long, which needs ZIP64 */
+  if (jar)
+  {
+    jar->offset = UINT32_MAX - 16;
+  }
+
+  bool overflowed = jar && !jsc_jar_add(jar, "B.class", data, sizeof(data));
+  bool closed = jsc_jar_close(jar);
+
+  if (!added)
+  {
+    printf("jsc_jar_add of a small entry\n");
+  }
+  else if (!overflowed || closed)
+  {
+    printf("jar offsets past 4 GiB were not rejected\n");
+  }
+  else
+  {
+    printf("jar tests completed...\n");
+  }
+
+  unlink(path);
+}
+
+/* the stub of function goes straight to an invokedynamic site */
+static bool lazy_stub_is_call_site(const uint8_t* data, uint32_t size,
+                                   const char* function)
+{
+  char* listing = disassemble_listing(data, size, JSC_DISASSEMBLE_CODE, true);
+  char* code = listing_method(listing, function);
+
+  bool site = code && strstr(code, "\ninvokedynamic ") &&
+              !strstr(code, "anewarray") && !strstr(code, "invokeWith") &&
+              strstr(listing, "MutableCallSite.setTarget");
+
+  free(code);
+  free(listing);
+  return site;
+}
+
+void test_lazy_functions()
+{
+  printf("testing lazy function compilation...\n");
+
+  /* the body of broken() is never parsed unless it is called */
+  const char* source = "let base = 'x';"
+                       "function used(a, b) { if (a > b) { return base; }"
+                       " return a; }"
+                       "function broken(a) { return ; ; let }"
+                       "let r = used(1, 2);";
+
+  jsc_engine_context* ctx = jsc_engine_init("JSCLazy");
+  ctx->flags = JSC_ENGINE_FLAG_LAZY_FUNCTIONS;
+
+  uint8_t* program = NULL;
+  uint8_t* function = NULL;
+  uint32_t program_size = 0;
+  uint32_t function_size = 0;
+
+  if (!jsc_engine_compile_to_buffer(ctx, source, &program, &program_size))
+  {
+    printf("lazy program failed to compile: %s\n", ctx->error_message);
+  }
+  else if (ctx->deferred_count != 2)
+  {
+    printf("expected 2 lazy functions, got %u\n", ctx->deferred_count);
+  }
+  else if (!lazy_stub_is_call_site(program, program_size, "used"))
+  {
+    printf("lazy stub does not call through its own call site\n");
+  }
+  else if (!jsc_engine_compile_lazy_function(ctx, 0, &function,
+                                             &function_size))
+  {
+    printf("lazy function failed to compile: %s\n", ctx->error_message);
+  }
+  else if (jsc_engine_compile_lazy_function(ctx, 1, &function,
+                                            &function_size) ||
+           jsc_engine_compile_lazy_function(ctx, 2, &function,
+                                            &function_size))
+  {
+    printf("invalid lazy function compiled\n");
+  }
+  else
+  {
+    printf("lazy function tests completed...\n");
+  }
+
+  free(program);
+  free(function);
+  jsc_engine_free(ctx);
+}
+
+typedef struct
+{
+  char* path;
+  char* class_name;
+  uint8_t* data;
+  uint32_t size;
+  char* error;
+  jsc_engine_stats stats;
+} compile_job;
+
+typedef struct
+{
+  compile_job* jobs;
+  size_t count;
+  size_t capacity;
+  size_t next;
+  uint32_t flags;
+  pthread_mutex_t lock;
+} compile_queue;
+
+static char* read_file(const char* path, size_t* out_size)
+{
+  FILE* file = fopen(path, "rb");
+
+  if (!file)
+  {
+    return NULL;
+  }
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  char* buffer = size >= 0 ? malloc((size_t)size + 1) : NULL;
+
+  if (!buffer || fread(buffer, 1, (size_t)size, file) != (size_t)size)
+  {
+    free(buffer);
+    fclose(file);
+    return NULL;
+  }
+
+  buffer[size] = '\0';
+  fclose(file);
+
+  if (out_size)
+  {
+    *out_size = (size_t)size;
+  }
+
+  return buffer;
+}
+
+/**
+ * @brief map "dir/my-script.js" to the binary class name "dir/my_script"
+ */
+static char* compile_class_name(const char* relative_path)
+{
+  size_t length = strlen(relative_path) - 3;
+  char* name = malloc(length * 2 + 2);
+
+  if (!name)
+  {
+    return NULL;
+  }
+
+  size_t out = 0;
+  bool segment_start = true;
+
+  for (size_t i = 0; i < length; i++)
+  {
+    char c = relative_path[i];
+
+    if (c == '/')
+    {
+      name[out++] = '/';
+      segment_start = true;
+      continue;
+    }
+
+    if (segment_start && isdigit((unsigned char)c))
+    {
+      name[out++] = '_';
+    }
+
+    name[out++] = (isalnum((unsigned char)c) || c == '_' || c == '$') ? c : '_';
+    segment_start = false;
+  }
+
+  name[out] = '\0';
+
+  return name;
+}
+
+static bool compile_collect(compile_queue* queue, const char* root,
+                            const char* relative)
+{
+  char path[1 << 12];
+  snprintf(path, sizeof(path), "%s%s%s", root, *relative ? "/" : "", relative);
+
+  DIR* dir = opendir(path);
+
+  if (!dir)
+  {
+    fprintf(stderr, "jsc: cannot open directory %s\n", path);
+    return false;
+  }
+
+  struct dirent* dirent;
+  bool ok = true;
+
+  while (ok && (dirent = readdir(dir)) != NULL)
+  {
+    if (dirent->d_name[0] == '.')
+    {
+      continue;
+    }
+
+    char child[1 << 12];
+    snprintf(child, sizeof(child), "%s%s%s", relative, *relative ? "/" : "",
+             dirent->d_name);
+
+    char full[1 << 13];
+    snprintf(full, sizeof(full), "%s/%s", root, child);
+
+    struct stat st;
+
+    if (stat(full, &st) != 0)
+    {
+      continue;
+    }
+
+    if (S_ISDIR(st.st_mode))
+    {
+      ok = compile_collect(queue, root, child);
+      continue;
+    }
+
+    size_t length = strlen(child);
+
+    if (length <= 3 || strcmp(child + length - 3, ".js") != 0)
+    {
+      continue;
+    }
+
+    if (queue->count == queue->capacity)
+    {
+      queue->capacity = queue->capacity ? queue->capacity * 2 : 64;
+      queue->jobs = realloc(queue->jobs, queue->capacity * sizeof(compile_job));
+
+      if (!queue->jobs)
+      {
+        ok = false;
+        break;
+      }
+    }
+
+    compile_job* job = &queue->jobs[queue->count++];
+    memset(job, 0, sizeof(compile_job));
+
+    job->path = strdup(full);
+    job->class_name = compile_class_name(child);
+    ok = job->path && job->class_name;
+  }
+
+  closedir(dir);
+
+  return ok;
+}
+
+static int compile_job_compare(const void* a, const void* b)
+{
+  return strcmp(((const compile_job*)a)->class_name,
+                ((const compile_job*)b)->class_name);
+}
+
+/**
+ * @brief compile queued scripts until the queue is drained
+ *
+ * @details Each script gets its own engine context, so workers share no
+ *          compiler state; compilation never starts a JVM.
+ */
+static void* compile_worker(void* arg)
+{
+  compile_queue* queue = (compile_queue*)arg;
+
+  for (;;)
+  {
+    pthread_mutex_lock(&queue->lock);
+    size_t index = queue->next++;
+    pthread_mutex_unlock(&queue->lock);
+
+    if (index >= queue->count)
+    {
+      return NULL;
+    }
+
+    compile_job* job = &queue->jobs[index];
+    char* source = read_file(job->path, NULL);
+
+    if (!source)
+    {
+      job->error = strdup("cannot read file");
+      continue;
+    }
+
+    jsc_engine_context* ctx = jsc_engine_init(job->class_name);
+
+    if (!ctx)
+    {
+      job->error = strdup("out of memory");
+      free(source);
+      continue;
+    }
+
+    ctx->flags = queue->flags;
+
+    if (!jsc_engine_compile_to_buffer(ctx, source, &job->data, &job->size))
+    {
+      job->error = strdup(ctx->error_message ? ctx->error_message
+                                             : "compilation failed");
+    }
+
+    job->stats = *jsc_engine_get_stats(ctx);
+    jsc_engine_free(ctx);
+    free(source);
+  }
+}
+
+static void compile_usage(void)
+{
+  fprintf(stderr, "usage: jsc compile <directory> [-o output.jar] "
+                  "[-j workers] [--main class] [--parallel-functions] "
+                  "[--invokedynamic] [--string-concat] [--optimize] "
+                  "[--drop-unused] [--stats]\n");
+}
+
+/**
+ * @brief jsc compile: ahead-of-time compile a directory tree into one JAR
+ *
+ * @details Every *.js file under the directory becomes a class named after
+ *          its relative path; two files that map to one name are an
+ *          error. Entries are written in class-name order and
+ *          stored uncompressed, so the output is reproducible and suitable
+ *          for a class-data-sharing archive (-XX:ArchiveClassesAtExit).
+ *          --stats prints the summed jsc_engine_stats as JSON on stderr.
+ */
+static int compile_command(int argc, char** argv)
+{
+  const char* directory = NULL;
+  const char* output = "out.jar";
+  const char* main_class = NULL;
+  long workers = sysconf(_SC_NPROCESSORS_ONLN);
+  uint32_t flags = 0;
+
+  for (int i = 0; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+    {
+      output = argv[++i];
+    }
+    else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+    {
+      workers = strtol(argv[++i], NULL, 10);
+    }
+    else if (strcmp(argv[i], "--main") == 0 && i + 1 < argc)
+    {
+      main_class = argv[++i];
+    }
+    else if (strcmp(argv[i], "--parallel-functions") == 0)
+    {
+      flags |= JSC_ENGINE_FLAG_PARALLEL_FUNCTIONS;
+    }
+    else if (strcmp(argv[i], "--invokedynamic") == 0)
+    {
+      flags |= JSC_ENGINE_FLAG_INVOKEDYNAMIC;
+    }
+    else if (strcmp(argv[i], "--string-concat") == 0)
+    {
+      flags |= JSC_ENGINE_FLAG_STRING_CONCAT;
+    }
+    else if (strcmp(argv[i], "--optimize") == 0)
+    {
+      flags |= JSC_ENGINE_FLAG_OPTIMIZE;
+    }
+    else if (strcmp(argv[i], "--drop-unused") == 0)
+    {
+      flags |= JSC_ENGINE_FLAG_DROP_UNUSED;
+    }
+    else if (strcmp(argv[i], "--stats") == 0)
+    {
+      flags |= JSC_ENGINE_FLAG_STATS;
+    }
+    else if (!directory && argv[i][0] != '-')
+    {
+      directory = argv[i];
+    }
+    else
+    {
+      compile_usage();
+      return 2;
+    }
+  }
+
+  if (!directory)
+  {
+    compile_usage();
+    return 2;
+  }
+
+  compile_queue queue;
+  memset(&queue, 0, sizeof(queue));
+  queue.flags = flags;
+  pthread_mutex_init(&queue.lock, NULL);
+
+  int status = 0;
+
+  if (!compile_collect(&queue, directory, ""))
+  {
+    status = 1;
+    goto cleanup;
+  }
+
+  qsort(queue.jobs, queue.count, sizeof(compile_job), compile_job_compare);
+
+  /* e.g. a-b.js and a_b.js, which would write the same JAR entry twice */
+  for (size_t i = 1; i < queue.count; i++)
+  {
+    if (strcmp(queue.jobs[i - 1].class_name, queue.jobs[i].class_name) == 0)
+    {
+      fprintf(stderr, "jsc: %s and %s both compile to class %s\n",
+              queue.jobs[i - 1].path, queue.jobs[i].path,
+              queue.jobs[i].class_name);
+      status = 1;
+    }
+  }
+
+  if (status != 0)
+  {
+    goto cleanup;
+  }
+
+  if (workers < 1)
+  {
+    workers = 1;
+  }
+
+  if ((size_t)workers > queue.count)
+  {
+    workers = queue.count ? (long)queue.count : 1;
+  }
+
+  pthread_t* threads = malloc(workers * sizeof(pthread_t));
+  long started = 0;
+
+  while (threads && started < workers &&
+         pthread_create(&threads[started], NULL, compile_worker, &queue) == 0)
+  {
+    started++;
+  }
+
+  if (started == 0)
+  {
+    compile_worker(&queue);
+  }
+
+  for (long i = 0; i < started; i++)
+  {
+    pthread_join(threads[i], NULL);
+  }
+
+  free(threads);
+
+  if (flags & JSC_ENGINE_FLAG_STATS)
+  {
+    jsc_engine_stats total;
+    memset(&total, 0, sizeof(total));
+
+    for (size_t i = 0; i < queue.count; i++)
+    {
+      jsc_engine_add_stats(&total, &queue.jobs[i].stats);
+    }
+
+    jsc_engine_print_stats(&total, stderr);
+  }
+
+  for (size_t i = 0; i < queue.count; i++)
+  {
+    if (queue.jobs[i].error)
+    {
+      fprintf(stderr, "jsc: %s: %s\n", queue.jobs[i].path,
+              queue.jobs[i].error);
+      status = 1;
+    }
+  }
+
+  if (status != 0)
+  {
+    goto cleanup;
+  }
+
+  jsc_jar* jar = jsc_jar_open(output, main_class);
+
+  if (!jar)
+  {
+    fprintf(stderr, "jsc: cannot create %s\n", output);
+    status = 1;
+    goto cleanup;
+  }
+
+  for (size_t i = 0; i < queue.count; i++)
+  {
+    char entry_name[1 << 12];
+    snprintf(entry_name, sizeof(entry_name), "%s.class",
+             queue.jobs[i].class_name);
+
+    jsc_jar_add(jar, entry_name, queue.jobs[i].data, queue.jobs[i].size);
+  }
+
+  uint8_t* runtime = NULL;
+  uint32_t runtime_size = jsc_runtime_build(&runtime);
+
+  jsc_jar_add(jar, JSC_RUNTIME_CLASS ".class", runtime, runtime_size);
+  free(runtime);
+
+  if (!jsc_jar_close(jar))
+  {
+    fprintf(stderr, "jsc: failed to write %s\n", output);
+    status = 1;
+    goto cleanup;
+  }
+
+  printf("compiled %zu scripts into %s with %ld workers\n", queue.count,
+         output, started ? started : 1);
+
+cleanup:
+  for (size_t i = 0; i < queue.count; i++)
+  {
+    free(queue.jobs[i].path);
+    free(queue.jobs[i].class_name);
+    free(queue.jobs[i].data);
+    free(queue.jobs[i].error);
+  }
+
+  free(queue.jobs);
+  pthread_mutex_destroy(&queue.lock);
+
+  return status;
+}
+
+static void disasm_usage(void)
+{
+  fprintf(stderr, "usage: jsc disasm <file.js|file.class> [--histogram] "
+                  "[--summary] [--invokedynamic] [--string-concat] "
+                  "[--optimize] [--drop-unused] [--stats]\n");
+}
+
+/**
+ * @brief jsc disasm: print the class compiled from a script, or a class file
+ *
+ * @details A script is compiled with the given flags as jsc compile would
+ *          and not written anywhere. The listing is stable, so codegen
+ *          changes such as extra boxing or jumps show up as diffs.
+ *          --histogram adds opcode counts per method and for the class,
+ *          --summary leaves out the instructions, and --stats prints the
+ *          compile's jsc_engine_stats as JSON on stderr.
+ */
+static int disasm_command(int argc, char** argv)
+{
+  const char* path = NULL;
+  uint32_t options = JSC_DISASSEMBLE_CODE;
+  uint32_t flags = 0;
+
+  for (int i = 0; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--histogram") == 0)
+    {
+      options |= JSC_DISASSEMBLE_HISTOGRAM;
+    }
+    else if (strcmp(argv[i], "--summary") == 0)
+    {
+      options &= ~JSC_DISASSEMBLE_CODE;
+    }
+    else if (strcmp(argv[i], "--invokedynamic") == 0)
+    {
+      flags |= JSC_ENGINE_FLAG_INVOKEDYNAMIC;
+    }
+    else if (strcmp(argv[i], "--string-concat") == 0)
+    {
+      flags |= JSC_ENGINE_FLAG_STRING_CONCAT;
+    }
+    else if (strcmp(argv[i], "--optimize") == 0)
+    {
+      flags |= JSC_ENGINE_FLAG_OPTIMIZE;
+    }
+    else if (strcmp(argv[i], "--drop-unused") == 0)
+    {
+      flags |= JSC_ENGINE_FLAG_DROP_UNUSED;
+    }
+    else if (strcmp(argv[i], "--stats") == 0)
+    {
+      flags |= JSC_ENGINE_FLAG_STATS;
+    }
+    else if (!path && argv[i][0] != '-')
+    {
+      path = argv[i];
+    }
+    else
+    {
+      disasm_usage();
+      return 2;
+    }
+  }
+
+  size_t length = path ? strlen(path) : 0;
+
+  if (length < 4)
+  {
+    disasm_usage();
+    return 2;
+  }
+
+  size_t size = 0;
+  char* contents = read_file(path, &size);
+
+  if (!contents)
+  {
+    fprintf(stderr, "jsc: cannot read %s\n", path);
+    return 1;
+  }
+
+  int status = 0;
+
+  if (strcmp(path + length - 3, ".js") == 0)
+  {
+    const char* base = strrchr(path, '/');
+    char* class_name = compile_class_name(base ? base + 1 : path);
+    jsc_engine_context* ctx = class_name ? jsc_engine_init(class_name) : NULL;
+    uint8_t* data = NULL;
+    uint32_t data_size = 0;
+
+    if (ctx)
+    {
+      ctx->flags = flags;
+    }
+
+    if (!ctx ||
+        !jsc_engine_compile_to_buffer(ctx, contents, &data, &data_size))
+    {
+      fprintf(stderr, "jsc: %s: %s\n", path,
+              ctx && ctx->error_message ? ctx->error_message
+                                        : "compilation failed");
+      status = 1;
+    }
+    else if (!jsc_bytecode_disassemble(data, data_size, stdout, options))
+    {
+      status = 1;
+    }
+
+    if (ctx && (flags & JSC_ENGINE_FLAG_STATS))
+    {
+      jsc_engine_print_stats(jsc_engine_get_stats(ctx), stderr);
+    }
+
+    free(data);
+    jsc_engine_free(ctx);
+    free(class_name);
+  }
+  else if (size > UINT32_MAX ||
+           !jsc_bytecode_disassemble((const uint8_t*)contents,
+                                     (uint32_t)size, stdout, options))
+  {
+    status = 1;
+  }
+
+  free(contents);
+  return status;
+}
+
+/* tight numeric loops timed by jsc bench, as functions without parameters */
+static const char* bench_source =
+    "function count() { let k = 0;"
+    "  for (let i = 0; i < 10000000; i++) { k = i; } return k; }"
+    "function nested() { let k = 0;"
+    "  for (let i = 0; i < 3000; i++) {"
+    "    for (let j = 0; j < 3000; j++) { k = j; } } return k; }"
+    "function down() { let k = 0;"
+    "  for (let i = 20000000; i > 0; i -= 2) { k = i; } return k; }"
+    "function stride() { let k = 0;"
+    "  for (let i = 0; i <= 30000000; i += 3) { k = i; } return k; }"
+    "function labeled() { let k = 0;"
+    "  outer: for (let i = 0; i < 10000000; i++) {"
+    "    for (let j = 0; j < 10; j++) { k = i; continue outer; } }"
+    "  return k; }"
+    "function empty() { for (let i = 0; i < 100000000; i++) {} return 0; }";
+
+static const char* bench_functions[] = {"count",  "nested",  "down",
+                                        "stride", "labeled", "empty"};
+
+static double bench_now(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static int bench_compare_times(const void* a, const void* b)
+{
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+/* print code size and branches of each method, backward ones apart */
+static void bench_print_code(const uint8_t* data, uint32_t size)
+{
+  jsc_class_reader reader;
+
+  if (!jsc_class_reader_init(&reader, data, size))
+  {
+    return;
+  }
+
+  for (uint16_t i = 0; i < reader.method_count; i++)
+  {
+    jsc_class_member_view method;
+    jsc_class_attribute_view code;
+
+    if (!jsc_class_reader_method(&reader, i, &method) ||
+        !jsc_class_reader_find_attribute(&reader, method.attributes,
+                                         method.attribute_count, "Code",
+                                         &code) ||
+        code.length < 8)
+    {
+      continue;
+    }
+
+    uint32_t length = (uint32_t)code.info[4] << 24 |
+                      (uint32_t)code.info[5] << 16 |
+                      (uint32_t)code.info[6] << 8 | code.info[7];
+    const uint8_t* bytes = code.info + 8;
+    uint32_t branches = 0;
+    uint32_t backward = 0;
+
+    for (uint32_t pc = 0; length <= code.length - 8 && pc < length;)
+    {
+      uint32_t n = jsc_bytecode_instruction_length(bytes, pc, length);
+      uint8_t opcode = bytes[pc];
+
+      if (n == 0)
+      {
+        break;
+      }
+
+      if ((opcode >= JSC_JVM_IFEQ && opcode <= JSC_JVM_GOTO) ||
+          opcode == JSC_JVM_IFNULL || opcode == JSC_JVM_IFNONNULL ||
+          opcode == JSC_JVM_GOTO_W)
+      {
+        branches++;
+        backward += (bytes[pc + 1] & 0x80) != 0;
+      }
+
+      pc += n;
+    }
+
+    uint16_t name_length = 0;
+    const char* name =
+        jsc_class_reader_utf8(&reader, method.name_index, &name_length);
+
+    printf("  %-12.*s %6u bytes %4u branches %4u backward\n", name_length,
+           name ? name : "?", length, branches, backward);
+  }
+
+  jsc_class_reader_free(&reader);
+}
+
+static void bench_usage(void)
+{
+  fprintf(stderr, "usage: jsc bench [--runs n] [--optimize]\n");
+}
+
+/**
+ * @brief jsc bench: compile and run a set of tight numeric loops
+ *
+ * @details Prints the median compile time over the runs, the code size and
+ *          branch count of each method, and, with a JVM, the median time of
+ *          calling each function, so loop codegen changes can be compared.
+ */
+static int bench_command(int argc, char** argv)
+{
+  long runs = 11;
+  uint32_t flags = 0;
+
+  for (int i = 0; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+    {
+      runs = strtol(argv[++i], NULL, 10);
+    }
+    else if (strcmp(argv[i], "--optimize") == 0)
+    {
+      flags |= JSC_ENGINE_FLAG_OPTIMIZE;
+    }
+    else
+    {
+      bench_usage();
+      return 2;
+    }
+  }
+
+  if (runs < 1 || runs > 1000)
+  {
+    bench_usage();
+    return 2;
+  }
+
+  double* times = (double*)malloc((size_t)runs * sizeof(double));
+  uint8_t* data = NULL;
+  uint32_t size = 0;
+
+  for (long run = 0; times && run < runs; run++)
+  {
+    jsc_engine_context* ctx = jsc_engine_init("JSCBench");
+
+    free(data);
+    data = NULL;
+
+    double start = bench_now();
+
+    if (ctx)
+    {
+      ctx->flags = flags;
+    }
+
+    if (!ctx || !jsc_engine_compile_to_buffer(ctx, bench_source, &data, &size))
+    {
+      fprintf(stderr, "jsc: bench: %s\n",
+              ctx && ctx->error_message ? ctx->error_message
+                                        : "compilation failed");
+      jsc_engine_free(ctx);
+      free(times);
+      free(data);
+      return 1;
+    }
+
+    times[run] = bench_now() - start;
+    jsc_engine_free(ctx);
+  }
+
+  if (!times)
+  {
+    return 1;
+  }
+
+  qsort(times, (size_t)runs, sizeof(double), bench_compare_times);
+  printf("compile: %.3f ms median of %ld, %u bytes\n",
+         times[runs / 2] * 1e3, runs, size);
+  bench_print_code(data, size);
+
+#ifndef JSC_NO_JVM
+  jsc_engine_context* ctx = jsc_engine_init("JSCBench");
+
+  if (ctx && jsc_engine_define_class(ctx, data, size))
+  {
+    for (size_t f = 0; f < sizeof(bench_functions) / sizeof(*bench_functions);
+         f++)
+    {
+      jsc_value result = jsc_value_create_undefined();
+
+      for (long run = 0; run < runs && !ctx->had_error; run++)
+      {
+        jsc_value_free(ctx->env, result);
+
+        double start = bench_now();
+        result = jsc_engine_call_method(ctx, bench_functions[f], NULL, 0);
+        times[run] = bench_now() - start;
+      }
+
+      if (ctx->had_error)
+      {
+        break;
+      }
+
+      qsort(times, (size_t)runs, sizeof(double), bench_compare_times);
+
+      char* text = jsc_value_to_string(result);
+      printf("run %-12s %10.3f ms median, result %s\n", bench_functions[f],
+             times[runs / 2] * 1e3, text ? text : "?");
+      free(text);
+      jsc_value_free(ctx->env, result);
+    }
+  }
+
+  if (!ctx || ctx->had_error)
+  {
+    fprintf(stderr, "jsc: bench: %s\n",
+            ctx && ctx->error_message ? ctx->error_message : "cannot run");
+  }
+
+  jsc_engine_free(ctx);
+#else
+  (void)bench_functions;
+#endif
+
+  free(times);
+  free(data);
+  return 0;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc > 1 && strcmp(argv[1], "compile") == 0)
+  {
+    return compile_command(argc - 2, argv + 2);
+  }
+
+  if (argc > 1 && strcmp(argv[1], "disasm") == 0)
+  {
+    return disasm_command(argc - 2, argv + 2);
+  }
+
+  if (argc > 1 && strcmp(argv[1], "bench") == 0)
+  {
+    return bench_command(argc - 2, argv + 2);
+  }
 
   // test_tokenize();
   // test_bytecode_basic();
   // test_bytecode();
+  test_cache();
+  test_parallel_functions();
+  test_deferred_errors();
+  test_lazy_functions();
+  test_direct_calls();
+  test_bytecode_invokedynamic();
+  test_invokedynamic();
+  test_string_concat();
+  test_stack_map();
+  test_dynamic_arithmetic();
+  test_max_stack();
+  test_peephole();
+  test_wide_branches();
+  test_method_splitting();
+  test_class_writer();
+  test_class_reader();
+  test_disassembler();
+  test_constant_folding();
+  test_dead_stores();
+  test_dead_code();
+  test_loops();
+  test_conditions();
+  test_switch();
+  test_stats();
+  test_jar();
+#ifndef JSC_NO_JVM
   test_engine_basic();
+#endif
 
   return 0;
 }